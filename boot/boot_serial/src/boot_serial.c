@@ -73,6 +73,10 @@
 #include "boot_serial/boot_serial_encryption.h"
 #endif
 
+#ifdef MCUBOOT_SERIAL_UPLOAD_HASH
+#include "bootutil/crypto/sha.h"
+#endif
+
 #include "bootutil/boot_hooks.h"
 
 BOOT_LOG_MODULE_DECLARE(mcuboot);
@@ -96,6 +100,25 @@ BOOT_LOG_MODULE_DECLARE(mcuboot);
 #define MCUBOOT_SERIAL_MAX_RECEIVE_SIZE 512
 #endif
 
+#ifndef MCUBOOT_SERIAL_UPLOAD_WINDOW
+#define MCUBOOT_SERIAL_UPLOAD_WINDOW 0
+#endif
+
+#ifndef MCUBOOT_SERIAL_WRITE_QUEUE
+#define MCUBOOT_SERIAL_WRITE_QUEUE 0
+#endif
+
+#ifdef MCUBOOT_SERIAL_COMPRESSED_UPLOAD
+#ifndef MCUBOOT_SERIAL_DECOMPRESS_BUF_SIZE
+#define MCUBOOT_SERIAL_DECOMPRESS_BUF_SIZE 512
+#endif
+#if MCUBOOT_SERIAL_WRITE_QUEUE > 0 && \
+    MCUBOOT_SERIAL_DECOMPRESS_BUF_SIZE > MCUBOOT_SERIAL_MAX_RECEIVE_SIZE
+#error "Decompressed upload buffer larger than the chunks of the write queue"
+#endif
+#define BS_LZ4_MIN_MATCH 4
+#endif
+
 #ifdef MCUBOOT_SERIAL_IMG_GRP_IMAGE_STATE
 #define BOOT_SERIAL_IMAGE_STATE_SIZE_MAX 48
 #else
@@ -124,6 +147,11 @@ BOOT_LOG_MODULE_DECLARE(mcuboot);
 
 #define BOOT_SERIAL_FRAME_MTU   124 /* 127 - pkt start (2 bytes) and stop (1 byte) */
 
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+/* COBS adds a byte every 254 bytes, and one at the start. */
+#define COBS_ENCODE_SIZE(in_size) ((in_size) + (in_size) / 254 + 1)
+#endif
+
 /* Number of estimated CBOR elements for responses */
 #define CBOR_ENTRIES_SLOT_INFO_IMAGE_MAP 4
 #define CBOR_ENTRIES_SLOT_INFO_SLOTS_MAP 3
@@ -159,6 +187,13 @@ static char dec_buf[MCUBOOT_SERIAL_MAX_RECEIVE_SIZE + 1];
 const struct boot_uart_funcs *boot_uf;
 static struct nmgr_hdr *bs_hdr;
 static bool bs_entry;
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+static bool bs_binary;              /* Framing of the packet being served */
+static struct {
+    uint8_t code;                   /* Code byte of the current COBS block */
+    uint8_t left;                   /* Bytes left in the current COBS block */
+} bs_cobs;
+#endif
 
 static char bs_obuf[BOOT_SERIAL_OUT_MAX];
 
@@ -168,6 +203,9 @@ static void boot_serial_output(void);
 static int boot_serial_get_hash(const struct image_header *hdr,
                                 const struct flash_area *fap, uint8_t *hash);
 #endif
+#ifdef MCUBOOT_SERIAL_UPLOAD_HASH
+static const uint8_t *bs_upload_hash_of(uint32_t area_id);
+#endif
 
 static zcbor_state_t cbor_state[2];
 
@@ -302,6 +340,10 @@ bs_list(char *buf, int len)
                 continue;
             }
 
+#ifdef MCUBOOT_SERIAL_UPLOAD_HASH
+            const uint8_t *known_hash = bs_upload_hash_of(area_id);
+#endif
+
             int rc = BOOT_HOOK_CALL(boot_read_image_header_hook,
                                     BOOT_HOOK_REGULAR, image_index, slot, &hdr);
             if (rc == BOOT_HOOK_REGULAR)
@@ -314,6 +356,13 @@ bs_list(char *buf, int len)
                 BOOT_HOOK_CALL_FIH(boot_image_check_hook,
                                    FIH_BOOT_HOOK_REGULAR,
                                    fih_rc, image_index, slot);
+#ifdef MCUBOOT_SERIAL_UPLOAD_HASH
+                if (FIH_EQ(fih_rc, FIH_BOOT_HOOK_REGULAR) && known_hash != NULL) {
+                    /* Image hashed as it was uploaded */
+                    FIH_CALL(bootutil_img_validate_hashed, fih_rc, NULL, 0, &hdr,
+                             fap, known_hash);
+                } else
+#endif
                 if (FIH_EQ(fih_rc, FIH_BOOT_HOOK_REGULAR))
                 {
 #if defined(MCUBOOT_ENC_IMAGES)
@@ -348,6 +397,12 @@ bs_list(char *buf, int len)
 
 #ifdef MCUBOOT_SERIAL_IMG_GRP_HASH
             /* Retrieve hash of image for identification */
+#ifdef MCUBOOT_SERIAL_UPLOAD_HASH
+            if (known_hash != NULL) {
+                memcpy(hash, known_hash, sizeof(hash));
+                rc = 0;
+            } else
+#endif
             rc = boot_serial_get_hash(&hdr, fap, hash);
 #endif
 
@@ -733,6 +788,31 @@ finish:
 #endif
 
 #ifdef MCUBOOT_ERASE_PROGRESSIVELY
+/** Finds the end of the range of flash erase_range() erases
+ *
+ * @retval On success: offset of the first byte past the sector holding @p end,
+ *         or @p start if @p end is before it;
+ *         On failure: -EINVAL.
+ */
+static off_t erase_range_end(const struct flash_area *fap, off_t start, off_t end)
+{
+    struct flash_sector sect;
+
+    if (end >= flash_area_get_size(fap)) {
+        return -EINVAL;
+    }
+
+    if (end < start) {
+        return start;
+    }
+
+    if (flash_area_get_sector(fap, end, &sect)) {
+        return -EINVAL;
+    }
+
+    return flash_sector_get_off(&sect) + flash_sector_get_size(&sect);
+}
+
 /** Erases range of flash, aligned to sector size
  *
  * Function will erase all sectors withing [start, end] range; it does not check
@@ -750,23 +830,17 @@ finish:
  */
 static off_t erase_range(const struct flash_area *fap, off_t start, off_t end)
 {
-    struct flash_sector sect;
+    off_t stop;
     size_t size;
     int rc;
 
-    if (end >= flash_area_get_size(fap)) {
-        return -EINVAL;
-    }
-
-    if (end < start) {
-        return start;
-    }
-
-    if (flash_area_get_sector(fap, end, &sect)) {
-        return -EINVAL;
+    stop = erase_range_end(fap, start, end);
+    if (stop <= start) {
+        /* Nothing to erase, or -EINVAL */
+        return stop;
     }
 
-    size = flash_sector_get_off(&sect) + flash_sector_get_size(&sect) - start;
+    size = stop - start;
     BOOT_LOG_DBG("Erasing range 0x%jx:0x%jx", (intmax_t)start,
 		 (intmax_t)(start + size - 1));
 
@@ -780,163 +854,272 @@ static off_t erase_range(const struct flash_area *fap, off_t start, off_t end)
 }
 #endif
 
+#ifdef MCUBOOT_SERIAL_COMPRESSED_UPLOAD
 /*
- * Image upload request.
+ * Steps of the decoder of compressed uploads, each expecting the next part of
+ * an LZ4 sequence.
  */
-static void
-bs_upload(char *buf, int len)
-{
-    static size_t img_size;             /* Total image size, held for duration of upload */
-    static uint32_t curr_off;           /* Expected current offset */
-    const uint8_t *img_chunk = NULL;    /* Pointer to buffer with received image chunk */
-    size_t img_chunk_len = 0;           /* Length of received image chunk */
-    size_t img_chunk_off = SIZE_MAX;    /* Offset of image chunk within image  */
-    size_t rem_bytes;                   /* Reminder bytes after aligning chunk write to
-                                         * to flash alignment */
-    uint32_t img_num_tmp = UINT_MAX;    /* Temp variable for image number */
-    static uint32_t img_num = 0;
-    size_t img_size_tmp = SIZE_MAX;     /* Temp variable for image size */
-    const struct flash_area *fap = NULL;
-    int rc;
-    struct zcbor_string img_chunk_data;
-    size_t decoded = 0;
-    bool ok;
+enum bs_lz4_step {
+    BS_LZ4_TOKEN,
+    BS_LZ4_LIT_LEN,                     /* Extra bytes of the literal length */
+    BS_LZ4_LIT,
+    BS_LZ4_DIST_LO,                     /* Match offset, little endian */
+    BS_LZ4_DIST_HI,
+    BS_LZ4_MATCH_LEN,                   /* Extra bytes of the match length */
+    BS_LZ4_FAILED,                      /* Stream rejected, the upload has to
+                                         * start over */
+};
+#endif
+
+/*
+ * State of the image upload, held for the duration of the upload.
+ */
+static struct {
+    size_t img_size;                    /* Total image size */
+    uint32_t curr_off;                  /* Offset past the bytes written */
+    uint32_t img_num;
 #ifdef MCUBOOT_ERASE_PROGRESSIVELY
-    static off_t not_yet_erased = 0;    /* Offset of next byte to erase; writes to flash
+    off_t not_yet_erased;               /* Offset of next byte to erase; writes to flash
                                          * are done in consecutive manner and erases are done
                                          * to allow currently received chunk to be written;
                                          * this state variable holds information where last
                                          * erase has stopped to let us know whether erase
                                          * is needed to be able to write current chunk.
                                          */
-    static struct flash_sector status_sector;
+    struct flash_sector status_sector;
+#endif
+#ifdef MCUBOOT_SERIAL_UPLOAD_HASH
+    /* Hash of the image, computed over the bytes as they are written. */
+    bootutil_sha_context sha_ctx;
+    uint32_t hash_area_id;              /* Flash area uploaded to */
+    uint32_t hash_end;                  /* End of the bytes covered by the
+                                         * hash, 0 if the image is not hashed */
+    bool hashed;                        /* hash holds the result */
+    uint8_t hash[IMAGE_HASH_SIZE];
+#endif
+#if MCUBOOT_SERIAL_UPLOAD_WINDOW > 0
+    /* Chunks received ahead of the expected offset, accepted once it
+     * reaches them.
+     */
+    struct {
+        uint32_t off;
+        size_t len;                     /* 0 when the entry is free */
+        uint8_t data[MCUBOOT_SERIAL_MAX_RECEIVE_SIZE];
+    } held[MCUBOOT_SERIAL_UPLOAD_WINDOW];
+#endif
+#if MCUBOOT_SERIAL_WRITE_QUEUE > 0
+    /* Chunks acknowledged but not yet written, in order from curr_off. */
+    uint32_t rx_off;                    /* Offset past the last chunk queued */
+    int write_rc;                       /* Error of a queued write, reported to
+                                         * the next upload request */
+    uint8_t q_head;
+    uint8_t q_count;
+#if defined(MCUBOOT_ERASE_PROGRESSIVELY) && defined(MCUBOOT_USE_FLASH_AREA_ASYNC_ERASE)
+    off_t erasing;                      /* End of the erase in progress, 0 if none */
+#endif
+    struct {
+        size_t len;
+        uint8_t data[MCUBOOT_SERIAL_MAX_RECEIVE_SIZE];
+    } queue[MCUBOOT_SERIAL_WRITE_QUEUE];
+#endif
+#ifdef MCUBOOT_SERIAL_COMPRESSED_UPLOAD
+    /* Decoder of a compressed upload, whose offsets are those of the
+     * compressed stream. Image bytes are staged in out, and the matches
+     * reaching before it are read back from the slot.
+     */
+    bool comp;
+    uint8_t lz4_step;
+    uint8_t lz4_token;
+    size_t c_size;                      /* Compressed stream size */
+    uint32_t c_off;                     /* Offset past the bytes decoded */
+    uint32_t lit_len;
+    uint32_t match_len;
+    uint32_t match_dist;
+    uint32_t out_off;                   /* Image offset of out[0] */
+    size_t out_len;
+    uint8_t out[MCUBOOT_SERIAL_DECOMPRESS_BUF_SIZE];
 #endif
+} bs_upload_state;
 
-    zcbor_state_t zsd[4];
-    zcbor_new_state(zsd, sizeof(zsd) / sizeof(zcbor_state_t), (uint8_t *)buf, len, 1, NULL, 0);
+static int
+bs_upload_open(const struct flash_area **fap)
+{
+#if !defined(MCUBOOT_SERIAL_DIRECT_IMAGE_UPLOAD)
+    return flash_area_open(flash_area_id_from_multi_image_slot(bs_upload_state.img_num, 0), fap);
+#else
+    return flash_area_open(flash_area_id_from_direct_image(bs_upload_state.img_num), fap);
+#endif
+}
 
-    struct zcbor_map_decode_key_val image_upload_decode[] = {
-        ZCBOR_MAP_DECODE_KEY_DECODER("image", zcbor_uint32_decode, &img_num_tmp),
-        ZCBOR_MAP_DECODE_KEY_DECODER("data", zcbor_bstr_decode, &img_chunk_data),
-        ZCBOR_MAP_DECODE_KEY_DECODER("len", zcbor_size_decode, &img_size_tmp),
-        ZCBOR_MAP_DECODE_KEY_DECODER("off", zcbor_size_decode, &img_chunk_off),
-    };
+/*
+ * Offset of the next chunk expected from the client.
+ */
+static uint32_t
+bs_upload_next_off(void)
+{
+#ifdef MCUBOOT_SERIAL_COMPRESSED_UPLOAD
+    if (bs_upload_state.comp) {
+        return bs_upload_state.c_off;
+    }
+#endif
+#if MCUBOOT_SERIAL_WRITE_QUEUE > 0
+    return bs_upload_state.rx_off;
+#else
+    return bs_upload_state.curr_off;
+#endif
+}
 
-    ok = zcbor_map_decode_bulk(zsd, image_upload_decode, ARRAY_SIZE(image_upload_decode),
-                               &decoded) == 0;
+/*
+ * Size of the stream uploaded by the client: the image, or its compressed
+ * form.
+ */
+static size_t
+bs_upload_stream_size(void)
+{
+#ifdef MCUBOOT_SERIAL_COMPRESSED_UPLOAD
+    if (bs_upload_state.comp) {
+        return bs_upload_state.c_size;
+    }
+#endif
+    return bs_upload_state.img_size;
+}
 
-    if (!ok) {
-        goto out_invalid_data;
+#ifdef MCUBOOT_SERIAL_UPLOAD_HASH
+/*
+ * Forgets the hash of the image, before a new upload.
+ */
+static void
+bs_upload_hash_reset(uint32_t area_id)
+{
+    if (bs_upload_state.hash_end != 0 && !bs_upload_state.hashed) {
+        bootutil_sha_drop(&bs_upload_state.sha_ctx);
     }
 
-    img_chunk = img_chunk_data.value;
-    img_chunk_len = img_chunk_data.len;
+    bs_upload_state.hash_area_id = area_id;
+    bs_upload_state.hash_end = 0;
+    bs_upload_state.hashed = false;
+}
 
-    /*
-     * Expected data format.
-     * {
-     *   "image":<image number in a multi-image set (OPTIONAL)>
-     *   "data":<image data>
-     *   "len":<image len>
-     *   "off":<current offset of image data>
-     * }
-     */
+/*
+ * Adds the bytes written at off to the hash of the image. The hash covers
+ * what bootutil_img_validate() hashes: the header, the image and the
+ * protected TLVs; encrypted images, whose hash is that of the plain text,
+ * are not hashed.
+ */
+static void
+bs_upload_hash(const uint8_t *data, uint32_t off, size_t len)
+{
+    struct image_header hdr;
 
-    if (img_chunk_off == SIZE_MAX || img_chunk == NULL) {
-        /*
-         * Offset must be set in every block.
-         */
-        goto out_invalid_data;
-    }
+    if (off == 0) {
+        if (len < sizeof(hdr)) {
+            return;
+        }
 
-    /* Use image number only from packet with offset == 0. */
-    if (img_chunk_off == 0) {
-        if (img_num_tmp != UINT_MAX) {
-            img_num = img_num_tmp;
-        } else {
-            img_num = 0;
+        memcpy(&hdr, data, sizeof(hdr));
+        if (hdr.ih_magic != IMAGE_MAGIC || IS_ENCRYPTED(&hdr) ||
+            hdr.ih_img_size > bs_upload_state.img_size ||
+            bs_upload_state.img_size - hdr.ih_img_size <
+            (uint32_t)hdr.ih_hdr_size + hdr.ih_protect_tlv_size) {
+            return;
         }
+
+        bootutil_sha_init(&bs_upload_state.sha_ctx);
+        bs_upload_state.hash_end = hdr.ih_hdr_size + hdr.ih_img_size +
+                                   hdr.ih_protect_tlv_size;
     }
 
-#if !defined(MCUBOOT_SERIAL_DIRECT_IMAGE_UPLOAD)
-    rc = flash_area_open(flash_area_id_from_multi_image_slot(img_num, 0), &fap);
-#else
-    rc = flash_area_open(flash_area_id_from_direct_image(img_num), &fap);
-#endif
-    if (rc) {
-        rc = MGMT_ERR_EINVAL;
-        goto out;
+    if (off >= bs_upload_state.hash_end) {
+        return;
     }
 
-    if (img_chunk_off == 0) {
-        /* Receiving chunk with 0 offset resets the upload state; this basically
-         * means that upload has started from beginning.
-         */
-        const size_t area_size = flash_area_get_size(fap);
+    len = MIN(len, bs_upload_state.hash_end - off);
+    bootutil_sha_update(&bs_upload_state.sha_ctx, data, len);
 
-        curr_off = 0;
-#ifdef MCUBOOT_ERASE_PROGRESSIVELY
-        /* Get trailer sector information; this is done early because inability to get
-         * that sector information means that upload will not work anyway.
-         * TODO: This is single occurrence issue, it should get detected during tests
-         * and fixed otherwise you are deploying broken mcuboot.
-         */
-        if (flash_area_get_sector(fap, boot_status_off(fap), &status_sector)) {
-            rc = MGMT_ERR_EUNKNOWN;
-            BOOT_LOG_ERR("Unable to determine flash sector of the image trailer");
-            goto out;
-         }
-#endif
+    if (off + len == bs_upload_state.hash_end) {
+        bootutil_sha_finish(&bs_upload_state.sha_ctx, bs_upload_state.hash);
+        bootutil_sha_drop(&bs_upload_state.sha_ctx);
+        bs_upload_state.hashed = true;
+    }
+}
 
-#if defined(MCUBOOT_VALIDATE_PRIMARY_SLOT_ONCE)
-        /* We are using swap state at end of flash area to store validation
-         * result. Make sure the user cannot write it from an image to skip validation.
-         */
-        if (img_size_tmp > (area_size - BOOT_MAGIC_SZ)) {
-            goto out_invalid_data;
-        }
-#else
-        if (img_size_tmp > area_size) {
-            goto out_invalid_data;
-        }
+/*
+ * Hash of the image uploaded to the area, computed as it was written, or
+ * NULL if there is none. The area is assumed to only be written by uploads.
+ */
+static const uint8_t *
+bs_upload_hash_of(uint32_t area_id)
+{
+    if (!bs_upload_state.hashed || bs_upload_state.hash_area_id != area_id ||
+        bs_upload_state.curr_off != bs_upload_state.img_size) {
+        return NULL;
+    }
 
-#endif
+    return bs_upload_state.hash;
+}
 
-#ifndef MCUBOOT_ERASE_PROGRESSIVELY
-        /* Non-progressive erase erases entire image slot when first chunk of
-         * an image is received.
-         */
-        rc = flash_area_erase(fap, 0, area_size);
-        if (rc) {
-            goto out_invalid_data;
+#ifdef MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE
+/*
+ * Validates an image uploaded to a primary slot against its hash, and leaves
+ * a validation cache record for it, so the next boot does not hash it in full
+ * either. The hash is dropped if the image fails, e.g. when it was not
+ * written as it was received, so listing images checks the slot itself.
+ */
+static void
+bs_upload_hash_cache(const struct flash_area *fap)
+{
+    const uint8_t *hash = bs_upload_hash_of(flash_area_get_id(fap));
+    struct image_header hdr;
+    uint8_t tmpbuf[64];
+    int image_index;
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+
+    for (image_index = 0; image_index < BOOT_IMAGE_NUMBER; image_index++) {
+        if (flash_area_get_id(fap) == FLASH_AREA_IMAGE_PRIMARY(image_index)) {
+            break;
         }
-#else
-        not_yet_erased = 0;
-#endif
+    }
 
-        img_size = img_size_tmp;
-    } else if (img_chunk_off != curr_off) {
-        /* If received chunk offset does not match expected one jump, pretend
-         * success and jump to out; out will respond to client with success
-         * and request the expected offset, held by curr_off.
-         */
-        rc = 0;
-        goto out;
-    } else if (curr_off + img_chunk_len > img_size) {
-        rc = MGMT_ERR_EINVAL;
-        goto out;
+    if (hash == NULL || image_index == BOOT_IMAGE_NUMBER ||
+        flash_area_read(fap, 0, &hdr, sizeof(hdr)) != 0) {
+        return;
+    }
+
+    FIH_CALL(bootutil_img_validate_cached_hashed, fih_rc, image_index, &hdr,
+             fap, hash, tmpbuf, sizeof(tmpbuf));
+    if (FIH_NOT_EQ(fih_rc, FIH_SUCCESS)) {
+        bs_upload_hash_reset(flash_area_get_id(fap));
     }
+}
+#endif
+#endif
+
+/*
+ * Writes a chunk of the image at the current offset, erasing flash first
+ * if needed, and advances the current offset past the bytes written.
+ */
+static int
+bs_upload_write(const struct flash_area *fap, const uint8_t *img_chunk,
+                size_t img_chunk_len)
+{
+    size_t rem_bytes;                   /* Reminder bytes after aligning chunk write to
+                                         * to flash alignment */
+    uint32_t curr_off = bs_upload_state.curr_off;
+#ifdef MCUBOOT_SERIAL_UPLOAD_HASH
+    const uint8_t *data = img_chunk;
+#endif
+    int rc;
 
 #ifdef MCUBOOT_ERASE_PROGRESSIVELY
     /* Progressive erase will erase enough flash, aligned to sector size,
      * as needed for the current chunk to be written.
      */
-    not_yet_erased = erase_range(fap, not_yet_erased,
-                                 curr_off + img_chunk_len - 1);
+    bs_upload_state.not_yet_erased = erase_range(fap,
+                                                 bs_upload_state.not_yet_erased,
+                                                 curr_off + img_chunk_len - 1);
 
-    if (not_yet_erased < 0) {
-        rc = MGMT_ERR_EINVAL;
-        goto out;
+    if (bs_upload_state.not_yet_erased < 0) {
+        return -EINVAL;
     }
 #endif
 
@@ -948,7 +1131,7 @@ bs_upload(char *buf, int len)
     rem_bytes = img_chunk_len % flash_area_align(fap);
     img_chunk_len -= rem_bytes;
 
-    if (curr_off + img_chunk_len + rem_bytes < img_size) {
+    if (curr_off + img_chunk_len + rem_bytes < bs_upload_state.img_size) {
         rem_bytes = 0;
     }
 
@@ -961,6 +1144,7 @@ bs_upload(char *buf, int len)
         size_t write_size = MCUBOOT_SERIAL_UNALIGNED_BUFFER_SIZE;
         uint8_t wbs_aligned[MCUBOOT_SERIAL_UNALIGNED_BUFFER_SIZE];
 
+        rc = 0;
         while (img_chunk_len >= flash_area_align(fap)) {
             if (write_size > img_chunk_len) {
                 write_size = img_chunk_len;
@@ -972,7 +1156,7 @@ bs_upload(char *buf, int len)
             rc = flash_area_write(fap, curr_off, wbs_aligned, write_size);
 
             if (rc != 0) {
-                goto out;
+                break;
             }
 
             curr_off += write_size;
@@ -1001,52 +1185,817 @@ bs_upload(char *buf, int len)
     }
 
     if (rc == 0) {
-        curr_off += img_chunk_len + rem_bytes;
-        if (curr_off == img_size) {
-#ifdef MCUBOOT_ERASE_PROGRESSIVELY
-            /* Assure that sector for image trailer was erased. */
-            /* Check whether it was erased during previous upload. */
-            off_t start = flash_sector_get_off(&status_sector);
-
-            if (erase_range(fap, start, start) < 0) {
-                rc = MGMT_ERR_EUNKNOWN;
-                goto out;
-            }
+#ifdef MCUBOOT_SERIAL_UPLOAD_HASH
+        bs_upload_hash(data, bs_upload_state.curr_off,
+                       curr_off + img_chunk_len + rem_bytes - bs_upload_state.curr_off);
 #endif
-            rc = BOOT_HOOK_CALL(boot_serial_uploaded_hook, 0, img_num, fap,
-                                img_size);
-            if (rc) {
-                BOOT_LOG_ERR("Error %d post upload hook", rc);
-                goto out;
-            }
-        }
-    } else {
-    out_invalid_data:
-        rc = MGMT_ERR_EINVAL;
+        bs_upload_state.curr_off = curr_off + img_chunk_len + rem_bytes;
     }
 
-out:
-    BOOT_LOG_DBG("RX: 0x%x", rc);
-    zcbor_map_start_encode(cbor_state, 10);
-    zcbor_tstr_put_lit_cast(cbor_state, "rc");
-    zcbor_int32_put(cbor_state, rc);
-    if (rc == 0) {
-        zcbor_tstr_put_lit_cast(cbor_state, "off");
-        zcbor_uint32_put(cbor_state, curr_off);
-    }
-    zcbor_map_end_encode(cbor_state, 10);
+    return rc;
+}
 
-    boot_serial_output();
+#if MCUBOOT_SERIAL_WRITE_QUEUE > 0
+/*
+ * Drops the queued chunks, so that the upload resumes from the last one
+ * written.
+ */
+static void
+bs_upload_discard(const struct flash_area *fap)
+{
+#if defined(MCUBOOT_ERASE_PROGRESSIVELY) && defined(MCUBOOT_USE_FLASH_AREA_ASYNC_ERASE)
+    if (bs_upload_state.erasing != 0) {
+        /* The sectors may be erased again, but not while being erased. */
+        while (flash_area_erase_poll(fap) > 0) {
+            MCUBOOT_WATCHDOG_FEED();
+        }
+
+        bs_upload_state.erasing = 0;
+    }
+#endif
+
+    bs_upload_state.q_count = 0;
+    bs_upload_state.rx_off = bs_upload_state.curr_off;
+#ifdef MCUBOOT_SERIAL_COMPRESSED_UPLOAD
+    /* The decoder cannot go back to the bytes written. */
+    if (bs_upload_state.comp) {
+        bs_upload_state.lz4_step = BS_LZ4_FAILED;
+    }
+#endif
+}
+
+/*
+ * Does one step of the work of writing the queued chunks: writes the oldest
+ * one or, with asynchronous erase, starts or polls the erase it needs first.
+ * Returns a negative value on failure, with the queue discarded, 0 once the
+ * queue is empty and a positive value while work remains.
+ */
+static int
+bs_upload_step(const struct flash_area *fap)
+{
+    uint8_t i = bs_upload_state.q_head;
+    int rc;
+
+    if (bs_upload_state.q_count == 0) {
+        return 0;
+    }
+
+#if defined(MCUBOOT_ERASE_PROGRESSIVELY) && defined(MCUBOOT_USE_FLASH_AREA_ASYNC_ERASE)
+    if (bs_upload_state.erasing != 0) {
+        rc = flash_area_erase_poll(fap);
+        if (rc > 0) {
+            return 1;
+        } else if (rc < 0) {
+            BOOT_LOG_ERR("Error %d while erasing range", rc);
+            bs_upload_state.erasing = 0;
+            goto fail;
+        }
+
+        bs_upload_state.not_yet_erased = bs_upload_state.erasing;
+        bs_upload_state.erasing = 0;
+    } else {
+        /* Reception goes on while the sectors the chunk needs are erased. */
+        off_t start = bs_upload_state.not_yet_erased;
+        off_t stop = erase_range_end(fap, start, bs_upload_state.curr_off +
+                                     bs_upload_state.queue[i].len - 1);
+
+        if (stop < 0) {
+            goto fail;
+        } else if (stop > start) {
+            BOOT_LOG_DBG("Erasing range 0x%jx:0x%jx", (intmax_t)start,
+                         (intmax_t)(stop - 1));
+            rc = flash_area_erase_submit(fap, start, stop - start);
+            if (rc != 0) {
+                BOOT_LOG_ERR("Error %d while erasing range", rc);
+                goto fail;
+            }
+
+            bs_upload_state.erasing = stop;
+            return 1;
+        }
+    }
+#endif
+
+    rc = bs_upload_write(fap, bs_upload_state.queue[i].data, bs_upload_state.queue[i].len);
+    if (rc != 0) {
+        goto fail;
+    }
+
+    bs_upload_state.q_head = (i + 1) % MCUBOOT_SERIAL_WRITE_QUEUE;
+    bs_upload_state.q_count--;
+
+    return bs_upload_state.q_count;
+
+fail:
+    bs_upload_discard(fap);
+    return -1;
+}
+
+/*
+ * Writes all the queued chunks.
+ */
+static int
+bs_upload_drain(const struct flash_area *fap)
+{
+    int rc;
+
+    do {
+        MCUBOOT_WATCHDOG_FEED();
+        rc = bs_upload_step(fap);
+    } while (rc > 0);
+
+    return rc;
+}
+
+/*
+ * Writes all the queued chunks before serving a command other than an
+ * upload, which may read or reset the slot.
+ */
+static void
+bs_upload_flush(void)
+{
+    const struct flash_area *fap;
+
+    if (bs_upload_state.q_count == 0 || bs_upload_open(&fap) != 0) {
+        return;
+    }
+
+    if (bs_upload_drain(fap) < 0) {
+        bs_upload_state.write_rc = MGMT_ERR_EINVAL;
+    }
+
+    flash_area_close(fap);
+}
+
+/*
+ * Cooperative task of the serial recovery loop, run while no input is
+ * pending: does one step of writing the queued chunks, so that the loop
+ * keeps reading the serial port between steps. Returns non-zero while
+ * work remains.
+ */
+static int
+bs_upload_work(void)
+{
+    const struct flash_area *fap;
+    int rc;
+
+    if (bs_upload_state.q_count == 0 || bs_upload_open(&fap) != 0) {
+        return 0;
+    }
+
+    rc = bs_upload_step(fap);
+    if (rc < 0) {
+        bs_upload_state.write_rc = MGMT_ERR_EINVAL;
+        rc = 0;
+    }
+
+    flash_area_close(fap);
+
+    return rc;
+}
+#endif
+
+/*
+ * Accepts the chunk at the offset expected next. With a write queue, the
+ * chunk is queued, and only written once the queue is full or the image
+ * complete, or from the serial recovery loop while waiting for input.
+ */
+static int
+bs_upload_accept(const struct flash_area *fap, const uint8_t *img_chunk,
+                 size_t img_chunk_len)
+{
+#if MCUBOOT_SERIAL_WRITE_QUEUE > 0
+    uint8_t i;
+    int rc;
+
+    /* Queue the bytes bs_upload_write() would write at once: all of the last
+     * chunk, but only up to the write alignment of the others.
+     */
+    if (bs_upload_state.rx_off + img_chunk_len < bs_upload_state.img_size) {
+        img_chunk_len -= img_chunk_len % flash_area_align(fap);
+    }
+
+    if (img_chunk_len == 0) {
+        return 0;
+    }
+
+    while (bs_upload_state.q_count == MCUBOOT_SERIAL_WRITE_QUEUE) {
+        MCUBOOT_WATCHDOG_FEED();
+        rc = bs_upload_step(fap);
+        if (rc < 0) {
+            return rc;
+        }
+    }
+
+    i = (bs_upload_state.q_head + bs_upload_state.q_count) % MCUBOOT_SERIAL_WRITE_QUEUE;
+    bs_upload_state.queue[i].len = img_chunk_len;
+    memcpy(bs_upload_state.queue[i].data, img_chunk, img_chunk_len);
+    bs_upload_state.q_count++;
+    bs_upload_state.rx_off += img_chunk_len;
+
+    return 0;
+#else
+    return bs_upload_write(fap, img_chunk, img_chunk_len);
+#endif
+}
+
+#ifdef MCUBOOT_SERIAL_COMPRESSED_UPLOAD
+/*
+ * Accepts the staged image bytes. Only the last of them may end off the
+ * write alignment.
+ */
+static int
+bs_lz4_flush(const struct flash_area *fap)
+{
+    int rc;
+
+    if (bs_upload_state.out_off + bs_upload_state.out_len < bs_upload_state.img_size &&
+        bs_upload_state.out_len % flash_area_align(fap) != 0) {
+        BOOT_LOG_ERR("Decompression buffer not a multiple of the write alignment");
+        return -1;
+    }
+
+    rc = bs_upload_accept(fap, bs_upload_state.out, bs_upload_state.out_len);
+    if (rc != 0) {
+        return rc;
+    }
+
+    bs_upload_state.out_off += bs_upload_state.out_len;
+    bs_upload_state.out_len = 0;
+
+    return 0;
+}
+
+/*
+ * Stages image bytes, accepting the buffer each time it is full.
+ */
+static int
+bs_lz4_put(const struct flash_area *fap, const uint8_t *data, size_t len)
+{
+    size_t n;
+    int rc;
+
+    if (len > bs_upload_state.img_size - bs_upload_state.out_off - bs_upload_state.out_len) {
+        return -1;
+    }
+
+    while (len > 0) {
+        if (bs_upload_state.out_len == sizeof(bs_upload_state.out)) {
+            rc = bs_lz4_flush(fap);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+
+        n = MIN(len, sizeof(bs_upload_state.out) - bs_upload_state.out_len);
+        memcpy(&bs_upload_state.out[bs_upload_state.out_len], data, n);
+        bs_upload_state.out_len += n;
+        data += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/*
+ * Stages the bytes of a match, copied from those staged or, before them,
+ * read back from the slot.
+ */
+static int
+bs_lz4_match(const struct flash_area *fap)
+{
+    uint32_t len = bs_upload_state.match_len;
+    uint32_t pos = bs_upload_state.out_off + bs_upload_state.out_len;
+    uint32_t src;
+    size_t n;
+    size_t i;
+    int rc;
+
+    if (bs_upload_state.match_dist == 0 || bs_upload_state.match_dist > pos ||
+        len > bs_upload_state.img_size - pos) {
+        return -1;
+    }
+
+    while (len > 0) {
+        if (bs_upload_state.out_len == sizeof(bs_upload_state.out)) {
+            rc = bs_lz4_flush(fap);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+
+        pos = bs_upload_state.out_off + bs_upload_state.out_len;
+        src = pos - bs_upload_state.match_dist;
+        n = MIN(len, sizeof(bs_upload_state.out) - bs_upload_state.out_len);
+
+        if (src < bs_upload_state.out_off) {
+            n = MIN(n, bs_upload_state.out_off - src);
+#if MCUBOOT_SERIAL_WRITE_QUEUE > 0
+            if (src + n > bs_upload_state.curr_off) {
+                rc = bs_upload_drain(fap);
+                if (rc < 0) {
+                    return rc;
+                }
+            }
+#endif
+            rc = flash_area_read(fap, src, &bs_upload_state.out[bs_upload_state.out_len], n);
+            if (rc != 0) {
+                return -1;
+            }
+        } else {
+            /* Byte by byte, as a match may repeat the bytes it produces. */
+            src -= bs_upload_state.out_off;
+            for (i = 0; i < n; i++) {
+                bs_upload_state.out[bs_upload_state.out_len + i] = bs_upload_state.out[src + i];
+            }
+        }
+
+        bs_upload_state.out_len += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/*
+ * Decodes a chunk of a compressed upload: an LZ4 block, without the frame,
+ * made of sequences of a token, literals and a match, except for the last
+ * one which ends after its literals. Sequences may be split across chunks.
+ * Once the stream is complete, the last image bytes are accepted.
+ */
+static int
+bs_lz4_decode(const struct flash_area *fap, const uint8_t *in, size_t in_len)
+{
+    const size_t chunk_len = in_len;
+    size_t n;
+    uint8_t b;
+    int rc = 0;
+
+    if (bs_upload_state.lz4_step == BS_LZ4_FAILED) {
+        return -1;
+    }
+
+    while (rc == 0 && in_len > 0) {
+        if (bs_upload_state.lz4_step == BS_LZ4_LIT) {
+            n = MIN(bs_upload_state.lit_len, in_len);
+            rc = bs_lz4_put(fap, in, n);
+            in += n;
+            in_len -= n;
+            bs_upload_state.lit_len -= n;
+            if (bs_upload_state.lit_len == 0) {
+                bs_upload_state.lz4_step = BS_LZ4_DIST_LO;
+            }
+            continue;
+        }
+
+        b = *in++;
+        in_len--;
+
+        switch (bs_upload_state.lz4_step) {
+        case BS_LZ4_TOKEN:
+            bs_upload_state.lz4_token = b;
+            bs_upload_state.lit_len = b >> 4;
+            if (bs_upload_state.lit_len == 15) {
+                bs_upload_state.lz4_step = BS_LZ4_LIT_LEN;
+            } else if (bs_upload_state.lit_len > 0) {
+                bs_upload_state.lz4_step = BS_LZ4_LIT;
+            } else {
+                bs_upload_state.lz4_step = BS_LZ4_DIST_LO;
+            }
+            break;
+
+        case BS_LZ4_LIT_LEN:
+            bs_upload_state.lit_len += b;
+            if (bs_upload_state.lit_len > bs_upload_state.img_size) {
+                rc = -1;
+            } else if (b != 255) {
+                bs_upload_state.lz4_step = BS_LZ4_LIT;
+            }
+            break;
+
+        case BS_LZ4_DIST_LO:
+            bs_upload_state.match_dist = b;
+            bs_upload_state.lz4_step = BS_LZ4_DIST_HI;
+            break;
+
+        case BS_LZ4_DIST_HI:
+            bs_upload_state.match_dist |= (uint32_t)b << 8;
+            bs_upload_state.match_len = (bs_upload_state.lz4_token & 0xf) + BS_LZ4_MIN_MATCH;
+            if ((bs_upload_state.lz4_token & 0xf) == 15) {
+                bs_upload_state.lz4_step = BS_LZ4_MATCH_LEN;
+            } else {
+                rc = bs_lz4_match(fap);
+                bs_upload_state.lz4_step = BS_LZ4_TOKEN;
+            }
+            break;
+
+        case BS_LZ4_MATCH_LEN:
+            bs_upload_state.match_len += b;
+            if (bs_upload_state.match_len > bs_upload_state.img_size) {
+                rc = -1;
+            } else if (b != 255) {
+                rc = bs_lz4_match(fap);
+                bs_upload_state.lz4_step = BS_LZ4_TOKEN;
+            }
+            break;
+
+        default:
+            rc = -1;
+            break;
+        }
+    }
+
+    if (rc == 0) {
+        bs_upload_state.c_off += chunk_len;
+
+        if (bs_upload_state.c_off == bs_upload_state.c_size) {
+            /* The stream ends with the literals of its last sequence. */
+            if (bs_upload_state.lz4_step != BS_LZ4_DIST_LO ||
+                bs_upload_state.out_off + bs_upload_state.out_len != bs_upload_state.img_size) {
+                rc = -1;
+            } else {
+                rc = bs_lz4_flush(fap);
+            }
+        }
+    }
+
+    if (rc != 0) {
+        BOOT_LOG_ERR("Compressed upload failed at 0x%x", bs_upload_state.c_off);
+        bs_upload_state.lz4_step = BS_LZ4_FAILED;
+    }
+
+    return rc;
+}
+#endif
+
+/*
+ * Takes the chunk at the offset expected next, decompressing it first if the
+ * upload is compressed.
+ */
+static int
+bs_upload_chunk(const struct flash_area *fap, const uint8_t *img_chunk,
+                size_t img_chunk_len)
+{
+#ifdef MCUBOOT_SERIAL_COMPRESSED_UPLOAD
+    if (bs_upload_state.comp) {
+        return bs_lz4_decode(fap, img_chunk, img_chunk_len);
+    }
+#endif
+    return bs_upload_accept(fap, img_chunk, img_chunk_len);
+}
+
+#if MCUBOOT_SERIAL_UPLOAD_WINDOW > 0
+/*
+ * Keeps a chunk received ahead of the current offset, if there is room for
+ * it in the window.
+ */
+static void
+bs_upload_hold(uint32_t off, const uint8_t *img_chunk, size_t img_chunk_len)
+{
+    int i;
+    int free_idx = -1;
+
+    if (img_chunk_len == 0 || img_chunk_len > sizeof(bs_upload_state.held[0].data)) {
+        return;
+    }
+
+    for (i = 0; i < MCUBOOT_SERIAL_UPLOAD_WINDOW; i++) {
+        if (bs_upload_state.held[i].len == 0) {
+            if (free_idx < 0) {
+                free_idx = i;
+            }
+        } else if (bs_upload_state.held[i].off == off) {
+            /* Retransmission of a chunk already held. */
+            return;
+        }
+    }
+
+    if (free_idx < 0) {
+        BOOT_LOG_DBG("Window full, dropping chunk at 0x%x", off);
+        return;
+    }
+
+    bs_upload_state.held[free_idx].off = off;
+    bs_upload_state.held[free_idx].len = img_chunk_len;
+    memcpy(bs_upload_state.held[free_idx].data, img_chunk, img_chunk_len);
+}
+
+/*
+ * Accepts the held chunks that the expected offset has reached, dropping
+ * those it has gone past.
+ */
+static int
+bs_upload_write_held(const struct flash_area *fap)
+{
+    bool written;
+    int i;
+    int rc;
+
+    do {
+        written = false;
+
+        for (i = 0; i < MCUBOOT_SERIAL_UPLOAD_WINDOW; i++) {
+            if (bs_upload_state.held[i].len == 0 ||
+                bs_upload_state.held[i].off > bs_upload_next_off()) {
+                continue;
+            }
+
+            if (bs_upload_state.held[i].off == bs_upload_next_off()) {
+                rc = bs_upload_chunk(fap, bs_upload_state.held[i].data,
+                                     bs_upload_state.held[i].len);
+                if (rc != 0) {
+                    return rc;
+                }
+
+                written = true;
+            }
+
+            bs_upload_state.held[i].len = 0;
+        }
+    } while (written);
+
+    return 0;
+}
+#endif
+
+/*
+ * Image upload request.
+ */
+static void
+bs_upload(char *buf, int len)
+{
+    const uint8_t *img_chunk = NULL;    /* Pointer to buffer with received image chunk */
+    size_t img_chunk_len = 0;           /* Length of received image chunk */
+    size_t img_chunk_off = SIZE_MAX;    /* Offset of image chunk within image  */
+    uint32_t img_num_tmp = UINT_MAX;    /* Temp variable for image number */
+    size_t img_size_tmp = SIZE_MAX;     /* Temp variable for image size */
+    const struct flash_area *fap = NULL;
+    int rc;
+    struct zcbor_string img_chunk_data;
+    size_t decoded = 0;
+    bool ok;
+#if MCUBOOT_SERIAL_UPLOAD_WINDOW > 0
+    uint32_t win = UINT32_MAX;          /* Window of the client (OPTIONAL) */
+#endif
+#ifdef MCUBOOT_SERIAL_COMPRESSED_UPLOAD
+    struct zcbor_string comp = { 0 };   /* Compression of the stream (OPTIONAL) */
+    size_t comp_size_tmp = SIZE_MAX;    /* Temp variable for compressed size */
+#endif
+
+    zcbor_state_t zsd[4];
+    zcbor_new_state(zsd, sizeof(zsd) / sizeof(zcbor_state_t), (uint8_t *)buf, len, 1, NULL, 0);
+
+    struct zcbor_map_decode_key_val image_upload_decode[] = {
+        ZCBOR_MAP_DECODE_KEY_DECODER("image", zcbor_uint32_decode, &img_num_tmp),
+        ZCBOR_MAP_DECODE_KEY_DECODER("data", zcbor_bstr_decode, &img_chunk_data),
+        ZCBOR_MAP_DECODE_KEY_DECODER("len", zcbor_size_decode, &img_size_tmp),
+        ZCBOR_MAP_DECODE_KEY_DECODER("off", zcbor_size_decode, &img_chunk_off),
+#if MCUBOOT_SERIAL_UPLOAD_WINDOW > 0
+        ZCBOR_MAP_DECODE_KEY_DECODER("win", zcbor_uint32_decode, &win),
+#endif
+#ifdef MCUBOOT_SERIAL_COMPRESSED_UPLOAD
+        ZCBOR_MAP_DECODE_KEY_DECODER("comp", zcbor_tstr_decode, &comp),
+        ZCBOR_MAP_DECODE_KEY_DECODER("clen", zcbor_size_decode, &comp_size_tmp),
+#endif
+    };
+
+    ok = zcbor_map_decode_bulk(zsd, image_upload_decode, ARRAY_SIZE(image_upload_decode),
+                               &decoded) == 0;
+
+    if (!ok) {
+        goto out_invalid_data;
+    }
+
+    img_chunk = img_chunk_data.value;
+    img_chunk_len = img_chunk_data.len;
+
+    /*
+     * Expected data format.
+     * {
+     *   "image":<image number in a multi-image set (OPTIONAL)>
+     *   "data":<image data>
+     *   "len":<image len>
+     *   "off":<current offset of image data>
+     *   "win":<chunks the client sends ahead of responses (OPTIONAL)>
+     *   "comp":<compression of the data, "lz4" (OPTIONAL)>
+     *   "clen":<compressed len, with "comp">
+     * }
+     *
+     * "comp" and "clen" are only used from the packet with offset == 0; the
+     * offsets of a compressed upload are those of the compressed data.
+     */
+
+    if (img_chunk_off == SIZE_MAX || img_chunk == NULL) {
+        /*
+         * Offset must be set in every block.
+         */
+        goto out_invalid_data;
+    }
+
+    /* Use image number only from packet with offset == 0. */
+    if (img_chunk_off == 0) {
+        if (img_num_tmp != UINT_MAX) {
+            bs_upload_state.img_num = img_num_tmp;
+        } else {
+            bs_upload_state.img_num = 0;
+        }
+    }
+
+    rc = bs_upload_open(&fap);
+    if (rc) {
+        rc = MGMT_ERR_EINVAL;
+        goto out;
+    }
+
+    if (img_chunk_off == 0) {
+        /* Receiving chunk with 0 offset resets the upload state; this basically
+         * means that upload has started from beginning.
+         */
+        const size_t area_size = flash_area_get_size(fap);
+
+        bs_upload_state.curr_off = 0;
+#ifdef MCUBOOT_SERIAL_UPLOAD_HASH
+        bs_upload_hash_reset(flash_area_get_id(fap));
+#endif
+#if MCUBOOT_SERIAL_WRITE_QUEUE > 0
+        bs_upload_discard(fap);
+        bs_upload_state.write_rc = 0;
+#endif
+#ifdef MCUBOOT_ERASE_PROGRESSIVELY
+        /* Get trailer sector information; this is done early because inability to get
+         * that sector information means that upload will not work anyway.
+         * TODO: This is single occurrence issue, it should get detected during tests
+         * and fixed otherwise you are deploying broken mcuboot.
+         */
+        if (flash_area_get_sector(fap, boot_status_off(fap),
+                                  &bs_upload_state.status_sector)) {
+            rc = MGMT_ERR_EUNKNOWN;
+            BOOT_LOG_ERR("Unable to determine flash sector of the image trailer");
+            goto out;
+         }
+#endif
+
+#if defined(MCUBOOT_VALIDATE_PRIMARY_SLOT_ONCE)
+        /* We are using swap state at end of flash area to store validation
+         * result. Make sure the user cannot write it from an image to skip validation.
+         */
+        if (img_size_tmp > (area_size - BOOT_MAGIC_SZ)) {
+            goto out_invalid_data;
+        }
+#else
+        if (img_size_tmp > area_size) {
+            goto out_invalid_data;
+        }
+
+#endif
+
+#ifdef MCUBOOT_SERIAL_COMPRESSED_UPLOAD
+        bs_upload_state.comp = false;
+        if (comp.len > 0) {
+            if (comp.len != sizeof("lz4") - 1 || memcmp(comp.value, "lz4", comp.len) != 0) {
+                rc = MGMT_ERR_ENOTSUP;
+                goto out;
+            }
+
+            if (comp_size_tmp == SIZE_MAX) {
+                goto out_invalid_data;
+            }
+
+            bs_upload_state.comp = true;
+            bs_upload_state.c_size = comp_size_tmp;
+            bs_upload_state.c_off = 0;
+            bs_upload_state.lz4_step = BS_LZ4_TOKEN;
+            bs_upload_state.out_off = 0;
+            bs_upload_state.out_len = 0;
+        }
+#endif
+
+#ifndef MCUBOOT_ERASE_PROGRESSIVELY
+        /* Non-progressive erase erases entire image slot when first chunk of
+         * an image is received.
+         */
+        rc = flash_area_erase(fap, 0, area_size);
+        if (rc) {
+            goto out_invalid_data;
+        }
+#else
+        bs_upload_state.not_yet_erased = 0;
+#endif
+
+#if MCUBOOT_SERIAL_UPLOAD_WINDOW > 0
+        memset(bs_upload_state.held, 0, sizeof(bs_upload_state.held));
+#endif
+
+        bs_upload_state.img_size = img_size_tmp;
+#if MCUBOOT_SERIAL_WRITE_QUEUE > 0
+    } else if (bs_upload_state.write_rc != 0) {
+        /* A queued chunk failed to be written; the upload resumes from the
+         * last chunk written, if the client tries again.
+         */
+        rc = bs_upload_state.write_rc;
+        bs_upload_state.write_rc = 0;
+        goto out;
+#endif
+    } else if (img_chunk_off != bs_upload_next_off()) {
+#if MCUBOOT_SERIAL_UPLOAD_WINDOW > 0
+        /* A chunk sent ahead of one that was lost is kept until the lost
+         * one is sent again, so that only it needs to be retransmitted.
+         */
+        if (img_chunk_off > bs_upload_next_off() &&
+            img_chunk_off + img_chunk_len <= bs_upload_stream_size()) {
+            bs_upload_hold(img_chunk_off, img_chunk, img_chunk_len);
+        }
+#endif
+        /* If received chunk offset does not match expected one jump, pretend
+         * success and jump to out; out will respond to client with success
+         * and request the expected offset.
+         */
+        rc = 0;
+        goto out;
+    } else if (bs_upload_next_off() + img_chunk_len > bs_upload_stream_size()) {
+        rc = MGMT_ERR_EINVAL;
+        goto out;
+    }
+
+    rc = bs_upload_chunk(fap, img_chunk, img_chunk_len);
+#if MCUBOOT_SERIAL_UPLOAD_WINDOW > 0
+    if (rc == 0) {
+        rc = bs_upload_write_held(fap);
+    }
+#endif
+#if MCUBOOT_SERIAL_WRITE_QUEUE > 0
+    /* The last chunk is only acknowledged once the image is written. */
+    if (rc == 0 && bs_upload_state.rx_off == bs_upload_state.img_size) {
+        rc = bs_upload_drain(fap);
+    }
+#endif
+
+    if (rc == 0) {
+        if (bs_upload_state.curr_off == bs_upload_state.img_size) {
+#ifdef MCUBOOT_ERASE_PROGRESSIVELY
+            /* Assure that sector for image trailer was erased. */
+            /* Check whether it was erased during previous upload. */
+            off_t start = flash_sector_get_off(&bs_upload_state.status_sector);
+
+            if (erase_range(fap, start, start) < 0) {
+                rc = MGMT_ERR_EUNKNOWN;
+                goto out;
+            }
+#endif
+            rc = BOOT_HOOK_CALL(boot_serial_uploaded_hook, 0, bs_upload_state.img_num,
+                                fap, bs_upload_state.img_size);
+            if (rc) {
+                BOOT_LOG_ERR("Error %d post upload hook", rc);
+                goto out;
+            }
+#if defined(MCUBOOT_SERIAL_UPLOAD_HASH) && defined(MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE)
+            bs_upload_hash_cache(fap);
+#endif
+        }
+    } else {
+    out_invalid_data:
+        rc = MGMT_ERR_EINVAL;
+    }
+
+out:
+    BOOT_LOG_DBG("RX: 0x%x", rc);
+    zcbor_map_start_encode(cbor_state, 10);
+    zcbor_tstr_put_lit_cast(cbor_state, "rc");
+    zcbor_int32_put(cbor_state, rc);
+    if (rc == 0) {
+        zcbor_tstr_put_lit_cast(cbor_state, "off");
+        zcbor_uint32_put(cbor_state, bs_upload_next_off());
+#if MCUBOOT_SERIAL_UPLOAD_WINDOW > 0
+        /* Only clients announcing a window are told the one supported. */
+        if (win != UINT32_MAX) {
+            zcbor_tstr_put_lit_cast(cbor_state, "win");
+            zcbor_uint32_put(cbor_state, MIN(win, MCUBOOT_SERIAL_UPLOAD_WINDOW));
+        }
+#endif
+#ifdef MCUBOOT_SERIAL_COMPRESSED_UPLOAD
+        /* Tells the client the data is decompressed; devices without support
+         * ignore "comp" and would write the data as it is.
+         */
+        if (comp.len > 0) {
+            zcbor_tstr_put_lit_cast(cbor_state, "comp");
+            zcbor_tstr_put_lit_cast(cbor_state, "lz4");
+        }
+#endif
+    }
+    zcbor_map_end_encode(cbor_state, 10);
+
+    boot_serial_output();
 
 #ifdef MCUBOOT_ENC_IMAGES
     /* Check if this upload was for the primary slot */
 #if !defined(MCUBOOT_SERIAL_DIRECT_IMAGE_UPLOAD)
-    if (flash_area_id_from_multi_image_slot(img_num, 0) == FLASH_AREA_IMAGE_PRIMARY(0))
+    if (flash_area_id_from_multi_image_slot(bs_upload_state.img_num, 0) ==
+        FLASH_AREA_IMAGE_PRIMARY(0))
 #else
-    if (flash_area_id_from_direct_image(img_num) == FLASH_AREA_IMAGE_PRIMARY(0))
+    if (flash_area_id_from_direct_image(bs_upload_state.img_num) == FLASH_AREA_IMAGE_PRIMARY(0))
 #endif
     {
-        if (curr_off == img_size) {
+        if (bs_upload_state.curr_off == bs_upload_state.img_size) {
             /* Last sector received, now start a decryption on the image if it is encrypted */
             rc = boot_handle_enc_fw(fap);
         }
@@ -1141,6 +2090,63 @@ bs_reset(char *buf, int len)
     }
 }
 
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+/*
+ * SMP parameters, listing the framings packets may be sent in; responses
+ * are sent in the framing of their request.
+ */
+static void
+bs_params(char *buf, int len)
+{
+    bool ok;
+
+    ok = zcbor_map_start_encode(cbor_state, 10) &&
+         zcbor_tstr_put_lit(cbor_state, "buf_size") &&
+         zcbor_uint32_put(cbor_state, MCUBOOT_SERIAL_MAX_RECEIVE_SIZE) &&
+         zcbor_tstr_put_lit(cbor_state, "buf_count") &&
+         zcbor_uint32_put(cbor_state, 1) &&
+         zcbor_tstr_put_lit(cbor_state, "framing") &&
+         zcbor_list_start_encode(cbor_state, 2) &&
+         zcbor_tstr_put_lit(cbor_state, "nlip") &&
+         zcbor_tstr_put_lit(cbor_state, "cobs") &&
+         zcbor_list_end_encode(cbor_state, 2) &&
+         zcbor_map_end_encode(cbor_state, 10);
+
+    if (!ok) {
+        reset_cbor_state();
+        bs_rc_rsp(MGMT_ERR_ENOMEM);
+        return;
+    }
+
+    boot_serial_output();
+}
+
+/*
+ * IEEE 802.3 CRC32 of the binary framing, continuing from crc.
+ */
+static uint32_t
+bs_crc32(uint32_t crc, const uint8_t *data, size_t len)
+{
+#ifdef __ZEPHYR__
+    return crc32_ieee_update(crc, data, len);
+#elif __ESPRESSIF__
+    return esp_crc32_le(crc, data, len);
+#else
+    int i;
+
+    crc = ~crc;
+    while (len--) {
+        crc ^= *data++;
+        for (i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+#endif
+}
+#endif
+
 /*
  * Parse incoming line of input from console.
  * Expect newtmgr protocol with serial transport.
@@ -1164,6 +2170,12 @@ boot_serial_input(char *buf, int len)
 
     reset_cbor_state();
 
+#if MCUBOOT_SERIAL_WRITE_QUEUE > 0
+    if (hdr->nh_group != MGMT_GROUP_ID_IMAGE || hdr->nh_id != IMGMGR_NMGR_ID_UPLOAD) {
+        bs_upload_flush();
+    }
+#endif
+
     /*
      * Limited support for commands.
      */
@@ -1197,6 +2209,11 @@ boot_serial_input(char *buf, int len)
         case NMGR_ID_RESET:
             bs_reset(buf, len);
             break;
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+        case NMGR_ID_PARAMS:
+            bs_params(buf, len);
+            break;
+#endif
         default:
             bs_rc_rsp(MGMT_ERR_ENOTSUP);
             break;
@@ -1213,6 +2230,78 @@ boot_serial_input(char *buf, int len)
 #endif
 }
 
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+/*
+ * Writes a packet in binary framing: the length, header, data and CRC32 of
+ * the packet are COBS encoded with every byte XORed with '\n', so that the
+ * packet holds no newline, and sent in lines like base64 encoded packets.
+ */
+static void
+boot_serial_output_bin(const char *data, int len)
+{
+    int out;
+    int code_off;
+    int i;
+    uint32_t crc;
+    uint16_t totlen;
+    char pkt_cont[2] = { BOOT_SERIAL_BIN_DATA_START1, BOOT_SERIAL_BIN_DATA_START2 };
+    char pkt_start[2] = { BOOT_SERIAL_BIN_PKT_START1, BOOT_SERIAL_BIN_PKT_START2 };
+    uint8_t buf[BOOT_SERIAL_OUT_MAX + sizeof(*bs_hdr) + sizeof(crc) + sizeof(totlen)];
+    char encoded_buf[COBS_ENCODE_SIZE(sizeof(buf))];
+
+    crc = bs_crc32(0, (uint8_t *)bs_hdr, sizeof(*bs_hdr));
+    crc = bs_crc32(crc, (const uint8_t *)data, len);
+
+    totlen = htons(len + sizeof(*bs_hdr) + sizeof(crc));
+    memcpy(buf, &totlen, sizeof(totlen));
+    totlen = sizeof(totlen);
+    memcpy(&buf[totlen], bs_hdr, sizeof(*bs_hdr));
+    totlen += sizeof(*bs_hdr);
+    memcpy(&buf[totlen], data, len);
+    totlen += len;
+    buf[totlen++] = crc >> 24;
+    buf[totlen++] = crc >> 16;
+    buf[totlen++] = crc >> 8;
+    buf[totlen++] = crc;
+
+    code_off = 0;
+    out = 1;
+    for (i = 0; i < totlen; i++) {
+        if (buf[i] != 0) {
+            encoded_buf[out++] = buf[i];
+        }
+
+        if (buf[i] == 0 || out - code_off == 0xff) {
+            encoded_buf[code_off] = out - code_off;
+            code_off = out++;
+        }
+    }
+    encoded_buf[code_off] = out - code_off;
+
+    for (i = 0; i < out; i++) {
+        encoded_buf[i] ^= '\n';
+    }
+
+    i = 0;
+    while (i < out) {
+        if (i == 0) {
+            boot_uf->write(pkt_start, sizeof(pkt_start));
+        } else {
+            boot_uf->write(pkt_cont, sizeof(pkt_cont));
+        }
+
+        len = MIN(BOOT_SERIAL_FRAME_MTU, out - i);
+        boot_uf->write(&encoded_buf[i], len);
+
+        i += len;
+
+        boot_uf->write("\n", 1);
+    }
+
+    BOOT_LOG_DBG("TX");
+}
+#endif
+
 static void
 boot_serial_output(void)
 {
@@ -1233,6 +2322,13 @@ boot_serial_output(void)
     bs_hdr->nh_len = htons(len);
     bs_hdr->nh_group = htons(bs_hdr->nh_group);
 
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+    if (bs_binary) {
+        boot_serial_output_bin(data, len);
+        return;
+    }
+#endif
+
 #ifdef __ZEPHYR__
     crc =  crc16_itu_t(CRC16_INITIAL_CRC, (uint8_t *)bs_hdr, sizeof(*bs_hdr));
     crc =  crc16_itu_t(crc, data, len);
@@ -1347,6 +2443,71 @@ boot_serial_in_dec(char *in, int inlen, char *out, int *out_off, int maxout)
     return 1;
 }
 
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+/*
+ * Decodes a line of a packet in binary framing, up to its newline.
+ * Returns 1 if full packet has been received.
+ */
+static int
+boot_serial_in_dec_bin(char *in, int inlen, char *out, int *out_off, int maxout)
+{
+    uint32_t crc;
+    uint16_t len;
+    uint8_t c;
+    int i;
+
+    for (i = 0; i < inlen && in[i] != '\n'; i++) {
+        c = in[i] ^ '\n';
+
+        if (bs_cobs.left == 0) {
+            if (c == 0) {
+                return -1;
+            }
+
+            /* Blocks shorter than the maximum end with a zero, which is only
+             * written once the next block shows it is not the delimiter.
+             */
+            if (bs_cobs.code != 0 && bs_cobs.code != 0xff) {
+                if (*out_off >= maxout) {
+                    return -1;
+                }
+                out[(*out_off)++] = 0;
+            }
+
+            bs_cobs.code = c;
+            bs_cobs.left = c - 1;
+        } else {
+            if (*out_off >= maxout) {
+                return -1;
+            }
+            out[(*out_off)++] = c;
+            bs_cobs.left--;
+        }
+    }
+
+    if (*out_off <= sizeof(uint16_t)) {
+        return 0;
+    }
+
+    len = ntohs(*(uint16_t *)out);
+    if (len != *out_off - sizeof(uint16_t) || len <= sizeof(crc)) {
+        return 0;
+    }
+
+    out += sizeof(uint16_t);
+    len -= sizeof(crc);
+    crc = ((uint32_t)(uint8_t)out[len] << 24) | ((uint32_t)(uint8_t)out[len + 1] << 16) |
+          ((uint32_t)(uint8_t)out[len + 2] << 8) | (uint8_t)out[len + 3];
+    if (crc != bs_crc32(0, (uint8_t *)out, len)) {
+        return 0;
+    }
+    *out_off -= sizeof(crc);
+    out[len] = '\0';
+
+    return 1;
+}
+#endif
+
 /*
  * Task which waits reading console, expecting to get image over
  * serial port.
@@ -1387,6 +2548,12 @@ boot_serial_read_console(const struct boot_uart_funcs *f,int timeout_in_ms)
 #endif
         rc = f->read(in_buf + off, sizeof(in_buf) - off, &full_line);
         if (rc <= 0 && !full_line) {
+#if MCUBOOT_SERIAL_WRITE_QUEUE > 0
+            /* Write queued chunks between reads, without idling meanwhile. */
+            if (bs_upload_work()) {
+                goto check_timeout;
+            }
+#endif
 #ifndef MCUBOOT_SERIAL_WAIT_FOR_DFU
             allow_idle = true;
 #endif
@@ -1405,10 +2572,24 @@ boot_serial_read_console(const struct boot_uart_funcs *f,int timeout_in_ms)
         if (in_buf[0] == SHELL_NLIP_PKT_START1 &&
           in_buf[1] == SHELL_NLIP_PKT_START2) {
             dec_off = 0;
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+            bs_binary = false;
+#endif
             rc = boot_serial_in_dec(&in_buf[2], off - 2, dec_buf, &dec_off, max_input);
         } else if (in_buf[0] == SHELL_NLIP_DATA_START1 &&
           in_buf[1] == SHELL_NLIP_DATA_START2) {
             rc = boot_serial_in_dec(&in_buf[2], off - 2, dec_buf, &dec_off, max_input);
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+        } else if (in_buf[0] == BOOT_SERIAL_BIN_PKT_START1 &&
+          in_buf[1] == BOOT_SERIAL_BIN_PKT_START2) {
+            dec_off = 0;
+            memset(&bs_cobs, 0, sizeof(bs_cobs));
+            bs_binary = true;
+            rc = boot_serial_in_dec_bin(&in_buf[2], off - 2, dec_buf, &dec_off, max_input);
+        } else if (in_buf[0] == BOOT_SERIAL_BIN_DATA_START1 &&
+          in_buf[1] == BOOT_SERIAL_BIN_DATA_START2) {
+            rc = boot_serial_in_dec_bin(&in_buf[2], off - 2, dec_buf, &dec_off, max_input);
+#endif
         }
 
         /* serve errors: out of decode memory, or bad encoding */
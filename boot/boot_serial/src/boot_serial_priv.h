@@ -33,6 +33,15 @@ extern "C" {
 #define SHELL_NLIP_DATA_START1  4
 #define SHELL_NLIP_DATA_START2  20
 
+/*
+ * Binary framing, marking lines of COBS encoded packets.
+ */
+#define BOOT_SERIAL_BIN_PKT_START1  6
+#define BOOT_SERIAL_BIN_PKT_START2  11
+
+#define BOOT_SERIAL_BIN_DATA_START1 4
+#define BOOT_SERIAL_BIN_DATA_START2 11
+
 /*
  * From newtmgr.h
  */
@@ -54,6 +63,7 @@ extern "C" {
 #define NMGR_ID_ECHO            0
 #define NMGR_ID_CONS_ECHO_CTRL  1
 #define NMGR_ID_RESET           5
+#define NMGR_ID_PARAMS          6
 
 #ifndef __packed
 #define __packed __attribute__((__packed__))
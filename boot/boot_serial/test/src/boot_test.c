@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <setjmp.h>
 #include "syscfg/syscfg.h"
 #include "sysflash/sysflash.h"
 #include "os/endian.h"
@@ -30,6 +31,10 @@
 #include "testutil/testutil.h"
 #include "hal/hal_flash.h"
 #include "flash_map_backend/flash_map_backend.h"
+#include "bootutil/bootutil.h"
+#include "bootutil/image.h"
+#include "bootutil/crypto/sha.h"
+#include "zcbor_encode.h"
 
 #include "boot_serial/boot_serial.h"
 #include "boot_serial_priv.h"
@@ -39,22 +44,417 @@ TEST_CASE_DECL(boot_serial_empty_msg)
 TEST_CASE_DECL(boot_serial_empty_img_msg)
 TEST_CASE_DECL(boot_serial_img_msg)
 TEST_CASE_DECL(boot_serial_upload_bigger_image)
+TEST_CASE_DECL(boot_serial_upload_window)
+TEST_CASE_DECL(boot_serial_upload_lz4)
+TEST_CASE_DECL(boot_serial_upload_hash)
+TEST_CASE_DECL(boot_serial_upload_hash_partial)
+TEST_CASE_DECL(boot_serial_bin_upload)
+TEST_CASE_DECL(boot_serial_bin_bad_crc)
+TEST_CASE_DECL(boot_serial_bin_multi_line)
+TEST_CASE_DECL(boot_serial_bin_cobs_block)
+TEST_CASE_DECL(boot_serial_bin_params)
+
+/* Output of the boot loader since the last tx_msg(). */
+static char test_uart_out[1024];
+static int test_uart_out_len;
 
 static void
 test_uart_write(const char *str, int len)
 {
+    assert(test_uart_out_len + len <= sizeof(test_uart_out));
+    memcpy(&test_uart_out[test_uart_out_len], str, len);
+    test_uart_out_len += len;
+}
+
+/* Input of the boot loader, left by tx_lines(). */
+static const char *test_uart_in;
+static int test_uart_in_len;
+static jmp_buf test_uart_in_end;
+
+/*
+ * Reads the input like boot_uart_read(), leaving the serial boot loader
+ * once all of it is read.
+ */
+static int
+test_uart_read(char *str, int cnt, int *newline)
+{
+    int i;
+
+    *newline = 0;
+    if (test_uart_in_len == 0) {
+        longjmp(test_uart_in_end, 1);
+    }
+
+    for (i = 0; i < cnt && test_uart_in_len > 0; i++) {
+        test_uart_in_len--;
+        if (*test_uart_in++ == '\n') {
+            *str = '\0';
+            *newline = 1;
+            break;
+        }
+        *str++ = test_uart_in[-1];
+    }
+
+    return i;
 }
 
 static const struct boot_uart_funcs test_uart = {
+    .read = test_uart_read,
     .write = test_uart_write
 };
 
 void
 tx_msg(void *src, int len)
 {
+    test_uart_out_len = 0;
     boot_serial_input(src, len);
 }
 
+/*
+ * Feeds the lines to the serial boot loader, until all are read.
+ */
+void
+tx_lines(const char *lines, int len)
+{
+    test_uart_out_len = 0;
+    test_uart_in = lines;
+    test_uart_in_len = len;
+    if (setjmp(test_uart_in_end) == 0) {
+        boot_serial_start(&test_uart);
+    }
+}
+
+/*
+ * IEEE 802.3 CRC32 of the binary framing.
+ */
+uint32_t
+bin_crc32(const void *data, int len)
+{
+    const uint8_t *p = data;
+    uint32_t crc;
+    int i;
+
+    crc = 0xffffffff;
+    while (len--) {
+        crc ^= *p++;
+        for (i = 0; i < 8; i++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+        }
+    }
+
+    return ~crc;
+}
+
+/*
+ * Frames the packet in binary framing with the given CRC32 into out: its
+ * length, the packet and the CRC32, COBS encoded and XORed with '\n', in
+ * lines of at most 124 bytes. Returns the length of the lines.
+ */
+int
+bin_encode(const void *pkt, int len, uint32_t crc, char *out)
+{
+    uint8_t raw[sizeof(uint16_t) + 512 + sizeof(crc)];
+    char enc[sizeof(raw) + sizeof(raw) / 254 + 1];
+    int raw_len;
+    int enc_len;
+    int code_off;
+    int out_len;
+    int i;
+
+    assert(len <= 512);
+    raw[0] = (len + sizeof(crc)) >> 8;
+    raw[1] = len + sizeof(crc);
+    memcpy(&raw[2], pkt, len);
+    raw_len = 2 + len;
+    raw[raw_len++] = crc >> 24;
+    raw[raw_len++] = crc >> 16;
+    raw[raw_len++] = crc >> 8;
+    raw[raw_len++] = crc;
+
+    code_off = 0;
+    enc_len = 1;
+    for (i = 0; i < raw_len; i++) {
+        if (raw[i] != 0) {
+            enc[enc_len++] = raw[i];
+        }
+        if (raw[i] == 0 || enc_len - code_off == 0xff) {
+            enc[code_off] = enc_len - code_off;
+            code_off = enc_len++;
+        }
+    }
+    enc[code_off] = enc_len - code_off;
+
+    out_len = 0;
+    for (i = 0; i < enc_len; i++) {
+        if (i % 124 == 0) {
+            if (i != 0) {
+                out[out_len++] = '\n';
+            }
+            out[out_len++] = i ? BOOT_SERIAL_BIN_DATA_START1 :
+                                 BOOT_SERIAL_BIN_PKT_START1;
+            out[out_len++] = i ? BOOT_SERIAL_BIN_DATA_START2 :
+                                 BOOT_SERIAL_BIN_PKT_START2;
+        }
+        out[out_len++] = enc[i] ^ '\n';
+    }
+    out[out_len++] = '\n';
+
+    return out_len;
+}
+
+/*
+ * Sends the packet in binary framing.
+ */
+void
+tx_bin(const void *pkt, int len)
+{
+    char lines[1024];
+
+    tx_lines(lines, bin_encode(pkt, len, bin_crc32(pkt, len), lines));
+}
+
+/*
+ * Decodes the lines of a packet in binary framing into out, returning its
+ * length.
+ */
+static int
+bin_decode(const char *in, int len, uint8_t *out)
+{
+    uint8_t code;
+    int out_len;
+    int i;
+    int n;
+
+    out_len = 0;
+    i = 0;
+    while (i < len) {
+        code = in[i++] ^ '\n';
+        assert(code != 0 && i + code - 1 <= len);
+        for (n = 1; n < code; n++) {
+            out[out_len++] = in[i++] ^ '\n';
+        }
+        /* Blocks shorter than the maximum end with a zero, but the last. */
+        if (code != 0xff && i < len) {
+            out[out_len++] = 0;
+        }
+    }
+
+    return out_len;
+}
+
+/*
+ * Whether the response to the last message is in binary framing.
+ */
+bool
+rx_bin(void)
+{
+    return test_uart_out_len > 1 &&
+           test_uart_out[1] == BOOT_SERIAL_BIN_PKT_START2;
+}
+
+/*
+ * Decodes the response to the last message into dst, returning the length
+ * of the packet, header included, or -1 if there was no response. The
+ * response is in the framing of the message.
+ */
+int
+rx_msg(void *dst, int maxlen)
+{
+    char lines[sizeof(test_uart_out)];
+    uint8_t pkt[sizeof(test_uart_out)];
+    uint16_t totlen;
+    uint32_t crc;
+    int lines_len;
+    int trailer;
+    bool bin;
+    int off;
+    int len;
+
+    if (test_uart_out_len == 0) {
+        return -1;
+    }
+    bin = rx_bin();
+
+    lines_len = 0;
+    for (off = 0; off < test_uart_out_len; off += len + 1) {
+        if (off == 0) {
+            assert(test_uart_out[0] == SHELL_NLIP_PKT_START1 &&
+                   (bin || test_uart_out[1] == SHELL_NLIP_PKT_START2));
+        } else if (bin) {
+            assert(test_uart_out[off] == BOOT_SERIAL_BIN_DATA_START1 &&
+                   test_uart_out[off + 1] == BOOT_SERIAL_BIN_DATA_START2);
+        } else {
+            assert(test_uart_out[off] == SHELL_NLIP_DATA_START1 &&
+                   test_uart_out[off + 1] == SHELL_NLIP_DATA_START2);
+        }
+        off += 2;
+
+        len = (char *)memchr(&test_uart_out[off], '\n',
+                             test_uart_out_len - off) - &test_uart_out[off];
+        memcpy(&lines[lines_len], &test_uart_out[off], len);
+        lines_len += len;
+    }
+
+    if (bin) {
+        len = bin_decode(lines, lines_len, pkt);
+        trailer = sizeof(crc);
+        assert(len > sizeof(totlen) + trailer);
+        crc = ((uint32_t)pkt[len - 4] << 24) | ((uint32_t)pkt[len - 3] << 16) |
+              ((uint32_t)pkt[len - 2] << 8) | pkt[len - 1];
+        assert(crc == bin_crc32(&pkt[sizeof(totlen)],
+                                len - sizeof(totlen) - trailer));
+    } else {
+        lines[lines_len] = '\0';
+        len = base64_decode(lines, pkt);
+        trailer = sizeof(uint16_t);
+        assert(len > sizeof(totlen) + trailer);
+        assert(crc16_ccitt(CRC16_INITIAL_CRC, &pkt[sizeof(totlen)],
+                           len - sizeof(totlen)) == 0);
+    }
+    memcpy(&totlen, pkt, sizeof(totlen));
+    assert(ntohs(totlen) == len - sizeof(totlen));
+
+    len -= sizeof(totlen) + trailer;
+    assert(len <= maxlen);
+    memcpy(dst, &pkt[sizeof(totlen)], len);
+
+    return len;
+}
+
+/*
+ * Builds in buf the upload request for the len bytes of img at off,
+ * returning its length.
+ */
+int
+upload_pkt(char *buf, int maxlen, const void *img, int img_len, int off,
+           int len)
+{
+    struct nmgr_hdr *hdr;
+    zcbor_state_t zs[2];
+    bool ok;
+
+    hdr = (struct nmgr_hdr *)buf;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->nh_op = NMGR_OP_WRITE;
+    hdr->nh_group = htons(MGMT_GROUP_ID_IMAGE);
+    hdr->nh_id = IMGMGR_NMGR_ID_UPLOAD;
+
+    zcbor_new_encode_state(zs, 2, (uint8_t *)buf + sizeof(*hdr),
+                           maxlen - sizeof(*hdr), 0);
+    ok = zcbor_map_start_encode(zs, 3) &&
+         zcbor_tstr_put_lit(zs, "data") &&
+         zcbor_bstr_encode_ptr(zs, (const char *)img + off, len) &&
+         zcbor_tstr_put_lit(zs, "off") &&
+         zcbor_uint32_put(zs, off);
+    if (off == 0) {
+        ok = ok &&
+             zcbor_tstr_put_lit(zs, "len") &&
+             zcbor_uint32_put(zs, img_len);
+    }
+    ok = ok && zcbor_map_end_encode(zs, 3);
+    assert(ok);
+
+    len = zs->payload - (uint8_t *)buf;
+    hdr->nh_len = htons(len - sizeof(*hdr));
+
+    return len;
+}
+
+/*
+ * Sends the upload request for the len bytes of img at off.
+ */
+void
+tx_upload(const void *img, int img_len, int off, int len)
+{
+    char buf[sizeof(struct nmgr_hdr) + 128];
+
+    tx_msg(buf, upload_pkt(buf, sizeof(buf), img, img_len, off, len));
+}
+
+/*
+ * Fills img with an unsigned image of img_len bytes, the TLV of its hash
+ * included, and stores that hash in hash.
+ */
+void
+build_img(uint8_t *img, int img_len, uint8_t *hash)
+{
+    struct image_header *hdr;
+    struct image_tlv_info *info;
+    struct image_tlv *tlv;
+    bootutil_sha_context sha_ctx;
+    int body_len;
+    int i;
+
+    body_len = img_len - sizeof(*hdr) - sizeof(*info) - sizeof(*tlv) - 32;
+    assert(body_len > 0);
+
+    memset(img, 0, img_len);
+    hdr = (struct image_header *)img;
+    hdr->ih_magic = IMAGE_MAGIC;
+    hdr->ih_hdr_size = sizeof(*hdr);
+    hdr->ih_img_size = body_len;
+    hdr->ih_ver.iv_major = 1;
+    hdr->ih_ver.iv_minor = 2;
+    hdr->ih_ver.iv_revision = 3;
+
+    for (i = 0; i < body_len; i++) {
+        img[sizeof(*hdr) + i] = i * 7;
+    }
+
+    bootutil_sha_init(&sha_ctx);
+    bootutil_sha_update(&sha_ctx, img, sizeof(*hdr) + body_len);
+    bootutil_sha_finish(&sha_ctx, hash);
+    bootutil_sha_drop(&sha_ctx);
+
+    info = (struct image_tlv_info *)&img[sizeof(*hdr) + body_len];
+    info->it_magic = IMAGE_TLV_INFO_MAGIC;
+    info->it_tlv_tot = sizeof(*info) + sizeof(*tlv) + 32;
+    tlv = (struct image_tlv *)(info + 1);
+    tlv->it_type = IMAGE_TLV_SHA256;
+    tlv->it_len = 32;
+    memcpy(tlv + 1, hash, 32);
+}
+
+/*
+ * Finds the CBOR encoded bytes in the data of the response, returning what
+ * follows them, or NULL if they are not found.
+ */
+const uint8_t *
+rx_find(const void *rsp, int len, const void *cbor, int cbor_len)
+{
+    const uint8_t *p = rsp;
+    int i;
+
+    for (i = sizeof(struct nmgr_hdr); i + cbor_len <= len; i++) {
+        if (!memcmp(&p[i], cbor, cbor_len)) {
+            return &p[i + cbor_len];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Hash of the first image listed in the response, NULL if none is listed.
+ */
+const uint8_t *
+rx_list_hash(void *rsp, int len)
+{
+    static const uint8_t key[] = { 0x64, 'h', 'a', 's', 'h', 0x58, 0x20 };
+
+    return rx_find(rsp, len - 32, key, sizeof(key));
+}
+
+#if MYNEWT_VAL(BOOTUTIL_VALIDATE_SLOT0_CACHE)
+int
+boot_validation_cache_key(uint8_t image_index, uint8_t *key, size_t *key_len)
+{
+    memset(key, 0xa5 ^ image_index, 32);
+    *key_len = 32;
+    return 0;
+}
+#endif
+
 TEST_SUITE(boot_serial_suite)
 {
     boot_serial_setup();
@@ -62,6 +462,15 @@ TEST_SUITE(boot_serial_suite)
     boot_serial_empty_img_msg();
     boot_serial_img_msg();
     boot_serial_upload_bigger_image();
+    boot_serial_upload_window();
+    boot_serial_upload_lz4();
+    boot_serial_upload_hash();
+    boot_serial_upload_hash_partial();
+    boot_serial_bin_upload();
+    boot_serial_bin_bad_crc();
+    boot_serial_bin_multi_line();
+    boot_serial_bin_cobs_block();
+    boot_serial_bin_params();
 }
 
 int
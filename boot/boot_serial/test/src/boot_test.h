@@ -42,6 +42,19 @@ extern "C" {
 #endif
 
 void tx_msg(void *src, int len);
+int rx_msg(void *dst, int maxlen);
+bool rx_bin(void);
+int upload_pkt(char *buf, int maxlen, const void *img, int img_len, int off,
+               int len);
+void tx_upload(const void *img, int img_len, int off, int len);
+void build_img(uint8_t *img, int img_len, uint8_t *hash);
+const uint8_t *rx_find(const void *rsp, int len, const void *cbor,
+                       int cbor_len);
+const uint8_t *rx_list_hash(void *rsp, int len);
+void tx_lines(const char *lines, int len);
+uint32_t bin_crc32(const void *data, int len);
+int bin_encode(const void *pkt, int len, uint32_t crc, char *out);
+void tx_bin(const void *pkt, int len);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,104 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "boot_test.h"
+
+TEST_CASE(boot_serial_bin_cobs_block)
+{
+    uint8_t img[243];
+    uint8_t rd_img[sizeof(img)];
+    char buf[sizeof(struct nmgr_hdr) + sizeof(img) + 32];
+    char lines[512];
+    uint8_t enc[512];
+    uint8_t rsp[128];
+    uint32_t crc;
+    int pkt_len;
+    int enc_len;
+    int len;
+    int rc;
+    int i;
+    struct nmgr_hdr *hdr;
+    const struct flash_area *fap;
+    static const uint8_t rc_ok[] = { 0x62, 'r', 'c', 0x00 };
+
+    /*
+     * The data follows the last zero of the frame, that of "off", so that
+     * with its key and the CRC32 it is a full block of 254 bytes:
+     * a3 63 'len' 18 f3 63 'off' 00 64 'data' 58 f3 <243 bytes> <CRC32>
+     */
+    static const uint8_t payload_start[] = {
+        0xa3,
+        0x63, 'l', 'e', 'n', 0x18, sizeof(img),
+        0x63, 'o', 'f', 'f', 0x00,
+        0x64, 'd', 'a', 't', 'a', 0x58, sizeof(img),
+    };
+
+    for (i = 0; i < sizeof(img); i++) {
+        img[i] = 1 + i;
+    }
+
+    hdr = (struct nmgr_hdr *)buf;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->nh_op = NMGR_OP_WRITE;
+    hdr->nh_group = htons(MGMT_GROUP_ID_IMAGE);
+    hdr->nh_id = IMGMGR_NMGR_ID_UPLOAD;
+    hdr->nh_len = htons(sizeof(payload_start) + sizeof(img));
+    pkt_len = sizeof(*hdr) + sizeof(payload_start) + sizeof(img);
+
+    /* Find a first byte with which no byte of the CRC32 is zero. */
+    do {
+        img[0]++;
+        memcpy(hdr + 1, payload_start, sizeof(payload_start));
+        memcpy((uint8_t *)(hdr + 1) + sizeof(payload_start), img,
+               sizeof(img));
+        crc = bin_crc32(buf, pkt_len);
+    } while ((crc & 0xff000000) == 0 || (crc & 0xff0000) == 0 ||
+             (crc & 0xff00) == 0 || (crc & 0xff) == 0);
+
+    len = bin_encode(buf, pkt_len, crc, lines);
+
+    /*
+     * Without the line markers and ends, the encoding ends with the 0xff
+     * code of the full block and an empty block after it.
+     */
+    enc_len = 0;
+    for (i = 0; i < len; i++) {
+        if (i == 0 || lines[i - 1] == '\n') {
+            i++;
+        } else if (lines[i] != '\n') {
+            enc[enc_len++] = lines[i] ^ '\n';
+        }
+    }
+    assert(enc_len > 256);
+    assert(enc[enc_len - 1] == 0x01);
+    assert(enc[enc_len - 256] == 0xff);
+
+    tx_lines(lines, len);
+
+    len = rx_msg(rsp, sizeof(rsp));
+    assert(len > 0);
+    assert(rx_bin());
+    assert(rx_find(rsp, len, rc_ok, sizeof(rc_ok)));
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_PRIMARY(0), &fap);
+    assert(rc == 0);
+
+    rc = flash_area_read(fap, 0, rd_img, sizeof(img));
+    assert(rc == 0);
+    assert(!memcmp(rd_img, img, sizeof(img)));
+}
@@ -0,0 +1,73 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "boot_test.h"
+
+TEST_CASE(boot_serial_bin_multi_line)
+{
+    uint8_t img[200];
+    uint8_t rd_img[sizeof(img)];
+    char buf[sizeof(struct nmgr_hdr) + sizeof(img) + 32];
+    char lines[512];
+    uint8_t rsp[128];
+    int pkt_len;
+    int line_cnt;
+    int len;
+    int rc;
+    int i;
+    const struct flash_area *fap;
+    static const uint8_t rc_ok[] = { 0x62, 'r', 'c', 0x00 };
+
+    for (i = 0; i < sizeof(img); i++) {
+        img[i] = i * 3;
+    }
+
+    pkt_len = upload_pkt(buf, sizeof(buf), img, sizeof(img), 0, sizeof(img));
+    len = bin_encode(buf, pkt_len, bin_crc32(buf, pkt_len), lines);
+
+    /*
+     * The packet starts with the 6/11 marker, and each line it continues
+     * on with the 4/11 one.
+     */
+    assert(lines[0] == BOOT_SERIAL_BIN_PKT_START1);
+    assert(lines[1] == BOOT_SERIAL_BIN_PKT_START2);
+    line_cnt = 1;
+    for (i = 0; i < len - 1; i++) {
+        if (lines[i] == '\n') {
+            assert(lines[i + 1] == BOOT_SERIAL_BIN_DATA_START1);
+            assert(lines[i + 2] == BOOT_SERIAL_BIN_DATA_START2);
+            line_cnt++;
+        }
+    }
+    assert(line_cnt >= 2);
+    assert(lines[len - 1] == '\n');
+
+    tx_lines(lines, len);
+
+    len = rx_msg(rsp, sizeof(rsp));
+    assert(len > 0);
+    assert(rx_bin());
+    assert(rx_find(rsp, len, rc_ok, sizeof(rc_ok)));
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_PRIMARY(0), &fap);
+    assert(rc == 0);
+
+    rc = flash_area_read(fap, 0, rd_img, sizeof(img));
+    assert(rc == 0);
+    assert(!memcmp(rd_img, img, sizeof(img)));
+}
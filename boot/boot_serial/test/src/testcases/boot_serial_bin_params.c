@@ -0,0 +1,62 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "boot_test.h"
+
+TEST_CASE(boot_serial_bin_params)
+{
+    char buf[sizeof(struct nmgr_hdr)];
+    uint8_t rsp[128];
+    const uint8_t *p;
+    int len;
+    struct nmgr_hdr *hdr;
+    /* The default MCUBOOT_SERIAL_MAX_RECEIVE_SIZE. */
+    static const uint8_t buf_size[] = {
+        0x68, 'b', 'u', 'f', '_', 's', 'i', 'z', 'e', 0x19, 0x02, 0x00
+    };
+    static const uint8_t buf_count[] = {
+        0x69, 'b', 'u', 'f', '_', 'c', 'o', 'u', 'n', 't', 0x01
+    };
+    static const uint8_t framing[] = {
+        0x67, 'f', 'r', 'a', 'm', 'i', 'n', 'g'
+    };
+    static const uint8_t framings[] = {
+        0x64, 'n', 'l', 'i', 'p', 0x64, 'c', 'o', 'b', 's'
+    };
+
+    hdr = (struct nmgr_hdr *)buf;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->nh_op = NMGR_OP_READ;
+    hdr->nh_group = htons(MGMT_GROUP_ID_DEFAULT);
+    hdr->nh_id = NMGR_ID_PARAMS;
+
+    tx_bin(buf, sizeof(*hdr));
+
+    len = rx_msg(rsp, sizeof(rsp));
+    assert(len > 0);
+    assert(rx_bin());
+    assert(rx_find(rsp, len, buf_size, sizeof(buf_size)));
+    assert(rx_find(rsp, len, buf_count, sizeof(buf_count)));
+
+    /* The framings follow the start of their array. */
+    p = rx_find(rsp, len, framing, sizeof(framing));
+    assert(p);
+    p++;
+    assert(p + sizeof(framings) <= rsp + len);
+    assert(!memcmp(p, framings, sizeof(framings)));
+}
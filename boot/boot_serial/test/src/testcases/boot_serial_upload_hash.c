@@ -0,0 +1,100 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+#include <flash_map_backend/flash_map_backend.h>
+
+#include "boot_test.h"
+#include "bootutil/crypto/sha.h"
+#include "../src/bootutil_priv.h"
+
+/*
+ * An image uploaded with chunks repeated and sent ahead of order is hashed
+ * over its bytes in order: the hash listed is that of the image stored, and
+ * the image gets its validation cache record.
+ */
+TEST_CASE(boot_serial_upload_hash)
+{
+    uint8_t img[256];
+    uint8_t rd_img[256];
+    uint8_t hash[32];
+    uint8_t rd_hash[32];
+    uint8_t rsp[512];
+    const uint8_t *listed_hash;
+    struct nmgr_hdr hdr;
+    struct boot_validation_cache rec;
+    bootutil_sha_context sha_ctx;
+    const struct flash_area *fap;
+    int len;
+    int off;
+    int rc;
+
+    build_img(img, sizeof(img), hash);
+
+    tx_upload(img, sizeof(img), 0, 32);
+    tx_upload(img, sizeof(img), 32, 32);
+    /* Repeated */
+    tx_upload(img, sizeof(img), 32, 32);
+    /* Ahead of the expected offset, held until it is reached */
+    tx_upload(img, sizeof(img), 96, 32);
+    tx_upload(img, sizeof(img), 64, 32);
+    /* Repeated once written */
+    tx_upload(img, sizeof(img), 96, 32);
+    for (off = 128; off < sizeof(img); off += 32) {
+        tx_upload(img, sizeof(img), off, 32);
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.nh_op = NMGR_OP_READ;
+    hdr.nh_group = htons(MGMT_GROUP_ID_IMAGE);
+    hdr.nh_id = IMGMGR_NMGR_ID_STATE;
+    tx_msg(&hdr, sizeof(hdr));
+
+    len = rx_msg(rsp, sizeof(rsp));
+    assert(len > 0);
+    listed_hash = rx_list_hash(rsp, len);
+    assert(listed_hash != NULL);
+
+    /*
+     * The hash listed is that of the image stored.
+     */
+    rc = flash_area_open(FLASH_AREA_IMAGE_PRIMARY(0), &fap);
+    assert(rc == 0);
+
+    rc = flash_area_read(fap, 0, rd_img, sizeof(rd_img));
+    assert(rc == 0);
+    assert(!memcmp(rd_img, img, sizeof(rd_img)));
+
+    bootutil_sha_init(&sha_ctx);
+    bootutil_sha_update(&sha_ctx, rd_img,
+                        sizeof(struct image_header) +
+                        ((struct image_header *)rd_img)->ih_img_size);
+    bootutil_sha_finish(&sha_ctx, rd_hash);
+    bootutil_sha_drop(&sha_ctx);
+    assert(!memcmp(rd_hash, hash, sizeof(hash)));
+    assert(!memcmp(listed_hash, rd_hash, sizeof(rd_hash)));
+
+    /*
+     * The complete upload left a validation cache record for the image.
+     */
+    rc = boot_read_validation_cache(fap, &rec);
+    assert(rc == 0);
+    assert(!memcmp(rec.hash, rd_hash, sizeof(rd_hash)));
+}
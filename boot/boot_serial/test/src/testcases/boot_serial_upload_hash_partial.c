@@ -0,0 +1,84 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+#include <flash_map_backend/flash_map_backend.h>
+
+#include "boot_test.h"
+#include "../src/bootutil_priv.h"
+
+/*
+ * An upload cut short has no hash to validate the image against: the image
+ * completed by other means is listed once validated from the slot, and gets
+ * no validation cache record.
+ */
+TEST_CASE(boot_serial_upload_hash_partial)
+{
+    uint8_t img[256];
+    uint8_t hash[32];
+    uint8_t rsp[512];
+    const uint8_t *listed_hash;
+    struct nmgr_hdr hdr;
+    struct boot_validation_cache rec;
+    const struct flash_area *fap;
+    int len;
+    int off;
+    int rc;
+
+    build_img(img, sizeof(img), hash);
+
+    /*
+     * All but the last chunk, which is written past the upload.
+     */
+    for (off = 0; off < sizeof(img) - 32; off += 32) {
+        tx_upload(img, sizeof(img), off, 32);
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.nh_op = NMGR_OP_READ;
+    hdr.nh_group = htons(MGMT_GROUP_ID_IMAGE);
+    hdr.nh_id = IMGMGR_NMGR_ID_STATE;
+    tx_msg(&hdr, sizeof(hdr));
+
+    len = rx_msg(rsp, sizeof(rsp));
+    assert(len > 0);
+    assert(rx_list_hash(rsp, len) == NULL);
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_PRIMARY(0), &fap);
+    assert(rc == 0);
+
+    rc = flash_area_write(fap, off, &img[off], 32);
+    assert(rc == 0);
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.nh_op = NMGR_OP_READ;
+    hdr.nh_group = htons(MGMT_GROUP_ID_IMAGE);
+    hdr.nh_id = IMGMGR_NMGR_ID_STATE;
+    tx_msg(&hdr, sizeof(hdr));
+
+    len = rx_msg(rsp, sizeof(rsp));
+    assert(len > 0);
+    listed_hash = rx_list_hash(rsp, len);
+    assert(listed_hash != NULL);
+    assert(!memcmp(listed_hash, hash, sizeof(hash)));
+
+    rc = boot_read_validation_cache(fap, &rec);
+    assert(rc == 1);
+}
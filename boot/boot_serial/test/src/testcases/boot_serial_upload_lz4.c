@@ -0,0 +1,114 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <flash_map_backend/flash_map_backend.h>
+
+#include "boot_test.h"
+
+/*
+ * An image uploaded compressed is decompressed into the slot, with the
+ * sequences of the stream split across chunks.
+ */
+TEST_CASE(boot_serial_upload_lz4)
+{
+    char img[128];
+    char rd_img[128];
+    char buf[sizeof(struct nmgr_hdr) + 128];
+    int len;
+    int rc;
+    int i;
+    struct nmgr_hdr *hdr;
+    const struct flash_area *fap;
+
+    const int payload_off = sizeof *hdr;
+
+    /* LZ4 block of the image: 16 literals, then a match of 107 bytes 16
+     * bytes back, and 5 last literals.
+     *
+     * 00000000  ff 01 00 01 02 03 04 05  |........|
+     * 00000008  06 07 08 09 0a 0b 0c 0d  |........|
+     * 00000010  0e 0f 10 00 58 50 0b 0c  |....XP..|
+     * 00000018  0d 0e 0f                 |...|
+     */
+
+    /* 00000000  a5 64 64 61 74 61 4a ff  |.ddataJ.|
+     * 00000008  01 00 01 02 03 04 05 06  |........|
+     * 00000010  07 63 6c 65 6e 18 80 63  |.clen..c|
+     * 00000018  6f 66 66 00 64 63 6f 6d  |off.dcom|
+     * 00000020  70 63 6c 7a 34 64 63 6c  |pclz4dcl|
+     * 00000028  65 6e 18 1b              |en..|
+     */
+    static const uint8_t payload_first[] = {
+        0xa5, 0x64, 0x64, 0x61, 0x74, 0x61, 0x4a, 0xff,
+        0x01, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+        0x07, 0x63, 0x6c, 0x65, 0x6e, 0x18, 0x80, 0x63,
+        0x6f, 0x66, 0x66, 0x00, 0x64, 0x63, 0x6f, 0x6d,
+        0x70, 0x63, 0x6c, 0x7a, 0x34, 0x64, 0x63, 0x6c,
+        0x65, 0x6e, 0x18, 0x1b,
+    };
+
+    /* 00000000  a2 64 64 61 74 61 51 08  |.ddataQ.|
+     * 00000008  09 0a 0b 0c 0d 0e 0f 10  |........|
+     * 00000010  00 58 50 0b 0c 0d 0e 0f  |.XP.....|
+     * 00000018  63 6f 66 66 0a           |coff.|
+     */
+    static const uint8_t payload_next[] = {
+        0xa2, 0x64, 0x64, 0x61, 0x74, 0x61, 0x51, 0x08,
+        0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10,
+        0x00, 0x58, 0x50, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+        0x63, 0x6f, 0x66, 0x66, 0x0a,
+    };
+
+    for (i = 0; i < sizeof(img); i++) {
+        img[i] = i % 16;
+    }
+
+    hdr = (struct nmgr_hdr *)buf;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->nh_op = NMGR_OP_WRITE;
+    hdr->nh_group = htons(MGMT_GROUP_ID_IMAGE);
+    hdr->nh_id = IMGMGR_NMGR_ID_UPLOAD;
+
+    memcpy(buf + payload_off, payload_first, sizeof payload_first);
+    len = sizeof payload_first;
+    hdr->nh_len = htons(len);
+    tx_msg(buf, sizeof(*hdr) + len);
+
+    /* The response was built in place of the request. */
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->nh_op = NMGR_OP_WRITE;
+    hdr->nh_group = htons(MGMT_GROUP_ID_IMAGE);
+    hdr->nh_id = IMGMGR_NMGR_ID_UPLOAD;
+
+    memcpy(buf + payload_off, payload_next, sizeof payload_next);
+    len = sizeof payload_next;
+    hdr->nh_len = htons(len);
+    tx_msg(buf, sizeof(*hdr) + len);
+
+    /*
+     * Validate contents inside the primary slot
+     */
+    rc = flash_area_open(FLASH_AREA_IMAGE_PRIMARY(0), &fap);
+    assert(rc == 0);
+
+    rc = flash_area_read(fap, 0, rd_img, sizeof(rd_img));
+    assert(rc == 0);
+    assert(!memcmp(rd_img, img, sizeof(rd_img)));
+}
@@ -91,6 +91,51 @@ void boot_state_clear(struct boot_loader_state *state);
 fih_ret context_boot_go(struct boot_loader_state *state, struct boot_rsp *rsp);
 const struct image_max_size *boot_get_max_app_size(void);
 
+/**
+ * Lends the bootloader a buffer to stream images through while they are
+ * hashed for validation.  This lets a port hand over RAM that is idle at boot
+ * time (e.g. the application's RAM) instead of growing MCUBOOT_HASH_BLOCK_SIZE.
+ * The buffer is only used when it is larger than the internal one, and must
+ * stay valid until boot_go() returns.
+ *
+ * @param buf                   Buffer to use, or NULL to stop using one.
+ * @param len                   Size of the buffer in bytes.
+ */
+void boot_set_hash_arena(uint8_t *buf, uint32_t len);
+
+/**
+ * Lends the bootloader a buffer to copy images through during upgrades, so
+ * each flash write programs up to a whole sector (or the buffer) at once.
+ * It is only used when it is larger than the internal one (see
+ * MCUBOOT_COPY_BUF_SIZE), must be 4-byte aligned and must stay valid until
+ * boot_go() returns.  Images are not hashed while they are copied, so the
+ * same memory may also be lent with boot_set_hash_arena().
+ *
+ * @param buf                   Buffer to use, or NULL to stop using one.
+ * @param len                   Size of the buffer in bytes.
+ */
+void boot_set_copy_arena(uint8_t *buf, uint32_t len);
+
+#ifdef MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE
+/**
+ * Retrieves the secret that keys the validation cache record of an image.
+ * Must be provided by the port when MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE is
+ * enabled.  The secret should be device-unique and not readable by the
+ * application (e.g. derived from a hardware unique key), otherwise whoever
+ * can write the flash can also forge a record for a modified image.
+ *
+ * @param image_index           Index of the image the record belongs to.
+ * @param key                   Buffer to store the secret in.
+ * @param key_len               On input the size of the buffer (at least
+ *                              32 bytes), on output the length of the secret.
+ *
+ * @return                      0 on success; nonzero on failure, in which
+ *                              case every boot does a full validation.
+ */
+int boot_validation_cache_key(uint8_t image_index, uint8_t *key,
+                              size_t *key_len);
+#endif
+
 #define SPLIT_GO_OK                 (0)
 #define SPLIT_GO_NON_MATCHING       (-1)
 #define SPLIT_GO_ERR                (-2)
@@ -53,6 +53,14 @@ uint32_t bootutil_get_caps(void);
 #define BOOTUTIL_CAP_DIRECT_XIP             (1<<17)
 #define BOOTUTIL_CAP_HW_ROLLBACK_PROT       (1<<18)
 #define BOOTUTIL_CAP_ECDSA_P384             (1<<19)
+#define BOOTUTIL_CAP_HASH_SEGMENTS          (1<<20)
+#define BOOTUTIL_CAP_MULTI_SIG              (1<<21)
+#define BOOTUTIL_CAP_CRYPTO_OPS             (1<<22)
+#define BOOTUTIL_CAP_COPY_SKIP_UNCHANGED    (1<<23)
+#define BOOTUTIL_CAP_DELTA_IMAGES           (1<<24)
+#define BOOTUTIL_CAP_DECOMPRESS_IMAGES      (1<<25)
+#define BOOTUTIL_CAP_SWAP_USING_OFFSET      (1<<26)
+#define BOOTUTIL_CAP_PARALLEL_UPGRADES      (1<<27)
 
 /*
  * Query the number of images this bootloader is configured for.  This
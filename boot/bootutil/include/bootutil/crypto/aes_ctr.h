@@ -32,7 +32,6 @@
     #endif
     #include <string.h>
     #include <tinycrypt/aes.h>
-    #include <tinycrypt/ctr_mode.h>
     #include <tinycrypt/constants.h>
     #define BOOTUTIL_CRYPTO_AES_CTR_KEY_SIZE TC_AES_KEY_SIZE
     #define BOOTUTIL_CRYPTO_AES_CTR_BLOCK_SIZE TC_AES_BLOCK_SIZE
@@ -40,6 +39,20 @@
 
 #include <stdint.h>
 
+#ifdef MCUBOOT_CRYPTO_OPS
+#include "bootutil/crypto/ops.h"
+
+/* The library wrappers below become the fallback of the ones dispatching to
+ * the registered crypto backend, at the end of this file.
+ */
+#define bootutil_aes_ctr_context bootutil_sw_aes_ctr_context
+#define bootutil_aes_ctr_init    bootutil_sw_aes_ctr_init
+#define bootutil_aes_ctr_drop    bootutil_sw_aes_ctr_drop
+#define bootutil_aes_ctr_set_key bootutil_sw_aes_ctr_set_key
+#define bootutil_aes_ctr_encrypt bootutil_sw_aes_ctr_encrypt
+#define bootutil_aes_ctr_decrypt bootutil_sw_aes_ctr_decrypt
+#endif /* MCUBOOT_CRYPTO_OPS */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -61,16 +74,18 @@ static inline int bootutil_aes_ctr_set_key(bootutil_aes_ctr_context *ctx, const
     return mbedtls_aes_setkey_enc(ctx, k, BOOTUTIL_CRYPTO_AES_CTR_KEY_SIZE * 8);
 }
 
-static inline int bootutil_aes_ctr_encrypt(bootutil_aes_ctr_context *ctx, uint8_t *counter, const uint8_t *m, uint32_t mlen, size_t blk_off, uint8_t *c)
+static inline int _bootutil_aes_ctr_encrypt_blocks(bootutil_aes_ctr_context *ctx, uint8_t *blocks, uint32_t cnt)
 {
-    uint8_t stream_block[BOOTUTIL_CRYPTO_AES_CTR_BLOCK_SIZE];
-    return mbedtls_aes_crypt_ctr(ctx, mlen, &blk_off, counter, stream_block, m, c);
-}
+    uint32_t i;
 
-static inline int bootutil_aes_ctr_decrypt(bootutil_aes_ctr_context *ctx, uint8_t *counter, const uint8_t *c, uint32_t clen, size_t blk_off, uint8_t *m)
-{
-    uint8_t stream_block[BOOTUTIL_CRYPTO_AES_CTR_BLOCK_SIZE];
-    return mbedtls_aes_crypt_ctr(ctx, clen, &blk_off, counter, stream_block, c, m);
+    for (i = 0; i < cnt; i++) {
+        if (mbedtls_aes_crypt_ecb(ctx, MBEDTLS_AES_ENCRYPT,
+                                  &blocks[i * BOOTUTIL_CRYPTO_AES_CTR_BLOCK_SIZE],
+                                  &blocks[i * BOOTUTIL_CRYPTO_AES_CTR_BLOCK_SIZE]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
 }
 #endif /* MCUBOOT_USE_MBED_TLS */
 
@@ -96,13 +111,86 @@ static inline int bootutil_aes_ctr_set_key(bootutil_aes_ctr_context *ctx, const
     return 0;
 }
 
-static int _bootutil_aes_ctr_crypt(bootutil_aes_ctr_context *ctx, uint8_t *counter, const uint8_t *in, uint32_t inlen, uint32_t blk_off, uint8_t *out)
+static inline int _bootutil_aes_ctr_encrypt_blocks(bootutil_aes_ctr_context *ctx, uint8_t *blocks, uint32_t cnt)
 {
-    int rc;
-    rc = tc_ctr_mode(out, inlen, in, inlen, counter, &blk_off, ctx);
-    if (rc != TC_CRYPTO_SUCCESS) {
+    uint32_t i;
+
+    for (i = 0; i < cnt; i++) {
+        if (tc_aes_encrypt(&blocks[i * BOOTUTIL_CRYPTO_AES_CTR_BLOCK_SIZE],
+                           &blocks[i * BOOTUTIL_CRYPTO_AES_CTR_BLOCK_SIZE],
+                           ctx) != TC_CRYPTO_SUCCESS) {
+            return -1;
+        }
+    }
+    return 0;
+}
+#endif /* MCUBOOT_USE_TINYCRYPT */
+
+/* Number of counter blocks turned into key stream at a time. */
+#ifndef MCUBOOT_AES_CTR_BATCH
+#define MCUBOOT_AES_CTR_BATCH 8
+#endif
+
+/*
+ * Encrypt or decrypt len bytes, starting blk_off bytes into the key stream
+ * block of the counter, whose last four bytes are a big endian block number.
+ * The key stream is generated MCUBOOT_AES_CTR_BATCH blocks at a time and
+ * combined with the data in a single pass.  The counter is left at the block
+ * following the last one used.
+ */
+static inline int _bootutil_aes_ctr_crypt(bootutil_aes_ctr_context *ctx, uint8_t *counter, const uint8_t *in, uint32_t len, uint32_t blk_off, uint8_t *out)
+{
+    uint8_t stream[BOOTUTIL_CRYPTO_AES_CTR_BLOCK_SIZE * MCUBOOT_AES_CTR_BATCH];
+    uint8_t *blk;
+    uint32_t block_num;
+    uint32_t cnt;
+    uint32_t n;
+    uint32_t i;
+
+    if (blk_off >= BOOTUTIL_CRYPTO_AES_CTR_BLOCK_SIZE) {
         return -1;
     }
+
+    block_num = ((uint32_t)counter[12] << 24) | ((uint32_t)counter[13] << 16) |
+                ((uint32_t)counter[14] << 8) | counter[15];
+
+    while (len > 0) {
+        cnt = (blk_off + len + BOOTUTIL_CRYPTO_AES_CTR_BLOCK_SIZE - 1) /
+              BOOTUTIL_CRYPTO_AES_CTR_BLOCK_SIZE;
+        if (cnt > MCUBOOT_AES_CTR_BATCH) {
+            cnt = MCUBOOT_AES_CTR_BATCH;
+        }
+
+        for (i = 0; i < cnt; i++, block_num++) {
+            blk = &stream[i * BOOTUTIL_CRYPTO_AES_CTR_BLOCK_SIZE];
+            memcpy(blk, counter, 12);
+            blk[12] = (uint8_t)(block_num >> 24);
+            blk[13] = (uint8_t)(block_num >> 16);
+            blk[14] = (uint8_t)(block_num >> 8);
+            blk[15] = (uint8_t)block_num;
+        }
+        if (_bootutil_aes_ctr_encrypt_blocks(ctx, stream, cnt) != 0) {
+            return -1;
+        }
+
+        n = cnt * BOOTUTIL_CRYPTO_AES_CTR_BLOCK_SIZE - blk_off;
+        if (n > len) {
+            n = len;
+        }
+        for (i = 0; i < n; i++) {
+            out[i] = in[i] ^ stream[blk_off + i];
+        }
+        in += n;
+        out += n;
+        len -= n;
+        blk_off = 0;
+    }
+
+    counter[12] = (uint8_t)(block_num >> 24);
+    counter[13] = (uint8_t)(block_num >> 16);
+    counter[14] = (uint8_t)(block_num >> 8);
+    counter[15] = (uint8_t)block_num;
+
     return 0;
 }
 
@@ -115,7 +203,80 @@ static inline int bootutil_aes_ctr_decrypt(bootutil_aes_ctr_context *ctx, uint8_
 {
     return _bootutil_aes_ctr_crypt(ctx, counter, c, clen, blk_off, m);
 }
-#endif /* MCUBOOT_USE_TINYCRYPT */
+
+#ifdef MCUBOOT_CRYPTO_OPS
+#undef bootutil_aes_ctr_context
+#undef bootutil_aes_ctr_init
+#undef bootutil_aes_ctr_drop
+#undef bootutil_aes_ctr_set_key
+#undef bootutil_aes_ctr_encrypt
+#undef bootutil_aes_ctr_decrypt
+
+typedef struct {
+    /* NULL when the library is used. */
+    const struct bootutil_aes_ctr_ops *ops;
+    union {
+        bootutil_sw_aes_ctr_context sw;
+        bootutil_crypto_ops_ctx hw;
+    } u;
+} bootutil_aes_ctr_context;
+
+static inline void bootutil_aes_ctr_init(bootutil_aes_ctr_context *ctx)
+{
+    const struct bootutil_crypto_ops *ops = bootutil_crypto_ops_get();
+
+    ctx->ops = (ops != NULL) ? ops->aes_ctr : NULL;
+    if (ctx->ops == NULL) {
+        bootutil_sw_aes_ctr_init(&ctx->u.sw);
+    }
+}
+
+static inline void bootutil_aes_ctr_drop(bootutil_aes_ctr_context *ctx)
+{
+    if (ctx->ops != NULL) {
+        if (ctx->ops->drop != NULL) {
+            ctx->ops->drop(&ctx->u.hw);
+        }
+        return;
+    }
+
+    bootutil_sw_aes_ctr_drop(&ctx->u.sw);
+}
+
+static inline int bootutil_aes_ctr_set_key(bootutil_aes_ctr_context *ctx, const uint8_t *k)
+{
+    int rc;
+
+    if (ctx->ops != NULL) {
+        rc = ctx->ops->set_key(&ctx->u.hw, k, BOOTUTIL_CRYPTO_AES_CTR_KEY_SIZE);
+        if (rc != BOOTUTIL_CRYPTO_OPS_FALLBACK) {
+            return rc;
+        }
+        ctx->ops = NULL;
+        bootutil_sw_aes_ctr_init(&ctx->u.sw);
+    }
+
+    return bootutil_sw_aes_ctr_set_key(&ctx->u.sw, k);
+}
+
+static inline int bootutil_aes_ctr_encrypt(bootutil_aes_ctr_context *ctx, uint8_t *counter, const uint8_t *m, uint32_t mlen, uint32_t blk_off, uint8_t *c)
+{
+    if (ctx->ops != NULL) {
+        return ctx->ops->crypt(&ctx->u.hw, counter, m, mlen, blk_off, c);
+    }
+
+    return bootutil_sw_aes_ctr_encrypt(&ctx->u.sw, counter, m, mlen, blk_off, c);
+}
+
+static inline int bootutil_aes_ctr_decrypt(bootutil_aes_ctr_context *ctx, uint8_t *counter, const uint8_t *c, uint32_t clen, uint32_t blk_off, uint8_t *m)
+{
+    if (ctx->ops != NULL) {
+        return ctx->ops->crypt(&ctx->u.hw, counter, c, clen, blk_off, m);
+    }
+
+    return bootutil_sw_aes_ctr_decrypt(&ctx->u.sw, counter, c, clen, blk_off, m);
+}
+#endif /* MCUBOOT_CRYPTO_OPS */
 
 #ifdef __cplusplus
 }
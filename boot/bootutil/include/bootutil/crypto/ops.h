@@ -0,0 +1,114 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Run-time crypto backend interface.
+ *
+ * With MCUBOOT_CRYPTO_OPS, the hash and AES-CTR abstractions of
+ * bootutil/crypto/sha.h and bootutil/crypto/aes_ctr.h, and the image
+ * signature check, first offer each operation to the backend registered with
+ * bootutil_crypto_ops_register(), e.g. a driver for a hash/AES engine of the
+ * SoC.  The library selected by MCUBOOT_USE_* is used for any operation the
+ * backend does not provide, or declines by returning
+ * BOOTUTIL_CRYPTO_OPS_FALLBACK, and when no backend is registered.
+ *
+ * The backend state lives in the bootutil contexts themselves, which reserve
+ * MCUBOOT_CRYPTO_OPS_CTX_SIZE bytes for it, so no allocation is needed.
+ */
+
+#ifndef __BOOTUTIL_CRYPTO_OPS_H_
+#define __BOOTUTIL_CRYPTO_OPS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mcuboot_config/mcuboot_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Returned by a backend operation to have the library perform it instead. */
+#define BOOTUTIL_CRYPTO_OPS_FALLBACK 1
+
+#ifndef MCUBOOT_CRYPTO_OPS_CTX_SIZE
+#define MCUBOOT_CRYPTO_OPS_CTX_SIZE 256
+#endif
+
+/* Backend state of a hash or AES-CTR context. */
+typedef union {
+    uint64_t u64[(MCUBOOT_CRYPTO_OPS_CTX_SIZE + 7) / 8];
+    void *ptr;
+} bootutil_crypto_ops_ctx;
+
+/* One buffer of a scatter-gather hash update. */
+struct bootutil_crypto_iovec {
+    const void *base;
+    uint32_t len;
+};
+
+struct bootutil_hash_ops {
+    /* Start a digest of digest_len bytes (the image hash size). */
+    int (*init)(bootutil_crypto_ops_ctx *ctx, uint32_t digest_len);
+    int (*update)(bootutil_crypto_ops_ctx *ctx, const void *data,
+                  uint32_t data_len);
+    /* Optional; update() is called for each buffer otherwise. */
+    int (*update_v)(bootutil_crypto_ops_ctx *ctx,
+                    const struct bootutil_crypto_iovec *iov, size_t iov_cnt);
+    int (*finish)(bootutil_crypto_ops_ctx *ctx, uint8_t *output);
+    /* Optional. */
+    void (*drop)(bootutil_crypto_ops_ctx *ctx);
+};
+
+struct bootutil_aes_ctr_ops {
+    int (*set_key)(bootutil_crypto_ops_ctx *ctx, const uint8_t *key,
+                   uint32_t key_len);
+    /*
+     * Encrypt or decrypt len bytes at once, any number of blocks, starting
+     * blk_off bytes into the key stream block of the big endian counter.
+     * The counter is left at the block following the last one used.
+     */
+    int (*crypt)(bootutil_crypto_ops_ctx *ctx, uint8_t *counter,
+                 const uint8_t *in, uint32_t len, uint32_t blk_off,
+                 uint8_t *out);
+    /* Optional. */
+    void (*drop)(bootutil_crypto_ops_ctx *ctx);
+};
+
+struct bootutil_crypto_ops {
+    const char *name;
+    /* Each of these is optional. */
+    const struct bootutil_hash_ops *hash;
+    const struct bootutil_aes_ctr_ops *aes_ctr;
+    /*
+     * Check the signature TLV of the given type against the image hash and
+     * the public key (as stored in bootutil_keys[]).  Return 0 if it is
+     * valid.
+     */
+    int (*verify_sig)(uint16_t type, const uint8_t *hash, uint32_t hash_len,
+                      const uint8_t *sig, size_t sig_len,
+                      const uint8_t *key, size_t key_len);
+};
+
+/**
+ * Make bootutil use a crypto backend, or only the library if ops is NULL.
+ *
+ * Contexts keep using the backend they were initialized with.
+ *
+ * @param ops   The backend, which must outlive its use.
+ *
+ * @return 0 on success, -1 if ops is missing a mandatory operation.
+ */
+int bootutil_crypto_ops_register(const struct bootutil_crypto_ops *ops);
+
+/**
+ * @return The registered crypto backend, or NULL.
+ */
+const struct bootutil_crypto_ops *bootutil_crypto_ops_get(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BOOTUTIL_CRYPTO_OPS_H_ */
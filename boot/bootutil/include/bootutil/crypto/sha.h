@@ -49,6 +49,19 @@
 #define BOOTUTIL_CRYPTO_SHA256_BLOCK_SIZE  (64)
 #define BOOTUTIL_CRYPTO_SHA256_DIGEST_SIZE (32)
 
+#include "bootutil/crypto/ops.h"
+
+#ifdef MCUBOOT_CRYPTO_OPS
+/* The library wrappers below become the fallback of the ones dispatching to
+ * the registered crypto backend, at the end of this file.
+ */
+#define bootutil_sha_context bootutil_sw_sha_context
+#define bootutil_sha_init    bootutil_sw_sha_init
+#define bootutil_sha_drop    bootutil_sw_sha_drop
+#define bootutil_sha_update  bootutil_sw_sha_update
+#define bootutil_sha_finish  bootutil_sw_sha_finish
+#endif /* MCUBOOT_CRYPTO_OPS */
+
 #if defined(MCUBOOT_USE_PSA_CRYPTO)
 
 #include <psa/crypto.h>
@@ -250,6 +263,97 @@ static inline int bootutil_sha_finish(bootutil_sha_context *ctx,
 }
 #endif /* MCUBOOT_USE_CC310 */
 
+#ifdef MCUBOOT_CRYPTO_OPS
+#undef bootutil_sha_context
+#undef bootutil_sha_init
+#undef bootutil_sha_drop
+#undef bootutil_sha_update
+#undef bootutil_sha_finish
+
+typedef struct {
+    /* NULL when the library is used. */
+    const struct bootutil_hash_ops *ops;
+    union {
+        bootutil_sw_sha_context sw;
+        bootutil_crypto_ops_ctx hw;
+    } u;
+} bootutil_sha_context;
+
+static inline int bootutil_sha_init(bootutil_sha_context *ctx)
+{
+    const struct bootutil_crypto_ops *ops = bootutil_crypto_ops_get();
+    int rc;
+
+    ctx->ops = (ops != NULL) ? ops->hash : NULL;
+    if (ctx->ops != NULL) {
+        rc = ctx->ops->init(&ctx->u.hw, IMAGE_HASH_SIZE);
+        if (rc != BOOTUTIL_CRYPTO_OPS_FALLBACK) {
+            return rc;
+        }
+        ctx->ops = NULL;
+    }
+
+    return bootutil_sw_sha_init(&ctx->u.sw);
+}
+
+static inline int bootutil_sha_drop(bootutil_sha_context *ctx)
+{
+    if (ctx->ops != NULL) {
+        if (ctx->ops->drop != NULL) {
+            ctx->ops->drop(&ctx->u.hw);
+        }
+        return 0;
+    }
+
+    return bootutil_sw_sha_drop(&ctx->u.sw);
+}
+
+static inline int bootutil_sha_update(bootutil_sha_context *ctx,
+                                      const void *data,
+                                      uint32_t data_len)
+{
+    if (ctx->ops != NULL) {
+        return ctx->ops->update(&ctx->u.hw, data, data_len);
+    }
+
+    return bootutil_sw_sha_update(&ctx->u.sw, data, data_len);
+}
+
+static inline int bootutil_sha_finish(bootutil_sha_context *ctx,
+                                      uint8_t *output)
+{
+    if (ctx->ops != NULL) {
+        return ctx->ops->finish(&ctx->u.hw, output);
+    }
+
+    return bootutil_sw_sha_finish(&ctx->u.sw, output);
+}
+#endif /* MCUBOOT_CRYPTO_OPS */
+
+/*
+ * Hash several buffers, in order, as if they were contiguous.  Returns what
+ * bootutil_sha_update() returns for the last one.
+ */
+static inline int bootutil_sha_update_v(bootutil_sha_context *ctx,
+                                        const struct bootutil_crypto_iovec *iov,
+                                        size_t iov_cnt)
+{
+    size_t i;
+    int rc = 0;
+
+#ifdef MCUBOOT_CRYPTO_OPS
+    if (ctx->ops != NULL && ctx->ops->update_v != NULL) {
+        return ctx->ops->update_v(&ctx->u.hw, iov, iov_cnt);
+    }
+#endif
+
+    for (i = 0; i < iov_cnt; i++) {
+        rc = bootutil_sha_update(ctx, iov[i].base, iov[i].len);
+    }
+
+    return rc;
+}
+
 #ifdef __cplusplus
 }
 #endif
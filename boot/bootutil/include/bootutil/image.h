@@ -78,6 +78,12 @@ struct flash_area;
 #define IMAGE_F_COMPRESSED_LZMA2         0x00000400
 #define IMAGE_F_COMPRESSED_ARM_THUMB_FLT 0x00000800
 
+/*
+ * Indicates that the image body is a patch to be applied to the image in the
+ * primary slot, see IMAGE_TLV_DELTA_BASE_SHA.
+ */
+#define IMAGE_F_DELTA                    0x00001000
+
 /*
  * ECSDA224 is with NIST P-224
  * ECSDA256 is with NIST P-256
@@ -124,6 +130,20 @@ struct flash_area;
                                             * the format and size of the raw slot (compressed)
                                             * signature
                                             */
+#define IMAGE_TLV_SEG_HASH          0x80   /*
+                                            * Segment hash table: u32 segment size
+                                            * followed by one digest per segment of
+                                            * image hdr and body (protected TLV)
+                                            */
+#define IMAGE_TLV_DELTA_BASE_SHA    0x90   /*
+                                            * Delta images: shaX hash of the image
+                                            * the patch applies to (protected TLV)
+                                            */
+#define IMAGE_TLV_DELTA_SIZE        0x91   /*
+                                            * Delta images: size of the patched
+                                            * image, including its header and TLVs
+                                            * (protected TLV)
+                                            */
 					   /*
 					    * vendor reserved TLVs at xxA0-xxFF,
 					    * where xx denotes the upper byte
@@ -189,6 +209,8 @@ struct image_tlv {
 #define MUST_DECOMPRESS(fap, idx, hdr) \
     (flash_area_get_id(fap) == FLASH_AREA_IMAGE_SECONDARY(idx) && IS_COMPRESSED(hdr))
 
+#define IS_DELTA(hdr) ((hdr)->ih_flags & IMAGE_F_DELTA)
+
 _Static_assert(sizeof(struct image_header) == IMAGE_HEADER_SIZE,
                "struct image_header not required size");
 
@@ -198,6 +220,75 @@ fih_ret bootutil_img_validate(struct enc_key_data *enc_state, int image_index,
                               const struct flash_area *fap,
                               uint8_t *tmp_buf, uint32_t tmp_buf_sz,
                               uint8_t *seed, int seed_len, uint8_t *out_hash);
+/*
+ * Validate an image stored start_off bytes into its flash area, as images
+ * in the secondary slot may be with MCUBOOT_SWAP_USING_OFFSET.
+ */
+fih_ret bootutil_img_validate_at(struct enc_key_data *enc_state,
+                                 int image_index, struct image_header *hdr,
+                                 const struct flash_area *fap,
+                                 uint32_t start_off, uint8_t *tmp_buf,
+                                 uint32_t tmp_buf_sz, uint8_t *seed,
+                                 int seed_len, uint8_t *out_hash);
+fih_ret bootutil_img_validate_cached(struct enc_key_data *enc_state,
+                                     int image_index,
+                                     struct image_header *hdr,
+                                     const struct flash_area *fap,
+                                     uint8_t *tmp_buf, uint32_t tmp_buf_sz);
+/*
+ * Validate an image against the hash computed as it was written, without
+ * reading it back; the _cached variant also leaves a validation cache record
+ * for an image in the primary slot, after reading the image back to check it
+ * has that hash.
+ */
+fih_ret bootutil_img_validate_hashed(struct enc_key_data *enc_state,
+                                     int image_index,
+                                     struct image_header *hdr,
+                                     const struct flash_area *fap,
+                                     const uint8_t *hash);
+fih_ret bootutil_img_validate_cached_hashed(int image_index,
+                                            struct image_header *hdr,
+                                            const struct flash_area *fap,
+                                            const uint8_t *hash,
+                                            uint8_t *tmp_buf,
+                                            uint32_t tmp_buf_sz);
+
+/*
+ * Check segments [first, first + count) of an image against its segment
+ * hash table.  The table is only trustworthy once the image as a whole has
+ * been validated, and only covers images stored in plain text.
+ */
+int bootutil_img_check_segments(struct image_header *hdr,
+                                const struct flash_area *fap, uint32_t first,
+                                uint32_t count, uint8_t *tmp_buf,
+                                uint32_t tmp_buf_sz);
+
+/*
+ * Signature verification statistics kept by MCUBOOT_MULTI_SIG, per
+ * signature algorithm.
+ */
+#define BOOTUTIL_SIG_RSA        0
+#define BOOTUTIL_SIG_ECDSA      1
+#define BOOTUTIL_SIG_ED25519    2
+#define BOOTUTIL_SIG_ALG_CNT    3
+
+struct bootutil_sig_stats {
+    uint32_t verified;  /* Signatures verified. */
+    uint32_t accepted;  /* Verified signatures that were valid. */
+    uint32_t skipped;   /* Signatures not verified: threshold already met. */
+    uint32_t cycles;    /* Cycles spent verifying (MCUBOOT_CYCLE_COUNT). */
+};
+
+/*
+ * Copy the statistics gathered since the last reset to stats, which holds
+ * BOOTUTIL_SIG_ALG_CNT entries.
+ */
+#ifdef MCUBOOT_MULTI_SIG
+void bootutil_sig_stats_get(struct bootutil_sig_stats *stats);
+void bootutil_sig_stats_reset(void);
+#endif
+
+struct boot_tlv_index;
 
 struct image_tlv_iter {
     const struct image_header *hdr;
@@ -207,12 +298,18 @@ struct image_tlv_iter {
     uint32_t prot_end;
     uint32_t tlv_off;
     uint32_t tlv_end;
+    const struct boot_tlv_index *index; /* NULL when scanning flash */
+    uint8_t index_pos;
 };
 
 int bootutil_tlv_iter_begin(struct image_tlv_iter *it,
                             const struct image_header *hdr,
                             const struct flash_area *fap, uint16_t type,
                             bool prot);
+int bootutil_tlv_iter_begin_at(struct image_tlv_iter *it,
+                               const struct image_header *hdr,
+                               const struct flash_area *fap,
+                               uint32_t start_off, uint16_t type, bool prot);
 int bootutil_tlv_iter_next(struct image_tlv_iter *it, uint32_t *off,
                            uint16_t *len, uint16_t *type);
 int bootutil_tlv_iter_is_prot(struct image_tlv_iter *it, uint32_t off);
@@ -220,6 +317,10 @@ int bootutil_tlv_iter_is_prot(struct image_tlv_iter *it, uint32_t off);
 int32_t bootutil_get_img_security_cnt(struct image_header *hdr,
                                       const struct flash_area *fap,
                                       uint32_t *security_cnt);
+int32_t bootutil_get_img_security_cnt_at(struct image_header *hdr,
+                                         const struct flash_area *fap,
+                                         uint32_t start_off,
+                                         uint32_t *security_cnt);
 
 #ifdef __cplusplus
 }
@@ -36,6 +36,11 @@ extern "C" {
 struct bootutil_key {
     const uint8_t *key;
     const unsigned int *len;
+    /* Optional digest of the key, computed with the image hash algorithm
+     * (e.g. by "imgtool getpubhash"), or NULL to compute it at boot when
+     * looking up the key of an IMAGE_TLV_KEYHASH.
+     */
+    const uint8_t *hash;
 };
 
 extern const struct bootutil_key bootutil_keys[];
@@ -106,6 +106,9 @@ boot_trailer_info_sz(void)
 #  else
            BOOT_ENC_KEY_ALIGN_SIZE * 2            +
 #  endif
+#endif
+#ifdef MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE
+           BOOT_VALIDATION_CACHE_ALIGN_SIZE       +
 #endif
            /* swap_type + copy_done + image_ok + swap_size */
            BOOT_MAX_ALIGN * 4                     +
@@ -198,6 +201,23 @@ boot_enc_key_off(const struct flash_area *fap, uint8_t slot)
 }
 #endif
 
+#ifdef MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE
+/*
+ * The validation cache record sits right below the encryption keys, or
+ * below swap_size when images are not encrypted.
+ */
+static inline uint32_t
+boot_validation_cache_off(const struct flash_area *fap)
+{
+#ifdef MCUBOOT_ENC_IMAGES
+    return boot_enc_key_off(fap, BOOT_NUM_SLOTS - 1) -
+           BOOT_VALIDATION_CACHE_ALIGN_SIZE;
+#else
+    return boot_swap_size_off(fap) - BOOT_VALIDATION_CACHE_ALIGN_SIZE;
+#endif
+}
+#endif
+
 /**
  * This functions tries to locate the status area after an aborted swap,
  * by looking for the magic in the possible locations.
@@ -306,6 +326,57 @@ boot_write_swap_size(const struct flash_area *fap, uint32_t swap_size)
     return boot_write_trailer(fap, off, (const uint8_t *) &swap_size, 4);
 }
 
+#ifdef MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE
+/**
+ * Reads the validation cache record from the trailer of an image slot.
+ *
+ * @returns 0 if a record was read, 1 if the record area is erased, or a
+ * negative value on flash errors.
+ */
+int
+boot_read_validation_cache(const struct flash_area *fap,
+                           struct boot_validation_cache *rec)
+{
+    uint32_t off;
+    int rc;
+
+    off = boot_validation_cache_off(fap);
+    rc = flash_area_read(fap, off, rec, sizeof(*rec));
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    if (bootutil_buffer_is_erased(fap, rec, sizeof(*rec))) {
+        return 1;
+    }
+
+    return 0;
+}
+
+int
+boot_write_validation_cache(const struct flash_area *fap,
+                            const struct boot_validation_cache *rec)
+{
+    uint8_t buf[BOOT_VALIDATION_CACHE_ALIGN_SIZE];
+    uint32_t off;
+    int rc;
+
+    off = boot_validation_cache_off(fap);
+    BOOT_LOG_DBG("writing validation cache; fa_id=%d off=0x%lx (0x%lx)",
+                 flash_area_get_id(fap), (unsigned long)off,
+                 (unsigned long)flash_area_get_off(fap) + off);
+
+    memset(buf, flash_area_erased_val(fap), sizeof(buf));
+    memcpy(buf, rec, sizeof(*rec));
+    rc = flash_area_write(fap, off, buf, sizeof(buf));
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    return 0;
+}
+#endif
+
 #ifdef MCUBOOT_ENC_IMAGES
 int
 boot_write_enc_key(const struct flash_area *fap, uint8_t slot,
@@ -336,7 +407,7 @@ uint32_t bootutil_max_image_size(const struct flash_area *fap)
 #if defined(MCUBOOT_SWAP_USING_SCRATCH) || defined(MCUBOOT_SINGLE_APPLICATION_SLOT) || \
     defined(MCUBOOT_FIRMWARE_LOADER) || defined(MCUBOOT_SINGLE_APPLICATION_SLOT_RAM_LOAD)
     return boot_status_off(fap);
-#elif defined(MCUBOOT_SWAP_USING_MOVE)
+#elif defined(MCUBOOT_SWAP_USING_MOVE) || defined(MCUBOOT_SWAP_USING_OFFSET)
     struct flash_sector sector;
     /* get the last sector offset */
     int rc = flash_area_get_sector(fap, boot_status_off(fap), &sector);
@@ -369,6 +440,7 @@ boot_read_image_size(struct boot_loader_state *state, int slot, uint32_t *size)
     const struct flash_area *fap;
     struct image_tlv_info info;
     uint32_t off;
+    uint32_t start_off;
     uint32_t protect_tlv_size;
     int area_id;
     int rc;
@@ -385,8 +457,9 @@ boot_read_image_size(struct boot_loader_state *state, int slot, uint32_t *size)
     }
 
     off = BOOT_TLV_OFF(boot_img_hdr(state, slot));
+    start_off = boot_get_state_secondary_offset(state, fap);
 
-    if (flash_area_read(fap, off, &info, sizeof(info))) {
+    if (flash_area_read(fap, start_off + off, &info, sizeof(info))) {
         rc = BOOT_EFLASH;
         goto done;
     }
@@ -398,7 +471,8 @@ boot_read_image_size(struct boot_loader_state *state, int slot, uint32_t *size)
             goto done;
         }
 
-        if (flash_area_read(fap, off + info.it_tlv_tot, &info, sizeof(info))) {
+        if (flash_area_read(fap, start_off + off + info.it_tlv_tot, &info,
+                            sizeof(info))) {
             rc = BOOT_EFLASH;
             goto done;
         }
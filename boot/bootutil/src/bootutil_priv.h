@@ -42,6 +42,9 @@
 #ifdef MCUBOOT_ENC_IMAGES
 #include "bootutil/enc_key.h"
 #endif
+#ifdef MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE
+#include "bootutil/crypto/sha.h"
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -49,7 +52,16 @@ extern "C" {
 
 struct flash_area;
 
+/*
+ * Size of the buffer images are streamed through while being hashed.  Every
+ * block costs one flash_area_read() call, so ports with large images may want
+ * to raise this, up to the size of a flash sector.
+ */
+#ifdef MCUBOOT_HASH_BLOCK_SIZE
+#define BOOT_TMPBUF_SZ  MCUBOOT_HASH_BLOCK_SIZE
+#else
 #define BOOT_TMPBUF_SZ  256
+#endif
 
 #define NO_ACTIVE_SLOT UINT32_MAX
 
@@ -58,11 +70,12 @@ struct flash_area;
 
 #if (defined(MCUBOOT_OVERWRITE_ONLY) + \
      defined(MCUBOOT_SWAP_USING_MOVE) + \
+     defined(MCUBOOT_SWAP_USING_OFFSET) + \
      defined(MCUBOOT_DIRECT_XIP) + \
      defined(MCUBOOT_RAM_LOAD) + \
      defined(MCUBOOT_FIRMWARE_LOADER) + \
      defined(MCUBOOT_SWAP_USING_SCRATCH)) > 1
-#error "Please enable only one of MCUBOOT_OVERWRITE_ONLY, MCUBOOT_SWAP_USING_MOVE, MCUBOOT_DIRECT_XIP, MCUBOOT_RAM_LOAD or MCUBOOT_FIRMWARE_LOADER"
+#error "Please enable only one of MCUBOOT_OVERWRITE_ONLY, MCUBOOT_SWAP_USING_MOVE, MCUBOOT_SWAP_USING_OFFSET, MCUBOOT_DIRECT_XIP, MCUBOOT_RAM_LOAD or MCUBOOT_FIRMWARE_LOADER"
 #endif
 
 #if !defined(MCUBOOT_DIRECT_XIP) && \
@@ -72,6 +85,7 @@ struct flash_area;
 
 #if !defined(MCUBOOT_OVERWRITE_ONLY) && \
     !defined(MCUBOOT_SWAP_USING_MOVE) && \
+    !defined(MCUBOOT_SWAP_USING_OFFSET) && \
     !defined(MCUBOOT_DIRECT_XIP) && \
     !defined(MCUBOOT_RAM_LOAD) && \
     !defined(MCUBOOT_SINGLE_APPLICATION_SLOT) && \
@@ -79,8 +93,26 @@ struct flash_area;
 #define MCUBOOT_SWAP_USING_SCRATCH 1
 #endif
 
+#if defined(MCUBOOT_SWAP_SCRATCH_POOL) && !MCUBOOT_SWAP_USING_SCRATCH
+#error "MCUBOOT_SWAP_SCRATCH_POOL requires swap using scratch"
+#endif
+
+#ifdef MCUBOOT_PARALLEL_UPGRADES
+#if !defined(MCUBOOT_SWAP_USING_MOVE) && !defined(MCUBOOT_SWAP_USING_OFFSET)
+#error "MCUBOOT_PARALLEL_UPGRADES requires MCUBOOT_SWAP_USING_MOVE or MCUBOOT_SWAP_USING_OFFSET"
+#endif
+#if (BOOT_IMAGE_NUMBER < 2)
+#error "MCUBOOT_PARALLEL_UPGRADES requires more than one image"
+#endif
+#if defined(MCUBOOT_BOOTSTRAP) || defined(MCUBOOT_IMAGE_ACCESS_HOOKS)
+#error "MCUBOOT_PARALLEL_UPGRADES is not supported with MCUBOOT_BOOTSTRAP or MCUBOOT_IMAGE_ACCESS_HOOKS"
+#endif
+#endif
+
 #define BOOT_STATUS_OP_MOVE     1
 #define BOOT_STATUS_OP_SWAP     2
+/* Swap using offset, of an image stored at the start of the secondary slot. */
+#define BOOT_STATUS_OP_SWAP_BACK 3
 
 /*
  * Maintain state of copy progress.
@@ -92,6 +124,15 @@ struct boot_status {
     uint8_t use_scratch;  /* Are status bytes ever written to scratch? */
     uint8_t swap_type;    /* The type of swap in effect */
     uint32_t swap_size;   /* Total size of swapped image */
+#ifdef MCUBOOT_COPY_SKIP_UNCHANGED
+    uint8_t copied;       /* Has a region been copied in full since boot? */
+#endif
+#ifdef MCUBOOT_SWAP_MOVE_STATUS_BATCH
+    uint8_t batched;      /* Has a status batch been recorded since boot? */
+#endif
+#ifdef MCUBOOT_PARALLEL_UPGRADES
+    uint8_t swapped;      /* Was the swap finished by lent sector operations? */
+#endif
 #ifdef MCUBOOT_ENC_IMAGES
     uint8_t enckey[BOOT_NUM_SLOTS][BOOT_ENC_KEY_ALIGN_SIZE];
 #if MCUBOOT_SWAP_SAVE_ENCTLV
@@ -101,6 +142,63 @@ struct boot_status {
     int source;           /* Which slot contains swap status metadata */
 };
 
+#ifdef MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE
+#if defined(MCUBOOT_DIRECT_XIP) || defined(MCUBOOT_RAM_LOAD)
+#error "MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE is not supported with MCUBOOT_DIRECT_XIP or MCUBOOT_RAM_LOAD"
+#endif
+
+/*
+ * Validation cache record, kept in the primary slot trailer once the image
+ * there has passed a full validation.  The tag is keyed with a device secret
+ * (see boot_validation_cache_key()) and also covers a handful of image blocks
+ * picked from that secret, so a record that was forged, or left behind by
+ * another image, sends the boot back to full validation.
+ */
+struct boot_validation_cache {
+    uint8_t hash[IMAGE_HASH_SIZE];        /* Image digest, as validated */
+    uint8_t fingerprint[IMAGE_HASH_SIZE]; /* Digest of header and TLV area */
+    uint32_t key_id;                      /* Key that signed the image */
+    uint8_t tag[IMAGE_HASH_SIZE];         /* Keyed digest over all the above */
+};
+
+#define BOOT_VALIDATION_CACHE_ALIGN_SIZE \
+    ALIGN_UP(sizeof(struct boot_validation_cache), BOOT_MAX_ALIGN)
+#endif
+
+#ifdef MCUBOOT_TLV_INDEX
+#ifdef MCUBOOT_RAM_LOAD
+#error "MCUBOOT_TLV_INDEX is not supported with MCUBOOT_RAM_LOAD"
+#endif
+
+/* Most TLVs an image can carry for its index to be used. */
+#ifndef MCUBOOT_TLV_INDEX_SIZE
+#define MCUBOOT_TLV_INDEX_SIZE 16
+#endif
+
+#define BOOT_TLV_INDEX_EMPTY    0
+#define BOOT_TLV_INDEX_READY    1
+#define BOOT_TLV_INDEX_UNUSABLE 2
+
+/*
+ * Types and locations of the TLVs of an image, gathered in a single pass over
+ * its TLV area the first time they are looked up, so that later TLV iterators
+ * over the same image do not read the TLV area again.  Images with more TLVs
+ * than fit, or whose TLV area is malformed, are scanned as before.
+ */
+struct boot_tlv_index {
+    uint8_t status;         /* BOOT_TLV_INDEX_[...] */
+    uint8_t fa_id;          /* Flash area the index was built from */
+    uint8_t count;
+    uint32_t prot_end;
+    uint32_t tlv_end;
+    struct {
+        uint16_t type;
+        uint16_t len;
+        uint32_t off;       /* Offset of the TLV's payload */
+    } entries[MCUBOOT_TLV_INDEX_SIZE];
+};
+#endif
+
 #define BOOT_STATUS_IDX_0   1
 
 #define BOOT_STATUS_STATE_0 1
@@ -196,6 +294,10 @@ _Static_assert(sizeof(boot_img_magic) == BOOT_MAGIC_SZ, "Invalid size for image
 #define BOOT_STATUS_MOVE_STATE_COUNT    1
 #define BOOT_STATUS_SWAP_STATE_COUNT    2
 #define BOOT_STATUS_STATE_COUNT         (BOOT_STATUS_MOVE_STATE_COUNT + BOOT_STATUS_SWAP_STATE_COUNT)
+#elif MCUBOOT_SWAP_USING_OFFSET
+#define BOOT_STATUS_SWAP_STATE_COUNT    2
+/* One more entry records the direction of the swap; keep the usual size. */
+#define BOOT_STATUS_STATE_COUNT         3
 #else
 #define BOOT_STATUS_STATE_COUNT         3
 #endif
@@ -228,6 +330,9 @@ struct boot_loader_state {
         const struct flash_area *area;
         boot_sector_t *sectors;
         uint32_t num_sectors;
+#ifdef MCUBOOT_TLV_INDEX
+        struct boot_tlv_index tlv_index;
+#endif
     } imgs[BOOT_IMAGE_NUMBER][BOOT_NUM_SLOTS];
 
 #if MCUBOOT_SWAP_USING_SCRATCH
@@ -241,6 +346,11 @@ struct boot_loader_state {
     uint8_t swap_type[BOOT_IMAGE_NUMBER];
     uint32_t write_sz;
 
+#if defined(MCUBOOT_SWAP_USING_OFFSET)
+    /* Is the image in the secondary slot stored one sector into it? */
+    bool secondary_offset[BOOT_IMAGE_NUMBER];
+#endif
+
 #if defined(MCUBOOT_ENC_IMAGES)
     struct enc_key_data enc[BOOT_IMAGE_NUMBER][BOOT_NUM_SLOTS];
 #endif
@@ -250,6 +360,17 @@ struct boot_loader_state {
     bool img_mask[BOOT_IMAGE_NUMBER];
 #endif
 
+#ifdef MCUBOOT_PARALLEL_UPGRADES
+    /* Swaps of the later images that are still under way, which are lent a
+     * sector operation each time the swap of the current image erases a
+     * sector; NULL for the other images.
+     */
+    struct boot_status *swap_bs[BOOT_IMAGE_NUMBER];
+    uint32_t swap_steps;   /* Sector operations left before swap_run() yields */
+    bool swap_yielded;     /* Did swap_run() return before finishing? */
+    bool swap_lending;     /* Is a sector operation being lent? */
+#endif
+
 #if defined(MCUBOOT_DIRECT_XIP) || defined(MCUBOOT_RAM_LOAD)
     struct slot_usage_t {
         /* Index of the slot chosen to be loaded */
@@ -267,8 +388,14 @@ struct boot_loader_state {
 #endif /* MCUBOOT_DIRECT_XIP || MCUBOOT_RAM_LOAD */
 };
 
-fih_ret bootutil_verify_sig(uint8_t *hash, uint32_t hlen, uint8_t *sig,
-                            size_t slen, uint8_t key_id);
+/* Signature verification, one function per supported algorithm. */
+fih_ret bootutil_verify_sig_rsa(uint8_t *hash, uint32_t hlen, uint8_t *sig,
+                                size_t slen, uint8_t key_id);
+fih_ret bootutil_verify_sig_ecdsa(uint8_t *hash, uint32_t hlen, uint8_t *sig,
+                                  size_t slen, uint8_t key_id);
+fih_ret bootutil_verify_sig_ed25519(uint8_t *hash, uint32_t hlen,
+                                    uint8_t *sig, size_t slen,
+                                    uint8_t key_id);
 
 fih_ret boot_fih_memequal(const void *s1, const void *s2, size_t n);
 
@@ -302,9 +429,93 @@ int boot_copy_region(struct boot_loader_state *state,
                      const struct flash_area *fap_src,
                      const struct flash_area *fap_dst,
                      uint32_t off_src, uint32_t off_dst, uint32_t sz);
+#ifdef MCUBOOT_COPY_SKIP_UNCHANGED
+bool boot_copy_region_unchanged(struct boot_loader_state *state,
+                                const struct flash_area *fap_src,
+                                const struct flash_area *fap_dst,
+                                uint32_t off_src, uint32_t off_dst,
+                                uint32_t sz, uint32_t copy_sz);
+#endif
 int boot_erase_region(const struct flash_area *fap, uint32_t off, uint32_t sz);
+int boot_erase_and_copy_region(struct boot_loader_state *state,
+                               const struct flash_area *fap_src,
+                               const struct flash_area *fap_dst,
+                               uint32_t off_src, uint32_t off_dst,
+                               uint32_t sz, uint32_t copy_sz);
 bool boot_status_is_reset(const struct boot_status *bs);
 
+#ifdef MCUBOOT_PARALLEL_UPGRADES
+/*
+ * Called by swap_run() before each sector operation: returns true, once the
+ * operations it was allowed are done, if it has to return for the swaps of
+ * other images to go on.  It is resumed by calling it again.
+ */
+static inline bool
+boot_swap_yield(struct boot_loader_state *state)
+{
+    if (state->swap_steps == 0) {
+        state->swap_yielded = true;
+        return true;
+    }
+
+    state->swap_steps--;
+    return false;
+}
+
+#define boot_swap_yielded(state) ((state)->swap_yielded)
+#define boot_swap_lent(state) ((state)->swap_lending)
+
+/*
+ * Performs a sector operation of the swap of each later image still under
+ * way, while the current swap waits on a sector erase.
+ */
+void boot_swap_lend(struct boot_loader_state *state);
+#else
+#define boot_swap_yield(state) false
+#define boot_swap_yielded(state) false
+#define boot_swap_lent(state) false
+#endif
+
+#if defined(MCUBOOT_SWAP_USING_OFFSET)
+/*
+ * Offset of the image in the given area of the current image: the size of
+ * the first sector of the secondary slot when its image is stored past that
+ * sector, 0 otherwise.
+ */
+uint32_t boot_get_state_secondary_offset(struct boot_loader_state *state,
+                                         const struct flash_area *fap);
+#else
+#define boot_get_state_secondary_offset(state, fap) 0
+#endif
+
+#ifdef MCUBOOT_DELTA_IMAGES
+/*
+ * Check that the delta image in the secondary slot applies to the image in
+ * the primary slot: returns 0 if so, 1 if it is already being applied and a
+ * negative value otherwise.
+ */
+int boot_delta_check_base(struct boot_loader_state *state);
+/* Apply, or finish applying, the delta image to the primary slot. */
+int boot_delta_apply(struct boot_loader_state *state,
+                     const struct flash_area *fap_pri,
+                     const struct flash_area *fap_sec, uint32_t *size);
+/* Forget the progress of the last delta image applied. */
+int boot_delta_clear_progress(struct boot_loader_state *state,
+                              const struct flash_area *fap_sec);
+#endif
+
+#ifdef MCUBOOT_DECOMPRESS_IMAGES
+/*
+ * Get the size of the image the compressed image in the secondary slot
+ * decompresses to, checking that it fits in the primary slot.
+ */
+int boot_decompress_size(struct boot_loader_state *state, uint32_t *size);
+/* Rebuild the original image in the erased primary slot. */
+int boot_decompress_image(struct boot_loader_state *state,
+                          const struct flash_area *fap_pri,
+                          const struct flash_area *fap_sec);
+#endif
+
 #ifdef MCUBOOT_ENC_IMAGES
 int boot_write_enc_key(const struct flash_area *fap, uint8_t slot,
                        const struct boot_status *bs);
@@ -312,6 +523,17 @@ int boot_read_enc_key(const struct flash_area *fap, uint8_t slot,
                       struct boot_status *bs);
 #endif
 
+#ifdef MCUBOOT_TLV_INDEX
+void boot_tlv_index_attach(struct boot_loader_state *state);
+#endif
+
+#ifdef MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE
+int boot_read_validation_cache(const struct flash_area *fap,
+                               struct boot_validation_cache *rec);
+int boot_write_validation_cache(const struct flash_area *fap,
+                                const struct boot_validation_cache *rec);
+#endif
+
 /**
  * Checks that a buffer is erased according to what the erase value for the
  * flash device provided in `flash_area` is.
@@ -425,6 +647,21 @@ boot_img_sector_off(const struct boot_loader_state *state, size_t slot,
            flash_area_get_off(&BOOT_IMG(state, slot).sectors[0]);
 }
 
+#if MCUBOOT_SWAP_USING_SCRATCH
+static inline size_t
+boot_scratch_sector_size(const struct boot_loader_state *state, size_t sector)
+{
+    return flash_area_get_size(&state->scratch.sectors[sector]);
+}
+
+static inline uint32_t
+boot_scratch_sector_off(const struct boot_loader_state *state, size_t sector)
+{
+    return flash_area_get_off(&state->scratch.sectors[sector]) -
+           flash_area_get_off(&state->scratch.sectors[0]);
+}
+#endif
+
 #else  /* defined(MCUBOOT_USE_FLASH_AREA_GET_SECTORS) */
 
 static inline size_t
@@ -442,6 +679,21 @@ boot_img_sector_off(const struct boot_loader_state *state, size_t slot,
            flash_sector_get_off(&BOOT_IMG(state, slot).sectors[0]);
 }
 
+#if MCUBOOT_SWAP_USING_SCRATCH
+static inline size_t
+boot_scratch_sector_size(const struct boot_loader_state *state, size_t sector)
+{
+    return flash_sector_get_size(&state->scratch.sectors[sector]);
+}
+
+static inline uint32_t
+boot_scratch_sector_off(const struct boot_loader_state *state, size_t sector)
+{
+    return flash_sector_get_off(&state->scratch.sectors[sector]) -
+           flash_sector_get_off(&state->scratch.sectors[0]);
+}
+#endif
+
 #endif  /* !defined(MCUBOOT_USE_FLASH_AREA_GET_SECTORS) */
 
 #ifdef MCUBOOT_RAM_LOAD
@@ -477,8 +729,31 @@ int boot_remove_image_from_flash(struct boot_loader_state *state,
 #else
 #define IMAGE_RAM_BASE ((uintptr_t)0)
 
+#ifdef MCUBOOT_USE_FLASH_AREA_GET_MAPPED_PTR
+/*
+ * Copy image data straight out of memory-mapped flash, falling back to
+ * flash_area_read() for ranges the backend cannot map.
+ */
+static inline int
+boot_load_mapped_data(const struct flash_area *fap, uint32_t off,
+                      void *dst, uint32_t len)
+{
+    const void *src;
+
+    if (flash_area_get_mapped_ptr(fap, off, len, &src) == 0) {
+        memcpy(dst, src, len);
+        return 0;
+    }
+
+    return flash_area_read(fap, off, dst, len);
+}
+
+#define LOAD_IMAGE_DATA(hdr, fap, start, output, size)       \
+    (boot_load_mapped_data((fap), (start), (output), (size)))
+#else
 #define LOAD_IMAGE_DATA(hdr, fap, start, output, size)       \
     (flash_area_read((fap), (start), (output), (size)))
+#endif
 
 #endif /* MCUBOOT_RAM_LOAD */
 
@@ -45,6 +45,8 @@ uint32_t bootutil_get_caps(void)
     res |= BOOTUTIL_CAP_OVERWRITE_UPGRADE;
 #elif defined(MCUBOOT_SWAP_USING_MOVE)
     res |= BOOTUTIL_CAP_SWAP_USING_MOVE;
+#elif defined(MCUBOOT_SWAP_USING_OFFSET)
+    res |= BOOTUTIL_CAP_SWAP_USING_OFFSET;
 #else
     res |= BOOTUTIL_CAP_SWAP_USING_SCRATCH;
 #endif
@@ -81,6 +83,27 @@ uint32_t bootutil_get_caps(void)
 #if defined(MCUBOOT_HW_ROLLBACK_PROT)
     res |= BOOTUTIL_CAP_HW_ROLLBACK_PROT;
 #endif
+#if defined(MCUBOOT_VERIFY_IMG_SEGMENTS)
+    res |= BOOTUTIL_CAP_HASH_SEGMENTS;
+#endif
+#if defined(MCUBOOT_MULTI_SIG)
+    res |= BOOTUTIL_CAP_MULTI_SIG;
+#endif
+#if defined(MCUBOOT_CRYPTO_OPS)
+    res |= BOOTUTIL_CAP_CRYPTO_OPS;
+#endif
+#if defined(MCUBOOT_COPY_SKIP_UNCHANGED)
+    res |= BOOTUTIL_CAP_COPY_SKIP_UNCHANGED;
+#endif
+#if defined(MCUBOOT_DELTA_IMAGES)
+    res |= BOOTUTIL_CAP_DELTA_IMAGES;
+#endif
+#if defined(MCUBOOT_DECOMPRESS_IMAGES)
+    res |= BOOTUTIL_CAP_DECOMPRESS_IMAGES;
+#endif
+#if defined(MCUBOOT_PARALLEL_UPGRADES)
+    res |= BOOTUTIL_CAP_PARALLEL_UPGRADES;
+#endif
 
     return res;
 }
@@ -0,0 +1,43 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stddef.h>
+
+#include "mcuboot_config/mcuboot_config.h"
+#include "bootutil/crypto/ops.h"
+
+#ifdef MCUBOOT_CRYPTO_OPS
+
+#if defined(__BOOTSIM__)
+static __thread const struct bootutil_crypto_ops *bootutil_crypto_ops;
+#else
+static const struct bootutil_crypto_ops *bootutil_crypto_ops;
+#endif
+
+int
+bootutil_crypto_ops_register(const struct bootutil_crypto_ops *ops)
+{
+    if (ops != NULL) {
+        if (ops->hash != NULL &&
+            (ops->hash->init == NULL || ops->hash->update == NULL ||
+             ops->hash->finish == NULL)) {
+            return -1;
+        }
+        if (ops->aes_ctr != NULL &&
+            (ops->aes_ctr->set_key == NULL || ops->aes_ctr->crypt == NULL)) {
+            return -1;
+        }
+    }
+
+    bootutil_crypto_ops = ops;
+    return 0;
+}
+
+const struct bootutil_crypto_ops *
+bootutil_crypto_ops_get(void)
+{
+    return bootutil_crypto_ops;
+}
+
+#endif /* MCUBOOT_CRYPTO_OPS */
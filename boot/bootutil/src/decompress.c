@@ -0,0 +1,1060 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Compressed image upgrades.
+ *
+ * The body of an image flagged IMAGE_F_COMPRESSED_LZMA2 is a two byte header
+ * (the dictionary size and the literal and position properties the image was
+ * compressed with) followed by a raw LZMA2 stream of the body of the original
+ * image.  With IMAGE_F_COMPRESSED_ARM_THUMB_FLT, the body went through the
+ * ARM-Thumb BCJ filter before being compressed.  The protected TLVs of the
+ * compressed image are those of the original image plus its size
+ * (IMAGE_TLV_DECOMP_SIZE), hash (IMAGE_TLV_DECOMP_SHA) and signature
+ * (IMAGE_TLV_DECOMP_SIGNATURE).
+ *
+ * Once the compressed image has been validated, the original image is
+ * rebuilt in the primary slot: its header, its body and its TLVs, with the
+ * hash and signature of the original image in place of those of the
+ * compressed one.  It is then validated like any other image.
+ *
+ * The decoder only keeps the last MCUBOOT_DECOMPRESS_BUF_SIZE bytes it has
+ * produced in RAM.  Matches reaching further back are read from the primary
+ * slot, where those bytes have been written already, so the memory needed
+ * does not depend on the dictionary size the image was compressed with.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mcuboot_config/mcuboot_config.h"
+
+#ifdef MCUBOOT_DECOMPRESS_IMAGES
+
+#include "bootutil/bootutil.h"
+#include "bootutil/bootutil_log.h"
+#include "bootutil/image.h"
+#include "bootutil/crypto/sha.h"
+#include "bootutil_priv.h"
+
+#if !defined(MCUBOOT_OVERWRITE_ONLY)
+#error "MCUBOOT_DECOMPRESS_IMAGES requires MCUBOOT_OVERWRITE_ONLY"
+#endif
+
+BOOT_LOG_MODULE_DECLARE(mcuboot);
+
+#ifndef MCUBOOT_DECOMPRESS_BUF_SIZE
+#define MCUBOOT_DECOMPRESS_BUF_SIZE     4096
+#endif
+
+#define LZMA_STATES             12
+#define LZMA_LIT_STATES         7
+#define LZMA_POS_BITS_MAX       4
+#define LZMA_LC_LP_MAX          4
+#define LZMA_LITERAL_SIZE       0x300
+#define LZMA_LEN_LOW_BITS       3
+#define LZMA_LEN_MID_BITS       3
+#define LZMA_LEN_HIGH_BITS      8
+#define LZMA_MATCH_LEN_MIN      2
+#define LZMA_MATCH_LEN_MAX      (LZMA_MATCH_LEN_MIN + 16 + 256 - 1)
+#define LZMA_DIST_STATES        4
+#define LZMA_DIST_SLOT_BITS     6
+#define LZMA_DIST_MODEL_START   4
+#define LZMA_DIST_MODEL_END     14
+#define LZMA_FULL_DISTANCES     128
+#define LZMA_ALIGN_BITS         4
+
+#define RC_TOP                  (1u << 24)
+#define RC_BIT_MODEL_BITS       11
+#define RC_MOVE_BITS            5
+#define RC_PROB_INIT            (1u << (RC_BIT_MODEL_BITS - 1))
+
+#define LZMA2_END               0x00
+#define LZMA2_COPY_RESET        0x01
+#define LZMA2_COPY              0x02
+#define LZMA2_LZMA              0x80
+
+/* Two bytes of properties precede the LZMA2 stream; it does not need them. */
+#define DECOMP_HDR_SZ           2
+
+/*
+ * The window holds the last DECOMP_WIN_SZ bytes produced, and is written to
+ * flash a half at a time, once the two bytes following that half (which the
+ * ARM-Thumb filter may need) have been produced.  Bytes no longer in the
+ * window must be in flash by then, along with the few after them that the
+ * filter needs to be reapplied to a match read back from flash.
+ */
+#define DECOMP_WIN_SZ           MCUBOOT_DECOMPRESS_BUF_SIZE
+#define DECOMP_FLUSH_SZ         (DECOMP_WIN_SZ / 2)
+#define DECOMP_FLUSH_AT         (DECOMP_FLUSH_SZ + 4)
+#define DECOMP_IN_SZ            256
+#define DECOMP_STAGE_SZ         256
+
+#if (DECOMP_WIN_SZ % 64) != 0 || \
+    DECOMP_FLUSH_AT + LZMA_MATCH_LEN_MAX + BOOT_MAX_ALIGN + 4 > DECOMP_WIN_SZ
+#error "MCUBOOT_DECOMPRESS_BUF_SIZE must be a multiple of 64 of at least 1024"
+#endif
+
+struct boot_decomp_len {
+    uint16_t choice;
+    uint16_t choice2;
+    uint16_t low[1 << LZMA_POS_BITS_MAX][1 << LZMA_LEN_LOW_BITS];
+    uint16_t mid[1 << LZMA_POS_BITS_MAX][1 << LZMA_LEN_MID_BITS];
+    uint16_t high[1 << LZMA_LEN_HIGH_BITS];
+};
+
+/* The probabilities of the LZMA decoder, which are all reset together. */
+struct boot_decomp_probs {
+    uint16_t is_match[LZMA_STATES][1 << LZMA_POS_BITS_MAX];
+    uint16_t is_rep[LZMA_STATES];
+    uint16_t is_rep0[LZMA_STATES];
+    uint16_t is_rep1[LZMA_STATES];
+    uint16_t is_rep2[LZMA_STATES];
+    uint16_t is_rep0_long[LZMA_STATES][1 << LZMA_POS_BITS_MAX];
+    uint16_t dist_slot[LZMA_DIST_STATES][1 << LZMA_DIST_SLOT_BITS];
+    /* Indexed from 1, as the bit trees are. */
+    uint16_t dist_special[LZMA_FULL_DISTANCES - LZMA_DIST_MODEL_END + 1];
+    uint16_t dist_align[1 << LZMA_ALIGN_BITS];
+    struct boot_decomp_len match_len;
+    struct boot_decomp_len rep_len;
+    uint16_t literal[1 << LZMA_LC_LP_MAX][LZMA_LITERAL_SIZE];
+};
+
+/* Where the TLVs of the original image come from. */
+struct boot_decomp_layout {
+    uint32_t size;          /* Of the body */
+    uint32_t sha_off;
+    uint32_t sig_off;
+    uint16_t sig_len;       /* 0 if the original image is not signed */
+    uint16_t prot_sz;       /* Of the protected TLV area, info included */
+    uint16_t tlv_sz;        /* Of the other TLVs, info included */
+};
+
+struct boot_decomp {
+    /* Input, from the secondary slot */
+    const struct flash_area *fap_in;
+    uint32_t in_off;        /* Flash offset of in_buf[0] */
+    uint32_t in_len;
+    uint32_t in_next;
+    uint32_t in_limit;      /* End of the current chunk */
+    uint32_t in_end;
+    uint8_t in_buf[DECOMP_IN_SZ];
+
+    /* Range decoder */
+    uint32_t range;
+    uint32_t code;
+
+    /* LZMA decoder */
+    uint32_t state;
+    uint32_t rep0;
+    uint32_t rep1;
+    uint32_t rep2;
+    uint32_t rep3;
+    uint32_t lc;
+    uint32_t lp;
+    uint32_t pb;
+    struct boot_decomp_probs probs;
+
+    /* Body, to the primary slot */
+    const struct flash_area *fap_out;
+    uint32_t out_off;       /* Flash offset of the body */
+    uint32_t size;
+    uint32_t pos;           /* Bytes produced so far */
+    uint32_t dict_start;    /* pos at the last dictionary reset */
+    uint32_t flushed;       /* Bytes passed on to be written */
+    uint32_t win_pos;       /* Where byte pos goes in win */
+    bool thumb;
+    bool err;
+    uint8_t win[DECOMP_WIN_SZ];
+    uint8_t stage[DECOMP_STAGE_SZ + 4];
+    uint8_t back[LZMA_MATCH_LEN_MAX + 6];
+
+    /* Aligned writes */
+    uint32_t wr_off;
+    uint32_t wr_len;
+    uint32_t align;
+    uint8_t wr_buf[BOOT_MAX_ALIGN];
+};
+
+#if defined(__BOOTSIM__)
+static __thread struct boot_decomp boot_decomp;
+#else
+static struct boot_decomp boot_decomp;
+#endif
+
+/*
+ * Write data to the primary slot after what was written before, a flash
+ * write unit at a time.
+ */
+static void
+boot_decomp_write(struct boot_decomp *d, const uint8_t *data, uint32_t len)
+{
+    uint32_t n;
+
+    if (d->wr_len > 0) {
+        n = d->align - d->wr_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&d->wr_buf[d->wr_len], data, n);
+        d->wr_len += n;
+        data += n;
+        len -= n;
+        if (d->wr_len < d->align) {
+            return;
+        }
+        if (flash_area_write(d->fap_out, d->wr_off, d->wr_buf, d->align) != 0) {
+            d->err = true;
+        }
+        d->wr_off += d->align;
+        d->wr_len = 0;
+    }
+
+    n = len - len % d->align;
+    if (n > 0) {
+        if (flash_area_write(d->fap_out, d->wr_off, data, n) != 0) {
+            d->err = true;
+        }
+        d->wr_off += n;
+        data += n;
+        len -= n;
+    }
+
+    memcpy(d->wr_buf, data, len);
+    d->wr_len = len;
+}
+
+static void
+boot_decomp_write_end(struct boot_decomp *d)
+{
+    if (d->wr_len > 0) {
+        memset(&d->wr_buf[d->wr_len], flash_area_erased_val(d->fap_out),
+               d->align - d->wr_len);
+        d->wr_len = d->align;
+        boot_decomp_write(d, NULL, 0);
+    }
+}
+
+/*
+ * Copy len bytes at off in the secondary slot to the primary slot.
+ */
+static void
+boot_decomp_write_from(struct boot_decomp *d, uint32_t off, uint32_t len)
+{
+    uint32_t n;
+
+    while (len > 0 && !d->err) {
+        n = len < DECOMP_STAGE_SZ ? len : DECOMP_STAGE_SZ;
+        if (flash_area_read(d->fap_in, off, d->stage, n) != 0) {
+            d->err = true;
+            return;
+        }
+        boot_decomp_write(d, d->stage, n);
+        off += n;
+        len -= n;
+    }
+}
+
+/*
+ * Undo, or apply to encode, the ARM-Thumb BCJ filter, which turns the target
+ * of each BL instruction from relative to absolute.  buf holds len bytes of
+ * the body from offset pos, which must be even.  Whether an instruction is
+ * converted only depends on its own bytes, so any part of the body can be
+ * processed on its own, along with the bytes either side of it.
+ */
+static void
+boot_decomp_thumb(uint8_t *buf, uint32_t len, uint32_t pos, bool encode)
+{
+    uint32_t addr;
+    uint32_t i;
+
+    for (i = 0; i + 4 <= len; i += 2) {
+        if ((buf[i + 1] & 0xf8) != 0xf0 || (buf[i + 3] & 0xf8) != 0xf8) {
+            continue;
+        }
+
+        addr = ((uint32_t)(buf[i + 1] & 0x07) << 19) |
+               ((uint32_t)buf[i] << 11) |
+               ((uint32_t)(buf[i + 3] & 0x07) << 8) |
+               (uint32_t)buf[i + 2];
+        addr <<= 1;
+        if (encode) {
+            addr += pos + i + 4;
+        } else {
+            addr -= pos + i + 4;
+        }
+        addr >>= 1;
+
+        buf[i + 1] = (uint8_t)(0xf0 | ((addr >> 19) & 0x07));
+        buf[i] = (uint8_t)(addr >> 11);
+        buf[i + 3] = (uint8_t)(0xf8 | ((addr >> 8) & 0x07));
+        buf[i + 2] = (uint8_t)addr;
+        i += 2;
+    }
+}
+
+/*
+ * Write the body up to end, which is still in the window along with the two
+ * bytes either side of it, to the primary slot.
+ */
+static void
+boot_decomp_flush(struct boot_decomp *d, uint32_t end)
+{
+    uint32_t start;
+    uint32_t stop;
+    uint32_t from;
+    uint32_t to;
+    uint32_t idx;
+    uint32_t i;
+
+    while (d->flushed < end) {
+        from = d->flushed;
+        to = end - from < DECOMP_STAGE_SZ ? end : from + DECOMP_STAGE_SZ;
+        start = from >= 2 ? from - 2 : 0;
+        stop = d->pos - to < 2 ? d->pos : to + 2;
+
+        idx = (d->win_pos + DECOMP_WIN_SZ - (d->pos - start)) % DECOMP_WIN_SZ;
+        for (i = 0; i < stop - start; i++) {
+            d->stage[i] = d->win[idx];
+            if (++idx == DECOMP_WIN_SZ) {
+                idx = 0;
+            }
+        }
+
+        if (d->thumb) {
+            boot_decomp_thumb(d->stage, stop - start, start, false);
+        }
+        boot_decomp_write(d, &d->stage[from - start], to - from);
+        d->flushed = to;
+    }
+
+    MCUBOOT_WATCHDOG_FEED();
+}
+
+static inline void
+boot_decomp_put(struct boot_decomp *d, uint8_t byte)
+{
+    if (d->pos - d->flushed == DECOMP_FLUSH_AT) {
+        boot_decomp_flush(d, d->flushed + DECOMP_FLUSH_SZ);
+    }
+
+    d->win[d->win_pos] = byte;
+    if (++d->win_pos == DECOMP_WIN_SZ) {
+        d->win_pos = 0;
+    }
+    d->pos++;
+}
+
+/*
+ * Read len bytes of the body from pos back from the primary slot, as they
+ * were before the ARM-Thumb filter was undone.
+ */
+static const uint8_t *
+boot_decomp_read_back(struct boot_decomp *d, uint32_t pos, uint32_t len)
+{
+    uint32_t start;
+
+    start = pos & ~1u;
+    if (start >= 2) {
+        start -= 2;
+    }
+
+    if (flash_area_read(d->fap_out, d->out_off + start, d->back,
+                        pos + len + 3 - start) != 0) {
+        d->err = true;
+    }
+    if (d->thumb) {
+        boot_decomp_thumb(d->back, pos + len + 3 - start, start, true);
+    }
+
+    return &d->back[pos - start];
+}
+
+/*
+ * Output len bytes starting dist bytes back.
+ */
+static void
+boot_decomp_repeat(struct boot_decomp *d, uint32_t dist, uint32_t len)
+{
+    const uint8_t *src;
+    uint32_t idx;
+
+    if (dist > d->pos - d->dict_start) {
+        d->err = true;
+        return;
+    }
+
+    if (dist > DECOMP_WIN_SZ) {
+        src = boot_decomp_read_back(d, d->pos - dist, len);
+        while (len-- > 0) {
+            boot_decomp_put(d, *src++);
+        }
+        return;
+    }
+
+    idx = d->win_pos >= dist ? d->win_pos - dist :
+                               d->win_pos + DECOMP_WIN_SZ - dist;
+    while (len-- > 0) {
+        boot_decomp_put(d, d->win[idx]);
+        if (++idx == DECOMP_WIN_SZ) {
+            idx = 0;
+        }
+    }
+}
+
+static uint8_t
+boot_decomp_get(struct boot_decomp *d, uint32_t dist)
+{
+    if (dist > d->pos - d->dict_start) {
+        d->err = true;
+        return 0;
+    }
+
+    if (dist > DECOMP_WIN_SZ) {
+        return *boot_decomp_read_back(d, d->pos - dist, 1);
+    }
+
+    return d->win[d->win_pos >= dist ? d->win_pos - dist :
+                                       d->win_pos + DECOMP_WIN_SZ - dist];
+}
+
+static uint8_t
+boot_decomp_in(struct boot_decomp *d)
+{
+    uint32_t len;
+
+    if (d->in_next >= d->in_limit) {
+        d->err = true;
+        return 0;
+    }
+
+    if (d->in_next - d->in_off >= d->in_len) {
+        len = d->in_end - d->in_next;
+        if (len > DECOMP_IN_SZ) {
+            len = DECOMP_IN_SZ;
+        }
+        if (flash_area_read(d->fap_in, d->in_next, d->in_buf, len) != 0) {
+            d->err = true;
+            return 0;
+        }
+        d->in_off = d->in_next;
+        d->in_len = len;
+    }
+
+    return d->in_buf[d->in_next++ - d->in_off];
+}
+
+static inline void
+boot_decomp_rc_normalize(struct boot_decomp *d)
+{
+    if (d->range < RC_TOP) {
+        d->range <<= 8;
+        d->code = (d->code << 8) | boot_decomp_in(d);
+    }
+}
+
+static inline uint32_t
+boot_decomp_bit(struct boot_decomp *d, uint16_t *prob)
+{
+    uint32_t bound;
+    uint32_t bit;
+
+    bound = (d->range >> RC_BIT_MODEL_BITS) * *prob;
+    if (d->code < bound) {
+        d->range = bound;
+        *prob += ((1u << RC_BIT_MODEL_BITS) - *prob) >> RC_MOVE_BITS;
+        bit = 0;
+    } else {
+        d->range -= bound;
+        d->code -= bound;
+        *prob -= *prob >> RC_MOVE_BITS;
+        bit = 1;
+    }
+    boot_decomp_rc_normalize(d);
+
+    return bit;
+}
+
+static uint32_t
+boot_decomp_direct(struct boot_decomp *d, uint32_t bits)
+{
+    uint32_t res = 0;
+    uint32_t mask;
+
+    while (bits-- > 0) {
+        d->range >>= 1;
+        d->code -= d->range;
+        mask = 0u - (d->code >> 31);
+        d->code += d->range & mask;
+        res = (res << 1) + (mask + 1);
+        boot_decomp_rc_normalize(d);
+    }
+
+    return res;
+}
+
+static uint32_t
+boot_decomp_tree(struct boot_decomp *d, uint16_t *probs, uint32_t bits)
+{
+    uint32_t sym = 1;
+    uint32_t i;
+
+    for (i = 0; i < bits; i++) {
+        sym = (sym << 1) | boot_decomp_bit(d, &probs[sym]);
+    }
+
+    return sym - (1u << bits);
+}
+
+static uint32_t
+boot_decomp_tree_rev(struct boot_decomp *d, uint16_t *probs, uint32_t bits)
+{
+    uint32_t sym = 1;
+    uint32_t res = 0;
+    uint32_t bit;
+    uint32_t i;
+
+    for (i = 0; i < bits; i++) {
+        bit = boot_decomp_bit(d, &probs[sym]);
+        sym = (sym << 1) | bit;
+        res |= bit << i;
+    }
+
+    return res;
+}
+
+static uint32_t
+boot_decomp_len(struct boot_decomp *d, struct boot_decomp_len *probs,
+                uint32_t pos_state)
+{
+    if (!boot_decomp_bit(d, &probs->choice)) {
+        return boot_decomp_tree(d, probs->low[pos_state], LZMA_LEN_LOW_BITS);
+    }
+    if (!boot_decomp_bit(d, &probs->choice2)) {
+        return (1 << LZMA_LEN_LOW_BITS) +
+               boot_decomp_tree(d, probs->mid[pos_state], LZMA_LEN_MID_BITS);
+    }
+    return (1 << LZMA_LEN_LOW_BITS) + (1 << LZMA_LEN_MID_BITS) +
+           boot_decomp_tree(d, probs->high, LZMA_LEN_HIGH_BITS);
+}
+
+static uint32_t
+boot_decomp_dist(struct boot_decomp *d, uint32_t len)
+{
+    struct boot_decomp_probs *p = &d->probs;
+    uint32_t slot;
+    uint32_t bits;
+    uint32_t dist;
+
+    slot = boot_decomp_tree(d, p->dist_slot[len < LZMA_DIST_STATES ?
+                                            len : LZMA_DIST_STATES - 1],
+                            LZMA_DIST_SLOT_BITS);
+    if (slot < LZMA_DIST_MODEL_START) {
+        return slot;
+    }
+
+    bits = (slot >> 1) - 1;
+    dist = (2 | (slot & 1)) << bits;
+    if (slot < LZMA_DIST_MODEL_END) {
+        return dist + boot_decomp_tree_rev(d, &p->dist_special[dist - slot],
+                                           bits);
+    }
+
+    dist += boot_decomp_direct(d, bits - LZMA_ALIGN_BITS) << LZMA_ALIGN_BITS;
+    return dist + boot_decomp_tree_rev(d, p->dist_align, LZMA_ALIGN_BITS);
+}
+
+static void
+boot_decomp_literal(struct boot_decomp *d, uint32_t dict_pos)
+{
+    uint16_t *probs;
+    uint32_t prev = 0;
+    uint32_t match;
+    uint32_t match_bit;
+    uint32_t bit;
+    uint32_t sym = 1;
+
+    if (dict_pos > 0) {
+        prev = boot_decomp_get(d, 1);
+    }
+    probs = d->probs.literal[((dict_pos & ((1u << d->lp) - 1)) << d->lc) +
+                             (prev >> (8 - d->lc))];
+
+    if (d->state >= LZMA_LIT_STATES) {
+        match = boot_decomp_get(d, d->rep0 + 1);
+        do {
+            match_bit = (match >> 7) & 1;
+            match <<= 1;
+            bit = boot_decomp_bit(d, &probs[((1 + match_bit) << 8) + sym]);
+            sym = (sym << 1) | bit;
+        } while (bit == match_bit && sym < 0x100);
+    }
+    while (sym < 0x100) {
+        sym = (sym << 1) | boot_decomp_bit(d, &probs[sym]);
+    }
+    boot_decomp_put(d, (uint8_t)sym);
+
+    if (d->state < 4) {
+        d->state = 0;
+    } else if (d->state < 10) {
+        d->state -= 3;
+    } else {
+        d->state -= 6;
+    }
+}
+
+static void
+boot_decomp_reset(struct boot_decomp *d)
+{
+    uint16_t *probs = (uint16_t *)&d->probs;
+    size_t i;
+
+    for (i = 0; i < sizeof(d->probs) / sizeof(*probs); i++) {
+        probs[i] = RC_PROB_INIT;
+    }
+    d->state = 0;
+    d->rep0 = 0;
+    d->rep1 = 0;
+    d->rep2 = 0;
+    d->rep3 = 0;
+}
+
+/*
+ * Decode an LZMA chunk up to the body offset end.
+ */
+static int
+boot_decomp_lzma(struct boot_decomp *d, uint32_t end)
+{
+    struct boot_decomp_probs *p = &d->probs;
+    uint32_t pos_state;
+    uint32_t dict_pos;
+    uint32_t dist;
+    uint32_t len;
+
+    while (d->pos < end && !d->err) {
+        dict_pos = d->pos - d->dict_start;
+        pos_state = dict_pos & ((1u << d->pb) - 1);
+
+        if (!boot_decomp_bit(d, &p->is_match[d->state][pos_state])) {
+            boot_decomp_literal(d, dict_pos);
+            continue;
+        }
+
+        if (!boot_decomp_bit(d, &p->is_rep[d->state])) {
+            /* A match at a new distance */
+            len = boot_decomp_len(d, &p->match_len, pos_state);
+            d->state = d->state < LZMA_LIT_STATES ? 7 : 10;
+            d->rep3 = d->rep2;
+            d->rep2 = d->rep1;
+            d->rep1 = d->rep0;
+            d->rep0 = boot_decomp_dist(d, len);
+        } else {
+            if (!boot_decomp_bit(d, &p->is_rep0[d->state])) {
+                if (!boot_decomp_bit(d, &p->is_rep0_long[d->state][pos_state])) {
+                    /* A single byte at the last distance */
+                    d->state = d->state < LZMA_LIT_STATES ? 9 : 11;
+                    boot_decomp_repeat(d, d->rep0 + 1, 1);
+                    continue;
+                }
+            } else {
+                if (!boot_decomp_bit(d, &p->is_rep1[d->state])) {
+                    dist = d->rep1;
+                } else {
+                    if (!boot_decomp_bit(d, &p->is_rep2[d->state])) {
+                        dist = d->rep2;
+                    } else {
+                        dist = d->rep3;
+                        d->rep3 = d->rep2;
+                    }
+                    d->rep2 = d->rep1;
+                }
+                d->rep1 = d->rep0;
+                d->rep0 = dist;
+            }
+            len = boot_decomp_len(d, &p->rep_len, pos_state);
+            d->state = d->state < LZMA_LIT_STATES ? 8 : 11;
+        }
+
+        /* This also rejects end markers, which LZMA2 does not use. */
+        if (d->rep0 >= dict_pos) {
+            return -1;
+        }
+        len += LZMA_MATCH_LEN_MIN;
+        if (len > end - d->pos) {
+            return -1;
+        }
+        boot_decomp_repeat(d, d->rep0 + 1, len);
+    }
+
+    return d->err ? -1 : 0;
+}
+
+/*
+ * Decode the LZMA2 stream of the body.
+ */
+static int
+boot_decomp_lzma2(struct boot_decomp *d)
+{
+    bool need_dict = true;
+    bool need_props = true;
+    uint32_t ctrl;
+    uint32_t unpacked;
+    uint32_t packed;
+    uint32_t props;
+    uint32_t i;
+
+    for (;;) {
+        ctrl = boot_decomp_in(d);
+        if (d->err) {
+            return -1;
+        }
+        if (ctrl == LZMA2_END) {
+            break;
+        }
+
+        if (ctrl == LZMA2_COPY_RESET || ctrl == LZMA2_COPY) {
+            if (ctrl == LZMA2_COPY_RESET) {
+                d->dict_start = d->pos;
+                need_dict = false;
+            } else if (need_dict) {
+                return -1;
+            }
+
+            unpacked = (uint32_t)boot_decomp_in(d) << 8;
+            unpacked |= boot_decomp_in(d);
+            unpacked++;
+            if (d->err || unpacked > d->size - d->pos) {
+                return -1;
+            }
+            for (i = 0; i < unpacked; i++) {
+                boot_decomp_put(d, boot_decomp_in(d));
+            }
+            continue;
+        }
+
+        if (ctrl < LZMA2_LZMA) {
+            return -1;
+        }
+
+        unpacked = (ctrl & 0x1f) << 16;
+        unpacked |= (uint32_t)boot_decomp_in(d) << 8;
+        unpacked |= boot_decomp_in(d);
+        unpacked++;
+        packed = (uint32_t)boot_decomp_in(d) << 8;
+        packed |= boot_decomp_in(d);
+        packed++;
+
+        /* Bits 6-5: reset nothing, the state, also the properties, or also
+         * the dictionary. */
+        if ((ctrl & 0x60) == 0x60) {
+            d->dict_start = d->pos;
+            need_dict = false;
+        } else if (need_dict) {
+            return -1;
+        }
+
+        if ((ctrl & 0x60) >= 0x40) {
+            props = boot_decomp_in(d);
+            if (props >= 9 * 5 * 5) {
+                return -1;
+            }
+            d->lc = props % 9;
+            props /= 9;
+            d->lp = props % 5;
+            d->pb = props / 5;
+            if (d->lc + d->lp > LZMA_LC_LP_MAX || d->pb > LZMA_POS_BITS_MAX) {
+                return -1;
+            }
+            need_props = false;
+        } else if (need_props) {
+            return -1;
+        }
+
+        if ((ctrl & 0x60) != 0) {
+            boot_decomp_reset(d);
+        }
+
+        if (d->err || unpacked > d->size - d->pos ||
+            packed > d->in_end - d->in_next) {
+            return -1;
+        }
+
+        /* Each chunk has its own range coder. */
+        d->in_limit = d->in_next + packed;
+        if (boot_decomp_in(d) != 0) {
+            return -1;
+        }
+        d->code = 0;
+        for (i = 0; i < 4; i++) {
+            d->code = (d->code << 8) | boot_decomp_in(d);
+        }
+        d->range = UINT32_MAX;
+
+        if (boot_decomp_lzma(d, d->pos + unpacked) != 0 ||
+            d->in_next != d->in_limit || d->code != 0) {
+            return -1;
+        }
+        d->in_limit = d->in_end;
+    }
+
+    return d->pos == d->size ? 0 : -1;
+}
+
+static void
+boot_decomp_tlv_info(struct boot_decomp *d, uint16_t magic, uint16_t tot)
+{
+    struct image_tlv_info info = {
+        .it_magic = magic,
+        .it_tlv_tot = tot,
+    };
+
+    boot_decomp_write(d, (const uint8_t *)&info, sizeof(info));
+}
+
+static bool
+boot_decomp_is_sig(uint16_t type)
+{
+    switch (type) {
+    case IMAGE_TLV_RSA2048_PSS:
+    case IMAGE_TLV_ECDSA224:
+    case IMAGE_TLV_ECDSA_SIG:
+    case IMAGE_TLV_RSA3072_PSS:
+    case IMAGE_TLV_ED25519:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Find the size, hash and signature of the original image among the TLVs of
+ * the compressed image, and work out the size of its own TLVs.
+ */
+static int
+boot_decomp_scan(const struct image_header *hdr,
+                 const struct flash_area *fap, struct boot_decomp_layout *l)
+{
+    struct image_tlv_iter it;
+    uint32_t prot_sz = 0;
+    uint32_t tlv_sz = 0;
+    uint32_t off;
+    uint16_t len;
+    uint16_t type;
+    bool sized = false;
+    bool hashed = false;
+    int rc;
+
+    memset(l, 0, sizeof(*l));
+
+    rc = bootutil_tlv_iter_begin(&it, hdr, fap, IMAGE_TLV_ANY, false);
+    if (rc != 0) {
+        return -1;
+    }
+
+    while (true) {
+        rc = bootutil_tlv_iter_next(&it, &off, &len, &type);
+        if (rc < 0) {
+            return -1;
+        } else if (rc > 0) {
+            break;
+        }
+
+        if (off - sizeof(struct image_tlv) < it.prot_end) {
+            if (type == IMAGE_TLV_DECOMP_SIZE) {
+                if (len != sizeof(l->size) ||
+                    flash_area_read(fap, off, &l->size, len) != 0) {
+                    return -1;
+                }
+                sized = true;
+            } else if (type == IMAGE_TLV_DECOMP_SHA) {
+                if (len != IMAGE_HASH_SIZE) {
+                    return -1;
+                }
+                l->sha_off = off;
+                hashed = true;
+            } else if (type == IMAGE_TLV_DECOMP_SIGNATURE) {
+                l->sig_off = off;
+                l->sig_len = len;
+            } else {
+                prot_sz += sizeof(struct image_tlv) + len;
+            }
+        } else if (type == EXPECTED_HASH_TLV) {
+            tlv_sz += sizeof(struct image_tlv) + IMAGE_HASH_SIZE;
+        } else if (boot_decomp_is_sig(type)) {
+            if (l->sig_len == 0) {
+                return -1;
+            }
+            tlv_sz += sizeof(struct image_tlv) + l->sig_len;
+        } else {
+            tlv_sz += sizeof(struct image_tlv) + len;
+        }
+    }
+
+    if (!sized || !hashed) {
+        return -1;
+    }
+
+    if (prot_sz > 0) {
+        prot_sz += sizeof(struct image_tlv_info);
+    }
+    tlv_sz += sizeof(struct image_tlv_info);
+    if (prot_sz > UINT16_MAX || tlv_sz > UINT16_MAX) {
+        return -1;
+    }
+    l->prot_sz = (uint16_t)prot_sz;
+    l->tlv_sz = (uint16_t)tlv_sz;
+
+    return 0;
+}
+
+int
+boot_decompress_size(struct boot_loader_state *state, uint32_t *size)
+{
+    const struct image_header *hdr;
+    struct boot_decomp_layout l;
+    uint32_t sz;
+
+    hdr = boot_img_hdr(state, BOOT_SECONDARY_SLOT);
+    if (!(hdr->ih_flags & IMAGE_F_COMPRESSED_LZMA2) ||
+        (hdr->ih_flags & IMAGE_F_COMPRESSED_LZMA1) || IS_ENCRYPTED(hdr) ||
+        hdr->ih_img_size < DECOMP_HDR_SZ) {
+        return -1;
+    }
+
+    if (boot_decomp_scan(hdr, BOOT_IMG_AREA(state, BOOT_SECONDARY_SLOT),
+                         &l) != 0) {
+        return -1;
+    }
+
+    if (!boot_u32_safe_add(&sz, hdr->ih_hdr_size, l.size) ||
+        !boot_u32_safe_add(&sz, sz, (uint32_t)l.prot_sz + l.tlv_sz) ||
+        sz > flash_area_get_size(BOOT_IMG_AREA(state, BOOT_PRIMARY_SLOT)) -
+             boot_trailer_sz(BOOT_WRITE_SZ(state))) {
+        return -1;
+    }
+
+    *size = sz;
+
+    return 0;
+}
+
+int
+boot_decompress_image(struct boot_loader_state *state,
+                      const struct flash_area *fap_pri,
+                      const struct flash_area *fap_sec)
+{
+    struct boot_decomp *d = &boot_decomp;
+    const struct image_header *hdr;
+    struct image_header new_hdr;
+    struct boot_decomp_layout l;
+    struct image_tlv_iter it;
+    struct image_tlv tlv;
+    uint32_t off;
+    uint16_t len;
+    uint16_t type;
+    bool unprot;
+    int rc;
+
+    hdr = boot_img_hdr(state, BOOT_SECONDARY_SLOT);
+    if (boot_decomp_scan(hdr, fap_sec, &l) != 0) {
+        return BOOT_EBADIMAGE;
+    }
+
+    d->fap_in = fap_sec;
+    d->in_off = 0;
+    d->in_len = 0;
+    d->fap_out = fap_pri;
+    d->in_next = hdr->ih_hdr_size + DECOMP_HDR_SZ;
+    d->in_end = hdr->ih_hdr_size + hdr->ih_img_size;
+    d->in_limit = d->in_end;
+    d->out_off = hdr->ih_hdr_size;
+    d->size = l.size;
+    d->pos = 0;
+    d->dict_start = 0;
+    d->flushed = 0;
+    d->win_pos = 0;
+    d->thumb = (hdr->ih_flags & IMAGE_F_COMPRESSED_ARM_THUMB_FLT) != 0;
+    d->err = false;
+    d->wr_off = 0;
+    d->wr_len = 0;
+    d->align = flash_area_align(fap_pri);
+
+    BOOT_LOG_INF("Image %d decompressing the secondary slot to the primary "
+                 "slot: 0x%lx bytes", BOOT_CURR_IMG(state),
+                 (unsigned long)l.size);
+
+    new_hdr = *hdr;
+    new_hdr.ih_img_size = l.size;
+    new_hdr.ih_protect_tlv_size = l.prot_sz;
+    new_hdr.ih_flags &= ~COMPRESSIONFLAGS;
+    boot_decomp_write(d, (const uint8_t *)&new_hdr, sizeof(new_hdr));
+    boot_decomp_write_from(d, sizeof(new_hdr),
+                           hdr->ih_hdr_size - sizeof(new_hdr));
+
+    rc = boot_decomp_lzma2(d);
+    if (rc != 0 || d->err) {
+        BOOT_LOG_ERR("Image %d could not be decompressed", BOOT_CURR_IMG(state));
+        return BOOT_EBADIMAGE;
+    }
+    boot_decomp_flush(d, d->size);
+
+    /* The protected TLVs, but those about the original image itself, then
+     * the others, with the hash and signature of the original image. */
+    if (l.prot_sz > 0) {
+        boot_decomp_tlv_info(d, IMAGE_TLV_PROT_INFO_MAGIC, l.prot_sz);
+    }
+
+    rc = bootutil_tlv_iter_begin(&it, hdr, fap_sec, IMAGE_TLV_ANY, false);
+    if (rc != 0) {
+        return BOOT_EBADIMAGE;
+    }
+
+    unprot = false;
+    while (true) {
+        rc = bootutil_tlv_iter_next(&it, &off, &len, &type);
+        if (rc < 0) {
+            return BOOT_EBADIMAGE;
+        } else if (rc > 0) {
+            break;
+        }
+
+        tlv.it_type = type;
+        tlv.it_len = len;
+        if (off - sizeof(struct image_tlv) < it.prot_end) {
+            if (type == IMAGE_TLV_DECOMP_SIZE || type == IMAGE_TLV_DECOMP_SHA ||
+                type == IMAGE_TLV_DECOMP_SIGNATURE) {
+                continue;
+            }
+        } else {
+            if (!unprot) {
+                boot_decomp_tlv_info(d, IMAGE_TLV_INFO_MAGIC, l.tlv_sz);
+                unprot = true;
+            }
+            if (type == EXPECTED_HASH_TLV) {
+                tlv.it_len = IMAGE_HASH_SIZE;
+                off = l.sha_off;
+            } else if (boot_decomp_is_sig(type)) {
+                tlv.it_len = l.sig_len;
+                off = l.sig_off;
+            }
+        }
+
+        boot_decomp_write(d, (const uint8_t *)&tlv, sizeof(tlv));
+        boot_decomp_write_from(d, off, tlv.it_len);
+    }
+
+    if (!unprot) {
+        boot_decomp_tlv_info(d, IMAGE_TLV_INFO_MAGIC, l.tlv_sz);
+    }
+
+    boot_decomp_write_end(d);
+    if (d->err) {
+        return BOOT_EFLASH;
+    }
+
+    return 0;
+}
+
+#endif /* MCUBOOT_DECOMPRESS_IMAGES */
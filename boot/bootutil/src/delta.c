@@ -0,0 +1,650 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Delta image upgrades.
+ *
+ * The body of an image flagged IMAGE_F_DELTA is a patch which rebuilds a
+ * complete signed image, header and TLVs included, out of the image in the
+ * primary slot (the base image, identified by its hash in the
+ * IMAGE_TLV_DELTA_BASE_SHA TLV) and of literal data.  It is a sequence of
+ * operations, in the order of the bytes they produce:
+ *
+ *   u32 op         bits 31-30: DELTA_OP_COPY or DELTA_OP_ADD,
+ *                  bits 29-0: number of bytes produced (non-zero)
+ *   u32 src        COPY only: offset in the base image of those bytes
+ *   u8  data[]     ADD only: the bytes themselves
+ *
+ * Words are little endian, unlike the TLVs.
+ *
+ * The patch is applied in place, one primary slot sector at a time, from the
+ * last sector of the new image down to the first one, so the bytes a COPY
+ * produces for a sector must come from at or below the end of that sector:
+ * they are still intact then.  Each sector is first generated into a staging
+ * area of the secondary slot, following the image, before the primary slot
+ * sector gets replaced with it.  Progress is recorded in the (otherwise
+ * unused) status area of the secondary slot, so an interrupted upgrade
+ * resumes with the step it was doing.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mcuboot_config/mcuboot_config.h"
+
+#ifdef MCUBOOT_DELTA_IMAGES
+
+#include "bootutil/bootutil.h"
+#include "bootutil/bootutil_log.h"
+#include "bootutil/image.h"
+#include "bootutil/crypto/sha.h"
+#include "bootutil_priv.h"
+
+#if !defined(MCUBOOT_OVERWRITE_ONLY)
+#error "MCUBOOT_DELTA_IMAGES requires MCUBOOT_OVERWRITE_ONLY"
+#endif
+
+BOOT_LOG_MODULE_DECLARE(mcuboot);
+
+#define DELTA_OP_COPY           1
+#define DELTA_OP_ADD            2
+#define DELTA_OP_SHIFT          30
+#define DELTA_LEN_MASK          0x3fffffff
+
+#if BOOT_MAX_ALIGN > 256
+#define DELTA_BUF_SZ            BOOT_MAX_ALIGN
+#else
+#define DELTA_BUF_SZ            256
+#endif
+
+/*
+ * Progress records: one when the upgrade starts, then one when each sector
+ * has been staged and one when it has been written to the primary slot.
+ */
+#define DELTA_RECORD_CNT        (1 + 2 * BOOT_MAX_IMG_SECTORS)
+
+struct boot_delta_op {
+    uint8_t type;
+    uint32_t len;
+    uint32_t src;       /* Base image offset, or patch data offset for ADD */
+    uint32_t next;      /* Offset of the following op */
+};
+
+struct boot_delta {
+    uint32_t patch_end;
+    uint32_t target_sz;
+    uint32_t sect_cnt;
+    uint32_t stage_off;
+    uint32_t stage_sz;
+    /* First op of each primary slot sector, and where its output starts. */
+    uint32_t op_off[BOOT_MAX_IMG_SECTORS];
+    uint32_t op_tgt[BOOT_MAX_IMG_SECTORS];
+};
+
+#if defined(__BOOTSIM__)
+static __thread struct boot_delta boot_delta;
+#else
+static struct boot_delta boot_delta;
+#endif
+
+static uint32_t
+boot_delta_get_u32(const uint8_t *buf)
+{
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) |
+           ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+/*
+ * Read the TLV of the given type, which must be len bytes long.
+ */
+static int
+boot_delta_read_tlv(const struct image_header *hdr,
+                    const struct flash_area *fap, uint16_t type,
+                    bool prot, void *buf, uint16_t len)
+{
+    struct image_tlv_iter it;
+    uint32_t off;
+    uint16_t tlv_len;
+    int rc;
+
+    rc = bootutil_tlv_iter_begin(&it, hdr, fap, type, prot);
+    if (rc != 0) {
+        return -1;
+    }
+
+    rc = bootutil_tlv_iter_next(&it, &off, &tlv_len, NULL);
+    if (rc != 0 || tlv_len != len) {
+        return -1;
+    }
+
+    rc = flash_area_read(fap, off, buf, len);
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    return 0;
+}
+
+static int
+boot_delta_read_op(const struct flash_area *fap, uint32_t off,
+                   uint32_t end, struct boot_delta_op *op)
+{
+    uint8_t buf[8];
+    uint32_t word;
+    uint32_t hdr_sz;
+    int rc;
+
+    if (end - off < 4) {
+        return -1;
+    }
+    rc = flash_area_read(fap, off, buf, 4);
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    word = boot_delta_get_u32(buf);
+    op->type = word >> DELTA_OP_SHIFT;
+    op->len = word & DELTA_LEN_MASK;
+    if (op->len == 0) {
+        return -1;
+    }
+
+    if (op->type == DELTA_OP_COPY) {
+        hdr_sz = 8;
+        if (end - off < hdr_sz) {
+            return -1;
+        }
+        rc = flash_area_read(fap, off + 4, &buf[4], 4);
+        if (rc != 0) {
+            return BOOT_EFLASH;
+        }
+        op->src = boot_delta_get_u32(&buf[4]);
+        op->next = off + hdr_sz;
+    } else if (op->type == DELTA_OP_ADD) {
+        hdr_sz = 4;
+        if (end - off - hdr_sz < op->len) {
+            return -1;
+        }
+        op->src = off + hdr_sz;
+        op->next = op->src + op->len;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Walk the patch once, checking that it produces exactly target_sz bytes in
+ * an order that can be applied in place, and index where the output of each
+ * sector starts.
+ */
+static int
+boot_delta_scan(struct boot_loader_state *state, struct boot_delta *d,
+                uint32_t off, const struct flash_area *fap_pri,
+                const struct flash_area *fap_sec)
+{
+    struct boot_delta_op op;
+    uint32_t sect;
+    uint32_t sect_off;
+    uint32_t sect_end;
+    uint32_t tgt;
+    uint32_t op_end;
+    uint32_t src_end;
+    int rc;
+
+    sect = 0;
+    tgt = 0;
+    while (off < d->patch_end) {
+        rc = boot_delta_read_op(fap_sec, off, d->patch_end, &op);
+        if (rc != 0) {
+            return rc;
+        }
+
+        if (!boot_u32_safe_add(&op_end, tgt, op.len) ||
+            op_end > d->target_sz) {
+            return -1;
+        }
+        if (op.type == DELTA_OP_COPY &&
+            (!boot_u32_safe_add(&src_end, op.src, op.len) ||
+             src_end > flash_area_get_size(fap_pri))) {
+            return -1;
+        }
+
+        while (sect < d->sect_cnt) {
+            sect_off = boot_img_sector_off(state, BOOT_PRIMARY_SLOT, sect);
+            sect_end = sect_off +
+                       boot_img_sector_size(state, BOOT_PRIMARY_SLOT, sect);
+            if (sect_off >= op_end) {
+                break;
+            }
+
+            if (tgt <= sect_off) {
+                d->op_off[sect] = off;
+                d->op_tgt[sect] = tgt;
+            }
+
+            if (op.type == DELTA_OP_COPY) {
+                src_end = op.src + ((op_end < sect_end) ? op_end : sect_end) -
+                          tgt;
+                if (src_end > sect_end) {
+                    BOOT_LOG_ERR("Delta image copies from a sector it has "
+                                 "already replaced");
+                    return -1;
+                }
+            }
+
+            if (sect_end > op_end) {
+                break;
+            }
+            sect++;
+        }
+
+        tgt = op_end;
+        off = op.next;
+    }
+
+    if (tgt != d->target_sz) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Find room for staging the largest sector of the new image between the end
+ * of the delta image and the trailer of the secondary slot.
+ */
+static int
+boot_delta_find_stage(struct boot_loader_state *state, struct boot_delta *d,
+                      const struct flash_area *fap_sec)
+{
+    uint32_t img_end;
+    uint32_t max_sz;
+    uint32_t trailer_off;
+    uint32_t sz;
+    size_t sect_cnt;
+    size_t sect;
+    int rc;
+
+    rc = boot_read_image_size(state, BOOT_SECONDARY_SLOT, &img_end);
+    if (rc != 0) {
+        return rc;
+    }
+
+    max_sz = 0;
+    for (sect = 0; sect < d->sect_cnt; sect++) {
+        sz = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, sect);
+        if (sz > max_sz) {
+            max_sz = sz;
+        }
+    }
+
+    sect_cnt = boot_img_num_sectors(state, BOOT_SECONDARY_SLOT);
+    trailer_off = boot_status_off(fap_sec);
+    d->stage_sz = 0;
+    for (sect = 0; sect < sect_cnt && d->stage_sz < max_sz; sect++) {
+        if (boot_img_sector_off(state, BOOT_SECONDARY_SLOT, sect) < img_end) {
+            continue;
+        }
+        if (d->stage_sz == 0) {
+            d->stage_off = boot_img_sector_off(state, BOOT_SECONDARY_SLOT, sect);
+        }
+        d->stage_sz += boot_img_sector_size(state, BOOT_SECONDARY_SLOT, sect);
+    }
+
+    if (d->stage_sz < max_sz || d->stage_off + d->stage_sz > trailer_off) {
+        BOOT_LOG_ERR("No room in the secondary slot to apply the delta image");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+boot_delta_prepare(struct boot_loader_state *state, struct boot_delta *d)
+{
+    const struct flash_area *fap_pri;
+    const struct flash_area *fap_sec;
+    const struct image_header *hdr;
+    uint32_t sz;
+    size_t sect_cnt;
+    int rc;
+
+    fap_pri = BOOT_IMG_AREA(state, BOOT_PRIMARY_SLOT);
+    fap_sec = BOOT_IMG_AREA(state, BOOT_SECONDARY_SLOT);
+    hdr = boot_img_hdr(state, BOOT_SECONDARY_SLOT);
+
+    rc = boot_delta_read_tlv(hdr, fap_sec, IMAGE_TLV_DELTA_SIZE, true,
+                             &d->target_sz, sizeof(d->target_sz));
+    if (rc != 0) {
+        return -1;
+    }
+    if (d->target_sz < sizeof(struct image_header) ||
+        d->target_sz > flash_area_get_size(fap_pri) -
+                       boot_trailer_sz(BOOT_WRITE_SZ(state))) {
+        return -1;
+    }
+
+    sect_cnt = boot_img_num_sectors(state, BOOT_PRIMARY_SLOT);
+    for (d->sect_cnt = 0, sz = 0; d->sect_cnt < sect_cnt && sz < d->target_sz;
+         d->sect_cnt++) {
+        sz += boot_img_sector_size(state, BOOT_PRIMARY_SLOT, d->sect_cnt);
+    }
+    if (sz < d->target_sz) {
+        return -1;
+    }
+
+    d->patch_end = hdr->ih_hdr_size + hdr->ih_img_size;
+    rc = boot_delta_scan(state, d, hdr->ih_hdr_size, fap_pri, fap_sec);
+    if (rc != 0) {
+        return rc;
+    }
+
+    return boot_delta_find_stage(state, d, fap_sec);
+}
+
+/*
+ * Count the progress records written so far.
+ */
+static int
+boot_delta_read_progress(const struct flash_area *fap, uint32_t *cnt)
+{
+    uint32_t off;
+    uint32_t align;
+    uint8_t val;
+    int rc;
+
+    off = boot_status_off(fap);
+    align = flash_area_align(fap);
+    for (*cnt = 0; *cnt < DELTA_RECORD_CNT; (*cnt)++) {
+        rc = flash_area_read(fap, off + *cnt * align, &val, 1);
+        if (rc != 0) {
+            return BOOT_EFLASH;
+        }
+        if (bootutil_buffer_is_erased(fap, &val, 1)) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static int
+boot_delta_write_progress(const struct flash_area *fap, uint32_t idx)
+{
+    return boot_write_trailer_flag(fap,
+                                   boot_status_off(fap) +
+                                   idx * flash_area_align(fap),
+                                   BOOT_FLAG_SET);
+}
+
+/*
+ * Generate the given sector of the new image into the staging area.
+ */
+static int
+boot_delta_stage(struct boot_loader_state *state, const struct boot_delta *d,
+                 uint32_t sect, const struct flash_area *fap_pri,
+                 const struct flash_area *fap_sec)
+{
+    uint8_t buf[DELTA_BUF_SZ] __attribute__((aligned(4)));
+    struct boot_delta_op op;
+    const struct flash_area *fap_src;
+    uint32_t start;
+    uint32_t end;
+    uint32_t tgt;
+    uint32_t off;
+    uint32_t from;
+    uint32_t len;
+    uint32_t chunk;
+    uint32_t fill;
+    uint32_t out;
+    int rc;
+
+    start = boot_img_sector_off(state, BOOT_PRIMARY_SLOT, sect);
+    end = start + boot_img_sector_size(state, BOOT_PRIMARY_SLOT, sect);
+    if (end > d->target_sz) {
+        end = d->target_sz;
+    }
+
+    rc = boot_erase_region(fap_sec, d->stage_off, d->stage_sz);
+    if (rc != 0) {
+        return rc;
+    }
+
+    off = d->op_off[sect];
+    tgt = d->op_tgt[sect];
+    out = d->stage_off;
+    fill = 0;
+    while (tgt < end) {
+        rc = boot_delta_read_op(fap_sec, off, d->patch_end, &op);
+        if (rc != 0) {
+            return rc;
+        }
+
+        from = (tgt < start) ? start - tgt : 0;
+        len = ((tgt + op.len < end) ? tgt + op.len : end) - tgt - from;
+        fap_src = (op.type == DELTA_OP_COPY) ? fap_pri : fap_sec;
+        from += op.src;
+
+        while (len > 0) {
+            chunk = sizeof(buf) - fill;
+            if (chunk > len) {
+                chunk = len;
+            }
+            rc = flash_area_read(fap_src, from, &buf[fill], chunk);
+            if (rc != 0) {
+                return BOOT_EFLASH;
+            }
+            from += chunk;
+            len -= chunk;
+            fill += chunk;
+
+            if (fill == sizeof(buf)) {
+                rc = flash_area_write(fap_sec, out, buf, fill);
+                if (rc != 0) {
+                    return BOOT_EFLASH;
+                }
+                out += fill;
+                fill = 0;
+            }
+        }
+
+        tgt += op.len;
+        off = op.next;
+    }
+
+    if (fill > 0) {
+        len = ALIGN_UP(fill, BOOT_WRITE_SZ(state));
+        memset(&buf[fill], flash_area_erased_val(fap_sec), len - fill);
+        rc = flash_area_write(fap_sec, out, buf, len);
+        if (rc != 0) {
+            return BOOT_EFLASH;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Replace the given primary slot sector with its staged contents.
+ */
+static int
+boot_delta_commit(struct boot_loader_state *state, const struct boot_delta *d,
+                  uint32_t sect, const struct flash_area *fap_pri,
+                  const struct flash_area *fap_sec)
+{
+    uint32_t start;
+    uint32_t sz;
+    int rc;
+
+    start = boot_img_sector_off(state, BOOT_PRIMARY_SLOT, sect);
+    sz = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, sect);
+    rc = boot_erase_region(fap_pri, start, sz);
+    if (rc != 0) {
+        return rc;
+    }
+
+    if (start + sz > d->target_sz) {
+        sz = ALIGN_UP(d->target_sz - start, BOOT_WRITE_SZ(state));
+    }
+
+    return boot_copy_region(state, fap_sec, fap_pri, d->stage_off, start, sz);
+}
+
+int
+boot_delta_check_base(struct boot_loader_state *state)
+{
+    uint8_t base_hash[IMAGE_HASH_SIZE];
+    uint8_t hash[IMAGE_HASH_SIZE];
+    const struct image_header *hdr;
+    uint32_t cnt;
+    int rc;
+
+    rc = boot_delta_prepare(state, &boot_delta);
+    if (rc != 0) {
+        return -1;
+    }
+
+    rc = boot_delta_read_progress(BOOT_IMG_AREA(state, BOOT_SECONDARY_SLOT),
+                                  &cnt);
+    if (rc != 0) {
+        return rc;
+    }
+    if (cnt > 0) {
+        /* Already started; the base image is no longer whole. */
+        return 1;
+    }
+
+    hdr = boot_img_hdr(state, BOOT_PRIMARY_SLOT);
+    if (hdr->ih_magic != IMAGE_MAGIC) {
+        return -1;
+    }
+
+    rc = boot_delta_read_tlv(boot_img_hdr(state, BOOT_SECONDARY_SLOT),
+                             BOOT_IMG_AREA(state, BOOT_SECONDARY_SLOT),
+                             IMAGE_TLV_DELTA_BASE_SHA, true,
+                             base_hash, sizeof(base_hash));
+    if (rc != 0) {
+        return -1;
+    }
+
+    rc = boot_delta_read_tlv(hdr, BOOT_IMG_AREA(state, BOOT_PRIMARY_SLOT),
+                             EXPECTED_HASH_TLV, false, hash, sizeof(hash));
+    if (rc != 0) {
+        return -1;
+    }
+
+    if (memcmp(base_hash, hash, sizeof(hash)) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+boot_delta_apply(struct boot_loader_state *state,
+                 const struct flash_area *fap_pri,
+                 const struct flash_area *fap_sec, uint32_t *size)
+{
+    struct boot_delta *d = &boot_delta;
+    uint32_t cnt;
+    uint32_t last;
+    uint32_t off;
+    uint32_t sect;
+    uint32_t i;
+    int rc;
+
+    rc = boot_delta_prepare(state, d);
+    if (rc != 0) {
+        return BOOT_EBADIMAGE;
+    }
+
+    rc = boot_delta_read_progress(fap_sec, &cnt);
+    if (rc != 0) {
+        return rc;
+    }
+
+    BOOT_LOG_INF("Image %d applying delta image to the primary slot: "
+                 "0x%lx bytes, %lu of %lu steps done", BOOT_CURR_IMG(state),
+                 (unsigned long)d->target_sz, (unsigned long)cnt,
+                 (unsigned long)(1 + 2 * d->sect_cnt));
+
+    if (cnt == 0) {
+        rc = boot_delta_write_progress(fap_sec, 0);
+        if (rc != 0) {
+            return rc;
+        }
+        cnt = 1;
+    }
+
+    if (cnt == 1) {
+        /* Nothing is copied from past the new image, which may be dropped. */
+        last = boot_img_num_sectors(state, BOOT_PRIMARY_SLOT) - 1;
+        if (d->sect_cnt <= last) {
+            off = boot_img_sector_off(state, BOOT_PRIMARY_SLOT, d->sect_cnt);
+            rc = boot_erase_region(fap_pri, off,
+                    boot_img_sector_off(state, BOOT_PRIMARY_SLOT, last) +
+                    boot_img_sector_size(state, BOOT_PRIMARY_SLOT, last) - off);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+    }
+
+    for (i = (cnt - 1) / 2; i < d->sect_cnt; i++) {
+        sect = d->sect_cnt - 1 - i;
+
+        if (cnt < 2 + 2 * i) {
+            rc = boot_delta_stage(state, d, sect, fap_pri, fap_sec);
+            if (rc == 0) {
+                rc = boot_delta_write_progress(fap_sec, 1 + 2 * i);
+            }
+            if (rc != 0) {
+                return rc;
+            }
+        }
+
+        if (cnt < 3 + 2 * i) {
+            rc = boot_delta_commit(state, d, sect, fap_pri, fap_sec);
+            if (rc == 0) {
+                rc = boot_delta_write_progress(fap_sec, 2 + 2 * i);
+            }
+            if (rc != 0) {
+                return rc;
+            }
+        }
+
+        MCUBOOT_WATCHDOG_FEED();
+    }
+
+    *size = d->target_sz;
+
+    return 0;
+}
+
+int
+boot_delta_clear_progress(struct boot_loader_state *state,
+                          const struct flash_area *fap_sec)
+{
+    uint32_t status_off;
+    uint32_t off;
+    uint32_t end;
+    size_t sect;
+
+    status_off = boot_status_off(fap_sec);
+    sect = boot_img_num_sectors(state, BOOT_SECONDARY_SLOT) - 1;
+    end = boot_img_sector_off(state, BOOT_SECONDARY_SLOT, sect) +
+          boot_img_sector_size(state, BOOT_SECONDARY_SLOT, sect);
+    while (sect > 0 &&
+           boot_img_sector_off(state, BOOT_SECONDARY_SLOT, sect) > status_off) {
+        sect--;
+    }
+    off = boot_img_sector_off(state, BOOT_SECONDARY_SLOT, sect);
+
+    return boot_erase_region(fap_sec, off, end - off);
+}
+
+#endif /* MCUBOOT_DELTA_IMAGES */
@@ -687,9 +687,15 @@ boot_enc_valid(struct enc_key_data *enc_state, int slot)
     return enc_state[slot].valid;
 }
 
-void
-boot_enc_encrypt(struct enc_key_data *enc_state, int slot, uint32_t off,
-             uint32_t sz, uint32_t blk_off, uint8_t *buf)
+/*
+ * Encrypt or decrypt sz bytes of the payload at offset off in place, blk_off
+ * being the offset of buf in its 16 byte block.  AES-CTR works the same both
+ * ways; the whole range is handed to the cipher at once so it can generate
+ * the key stream of many blocks per call.
+ */
+static void
+boot_enc_crypt(struct enc_key_data *enc_state, int slot, uint32_t off,
+               uint32_t sz, uint32_t blk_off, uint8_t *buf)
 {
     struct enc_key_data *enc = &enc_state[slot];
     uint8_t nonce[16];
@@ -711,26 +717,17 @@ boot_enc_encrypt(struct enc_key_data *enc_state, int slot, uint32_t off,
 }
 
 void
-boot_enc_decrypt(struct enc_key_data *enc_state, int slot, uint32_t off,
+boot_enc_encrypt(struct enc_key_data *enc_state, int slot, uint32_t off,
              uint32_t sz, uint32_t blk_off, uint8_t *buf)
 {
-    struct enc_key_data *enc = &enc_state[slot];
-    uint8_t nonce[16];
-
-    /* Nothing to do with size == 0 */
-    if (sz == 0) {
-       return;
-    }
-
-    memset(nonce, 0, 12);
-    off >>= 4;
-    nonce[12] = (uint8_t)(off >> 24);
-    nonce[13] = (uint8_t)(off >> 16);
-    nonce[14] = (uint8_t)(off >> 8);
-    nonce[15] = (uint8_t)off;
+    boot_enc_crypt(enc_state, slot, off, sz, blk_off, buf);
+}
 
-    assert(enc->valid == 1);
-    bootutil_aes_ctr_decrypt(&enc->aes_ctr, nonce, buf, sz, blk_off, buf);
+void
+boot_enc_decrypt(struct enc_key_data *enc_state, int slot, uint32_t off,
+             uint32_t sz, uint32_t blk_off, uint8_t *buf)
+{
+    boot_enc_crypt(enc_state, slot, off, sz, blk_off, buf);
 }
 
 /**
@@ -37,8 +37,8 @@
 
 #if !defined(MCUBOOT_BUILTIN_KEY)
 fih_ret
-bootutil_verify_sig(uint8_t *hash, uint32_t hlen, uint8_t *sig, size_t slen,
-                    uint8_t key_id)
+bootutil_verify_sig_ecdsa(uint8_t *hash, uint32_t hlen, uint8_t *sig,
+                          size_t slen, uint8_t key_id)
 {
     int rc;
     bootutil_ecdsa_context ctx;
@@ -68,8 +68,8 @@ out:
 }
 #else /* !MCUBOOT_BUILTIN_KEY */
 fih_ret
-bootutil_verify_sig(uint8_t *hash, uint32_t hlen, uint8_t *sig, size_t slen,
-                    uint8_t key_id)
+bootutil_verify_sig_ecdsa(uint8_t *hash, uint32_t hlen, uint8_t *sig,
+                          size_t slen, uint8_t key_id)
 {
     int rc;
     bootutil_ecdsa_context ctx;
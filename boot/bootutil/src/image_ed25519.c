@@ -66,8 +66,8 @@ bootutil_import_key(uint8_t **cp, uint8_t *end)
 }
 
 fih_ret
-bootutil_verify_sig(uint8_t *hash, uint32_t hlen, uint8_t *sig, size_t slen,
-  uint8_t key_id)
+bootutil_verify_sig_ed25519(uint8_t *hash, uint32_t hlen, uint8_t *sig,
+                            size_t slen, uint8_t key_id)
 {
     int rc;
     FIH_DECLARE(fih_rc, FIH_FAILURE);
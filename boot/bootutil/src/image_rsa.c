@@ -122,6 +122,7 @@ bootutil_cmp_rsasig(bootutil_rsa_context *ctx, uint8_t *hash, uint32_t hlen,
   uint8_t *sig, size_t slen)
 {
     bootutil_sha_context shactx;
+    struct bootutil_crypto_iovec m_prime[3];
     uint8_t em[MBEDTLS_MPI_MAX_SIZE];
     uint8_t db_mask[PSS_MASK_LEN];
     uint8_t h2[PSS_HLEN];
@@ -221,10 +222,14 @@ bootutil_cmp_rsasig(bootutil_rsa_context *ctx, uint8_t *hash, uint32_t hlen,
     /* Step 12.  Let M' = 0x00 00 00 00 00 00 00 00 || mHash || salt; */
 
     /* Step 13.  Let H' = Hash(M') */
+    m_prime[0].base = pss_zeros;
+    m_prime[0].len = 8;
+    m_prime[1].base = hash;
+    m_prime[1].len = PSS_HLEN;
+    m_prime[2].base = &db_mask[PSS_MASK_SALT_POS];
+    m_prime[2].len = PSS_SLEN;
     bootutil_sha_init(&shactx);
-    bootutil_sha_update(&shactx, pss_zeros, 8);
-    bootutil_sha_update(&shactx, hash, PSS_HLEN);
-    bootutil_sha_update(&shactx, &db_mask[PSS_MASK_SALT_POS], PSS_SLEN);
+    bootutil_sha_update_v(&shactx, m_prime, 3);
     bootutil_sha_finish(&shactx, h2);
     bootutil_sha_drop(&shactx);
 
@@ -259,8 +264,8 @@ bootutil_cmp_rsasig(bootutil_rsa_context *ctx, uint8_t *hash, uint32_t hlen,
 #endif /* MCUBOOT_USE_PSA_CRYPTO */
 
 fih_ret
-bootutil_verify_sig(uint8_t *hash, uint32_t hlen, uint8_t *sig, size_t slen,
-  uint8_t key_id)
+bootutil_verify_sig_rsa(uint8_t *hash, uint32_t hlen, uint8_t *sig,
+                        size_t slen, uint8_t key_id)
 {
     bootutil_rsa_context ctx;
     int rc;
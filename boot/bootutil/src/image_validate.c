@@ -56,42 +56,263 @@
 
 #include "bootutil_priv.h"
 
+#ifndef MCUBOOT_RAM_LOAD
 /*
- * Compute SHA hash over the image.
+ * Size of the next block of the image to hash, starting at off.
+ */
+static uint32_t
+bootutil_img_hash_blk_sz(struct image_header *hdr, uint32_t off,
+                         uint32_t size, uint32_t buf_sz)
+{
+    uint32_t blk_sz;
+
+    blk_sz = size - off;
+    if (blk_sz > buf_sz) {
+        blk_sz = buf_sz;
+    }
+#ifdef MCUBOOT_ENC_IMAGES
+    /* The only data that is encrypted in an image is the payload;
+     * both header and TLVs (when protected) are not.
+     */
+    if ((off < hdr->ih_hdr_size) && ((off + blk_sz) > hdr->ih_hdr_size)) {
+        /* read only the header */
+        blk_sz = hdr->ih_hdr_size - off;
+    }
+    if ((off < BOOT_TLV_OFF(hdr)) && ((off + blk_sz) > BOOT_TLV_OFF(hdr))) {
+        /* read only up to the end of the image payload */
+        blk_sz = BOOT_TLV_OFF(hdr) - off;
+    }
+#else
+    (void)hdr;
+#endif
+
+    return blk_sz;
+}
+
+/*
+ * Add a block read from the image at off to the hash, decrypting it first
+ * when it belongs to an encrypted payload.
+ */
+static void
+bootutil_img_hash_blk(bootutil_sha_context *sha_ctx,
+                      struct enc_key_data *enc_state, int image_index,
+                      struct image_header *hdr, const struct flash_area *fap,
+                      uint32_t off, uint8_t *buf, uint32_t blk_sz)
+{
+#ifdef MCUBOOT_ENC_IMAGES
+    uint32_t blk_off;
+
+    if (MUST_DECRYPT(fap, image_index, hdr)) {
+        /* Only payload is encrypted (area between header and TLVs) */
+        int slot = flash_area_id_to_multi_image_slot(image_index,
+                        flash_area_get_id(fap));
+
+        if (off >= hdr->ih_hdr_size && off < BOOT_TLV_OFF(hdr)) {
+            blk_off = (off - hdr->ih_hdr_size) & 0xf;
+            boot_enc_decrypt(enc_state, slot, off - hdr->ih_hdr_size,
+                             blk_sz, blk_off, buf);
+        }
+    }
+#else
+    (void)enc_state;
+    (void)image_index;
+    (void)hdr;
+    (void)fap;
+    (void)off;
+#endif
+    bootutil_sha_update(sha_ctx, buf, blk_sz);
+}
+#endif /* !MCUBOOT_RAM_LOAD */
+
+#ifdef MCUBOOT_VERIFY_IMG_SEGMENTS
+/*
+ * Progress through the segment hash table (IMAGE_TLV_SEG_HASH) of an image,
+ * which holds one digest per seg_sz bytes of its header and payload.
+ */
+struct bootutil_seg_state {
+    bootutil_sha_context sha_ctx;
+    uint32_t seg_sz;        /* 0 if the image carries no table */
+    uint32_t region_sz;     /* Bytes covered by the table */
+    uint32_t table_off;     /* Offset of the first digest in the area */
+    uint32_t seg;           /* Segment being hashed */
+    uint32_t seg_fill;      /* Bytes of that segment hashed so far */
+};
+
+/*
+ * Locate the segment hash table of an image and get ready to check segments
+ * from the first one.
+ *
+ * @return 0 on success, also when the image has no table; nonzero if the
+ * table is malformed.
+ */
+static int
+bootutil_img_seg_begin(struct bootutil_seg_state *st,
+                       struct image_header *hdr, const struct flash_area *fap,
+                       uint32_t start_off)
+{
+    struct image_tlv_iter it;
+    uint32_t seg_sz;
+    uint32_t seg_cnt;
+    uint32_t off;
+    uint16_t len;
+    int rc;
+
+    memset(st, 0, sizeof(*st));
+    st->region_sz = BOOT_TLV_OFF(hdr);
+
+    if (hdr->ih_protect_tlv_size == 0) {
+        return 0;
+    }
+
+    rc = bootutil_tlv_iter_begin_at(&it, hdr, fap, start_off,
+                                    IMAGE_TLV_SEG_HASH, true);
+    if (rc) {
+        return rc;
+    }
+
+    rc = bootutil_tlv_iter_next(&it, &off, &len, NULL);
+    if (rc > 0) {
+        /* No table, nothing to check segments against. */
+        return 0;
+    } else if (rc < 0) {
+        return rc;
+    }
+
+    if (len < sizeof(seg_sz)) {
+        return -1;
+    }
+
+    rc = LOAD_IMAGE_DATA(hdr, fap, off, &seg_sz, sizeof(seg_sz));
+    if (rc) {
+        return BOOT_EFLASH;
+    }
+
+    if (seg_sz == 0) {
+        return -1;
+    }
+
+    seg_cnt = st->region_sz / seg_sz + (st->region_sz % seg_sz != 0);
+    if (seg_cnt > (len - sizeof(seg_sz)) / IMAGE_HASH_SIZE ||
+        len != sizeof(seg_sz) + seg_cnt * IMAGE_HASH_SIZE) {
+        return -1;
+    }
+
+    st->seg_sz = seg_sz;
+    st->table_off = off + sizeof(seg_sz);
+    bootutil_sha_init(&st->sha_ctx);
+
+    return 0;
+}
+
+static void
+bootutil_img_seg_end(struct bootutil_seg_state *st)
+{
+    if (st->seg_sz != 0) {
+        bootutil_sha_drop(&st->sha_ctx);
+        st->seg_sz = 0;
+    }
+}
+
+/*
+ * Hash the next len bytes of the image, which must follow on from the ones
+ * hashed before, checking every segment against the table as soon as it is
+ * complete.  Bytes past the header and payload are ignored.
+ *
+ * @return 0 on success; nonzero on a read error or on the first segment
+ * that does not match the table.
+ */
+static int
+bootutil_img_seg_update(struct bootutil_seg_state *st,
+                        struct image_header *hdr, const struct flash_area *fap,
+                        uint32_t off, const uint8_t *data, uint32_t len)
+{
+    uint8_t digest[IMAGE_HASH_SIZE];
+    uint8_t expected[IMAGE_HASH_SIZE];
+    uint32_t n;
+    int rc;
+
+    if (st->seg_sz == 0 || off >= st->region_sz) {
+        return 0;
+    }
+    if (len > st->region_sz - off) {
+        len = st->region_sz - off;
+    }
+
+    while (len > 0) {
+        n = st->seg_sz - st->seg_fill;
+        if (n > len) {
+            n = len;
+        }
+        bootutil_sha_update(&st->sha_ctx, data, n);
+        st->seg_fill += n;
+        data += n;
+        len -= n;
+        off += n;
+
+        if (st->seg_fill < st->seg_sz && off < st->region_sz) {
+            continue;
+        }
+
+        bootutil_sha_finish(&st->sha_ctx, digest);
+        bootutil_sha_drop(&st->sha_ctx);
+        bootutil_sha_init(&st->sha_ctx);
+
+        rc = LOAD_IMAGE_DATA(hdr, fap, st->table_off + st->seg * IMAGE_HASH_SIZE,
+                             expected, sizeof(expected));
+        if (rc) {
+            return BOOT_EFLASH;
+        }
+        if (memcmp(digest, expected, sizeof(digest)) != 0) {
+            return -1;
+        }
+
+        st->seg++;
+        st->seg_fill = 0;
+    }
+
+    return 0;
+}
+#endif /* MCUBOOT_VERIFY_IMG_SEGMENTS */
+
+/*
+ * Compute SHA hash over the image stored start_off bytes into fap.
  * (SHA384 if ECDSA-P384 is being used,
  *  SHA256 otherwise).
+ *
+ * With MCUBOOT_VERIFY_IMG_SEGMENTS, images carrying a segment hash table
+ * also have every segment checked as it goes by, so a corrupt image is
+ * rejected without being read to the end.
  */
 static int
 bootutil_img_hash(struct enc_key_data *enc_state, int image_index,
                   struct image_header *hdr, const struct flash_area *fap,
-                  uint8_t *tmp_buf, uint32_t tmp_buf_sz, uint8_t *hash_result,
-                  uint8_t *seed, int seed_len)
+                  uint32_t start_off, uint8_t *tmp_buf, uint32_t tmp_buf_sz,
+                  uint8_t *hash_result, uint8_t *seed, int seed_len)
 {
     bootutil_sha_context sha_ctx;
     uint32_t blk_sz;
     uint32_t size;
-    uint16_t hdr_size;
     uint32_t off;
     int rc;
-    uint32_t blk_off;
-    uint32_t tlv_off;
+#ifdef MCUBOOT_USE_FLASH_AREA_ASYNC_READ
+    uint8_t *bufs[2];
+    uint32_t next_sz;
+    int cur;
+#endif
+#ifdef MCUBOOT_VERIFY_IMG_SEGMENTS
+    struct bootutil_seg_state seg;
+#endif
 
-#if (BOOT_IMAGE_NUMBER == 1) || !defined(MCUBOOT_ENC_IMAGES) || \
-    defined(MCUBOOT_RAM_LOAD)
+#ifdef MCUBOOT_RAM_LOAD
     (void)enc_state;
     (void)image_index;
-    (void)hdr_size;
-    (void)blk_off;
-    (void)tlv_off;
-#ifdef MCUBOOT_RAM_LOAD
     (void)blk_sz;
     (void)off;
-    (void)rc;
     (void)fap;
+    (void)start_off;
     (void)tmp_buf;
     (void)tmp_buf_sz;
 #endif
-#endif
 
 #ifdef MCUBOOT_ENC_IMAGES
     /* Encrypted images only exist in the secondary slot */
@@ -101,7 +322,15 @@ bootutil_img_hash(struct enc_key_data *enc_state, int image_index,
     }
 #endif
 
+#ifdef MCUBOOT_VERIFY_IMG_SEGMENTS
+    rc = bootutil_img_seg_begin(&seg, hdr, fap, start_off);
+    if (rc) {
+        return rc;
+    }
+#endif
+
     bootutil_sha_init(&sha_ctx);
+    rc = 0;
 
     /* in some cases (split image) the hash is seeded with data from
      * the loader image */
@@ -110,9 +339,8 @@ bootutil_img_hash(struct enc_key_data *enc_state, int image_index,
     }
 
     /* Hash is computed over image header and image itself. */
-    size = hdr_size = hdr->ih_hdr_size;
+    size = hdr->ih_hdr_size;
     size += hdr->ih_img_size;
-    tlv_off = size;
 
     /* If protected TLVs are present they are also hashed. */
     size += hdr->ih_protect_tlv_size;
@@ -121,62 +349,183 @@ bootutil_img_hash(struct enc_key_data *enc_state, int image_index,
     bootutil_sha_update(&sha_ctx,
                         (void*)(IMAGE_RAM_BASE + hdr->ih_load_addr),
                         size);
+#ifdef MCUBOOT_VERIFY_IMG_SEGMENTS
+    rc = bootutil_img_seg_update(&seg, hdr, fap, 0,
+                    (const uint8_t *)(IMAGE_RAM_BASE + hdr->ih_load_addr),
+                    size);
+#endif
 #else
-    for (off = 0; off < size; off += blk_sz) {
-        blk_sz = size - off;
-        if (blk_sz > tmp_buf_sz) {
-            blk_sz = tmp_buf_sz;
-        }
-#ifdef MCUBOOT_ENC_IMAGES
-        /* The only data that is encrypted in an image is the payload;
-         * both header and TLVs (when protected) are not.
+    off = 0;
+#ifdef MCUBOOT_USE_FLASH_AREA_GET_MAPPED_PTR
+    {
+        const void *mapped;
+
+        /* Feed the hash straight from memory-mapped flash.  Encrypted
+         * payloads still go through tmp_buf, where they are decrypted.
          */
-        if ((off < hdr_size) && ((off + blk_sz) > hdr_size)) {
-            /* read only the header */
-            blk_sz = hdr_size - off;
-        }
-        if ((off < tlv_off) && ((off + blk_sz) > tlv_off)) {
-            /* read only up to the end of the image payload */
-            blk_sz = tlv_off - off;
+#ifdef MCUBOOT_ENC_IMAGES
+        if (!MUST_DECRYPT(fap, image_index, hdr))
+#endif
+        {
+            if (flash_area_get_mapped_ptr(fap, start_off, size,
+                                          &mapped) == 0) {
+                bootutil_sha_update(&sha_ctx, mapped, size);
+#ifdef MCUBOOT_VERIFY_IMG_SEGMENTS
+                rc = bootutil_img_seg_update(&seg, hdr, fap, 0, mapped, size);
+#endif
+                off = size;
+            }
         }
+    }
 #endif
-        rc = flash_area_read(fap, off, tmp_buf, blk_sz);
+#ifdef MCUBOOT_USE_FLASH_AREA_ASYNC_READ
+    /* Split tmp_buf in two halves, so the next block is read into one
+     * while the current one is decrypted and hashed from the other.
+     */
+    bufs[0] = tmp_buf;
+    bufs[1] = tmp_buf + tmp_buf_sz / 2;
+    cur = 0;
+
+    if (rc == 0 && off < size) {
+        blk_sz = bootutil_img_hash_blk_sz(hdr, off, size, tmp_buf_sz / 2);
+        rc = flash_area_read_submit(fap, start_off + off, bufs[cur], blk_sz);
+    }
+
+    while (rc == 0 && off < size) {
+        rc = flash_area_read_wait(fap);
         if (rc) {
-            bootutil_sha_drop(&sha_ctx);
-            return rc;
+            break;
         }
-#ifdef MCUBOOT_ENC_IMAGES
-        if (MUST_DECRYPT(fap, image_index, hdr)) {
-            /* Only payload is encrypted (area between header and TLVs) */
-            int slot = flash_area_id_to_multi_image_slot(image_index,
-                            flash_area_get_id(fap));
-
-            if (off >= hdr_size && off < tlv_off) {
-                blk_off = (off - hdr_size) & 0xf;
-                boot_enc_decrypt(enc_state, slot, off - hdr_size,
-                                 blk_sz, blk_off, tmp_buf);
+
+        next_sz = 0;
+        if (off + blk_sz < size) {
+            next_sz = bootutil_img_hash_blk_sz(hdr, off + blk_sz, size,
+                                               tmp_buf_sz / 2);
+            rc = flash_area_read_submit(fap, start_off + off + blk_sz,
+                                        bufs[cur ^ 1], next_sz);
+            if (rc) {
+                break;
             }
         }
+
+        bootutil_img_hash_blk(&sha_ctx, enc_state, image_index, hdr, fap,
+                              off, bufs[cur], blk_sz);
+#ifdef MCUBOOT_VERIFY_IMG_SEGMENTS
+        rc = bootutil_img_seg_update(&seg, hdr, fap, off, bufs[cur], blk_sz);
+        if (rc) {
+            if (next_sz != 0) {
+                /* Don't leave a read landing in tmp_buf behind. */
+                (void)flash_area_read_wait(fap);
+            }
+            break;
+        }
+#endif
+
+        off += blk_sz;
+        blk_sz = next_sz;
+        cur ^= 1;
+    }
+#else
+    for (; rc == 0 && off < size; off += blk_sz) {
+        blk_sz = bootutil_img_hash_blk_sz(hdr, off, size, tmp_buf_sz);
+        rc = flash_area_read(fap, start_off + off, tmp_buf, blk_sz);
+        if (rc) {
+            break;
+        }
+        bootutil_img_hash_blk(&sha_ctx, enc_state, image_index, hdr, fap,
+                              off, tmp_buf, blk_sz);
+#ifdef MCUBOOT_VERIFY_IMG_SEGMENTS
+        rc = bootutil_img_seg_update(&seg, hdr, fap, off, tmp_buf, blk_sz);
 #endif
-        bootutil_sha_update(&sha_ctx, tmp_buf, blk_sz);
     }
+#endif /* MCUBOOT_USE_FLASH_AREA_ASYNC_READ */
 #endif /* MCUBOOT_RAM_LOAD */
-    bootutil_sha_finish(&sha_ctx, hash_result);
+#ifdef MCUBOOT_VERIFY_IMG_SEGMENTS
+    bootutil_img_seg_end(&seg);
+#endif
+    if (rc == 0) {
+        bootutil_sha_finish(&sha_ctx, hash_result);
+    }
     bootutil_sha_drop(&sha_ctx);
 
-    return 0;
+    return rc;
 }
 
+#ifdef MCUBOOT_VERIFY_IMG_SEGMENTS
 /*
- * Currently, we only support being able to verify one type of
- * signature, because there is a single verification function that we
- * call.  List the type of TLV we are expecting.  If we aren't
- * configured for any signature, don't define this macro.
+ * Check a run of segments of an image against its segment hash table,
+ * reading them as they are stored.
+ */
+int
+bootutil_img_check_segments(struct image_header *hdr,
+                            const struct flash_area *fap, uint32_t first,
+                            uint32_t count, uint8_t *tmp_buf,
+                            uint32_t tmp_buf_sz)
+{
+    struct bootutil_seg_state seg;
+    uint32_t blk_sz;
+    uint32_t off;
+    uint32_t end;
+    int rc;
+
+    if (hdr == NULL || fap == NULL || tmp_buf == NULL || tmp_buf_sz == 0) {
+        return BOOT_EBADARGS;
+    }
+
+    rc = bootutil_img_seg_begin(&seg, hdr, fap, 0);
+    if (rc) {
+        return rc;
+    }
+
+    if (seg.seg_sz == 0 || count == 0 ||
+        first >= (seg.region_sz + seg.seg_sz - 1) / seg.seg_sz ||
+        count > (seg.region_sz + seg.seg_sz - 1) / seg.seg_sz - first) {
+        bootutil_img_seg_end(&seg);
+        return BOOT_EBADARGS;
+    }
+
+    seg.seg = first;
+    off = first * seg.seg_sz;
+    end = off + count * seg.seg_sz;
+    if (end > seg.region_sz || end < off) {
+        end = seg.region_sz;
+    }
+
+    for (; rc == 0 && off < end; off += blk_sz) {
+        blk_sz = end - off;
+        if (blk_sz > tmp_buf_sz) {
+            blk_sz = tmp_buf_sz;
+        }
+        rc = LOAD_IMAGE_DATA(hdr, fap, off, tmp_buf, blk_sz);
+        if (rc) {
+            rc = BOOT_EFLASH;
+            break;
+        }
+        rc = bootutil_img_seg_update(&seg, hdr, fap, off, tmp_buf, blk_sz);
+    }
+
+    bootutil_img_seg_end(&seg);
+
+    return rc;
+}
+#endif /* MCUBOOT_VERIFY_IMG_SEGMENTS */
+
+/*
+ * Unless MCUBOOT_MULTI_SIG is enabled, we only support being able to
+ * verify one type of signature, with a single verification function.
+ * List the type of TLV we are expecting and the function checking it.  If
+ * we aren't configured for any signature, don't define these macros.  With
+ * several types, they describe the first one, and the buffer is sized for
+ * the largest.
  */
 #if (defined(MCUBOOT_SIGN_RSA)      + \
      defined(MCUBOOT_SIGN_EC256)    + \
      defined(MCUBOOT_SIGN_EC384)    + \
      defined(MCUBOOT_SIGN_ED25519)) > 1
+#define MIXED_SIG_TYPES
+#endif
+
+#if defined(MIXED_SIG_TYPES) && !defined(MCUBOOT_MULTI_SIG)
 #error "Only a single signature type is supported!"
 #endif
 
@@ -190,20 +539,182 @@ bootutil_img_hash(struct enc_key_data *enc_state, int image_index,
 #    endif
 #    define SIG_BUF_SIZE (MCUBOOT_SIGN_RSA_LEN / 8)
 #    define EXPECTED_SIG_LEN(x) ((x) == SIG_BUF_SIZE) /* 2048 bits */
+#    define EXPECTED_SIG_VERIFY bootutil_verify_sig_rsa
 #elif defined(MCUBOOT_SIGN_EC256) || \
       defined(MCUBOOT_SIGN_EC384) || \
       defined(MCUBOOT_SIGN_EC)
 #    define EXPECTED_SIG_TLV IMAGE_TLV_ECDSA_SIG
 #    define SIG_BUF_SIZE 128
 #    define EXPECTED_SIG_LEN(x) (1) /* always true, ASN.1 will validate */
+#    define EXPECTED_SIG_VERIFY bootutil_verify_sig_ecdsa
 #elif defined(MCUBOOT_SIGN_ED25519)
 #    define EXPECTED_SIG_TLV IMAGE_TLV_ED25519
 #    define SIG_BUF_SIZE 64
 #    define EXPECTED_SIG_LEN(x) ((x) == SIG_BUF_SIZE)
+#    define EXPECTED_SIG_VERIFY bootutil_verify_sig_ed25519
 #else
 #    define SIG_BUF_SIZE 32 /* no signing, sha256 digest only */
 #endif
 
+#ifdef MCUBOOT_MULTI_SIG
+#ifndef EXPECTED_SIG_TLV
+#error "MCUBOOT_MULTI_SIG requires at least one signature type"
+#endif
+#if defined(MCUBOOT_HW_KEY) || defined(MCUBOOT_BUILTIN_KEY)
+#error "MCUBOOT_MULTI_SIG requires the keys to be in bootutil_keys[]"
+#endif
+#if defined(MIXED_SIG_TYPES) && IMAGE_HASH_SIZE != 32
+#error "Mixed signature types are only supported with SHA256 image hashes"
+#endif
+
+#ifndef MCUBOOT_MULTI_SIG_THRESHOLD
+#define MCUBOOT_MULTI_SIG_THRESHOLD 1
+#endif
+#if MCUBOOT_MULTI_SIG_THRESHOLD < 1 || MCUBOOT_MULTI_SIG_THRESHOLD > 255
+#error "MCUBOOT_MULTI_SIG_THRESHOLD must be between 1 and 255"
+#endif
+
+/* Cycle counter read around each signature verification, if the port has
+ * one.
+ */
+#ifndef MCUBOOT_CYCLE_COUNT
+#define MCUBOOT_CYCLE_COUNT() 0
+#endif
+
+struct bootutil_sig_alg {
+    uint16_t tlv;       /* Signature TLV type. */
+    uint16_t len;       /* Signature length, 0 if checked when verifying. */
+    uint8_t stat;       /* Index in bootutil_sig_stats_tbl. */
+    fih_ret (*verify)(uint8_t *hash, uint32_t hlen, uint8_t *sig,
+                      size_t slen, uint8_t key_id);
+};
+
+static const struct bootutil_sig_alg bootutil_sig_algs[] = {
+#if defined(MCUBOOT_SIGN_RSA)
+    {
+        .tlv = EXPECTED_SIG_TLV,
+        .len = MCUBOOT_SIGN_RSA_LEN / 8,
+        .stat = BOOTUTIL_SIG_RSA,
+        .verify = bootutil_verify_sig_rsa,
+    },
+#endif
+#if defined(MCUBOOT_SIGN_EC256) || defined(MCUBOOT_SIGN_EC384)
+    {
+        .tlv = IMAGE_TLV_ECDSA_SIG,
+        .len = 0,
+        .stat = BOOTUTIL_SIG_ECDSA,
+        .verify = bootutil_verify_sig_ecdsa,
+    },
+#endif
+#if defined(MCUBOOT_SIGN_ED25519)
+    {
+        .tlv = IMAGE_TLV_ED25519,
+        .len = 64,
+        .stat = BOOTUTIL_SIG_ED25519,
+        .verify = bootutil_verify_sig_ed25519,
+    },
+#endif
+};
+
+#if defined(__BOOTSIM__)
+static __thread struct bootutil_sig_stats
+    bootutil_sig_stats_tbl[BOOTUTIL_SIG_ALG_CNT];
+#else
+static struct bootutil_sig_stats bootutil_sig_stats_tbl[BOOTUTIL_SIG_ALG_CNT];
+#endif
+
+void
+bootutil_sig_stats_get(struct bootutil_sig_stats *stats)
+{
+    memcpy(stats, bootutil_sig_stats_tbl, sizeof(bootutil_sig_stats_tbl));
+}
+
+void
+bootutil_sig_stats_reset(void)
+{
+    memset(bootutil_sig_stats_tbl, 0, sizeof(bootutil_sig_stats_tbl));
+}
+
+static const struct bootutil_sig_alg *
+bootutil_find_sig_alg(uint16_t type)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(bootutil_sig_algs) / sizeof(bootutil_sig_algs[0]);
+         i++) {
+        if (bootutil_sig_algs[i].tlv == type) {
+            return &bootutil_sig_algs[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Tell whether a signature by the given key still needs to be verified:
+ * not once enough keys have signed the image, nor when the key already
+ * counts towards the threshold.
+ */
+static bool
+bootutil_sig_needed(const uint8_t *signers, int signer_cnt, int key_id)
+{
+    int i;
+
+    if (signer_cnt >= MCUBOOT_MULTI_SIG_THRESHOLD) {
+        return false;
+    }
+
+    for (i = 0; i < signer_cnt; i++) {
+        if (signers[i] == key_id) {
+            return false;
+        }
+    }
+
+    return true;
+}
+#endif /* MCUBOOT_MULTI_SIG */
+
+#if defined(MCUBOOT_CRYPTO_OPS) && defined(EXPECTED_SIG_TLV)
+/*
+ * Offer a signature to the registered crypto backend, and only verify it
+ * with the library if the backend has no signature support for its type.
+ */
+static fih_ret
+bootutil_verify_sig_ops(uint16_t type,
+                        fih_ret (*verify)(uint8_t *hash, uint32_t hlen,
+                                          uint8_t *sig, size_t slen,
+                                          uint8_t key_id),
+                        uint8_t *hash, uint32_t hlen, uint8_t *sig,
+                        size_t slen, uint8_t key_id)
+{
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+#if !defined(MCUBOOT_BUILTIN_KEY)
+    const struct bootutil_crypto_ops *ops = bootutil_crypto_ops_get();
+    int rc;
+
+    if (ops != NULL && ops->verify_sig != NULL) {
+        rc = ops->verify_sig(type, hash, hlen, sig, slen,
+                             bootutil_keys[key_id].key,
+                             *bootutil_keys[key_id].len);
+        if (rc != BOOTUTIL_CRYPTO_OPS_FALLBACK) {
+            FIH_RET(fih_ret_encode_zero_equality(rc));
+        }
+    }
+#else
+    (void)type;
+#endif
+
+    FIH_CALL(verify, fih_rc, hash, hlen, sig, slen, key_id);
+    FIH_RET(fih_rc);
+}
+
+#define BOOTUTIL_VERIFY_SIG(verify, type, fih_rc, ...) \
+    FIH_CALL(bootutil_verify_sig_ops, fih_rc, type, verify, __VA_ARGS__)
+#else
+#define BOOTUTIL_VERIFY_SIG(verify, type, fih_rc, ...) \
+    FIH_CALL(verify, fih_rc, __VA_ARGS__)
+#endif /* MCUBOOT_CRYPTO_OPS && EXPECTED_SIG_TLV */
+
 #if (defined(MCUBOOT_HW_KEY)       + \
      defined(MCUBOOT_BUILTIN_KEY)) > 1
 #error "Please use either MCUBOOT_HW_KEY or the MCUBOOT_BUILTIN_KEY feature."
@@ -231,25 +742,38 @@ bootutil_find_key(uint8_t *keyhash, uint8_t keyhash_len)
 {
     bootutil_sha_context sha_ctx;
     int i;
+    int found = -1;
     const struct bootutil_key *key;
+    const uint8_t *digest;
     uint8_t hash[IMAGE_HASH_SIZE];
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
 
     if (keyhash_len > IMAGE_HASH_SIZE) {
         return -1;
     }
 
+    /* Every key is compared, so that the time taken does not depend on
+     * which one matches.  Keys built with their hash (see sign_key.h) cost
+     * only the comparison; the others are hashed here.
+     */
     for (i = 0; i < bootutil_key_cnt; i++) {
         key = &bootutil_keys[i];
-        bootutil_sha_init(&sha_ctx);
-        bootutil_sha_update(&sha_ctx, key->key, *key->len);
-        bootutil_sha_finish(&sha_ctx, hash);
-        if (!memcmp(hash, keyhash, keyhash_len)) {
+        digest = key->hash;
+        if (digest == NULL) {
+            bootutil_sha_init(&sha_ctx);
+            bootutil_sha_update(&sha_ctx, key->key, *key->len);
+            bootutil_sha_finish(&sha_ctx, hash);
             bootutil_sha_drop(&sha_ctx);
-            return i;
+            digest = hash;
+        }
+
+        FIH_CALL(boot_fih_memequal, fih_rc, digest, keyhash, keyhash_len);
+        if (FIH_EQ(fih_rc, FIH_SUCCESS) && found < 0) {
+            found = i;
         }
     }
-    bootutil_sha_drop(&sha_ctx);
-    return -1;
+
+    return found;
 }
 #else /* !MCUBOOT_HW_KEY */
 extern unsigned int pub_key_len;
@@ -306,6 +830,19 @@ int32_t
 bootutil_get_img_security_cnt(struct image_header *hdr,
                               const struct flash_area *fap,
                               uint32_t *img_security_cnt)
+{
+    return bootutil_get_img_security_cnt_at(hdr, fap, 0, img_security_cnt);
+}
+
+/*
+ * Reads the value of an image's security counter, for an image stored
+ * start_off bytes into its flash area.
+ */
+int32_t
+bootutil_get_img_security_cnt_at(struct image_header *hdr,
+                                 const struct flash_area *fap,
+                                 uint32_t start_off,
+                                 uint32_t *img_security_cnt)
 {
     struct image_tlv_iter it;
     uint32_t off;
@@ -324,7 +861,8 @@ bootutil_get_img_security_cnt(struct image_header *hdr,
         return BOOT_EBADIMAGE;
     }
 
-    rc = bootutil_tlv_iter_begin(&it, hdr, fap, IMAGE_TLV_SEC_CNT, true);
+    rc = bootutil_tlv_iter_begin_at(&it, hdr, fap, start_off,
+                                    IMAGE_TLV_SEC_CNT, true);
     if (rc) {
         return rc;
     }
@@ -386,6 +924,26 @@ bootutil_img_validate(struct enc_key_data *enc_state, int image_index,
                       struct image_header *hdr, const struct flash_area *fap,
                       uint8_t *tmp_buf, uint32_t tmp_buf_sz, uint8_t *seed,
                       int seed_len, uint8_t *out_hash)
+{
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+
+    FIH_CALL(bootutil_img_validate_at, fih_rc, enc_state, image_index, hdr,
+             fap, 0, tmp_buf, tmp_buf_sz, seed, seed_len, out_hash);
+
+    FIH_RET(fih_rc);
+}
+
+/*
+ * Verify the integrity of the image stored start_off bytes into fap, hashing
+ * it unless its hash is already known.
+ */
+static fih_ret
+bootutil_img_validate_common(struct enc_key_data *enc_state, int image_index,
+                             struct image_header *hdr,
+                             const struct flash_area *fap, uint32_t start_off,
+                             uint8_t *tmp_buf, uint32_t tmp_buf_sz,
+                             uint8_t *seed, int seed_len,
+                             const uint8_t *known_hash, uint8_t *out_hash)
 {
     uint32_t off;
     uint16_t len;
@@ -404,6 +962,14 @@ bootutil_img_validate(struct enc_key_data *enc_state, int image_index,
 #ifdef MCUBOOT_HW_KEY
     uint8_t key_buf[KEY_BUF_SIZE];
 #endif
+#ifdef MCUBOOT_MULTI_SIG
+    /* Keys whose signature of the image is valid. */
+    uint8_t signers[MCUBOOT_MULTI_SIG_THRESHOLD];
+    int signer_cnt = 0;
+    const struct bootutil_sig_alg *sig_alg;
+    struct bootutil_sig_stats *sig_stats;
+    uint32_t sig_start;
+#endif
 #endif /* EXPECTED_SIG_TLV */
     struct image_tlv_iter it;
     uint8_t buf[SIG_BUF_SIZE];
@@ -416,17 +982,22 @@ bootutil_img_validate(struct enc_key_data *enc_state, int image_index,
     FIH_DECLARE(security_counter_valid, FIH_FAILURE);
 #endif
 
-    rc = bootutil_img_hash(enc_state, image_index, hdr, fap, tmp_buf,
-            tmp_buf_sz, hash, seed, seed_len);
-    if (rc) {
-        goto out;
+    if (known_hash != NULL) {
+        memcpy(hash, known_hash, IMAGE_HASH_SIZE);
+    } else {
+        rc = bootutil_img_hash(enc_state, image_index, hdr, fap, start_off,
+                tmp_buf, tmp_buf_sz, hash, seed, seed_len);
+        if (rc) {
+            goto out;
+        }
     }
 
     if (out_hash) {
         memcpy(out_hash, hash, IMAGE_HASH_SIZE);
     }
 
-    rc = bootutil_tlv_iter_begin(&it, hdr, fap, IMAGE_TLV_ANY, false);
+    rc = bootutil_tlv_iter_begin_at(&it, hdr, fap, start_off, IMAGE_TLV_ANY,
+                                    false);
     if (rc) {
         goto out;
     }
@@ -514,7 +1085,39 @@ bootutil_img_validate(struct enc_key_data *enc_state, int image_index,
              * can be multiple signatures, each preceded by a key.
              */
 #endif /* EXPECTED_KEY_TLV */
-#ifdef EXPECTED_SIG_TLV
+#if defined(MCUBOOT_MULTI_SIG)
+        } else if ((sig_alg = bootutil_find_sig_alg(type)) != NULL) {
+            /* Ignore this signature if it is out of bounds. */
+            if (key_id < 0 || key_id >= bootutil_key_cnt) {
+                key_id = -1;
+                continue;
+            }
+            if ((sig_alg->len != 0 && len != sig_alg->len) ||
+                len > sizeof(buf)) {
+                rc = -1;
+                goto out;
+            }
+            sig_stats = &bootutil_sig_stats_tbl[sig_alg->stat];
+            if (!bootutil_sig_needed(signers, signer_cnt, key_id)) {
+                sig_stats->skipped++;
+                key_id = -1;
+                continue;
+            }
+            rc = LOAD_IMAGE_DATA(hdr, fap, off, buf, len);
+            if (rc) {
+                goto out;
+            }
+            sig_start = MCUBOOT_CYCLE_COUNT();
+            BOOTUTIL_VERIFY_SIG(sig_alg->verify, type, fih_rc, hash,
+                                sizeof(hash), buf, len, key_id);
+            sig_stats->cycles += (uint32_t)(MCUBOOT_CYCLE_COUNT() - sig_start);
+            sig_stats->verified++;
+            if (FIH_EQ(fih_rc, FIH_SUCCESS)) {
+                sig_stats->accepted++;
+                signers[signer_cnt++] = key_id;
+            }
+            key_id = -1;
+#elif defined(EXPECTED_SIG_TLV)
         } else if (type == EXPECTED_SIG_TLV) {
             /* Ignore this signature if it is out of bounds. */
             if (key_id < 0 || key_id >= bootutil_key_cnt) {
@@ -529,8 +1132,9 @@ bootutil_img_validate(struct enc_key_data *enc_state, int image_index,
             if (rc) {
                 goto out;
             }
-            FIH_CALL(bootutil_verify_sig, valid_signature, hash, sizeof(hash),
-                                                           buf, len, key_id);
+            BOOTUTIL_VERIFY_SIG(EXPECTED_SIG_VERIFY, EXPECTED_SIG_TLV,
+                                valid_signature, hash, sizeof(hash), buf, len,
+                                key_id);
             key_id = -1;
 #endif /* EXPECTED_SIG_TLV */
 #ifdef MCUBOOT_HW_ROLLBACK_PROT
@@ -577,6 +1181,10 @@ bootutil_img_validate(struct enc_key_data *enc_state, int image_index,
     if (rc) {
         goto out;
     }
+#ifdef MCUBOOT_MULTI_SIG
+    valid_signature = fih_ret_encode_zero_equality(signer_cnt <
+                                                   MCUBOOT_MULTI_SIG_THRESHOLD);
+#endif
 #ifdef EXPECTED_SIG_TLV
     FIH_SET(fih_rc, valid_signature);
 #endif
@@ -594,3 +1202,399 @@ out:
 
     FIH_RET(fih_rc);
 }
+
+/*
+ * Verify the integrity of the image stored start_off bytes into fap.
+ */
+fih_ret
+bootutil_img_validate_at(struct enc_key_data *enc_state, int image_index,
+                         struct image_header *hdr,
+                         const struct flash_area *fap, uint32_t start_off,
+                         uint8_t *tmp_buf, uint32_t tmp_buf_sz, uint8_t *seed,
+                         int seed_len, uint8_t *out_hash)
+{
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+
+    FIH_CALL(bootutil_img_validate_common, fih_rc, enc_state, image_index,
+             hdr, fap, start_off, tmp_buf, tmp_buf_sz, seed, seed_len, NULL,
+             out_hash);
+
+    FIH_RET(fih_rc);
+}
+
+/*
+ * Verify an image whose hash was computed as it was written, e.g. by serial
+ * recovery: only its TLVs are checked, against that hash.  The image is
+ * trusted to hold what was hashed, so the hash must not come from anywhere
+ * else.
+ */
+fih_ret
+bootutil_img_validate_hashed(struct enc_key_data *enc_state, int image_index,
+                             struct image_header *hdr,
+                             const struct flash_area *fap,
+                             const uint8_t *hash)
+{
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+
+    FIH_CALL(bootutil_img_validate_common, fih_rc, enc_state, image_index,
+             hdr, fap, 0, NULL, 0, NULL, 0, hash, NULL);
+
+    FIH_RET(fih_rc);
+}
+
+#ifdef MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE
+#if IMAGE_HASH_SIZE > 32
+#define VC_HMAC_BLOCK_SZ    128
+#else
+#define VC_HMAC_BLOCK_SZ    64
+#endif
+
+/* Every record covers one image block per 32 bits of a digest, at offsets
+ * only the holder of the cache key can predict.
+ */
+#define VC_SAMPLE_CNT       (IMAGE_HASH_SIZE / 4)
+#define VC_SAMPLE_SZ        64
+
+/*
+ * Starts an HMAC over the image hash function: hashes the key padded with
+ * the inner (0x36) or outer (0x5c) pad byte.
+ */
+static void
+bootutil_vc_hmac_start(bootutil_sha_context *ctx, const uint8_t *key,
+                       size_t key_len, uint8_t pad)
+{
+    uint8_t block[VC_HMAC_BLOCK_SZ];
+    size_t i;
+
+    memset(block, pad, sizeof(block));
+    for (i = 0; i < key_len; i++) {
+        block[i] ^= key[i];
+    }
+
+    bootutil_sha_init(ctx);
+    bootutil_sha_update(ctx, block, sizeof(block));
+    memset(block, 0, sizeof(block));
+}
+
+static int
+bootutil_vc_hash_range(bootutil_sha_context *ctx, struct image_header *hdr,
+                       const struct flash_area *fap, uint32_t off,
+                       uint32_t end, uint8_t *buf, uint32_t buf_sz)
+{
+    uint32_t blk_sz;
+    int rc;
+
+    while (off < end) {
+        blk_sz = end - off;
+        if (blk_sz > buf_sz) {
+            blk_sz = buf_sz;
+        }
+        rc = LOAD_IMAGE_DATA(hdr, fap, off, buf, blk_sz);
+        if (rc) {
+            return rc;
+        }
+        bootutil_sha_update(ctx, buf, blk_sz);
+        off += blk_sz;
+    }
+
+    return 0;
+}
+
+/*
+ * Builds the validation cache record of an image whose hash TLV must carry
+ * the given digest.  Only the header, the TLV area and a few sampled blocks
+ * of the image are read.
+ *
+ * @return 0 on success; nonzero if the record cannot be built, including
+ * when the image does not carry the digest.
+ */
+static int
+bootutil_vc_compute(int image_index, struct image_header *hdr,
+                    const struct flash_area *fap, const uint8_t *hash,
+                    struct boot_validation_cache *rec, uint8_t *tmp_buf,
+                    uint32_t tmp_buf_sz)
+{
+    bootutil_sha_context sha_ctx;
+    struct image_tlv_iter it;
+    uint8_t key[IMAGE_HASH_SIZE];
+    size_t key_len = sizeof(key);
+    uint8_t digest[IMAGE_HASH_SIZE];
+#ifdef MCUBOOT_HW_KEY
+    uint8_t key_buf[KEY_BUF_SIZE];
+#endif
+    uint32_t off;
+    uint32_t blk_off;
+    uint32_t blk_cnt;
+    uint32_t sample;
+    uint16_t len;
+    uint16_t type;
+    bool hash_found = false;
+    int key_id = -1;
+    int i;
+    int rc;
+
+    if (tmp_buf_sz < VC_SAMPLE_SZ) {
+        return -1;
+    }
+
+    rc = boot_validation_cache_key(image_index, key, &key_len);
+    if (rc != 0 || key_len == 0 || key_len > sizeof(key)) {
+        return -1;
+    }
+
+    memset(rec, 0, sizeof(*rec));
+    memcpy(rec->hash, hash, IMAGE_HASH_SIZE);
+
+    rc = bootutil_tlv_iter_begin(&it, hdr, fap, IMAGE_TLV_ANY, false);
+    if (rc) {
+        goto out;
+    }
+
+    if (it.tlv_end > bootutil_max_image_size(fap)) {
+        rc = -1;
+        goto out;
+    }
+
+    /* Fingerprint: the header as stored and the whole TLV area. */
+    bootutil_sha_init(&sha_ctx);
+    rc = bootutil_vc_hash_range(&sha_ctx, hdr, fap, 0, IMAGE_HEADER_SIZE,
+                                tmp_buf, tmp_buf_sz);
+    if (rc == 0) {
+        rc = bootutil_vc_hash_range(&sha_ctx, hdr, fap, BOOT_TLV_OFF(hdr),
+                                    it.tlv_end, tmp_buf, tmp_buf_sz);
+    }
+    bootutil_sha_finish(&sha_ctx, rec->fingerprint);
+    bootutil_sha_drop(&sha_ctx);
+    if (rc) {
+        goto out;
+    }
+
+    while (true) {
+        rc = bootutil_tlv_iter_next(&it, &off, &len, &type);
+        if (rc < 0) {
+            goto out;
+        } else if (rc > 0) {
+            rc = 0;
+            break;
+        }
+
+        if (type == EXPECTED_HASH_TLV) {
+            if (len != IMAGE_HASH_SIZE) {
+                rc = -1;
+                goto out;
+            }
+            rc = LOAD_IMAGE_DATA(hdr, fap, off, digest, len);
+            if (rc) {
+                goto out;
+            }
+            hash_found = (memcmp(digest, hash, IMAGE_HASH_SIZE) == 0);
+#ifdef EXPECTED_KEY_TLV
+        } else if (type == EXPECTED_KEY_TLV && key_id < 0) {
+            if (len > KEY_BUF_SIZE) {
+                rc = -1;
+                goto out;
+            }
+#ifndef MCUBOOT_HW_KEY
+            rc = LOAD_IMAGE_DATA(hdr, fap, off, digest, len);
+            if (rc) {
+                goto out;
+            }
+            key_id = bootutil_find_key(digest, len);
+#else
+            rc = LOAD_IMAGE_DATA(hdr, fap, off, key_buf, len);
+            if (rc) {
+                goto out;
+            }
+            key_id = bootutil_find_key(image_index, key_buf, len);
+#endif /* !MCUBOOT_HW_KEY */
+#endif /* EXPECTED_KEY_TLV */
+        }
+    }
+
+    if (!hash_found) {
+        rc = -1;
+        goto out;
+    }
+
+#if defined(EXPECTED_SIG_TLV) && defined(MCUBOOT_BUILTIN_KEY)
+    key_id = image_index;
+#endif
+    rec->key_id = (uint32_t)key_id;
+
+    /* Sample offsets are drawn from H(key || hash), so they differ between
+     * devices and cannot be steered around by whoever modifies the image.
+     */
+    bootutil_sha_init(&sha_ctx);
+    bootutil_sha_update(&sha_ctx, key, key_len);
+    bootutil_sha_update(&sha_ctx, hash, IMAGE_HASH_SIZE);
+    bootutil_sha_finish(&sha_ctx, digest);
+    bootutil_sha_drop(&sha_ctx);
+
+    bootutil_vc_hmac_start(&sha_ctx, key, key_len, 0x36);
+    bootutil_sha_update(&sha_ctx, rec, offsetof(struct boot_validation_cache,
+                                                tag));
+
+    blk_cnt = hdr->ih_img_size / VC_SAMPLE_SZ;
+    for (i = 0; i < VC_SAMPLE_CNT && rc == 0; i++) {
+        if (blk_cnt == 0) {
+            /* Tiny image: it is cheaper to cover it whole. */
+            rc = bootutil_vc_hash_range(&sha_ctx, hdr, fap, hdr->ih_hdr_size,
+                                        BOOT_TLV_OFF(hdr), tmp_buf,
+                                        tmp_buf_sz);
+            break;
+        }
+        memcpy(&sample, &digest[i * 4], sizeof(sample));
+        blk_off = hdr->ih_hdr_size + (sample % blk_cnt) * VC_SAMPLE_SZ;
+        rc = bootutil_vc_hash_range(&sha_ctx, hdr, fap, blk_off,
+                                    blk_off + VC_SAMPLE_SZ, tmp_buf,
+                                    tmp_buf_sz);
+    }
+    bootutil_sha_finish(&sha_ctx, digest);
+    bootutil_sha_drop(&sha_ctx);
+    if (rc) {
+        goto out;
+    }
+
+    bootutil_vc_hmac_start(&sha_ctx, key, key_len, 0x5c);
+    bootutil_sha_update(&sha_ctx, digest, IMAGE_HASH_SIZE);
+    bootutil_sha_finish(&sha_ctx, rec->tag);
+    bootutil_sha_drop(&sha_ctx);
+
+out:
+    memset(key, 0, sizeof(key));
+    return rc;
+}
+
+#ifdef MCUBOOT_HW_ROLLBACK_PROT
+/*
+ * Check the security counter of an image validated through its cache record
+ * against the stored one, which may have been raised since the record was
+ * written.
+ */
+static fih_ret
+bootutil_vc_check_security_cnt(int image_index, struct image_header *hdr,
+                               const struct flash_area *fap)
+{
+    uint32_t img_security_cnt;
+    fih_int security_cnt = fih_int_encode(INT_MAX);
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+
+    if (bootutil_get_img_security_cnt(hdr, fap, &img_security_cnt) != 0) {
+        FIH_RET(fih_rc);
+    }
+
+    FIH_CALL(boot_nv_security_counter_get, fih_rc, image_index, &security_cnt);
+    if (FIH_NOT_EQ(fih_rc, FIH_SUCCESS)) {
+        FIH_SET(fih_rc, FIH_FAILURE);
+        FIH_RET(fih_rc);
+    }
+
+    fih_rc = fih_ret_encode_zero_equality(img_security_cnt <
+                                          (uint32_t)fih_int_decode(security_cnt));
+    FIH_RET(fih_rc);
+}
+#endif
+
+/*
+ * Validate an image in the primary slot, trusting its validation cache
+ * record when it is intact and matches the image.  Otherwise the image is
+ * fully validated and, if the record area is still erased, a record is
+ * written so the following boots can skip the full validation.  With
+ * MCUBOOT_HW_ROLLBACK_PROT, the security counter of an image trusted through
+ * its record is still checked against the stored one.
+ *
+ * A record is never rewritten: one that does not match (e.g. because it was
+ * tampered with) leaves every boot doing a full validation until the trailer
+ * is erased by the next upgrade.
+ */
+fih_ret
+bootutil_img_validate_cached(struct enc_key_data *enc_state, int image_index,
+                             struct image_header *hdr,
+                             const struct flash_area *fap, uint8_t *tmp_buf,
+                             uint32_t tmp_buf_sz)
+{
+    struct boot_validation_cache rec;
+    struct boot_validation_cache expected;
+    uint8_t hash[IMAGE_HASH_SIZE];
+    int rec_rc;
+    int rc;
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+
+    rec_rc = boot_read_validation_cache(fap, &rec);
+    if (rec_rc == 0) {
+        rc = bootutil_vc_compute(image_index, hdr, fap, rec.hash, &expected,
+                                 tmp_buf, tmp_buf_sz);
+        if (rc == 0) {
+            FIH_CALL(boot_fih_memequal, fih_rc, &expected, &rec,
+                     sizeof(rec));
+            if (FIH_EQ(fih_rc, FIH_SUCCESS)) {
+#ifdef MCUBOOT_HW_ROLLBACK_PROT
+                FIH_CALL(bootutil_vc_check_security_cnt, fih_rc, image_index,
+                         hdr, fap);
+#endif
+                FIH_RET(fih_rc);
+            }
+        }
+    }
+
+    FIH_CALL(bootutil_img_validate, fih_rc, enc_state, image_index, hdr, fap,
+             tmp_buf, tmp_buf_sz, NULL, 0, hash);
+    if (FIH_EQ(fih_rc, FIH_SUCCESS) && rec_rc == 1) {
+        /* A record that fails to be written only costs the next boot
+         * another full validation.
+         */
+        rc = bootutil_vc_compute(image_index, hdr, fap, hash, &rec, tmp_buf,
+                                 tmp_buf_sz);
+        if (rc == 0) {
+            (void)boot_write_validation_cache(fap, &rec);
+        }
+    }
+
+    FIH_RET(fih_rc);
+}
+
+/*
+ * Validate an image in the primary slot against the hash computed as it was
+ * written, as bootutil_img_validate_hashed() does, and write its validation
+ * cache record if the record area is still erased, so the following boots do
+ * not hash it in full either.
+ *
+ * Unlike the result of the validation, the record outlives the upload, so it
+ * is only written once the image read back from the slot is found to have
+ * that hash: a write that failed without reporting it fails the validation
+ * rather than being vouched for.
+ */
+fih_ret
+bootutil_img_validate_cached_hashed(int image_index, struct image_header *hdr,
+                                    const struct flash_area *fap,
+                                    const uint8_t *hash, uint8_t *tmp_buf,
+                                    uint32_t tmp_buf_sz)
+{
+    struct boot_validation_cache rec;
+    uint8_t stored_hash[IMAGE_HASH_SIZE];
+    int rc;
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+
+    FIH_CALL(bootutil_img_validate_hashed, fih_rc, NULL, image_index, hdr,
+             fap, hash);
+    if (FIH_EQ(fih_rc, FIH_SUCCESS) &&
+        boot_read_validation_cache(fap, &rec) == 1) {
+        FIH_SET(fih_rc, FIH_FAILURE);
+        rc = bootutil_img_hash(NULL, image_index, hdr, fap, 0, tmp_buf,
+                               tmp_buf_sz, stored_hash, NULL, 0);
+        if (rc == 0) {
+            FIH_CALL(boot_fih_memequal, fih_rc, stored_hash, hash,
+                     IMAGE_HASH_SIZE);
+        }
+        if (FIH_EQ(fih_rc, FIH_SUCCESS)) {
+            rc = bootutil_vc_compute(image_index, hdr, fap, hash, &rec,
+                                     tmp_buf, tmp_buf_sz);
+            if (rc == 0) {
+                (void)boot_write_validation_cache(fap, &rec);
+            }
+        }
+    }
+
+    FIH_RET(fih_rc);
+}
+#endif /* MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE */
@@ -104,12 +104,30 @@ static struct sector_buffer_t sector_buffers;
 #define TARGET_STATIC
 #endif
 
-#if BOOT_MAX_ALIGN > 1024
+#if defined(MCUBOOT_COPY_BUF_SIZE)
+#define BUF_SZ MCUBOOT_COPY_BUF_SIZE
+#elif BOOT_MAX_ALIGN > 1024
 #define BUF_SZ BOOT_MAX_ALIGN
 #else
 #define BUF_SZ 1024
 #endif
 
+#if (BUF_SZ < BOOT_MAX_ALIGN) || (BUF_SZ % BOOT_MAX_ALIGN != 0)
+#error "MCUBOOT_COPY_BUF_SIZE must be a multiple of the flash write alignment"
+#endif
+
+#if defined(MCUBOOT_FLASH_PAGE_SIZE) && \
+    (MCUBOOT_FLASH_PAGE_SIZE % BOOT_MAX_ALIGN != 0)
+#error "MCUBOOT_FLASH_PAGE_SIZE must be a multiple of the flash write alignment"
+#endif
+
+#ifdef MCUBOOT_USE_FLASH_AREA_ASYNC_READ
+/* Room for two chunks: one is read while the other is written out. */
+#define COPY_BUF_SZ (2 * BUF_SZ)
+#else
+#define COPY_BUF_SZ BUF_SZ
+#endif
+
 static int
 boot_read_image_headers(struct boot_loader_state *state, bool require_all,
         struct boot_status *bs)
@@ -118,6 +136,9 @@ boot_read_image_headers(struct boot_loader_state *state, bool require_all,
     int i;
 
     for (i = 0; i < BOOT_NUM_SLOTS; i++) {
+#ifdef MCUBOOT_TLV_INDEX
+        BOOT_IMG(state, i).tlv_index.status = BOOT_TLV_INDEX_EMPTY;
+#endif
         rc = BOOT_HOOK_CALL(boot_read_image_header_hook, BOOT_HOOK_REGULAR,
                             BOOT_CURR_IMG(state), i, boot_img_hdr(state, i));
         if (rc == BOOT_HOOK_REGULAR)
@@ -545,7 +566,8 @@ boot_verify_slot_dependencies(struct boot_loader_state *state, uint32_t slot)
         goto done;
     }
 
-    rc = bootutil_tlv_iter_begin(&it, boot_img_hdr(state, slot), fap,
+    rc = bootutil_tlv_iter_begin_at(&it, boot_img_hdr(state, slot), fap,
+            boot_get_state_secondary_offset(state, fap),
             IMAGE_TLV_DEPENDENCY, true);
     if (rc != 0) {
         goto done;
@@ -668,6 +690,15 @@ boot_status_reset(struct boot_status *bs)
     bs->use_scratch = 0;
     bs->swap_size = 0;
     bs->source = 0;
+#ifdef MCUBOOT_COPY_SKIP_UNCHANGED
+    bs->copied = 0;
+#endif
+#ifdef MCUBOOT_SWAP_MOVE_STATUS_BATCH
+    bs->batched = 0;
+#endif
+#ifdef MCUBOOT_PARALLEL_UPGRADES
+    bs->swapped = 0;
+#endif
 
     bs->op = BOOT_STATUS_OP_MOVE;
     bs->idx = BOOT_STATUS_IDX_0;
@@ -748,6 +779,42 @@ boot_write_status(const struct boot_loader_state *state, struct boot_status *bs)
 #endif /* !MCUBOOT_RAM_LOAD */
 #endif /* !MCUBOOT_DIRECT_XIP */
 
+/*
+ * Buffer lent by the port for hashing images, see boot_set_hash_arena().
+ */
+#if defined(__BOOTSIM__)
+static __thread uint8_t *boot_hash_arena;
+static __thread uint32_t boot_hash_arena_sz;
+#else
+static uint8_t *boot_hash_arena;
+static uint32_t boot_hash_arena_sz;
+#endif
+
+void
+boot_set_hash_arena(uint8_t *buf, uint32_t len)
+{
+    boot_hash_arena = buf;
+    boot_hash_arena_sz = (buf != NULL) ? len : 0;
+}
+
+/*
+ * Buffer lent by the port for copying images, see boot_set_copy_arena().
+ */
+#if defined(__BOOTSIM__)
+static __thread uint8_t *boot_copy_arena;
+static __thread uint32_t boot_copy_arena_sz;
+#else
+static uint8_t *boot_copy_arena;
+static uint32_t boot_copy_arena_sz;
+#endif
+
+void
+boot_set_copy_arena(uint8_t *buf, uint32_t len)
+{
+    boot_copy_arena = buf;
+    boot_copy_arena_sz = (buf != NULL) ? len : 0;
+}
+
 /*
  * Validate image hash/signature and optionally the security counter in a slot.
  */
@@ -756,6 +823,8 @@ boot_image_check(struct boot_loader_state *state, struct image_header *hdr,
                  const struct flash_area *fap, struct boot_status *bs)
 {
     TARGET_STATIC uint8_t tmpbuf[BOOT_TMPBUF_SZ];
+    uint8_t *buf = tmpbuf;
+    uint32_t buf_sz = BOOT_TMPBUF_SZ;
     int rc;
     FIH_DECLARE(fih_rc, FIH_FAILURE);
 
@@ -780,8 +849,25 @@ boot_image_check(struct boot_loader_state *state, struct image_header *hdr,
     }
 #endif
 
-    FIH_CALL(bootutil_img_validate, fih_rc, BOOT_CURR_ENC(state),
-             BOOT_CURR_IMG(state), hdr, fap, tmpbuf, BOOT_TMPBUF_SZ,
+    /* Only prefer the arena when it actually saves flash reads. */
+    if (boot_hash_arena_sz > BOOT_TMPBUF_SZ) {
+        buf = boot_hash_arena;
+        buf_sz = boot_hash_arena_sz;
+    }
+
+#ifdef MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE
+    /* Outside of an upgrade, the primary slot may vouch for itself. */
+    if (bs == NULL && flash_area_get_id(fap) ==
+                      FLASH_AREA_IMAGE_PRIMARY(BOOT_CURR_IMG(state))) {
+        FIH_CALL(bootutil_img_validate_cached, fih_rc, BOOT_CURR_ENC(state),
+                 BOOT_CURR_IMG(state), hdr, fap, buf, buf_sz);
+        FIH_RET(fih_rc);
+    }
+#endif
+
+    FIH_CALL(bootutil_img_validate_at, fih_rc, BOOT_CURR_ENC(state),
+             BOOT_CURR_IMG(state), hdr, fap,
+             boot_get_state_secondary_offset(state, fap), buf, buf_sz,
              NULL, 0, NULL);
 
     FIH_RET(fih_rc);
@@ -853,6 +939,11 @@ boot_is_header_valid(const struct image_header *hdr, const struct flash_area *fa
         }
     }
 
+    if (!boot_u32_safe_add(&size, size,
+                           boot_get_state_secondary_offset(state, fap))) {
+        return false;
+    }
+
     if (size >= flash_area_get_size(fap)) {
         return false;
     }
@@ -879,6 +970,29 @@ boot_is_header_valid(const struct image_header *hdr, const struct flash_area *fa
     {
         return false;
     }
+
+    /* Only an upgrade may be compressed, with LZMA2, and not encrypted. */
+    if (IS_COMPRESSED(hdr) &&
+        (!MUST_DECOMPRESS(fap, BOOT_CURR_IMG(state), hdr) ||
+         !(hdr->ih_flags & IMAGE_F_COMPRESSED_LZMA2) || IS_ENCRYPTED(hdr)))
+    {
+        return false;
+    }
+#endif
+
+#if !defined(MCUBOOT_DELTA_IMAGES)
+    if (IS_DELTA(hdr)) {
+        return false;
+    }
+#else
+    /* Only an upgrade may be a delta image, and it is neither encrypted nor
+     * compressed. */
+    if (IS_DELTA(hdr) &&
+        (flash_area_get_id(fap) != FLASH_AREA_IMAGE_SECONDARY(BOOT_CURR_IMG(state)) ||
+         IS_ENCRYPTED(hdr) || IS_COMPRESSED(hdr)))
+    {
+        return false;
+    }
 #endif
 
     return true;
@@ -991,7 +1105,8 @@ boot_validate_slot(struct boot_loader_state *state, int slot,
     if (boot_check_header_erased(state, slot) == 0 ||
         (hdr->ih_flags & IMAGE_F_NON_BOOTABLE)) {
 
-#if defined(MCUBOOT_SWAP_USING_SCRATCH) || defined(MCUBOOT_SWAP_USING_MOVE)
+#if defined(MCUBOOT_SWAP_USING_SCRATCH) || defined(MCUBOOT_SWAP_USING_MOVE) || \
+    defined(MCUBOOT_SWAP_USING_OFFSET)
         /*
          * This fixes an issue where an image might be erased, but a trailer
          * be left behind. It can happen if the image is in the secondary slot
@@ -1053,6 +1168,42 @@ boot_validate_slot(struct boot_loader_state *state, int slot,
         goto out;
     }
 
+#ifdef MCUBOOT_DELTA_IMAGES
+    if (slot != BOOT_PRIMARY_SLOT && IS_DELTA(hdr)) {
+        /* The image the patch applies to must be the valid image in the
+         * primary slot, unless it is already being patched. */
+        rc = boot_delta_check_base(state);
+        if (rc == 0) {
+            FIH_CALL(boot_image_check, fih_rc, state,
+                     boot_img_hdr(state, BOOT_PRIMARY_SLOT),
+                     BOOT_IMG_AREA(state, BOOT_PRIMARY_SLOT), NULL);
+        } else if (rc != 1) {
+            fih_rc = FIH_FAILURE;
+        }
+        if (FIH_NOT_EQ(fih_rc, FIH_SUCCESS)) {
+            BOOT_LOG_ERR("Delta image does not apply to the primary slot");
+            flash_area_erase(fap, 0, flash_area_get_size(fap));
+            fih_rc = FIH_NO_BOOTABLE_IMAGE;
+            goto out;
+        }
+    }
+#endif
+
+#ifdef MCUBOOT_DECOMPRESS_IMAGES
+    if (slot != BOOT_PRIMARY_SLOT && IS_COMPRESSED(hdr)) {
+        /* Check before the primary slot is erased that the image can be
+         * decompressed and fits there. */
+        uint32_t decomp_size;
+
+        if (boot_decompress_size(state, &decomp_size) != 0) {
+            BOOT_LOG_ERR("Compressed image does not fit the primary slot");
+            flash_area_erase(fap, 0, flash_area_get_size(fap));
+            fih_rc = FIH_NO_BOOTABLE_IMAGE;
+            goto out;
+        }
+    }
+#endif
+
 #if MCUBOOT_IMAGE_NUMBER > 1 && !defined(MCUBOOT_ENC_IMAGES) && defined(MCUBOOT_VERIFY_IMG_ADDRESS)
     /* Verify that the image in the secondary slot has a reset address
      * located in the primary slot. This is done to avoid users incorrectly
@@ -1063,7 +1214,8 @@ boot_validate_slot(struct boot_loader_state *state, int slot,
         const struct flash_area *pri_fa = BOOT_IMG_AREA(state, BOOT_PRIMARY_SLOT);
         struct image_header *secondary_hdr = boot_img_hdr(state, slot);
         uint32_t reset_value = 0;
-        uint32_t reset_addr = secondary_hdr->ih_hdr_size + sizeof(reset_value);
+        uint32_t reset_addr = boot_get_state_secondary_offset(state, fap) +
+                              secondary_hdr->ih_hdr_size + sizeof(reset_value);
 
         rc = flash_area_read(fap, reset_addr, &reset_value, sizeof(reset_value));
         if (rc != 0) {
@@ -1206,6 +1358,38 @@ static void like_mbedtls_zeroize(void *p, size_t n)
 }
 #endif
 
+/*
+ * Returns the number of bytes to copy next, at most buf_sz.  With
+ * MCUBOOT_FLASH_PAGE_SIZE, a chunk that is not the last one is cut short so it
+ * ends on a page boundary of the destination; every later chunk then programs
+ * whole pages.
+ */
+static uint32_t
+boot_copy_chunk_sz(uint32_t off_dst, uint32_t left, uint32_t buf_sz)
+{
+    uint32_t chunk_sz;
+#ifdef MCUBOOT_FLASH_PAGE_SIZE
+    uint32_t end;
+#endif
+
+    if (left <= buf_sz) {
+        return left;
+    }
+    chunk_sz = buf_sz;
+
+#ifdef MCUBOOT_FLASH_PAGE_SIZE
+    end = off_dst + chunk_sz;
+    end -= end % MCUBOOT_FLASH_PAGE_SIZE;
+    if (end > off_dst) {
+        chunk_sz = end - off_dst;
+    }
+#else
+    (void)off_dst;
+#endif
+
+    return chunk_sz;
+}
+
 /**
  * Copies the contents of one flash region to another.  You must erase the
  * destination region prior to calling this function.
@@ -1227,7 +1411,8 @@ boot_copy_region(struct boot_loader_state *state,
                  uint32_t off_src, uint32_t off_dst, uint32_t sz)
 {
     uint32_t bytes_copied;
-    int chunk_sz;
+    uint32_t chunk_sz;
+    bool write_chunk = true;
     int rc;
 #ifdef MCUBOOT_ENC_IMAGES
     uint32_t off = off_dst;
@@ -1252,7 +1437,24 @@ boot_copy_region(struct boot_loader_state *state,
     (void)state;
 #endif
 
-    TARGET_STATIC uint8_t buf[BUF_SZ] __attribute__((aligned(4)));
+    TARGET_STATIC uint8_t copy_buf[COPY_BUF_SZ] __attribute__((aligned(4)));
+    uint8_t *buf = copy_buf;
+    uint32_t buf_sz = BUF_SZ;
+    uint8_t *cur_buf;
+#ifdef MCUBOOT_USE_FLASH_AREA_ASYNC_READ
+    uint32_t next_chunk_sz = 0;
+#endif
+
+    if (boot_copy_arena_sz > COPY_BUF_SZ) {
+        buf = boot_copy_arena;
+#ifdef MCUBOOT_USE_FLASH_AREA_ASYNC_READ
+        buf_sz = boot_copy_arena_sz / 2;
+#else
+        buf_sz = boot_copy_arena_sz;
+#endif
+        buf_sz -= buf_sz % BOOT_MAX_ALIGN;
+    }
+    cur_buf = buf;
 
 #ifdef MCUBOOT_ENC_IMAGES
     encrypted_src = (flash_area_get_id(fap_src) != FLASH_AREA_IMAGE_PRIMARY(image_index));
@@ -1276,77 +1478,591 @@ boot_copy_region(struct boot_loader_state *state,
     }
 #endif
 
-    bytes_copied = 0;
-    while (bytes_copied < sz) {
-        if (sz - bytes_copied > sizeof buf) {
-            chunk_sz = sizeof buf;
-        } else {
-            chunk_sz = sz - bytes_copied;
-        }
+    bytes_copied = 0;
+#ifdef MCUBOOT_USE_FLASH_AREA_ASYNC_READ
+    chunk_sz = boot_copy_chunk_sz(off_dst, sz, buf_sz);
+    if (chunk_sz > 0) {
+        rc = flash_area_read_submit(fap_src, off_src, cur_buf, chunk_sz);
+        if (rc != 0) {
+            return BOOT_EFLASH;
+        }
+    }
+#endif
+    while (bytes_copied < sz) {
+#ifdef MCUBOOT_USE_FLASH_AREA_ASYNC_READ
+        rc = flash_area_read_wait(fap_src);
+        if (rc != 0) {
+            return BOOT_EFLASH;
+        }
+
+        next_chunk_sz = boot_copy_chunk_sz(off_dst + bytes_copied + chunk_sz,
+                                           sz - bytes_copied - chunk_sz,
+                                           buf_sz);
+        if (next_chunk_sz > 0) {
+            rc = flash_area_read_submit(fap_src,
+                                        off_src + bytes_copied + chunk_sz,
+                                        (cur_buf == buf) ? &buf[buf_sz] :
+                                                           buf,
+                                        next_chunk_sz);
+            if (rc != 0) {
+                return BOOT_EFLASH;
+            }
+        }
+#else
+        chunk_sz = boot_copy_chunk_sz(off_dst + bytes_copied,
+                                      sz - bytes_copied, buf_sz);
+
+        rc = flash_area_read(fap_src, off_src + bytes_copied, cur_buf,
+                             chunk_sz);
+        if (rc != 0) {
+            return BOOT_EFLASH;
+        }
+#endif
+
+#ifdef MCUBOOT_ENC_IMAGES
+        /* If only copy, then does not matter if header indicates need for
+         * encryptio/decryptio, we just copy data. */
+        if (!only_copy && IS_ENCRYPTED(hdr)) {
+            uint32_t abs_off = off + bytes_copied;
+            if (abs_off < hdr->ih_hdr_size) {
+                /* do not decrypt header */
+                if (abs_off + chunk_sz > hdr->ih_hdr_size) {
+                    /* The lower part of the chunk contains header data */
+                    blk_off = 0;
+                    blk_sz = chunk_sz - (hdr->ih_hdr_size - abs_off);
+                    idx = hdr->ih_hdr_size  - abs_off;
+                } else {
+                    /* The chunk contains exclusively header data */
+                    blk_sz = 0; /* nothing to decrypt */
+                }
+            } else {
+                idx = 0;
+                blk_sz = chunk_sz;
+                blk_off = (abs_off - hdr->ih_hdr_size) & 0xf;
+            }
+
+            if (blk_sz > 0)
+            {
+                tlv_off = BOOT_TLV_OFF(hdr);
+                if (abs_off + chunk_sz > tlv_off) {
+                    /* do not decrypt TLVs */
+                    if (abs_off >= tlv_off) {
+                        blk_sz = 0;
+                    } else {
+                        blk_sz = tlv_off - abs_off;
+                    }
+                }
+                if (source_slot == 0) {
+                    boot_enc_encrypt(BOOT_CURR_ENC(state), source_slot,
+                            (abs_off + idx) - hdr->ih_hdr_size, blk_sz,
+                            blk_off, &cur_buf[idx]);
+                } else {
+                    boot_enc_decrypt(BOOT_CURR_ENC(state), source_slot,
+                            (abs_off + idx) - hdr->ih_hdr_size, blk_sz,
+                            blk_off, &cur_buf[idx]);
+                }
+            }
+        }
+#endif
+
+#ifdef MCUBOOT_COPY_SKIP_UNCHANGED
+        /* The destination is erased already, so erased data needs no write. */
+        write_chunk = !bootutil_buffer_is_erased(fap_dst, cur_buf, chunk_sz);
+#endif
+        rc = 0;
+        if (write_chunk) {
+            rc = flash_area_write(fap_dst, off_dst + bytes_copied, cur_buf,
+                                  chunk_sz);
+        }
+        if (rc != 0) {
+#ifdef MCUBOOT_USE_FLASH_AREA_ASYNC_READ
+            if (next_chunk_sz > 0) {
+                /* Don't leave a read in flight into buf. */
+                (void)flash_area_read_wait(fap_src);
+            }
+#endif
+            return BOOT_EFLASH;
+        }
+
+        bytes_copied += chunk_sz;
+#ifdef MCUBOOT_USE_FLASH_AREA_ASYNC_READ
+        chunk_sz = next_chunk_sz;
+        cur_buf = (cur_buf == buf) ? &buf[buf_sz] : buf;
+#endif
+
+        MCUBOOT_WATCHDOG_FEED();
+    }
+
+    return 0;
+}
+
+#ifdef MCUBOOT_COPY_SKIP_UNCHANGED
+/**
+ * Checks whether a region already reads as erasing it and copying another
+ * region over it with boot_copy_region() would leave it, so that both can be
+ * skipped.  Copies that encrypt or decrypt are never considered unchanged.
+ *
+ * @param fap_src               The source flash area.
+ * @param fap_dst               The destination flash area.
+ * @param off_src               The offset within the source flash area.
+ * @param off_dst               The offset within the destination flash area.
+ * @param sz                    The number of bytes that would be erased.
+ * @param copy_sz               The number of bytes that would be copied,
+ *                                  at most sz; the rest must read as erased.
+ *
+ * @return                      true if the region is unchanged; false if it
+ *                                  differs or could not be read.
+ */
+bool
+boot_copy_region_unchanged(struct boot_loader_state *state,
+                           const struct flash_area *fap_src,
+                           const struct flash_area *fap_dst,
+                           uint32_t off_src, uint32_t off_dst,
+                           uint32_t sz, uint32_t copy_sz)
+{
+    TARGET_STATIC uint8_t buf[2][BUF_SZ / 2] __attribute__((aligned(4)));
+    uint8_t *src_buf = buf[0];
+    uint8_t *dst_buf = buf[1];
+    uint32_t buf_sz = BUF_SZ / 2;
+    uint32_t off;
+    uint32_t chunk_sz;
+    int rc;
+#ifdef MCUBOOT_ENC_IMAGES
+    uint8_t image_index = BOOT_CURR_IMG(state);
+    bool encrypted_src;
+    bool encrypted_dst;
+    int slot;
+
+    encrypted_src = (flash_area_get_id(fap_src) != FLASH_AREA_IMAGE_PRIMARY(image_index));
+    encrypted_dst = (flash_area_get_id(fap_dst) != FLASH_AREA_IMAGE_PRIMARY(image_index));
+    if (encrypted_src != encrypted_dst) {
+        slot = encrypted_dst ? BOOT_PRIMARY_SLOT : BOOT_SECONDARY_SLOT;
+        if (IS_ENCRYPTED(boot_img_hdr(state, slot))) {
+            return false;
+        }
+    }
+#else
+    (void)state;
+#endif
+
+    if (boot_copy_arena_sz > BUF_SZ) {
+        buf_sz = boot_copy_arena_sz / 2;
+        src_buf = boot_copy_arena;
+        dst_buf = &boot_copy_arena[buf_sz];
+    }
+
+    for (off = 0; off < sz; off += chunk_sz) {
+        if (off < copy_sz) {
+            chunk_sz = (copy_sz - off > buf_sz) ? buf_sz : copy_sz - off;
+        } else {
+            chunk_sz = (sz - off > buf_sz) ? buf_sz : sz - off;
+        }
+
+        rc = flash_area_read(fap_dst, off_dst + off, dst_buf, chunk_sz);
+        if (rc != 0) {
+            return false;
+        }
+
+        if (off < copy_sz) {
+            rc = flash_area_read(fap_src, off_src + off, src_buf, chunk_sz);
+            if (rc != 0 || memcmp(src_buf, dst_buf, chunk_sz) != 0) {
+                return false;
+            }
+        } else if (!bootutil_buffer_is_erased(fap_dst, dst_buf, chunk_sz)) {
+            return false;
+        }
+
+        MCUBOOT_WATCHDOG_FEED();
+    }
+
+    return true;
+}
+#endif /* MCUBOOT_COPY_SKIP_UNCHANGED */
+
+#ifdef MCUBOOT_USE_FLASH_AREA_ASYNC_ERASE
+/*
+ * Starts erasing the sector at off, up to at most sz bytes, and returns the
+ * number of bytes being erased in erase_sz.
+ */
+static int
+boot_erase_sector_submit(const struct flash_area *fap, uint32_t off,
+                         uint32_t sz, uint32_t *erase_sz)
+{
+    struct flash_sector sector;
+    uint32_t end;
+    int rc;
+
+    rc = flash_area_get_sector(fap, off, &sector);
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    end = flash_sector_get_off(&sector) + flash_sector_get_size(&sector);
+    *erase_sz = (end - off < sz) ? end - off : sz;
+
+    rc = flash_area_erase_submit(fap, off, *erase_sz);
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    return 0;
+}
+
+/*
+ * Waits for the erase started with boot_erase_sector_submit() to finish.
+ */
+static int
+boot_erase_sector_wait(const struct flash_area *fap)
+{
+    int rc;
+
+    do {
+        rc = flash_area_erase_poll(fap);
+        MCUBOOT_WATCHDOG_FEED();
+    } while (rc > 0);
+
+    return (rc == 0) ? 0 : BOOT_EFLASH;
+}
+#endif /* MCUBOOT_USE_FLASH_AREA_ASYNC_ERASE */
+
+/**
+ * Erases a region of flash and copies another region to its start.  With
+ * MCUBOOT_USE_FLASH_AREA_ASYNC_ERASE, the region is erased a sector at a
+ * time, each erase being started before the data of the previous sector is
+ * programmed, so both overlap on flash that can.
+ *
+ * A reset may leave any part of the region erased, programmed or as it was,
+ * as it may in the middle of an erase spanning several sectors.
+ *
+ * @param fap_src               The source flash area.
+ * @param fap_dst               The destination flash area.
+ * @param off_src               The offset within the source flash area to
+ *                                  copy from.
+ * @param off_dst               The offset within the destination flash area
+ *                                  of the region to erase and copy to.
+ * @param sz                    The number of bytes to erase.
+ * @param copy_sz               The number of bytes to copy, at most sz.
+ *
+ * @return                      0 on success; nonzero on failure.
+ */
+int
+boot_erase_and_copy_region(struct boot_loader_state *state,
+                           const struct flash_area *fap_src,
+                           const struct flash_area *fap_dst,
+                           uint32_t off_src, uint32_t off_dst,
+                           uint32_t sz, uint32_t copy_sz)
+{
+#ifdef MCUBOOT_USE_FLASH_AREA_ASYNC_ERASE
+    uint32_t done;
+    uint32_t end;
+    uint32_t erase_sz;
+    int rc;
+
+    rc = boot_erase_sector_submit(fap_dst, off_dst, sz, &erase_sz);
+    if (rc != 0) {
+        return rc;
+    }
+
+#ifdef MCUBOOT_PARALLEL_UPGRADES
+    boot_swap_lend(state);
+#endif
+
+    for (done = 0; done < sz; done = end) {
+        rc = boot_erase_sector_wait(fap_dst);
+        if (rc != 0) {
+            return rc;
+        }
+
+        end = done + erase_sz;
+        if (end < sz) {
+            rc = boot_erase_sector_submit(fap_dst, off_dst + end, sz - end,
+                                          &erase_sz);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+
+        if (done < copy_sz) {
+            rc = boot_copy_region(state, fap_src, fap_dst, off_src + done,
+                                  off_dst + done,
+                                  ((end < copy_sz) ? end : copy_sz) - done);
+            if (rc != 0) {
+                if (end < sz) {
+                    /* Don't leave an erase in flight. */
+                    (void)boot_erase_sector_wait(fap_dst);
+                }
+                return rc;
+            }
+        }
+    }
+
+    return 0;
+#else
+    int rc;
+
+    rc = boot_erase_region(fap_dst, off_dst, sz);
+    if (rc != 0) {
+        return rc;
+    }
+
+#ifdef MCUBOOT_PARALLEL_UPGRADES
+    boot_swap_lend(state);
+#endif
+
+    return boot_copy_region(state, fap_src, fap_dst, off_src, off_dst,
+                            copy_sz);
+#endif /* MCUBOOT_USE_FLASH_AREA_ASYNC_ERASE */
+}
+
+#if defined(MCUBOOT_OVERWRITE_ONLY) || defined(MCUBOOT_BOOTSTRAP)
+/**
+ * Erase the primary slot ahead of an upgrade; with
+ * MCUBOOT_OVERWRITE_ONLY_FAST, only the sectors a new image of src_size bytes
+ * and the trailer take up.
+ *
+ * @param size                  The number of bytes to copy to the slot.
+ * @param erase_sz_out          If not NULL, the sectors the image is copied
+ *                                  to are left for the caller to erase, and
+ *                                  this is set to the number of bytes they
+ *                                  span from the start of the slot.
+ */
+static void
+boot_erase_primary_slot(struct boot_loader_state *state,
+                        const struct flash_area *fap_primary_slot,
+                        uint32_t src_size, size_t *size_out,
+                        uint32_t *erase_sz_out)
+{
+    size_t sect_count;
+    size_t sect;
+    int rc;
+    size_t size;
+    size_t this_size;
+
+#if defined(MCUBOOT_OVERWRITE_ONLY_FAST)
+    uint32_t sector;
+    uint32_t trailer_sz;
+    uint32_t off;
+    uint32_t sz;
+#else
+    (void)src_size;
+#endif
+
+    BOOT_LOG_INF("Erasing the primary slot");
+
+    sect_count = boot_img_num_sectors(state, BOOT_PRIMARY_SLOT);
+    for (sect = 0, size = 0; sect < sect_count; sect++) {
+        this_size = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, sect);
+        if (erase_sz_out == NULL) {
+            rc = boot_erase_region(fap_primary_slot, size, this_size);
+            assert(rc == 0);
+        } else {
+            *erase_sz_out = size + this_size;
+        }
+
+#if defined(MCUBOOT_OVERWRITE_ONLY_FAST)
+        if ((size + this_size) >= src_size) {
+            size += src_size - size;
+            size += BOOT_WRITE_SZ(state) - (size % BOOT_WRITE_SZ(state));
+            break;
+        }
+#endif
+
+        size += this_size;
+    }
+
+#if defined(MCUBOOT_OVERWRITE_ONLY_FAST)
+    trailer_sz = boot_trailer_sz(BOOT_WRITE_SZ(state));
+    sector = boot_img_num_sectors(state, BOOT_PRIMARY_SLOT) - 1;
+    sz = 0;
+    do {
+        sz += boot_img_sector_size(state, BOOT_PRIMARY_SLOT, sector);
+        off = boot_img_sector_off(state, BOOT_PRIMARY_SLOT, sector);
+        sector--;
+    } while (sz < trailer_sz);
+
+    rc = boot_erase_region(fap_primary_slot, off, sz);
+    assert(rc == 0);
+#endif
+
+    *size_out = size;
+}
+
+/**
+ * Erase the primary slot and copy the image in the secondary slot to it.
+ *
+ * @param size                  On success, the number of bytes copied.
+ *
+ * @return                      0 on success; nonzero on failure.
+ */
+static int
+boot_overwrite_slot(struct boot_loader_state *state, struct boot_status *bs,
+                    const struct flash_area *fap_primary_slot,
+                    const struct flash_area *fap_secondary_slot,
+                    size_t *size_out)
+{
+    uint32_t src_size = 0;
+    size_t size;
+    int rc;
+#ifdef MCUBOOT_USE_FLASH_AREA_ASYNC_ERASE
+    uint32_t erase_sz;
+#endif
+
+    (void)bs;
+
+#if defined(MCUBOOT_OVERWRITE_ONLY_FAST)
+    rc = boot_read_image_size(state, BOOT_SECONDARY_SLOT, &src_size);
+    assert(rc == 0);
+#endif
+
+#ifdef MCUBOOT_USE_FLASH_AREA_ASYNC_ERASE
+    /* The sectors are erased along with the copy, a sector ahead of it. */
+    boot_erase_primary_slot(state, fap_primary_slot, src_size, &size,
+                            &erase_sz);
+#else
+    boot_erase_primary_slot(state, fap_primary_slot, src_size, &size, NULL);
+#endif
+
+#ifdef MCUBOOT_ENC_IMAGES
+    if (IS_ENCRYPTED(boot_img_hdr(state, BOOT_SECONDARY_SLOT))) {
+        rc = boot_enc_load(BOOT_CURR_ENC(state), BOOT_SECONDARY_SLOT,
+                boot_img_hdr(state, BOOT_SECONDARY_SLOT),
+                fap_secondary_slot, bs);
+
+        if (rc < 0) {
+            return BOOT_EBADIMAGE;
+        }
+        if (rc == 0 && boot_enc_set_key(BOOT_CURR_ENC(state), 1, bs)) {
+            return BOOT_EBADIMAGE;
+        }
+    }
+#endif
+
+    BOOT_LOG_INF("Image %d copying the secondary slot to the primary slot: 0x%zx bytes",
+                 BOOT_CURR_IMG(state), size);
+#ifdef MCUBOOT_USE_FLASH_AREA_ASYNC_ERASE
+    rc = boot_erase_and_copy_region(state, fap_secondary_slot,
+                                    fap_primary_slot, 0, 0, erase_sz, size);
+#else
+    rc = boot_copy_region(state, fap_secondary_slot, fap_primary_slot, 0, 0, size);
+#endif
+    if (rc != 0) {
+        return rc;
+    }
+
+    *size_out = size;
+
+    return 0;
+}
+
+#if defined(MCUBOOT_DELTA_IMAGES) || defined(MCUBOOT_DECOMPRESS_IMAGES)
+/**
+ * Read the header of the image rebuilt in the primary slot from a delta or
+ * compressed image, and check that image.
+ *
+ * @return                      0 if it is valid; nonzero otherwise.
+ */
+static int
+boot_check_rebuilt_slot(struct boot_loader_state *state, struct boot_status *bs,
+                        const struct flash_area *fap_primary_slot)
+{
+    struct image_header *hdr;
+    int rc;
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+
+    hdr = boot_img_hdr(state, BOOT_PRIMARY_SLOT);
+    rc = boot_read_image_header(state, BOOT_PRIMARY_SLOT, hdr, NULL);
+    if (rc != 0) {
+        return rc;
+    }
+
+    if (boot_is_header_valid(hdr, fap_primary_slot, state)) {
+        FIH_CALL(boot_image_check, fih_rc, state, hdr, fap_primary_slot, bs);
+    }
+    if (FIH_NOT_EQ(fih_rc, FIH_SUCCESS)) {
+        return BOOT_EBADIMAGE;
+    }
+
+    return 0;
+}
+#endif
+
+#ifdef MCUBOOT_DELTA_IMAGES
+/**
+ * Apply the delta image in the secondary slot to the primary slot, and check
+ * the image it produced.
+ *
+ * @param size                  On success, the size of the new image.
+ *
+ * @return                      0 on success; nonzero on failure.
+ */
+static int
+boot_patch_slot(struct boot_loader_state *state, struct boot_status *bs,
+                const struct flash_area *fap_primary_slot,
+                const struct flash_area *fap_secondary_slot,
+                size_t *size_out)
+{
+    uint32_t size;
+    int rc;
+
+    rc = boot_delta_apply(state, fap_primary_slot, fap_secondary_slot, &size);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = boot_check_rebuilt_slot(state, bs, fap_primary_slot);
+    if (rc != 0) {
+        BOOT_LOG_ERR("Image %d delta image produced an invalid image",
+                     BOOT_CURR_IMG(state));
+        return rc;
+    }
 
-        rc = flash_area_read(fap_src, off_src + bytes_copied, buf, chunk_sz);
-        if (rc != 0) {
-            return BOOT_EFLASH;
-        }
+    *size_out = size;
 
-#ifdef MCUBOOT_ENC_IMAGES
-        /* If only copy, then does not matter if header indicates need for
-         * encryptio/decryptio, we just copy data. */
-        if (!only_copy && IS_ENCRYPTED(hdr)) {
-            uint32_t abs_off = off + bytes_copied;
-            if (abs_off < hdr->ih_hdr_size) {
-                /* do not decrypt header */
-                if (abs_off + chunk_sz > hdr->ih_hdr_size) {
-                    /* The lower part of the chunk contains header data */
-                    blk_off = 0;
-                    blk_sz = chunk_sz - (hdr->ih_hdr_size - abs_off);
-                    idx = hdr->ih_hdr_size  - abs_off;
-                } else {
-                    /* The chunk contains exclusively header data */
-                    blk_sz = 0; /* nothing to decrypt */
-                }
-            } else {
-                idx = 0;
-                blk_sz = chunk_sz;
-                blk_off = (abs_off - hdr->ih_hdr_size) & 0xf;
-            }
+    return 0;
+}
+#endif /* MCUBOOT_DELTA_IMAGES */
 
-            if (blk_sz > 0)
-            {
-                tlv_off = BOOT_TLV_OFF(hdr);
-                if (abs_off + chunk_sz > tlv_off) {
-                    /* do not decrypt TLVs */
-                    if (abs_off >= tlv_off) {
-                        blk_sz = 0;
-                    } else {
-                        blk_sz = tlv_off - abs_off;
-                    }
-                }
-                if (source_slot == 0) {
-                    boot_enc_encrypt(BOOT_CURR_ENC(state), source_slot,
-                            (abs_off + idx) - hdr->ih_hdr_size, blk_sz,
-                            blk_off, &buf[idx]);
-                } else {
-                    boot_enc_decrypt(BOOT_CURR_ENC(state), source_slot,
-                            (abs_off + idx) - hdr->ih_hdr_size, blk_sz,
-                            blk_off, &buf[idx]);
-                }
-            }
-        }
-#endif
+#ifdef MCUBOOT_DECOMPRESS_IMAGES
+/**
+ * Erase the primary slot and decompress the compressed image in the
+ * secondary slot to it, then check the image it produced.
+ *
+ * @param size                  On success, the size of the new image.
+ *
+ * @return                      0 on success; nonzero on failure.
+ */
+static int
+boot_decompress_slot(struct boot_loader_state *state, struct boot_status *bs,
+                     const struct flash_area *fap_primary_slot,
+                     const struct flash_area *fap_secondary_slot,
+                     size_t *size_out)
+{
+    uint32_t size;
+    size_t erased;
+    int rc;
 
-        rc = flash_area_write(fap_dst, off_dst + bytes_copied, buf, chunk_sz);
-        if (rc != 0) {
-            return BOOT_EFLASH;
-        }
+    rc = boot_decompress_size(state, &size);
+    if (rc != 0) {
+        return BOOT_EBADIMAGE;
+    }
 
-        bytes_copied += chunk_sz;
+    boot_erase_primary_slot(state, fap_primary_slot, size, &erased, NULL);
 
-        MCUBOOT_WATCHDOG_FEED();
+    rc = boot_decompress_image(state, fap_primary_slot, fap_secondary_slot);
+    if (rc == 0) {
+        rc = boot_check_rebuilt_slot(state, bs, fap_primary_slot);
+    }
+    if (rc != 0) {
+        BOOT_LOG_ERR("Image %d compressed image produced an invalid image",
+                     BOOT_CURR_IMG(state));
+        return rc;
     }
 
+    *size_out = size;
+
     return 0;
 }
+#endif /* MCUBOOT_DECOMPRESS_IMAGES */
 
 /**
  * Overwrite primary slot with the image contained in the secondary slot.
@@ -1361,39 +2077,25 @@ boot_copy_region(struct boot_loader_state *state,
  *
  * @return                      0 on success; nonzero on failure.
  */
-#if defined(MCUBOOT_OVERWRITE_ONLY) || defined(MCUBOOT_BOOTSTRAP)
 static int
 boot_copy_image(struct boot_loader_state *state, struct boot_status *bs)
 {
-    size_t sect_count;
-    size_t sect;
     int rc;
     size_t size;
-    size_t this_size;
     size_t last_sector;
     const struct flash_area *fap_primary_slot;
     const struct flash_area *fap_secondary_slot;
     uint8_t image_index;
-
-#if defined(MCUBOOT_OVERWRITE_ONLY_FAST)
-    uint32_t sector;
-    uint32_t trailer_sz;
-    uint32_t off;
-    uint32_t sz;
+    int hdr_slot = BOOT_SECONDARY_SLOT;
+#ifdef MCUBOOT_DELTA_IMAGES
+    bool delta;
 #endif
 
-    (void)bs;
-
-#if defined(MCUBOOT_OVERWRITE_ONLY_FAST)
-    uint32_t src_size = 0;
-    rc = boot_read_image_size(state, BOOT_SECONDARY_SLOT, &src_size);
-    assert(rc == 0);
-#endif
+    (void)hdr_slot;
 
     image_index = BOOT_CURR_IMG(state);
 
     BOOT_LOG_INF("Image %d upgrade secondary slot -> primary slot", image_index);
-    BOOT_LOG_INF("Erasing the primary slot");
 
     rc = flash_area_open(FLASH_AREA_IMAGE_PRIMARY(image_index),
             &fap_primary_slot);
@@ -1403,55 +2105,25 @@ boot_copy_image(struct boot_loader_state *state, struct boot_status *bs)
             &fap_secondary_slot);
     assert (rc == 0);
 
-    sect_count = boot_img_num_sectors(state, BOOT_PRIMARY_SLOT);
-    for (sect = 0, size = 0; sect < sect_count; sect++) {
-        this_size = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, sect);
-        rc = boot_erase_region(fap_primary_slot, size, this_size);
-        assert(rc == 0);
-
-#if defined(MCUBOOT_OVERWRITE_ONLY_FAST)
-        if ((size + this_size) >= src_size) {
-            size += src_size - size;
-            size += BOOT_WRITE_SZ(state) - (size % BOOT_WRITE_SZ(state));
-            break;
-        }
+#ifdef MCUBOOT_DELTA_IMAGES
+    delta = IS_DELTA(boot_img_hdr(state, BOOT_SECONDARY_SLOT));
+    if (delta) {
+        rc = boot_patch_slot(state, bs, fap_primary_slot, fap_secondary_slot,
+                             &size);
+        hdr_slot = BOOT_PRIMARY_SLOT;
+    } else
 #endif
-
-        size += this_size;
-    }
-
-#if defined(MCUBOOT_OVERWRITE_ONLY_FAST)
-    trailer_sz = boot_trailer_sz(BOOT_WRITE_SZ(state));
-    sector = boot_img_num_sectors(state, BOOT_PRIMARY_SLOT) - 1;
-    sz = 0;
-    do {
-        sz += boot_img_sector_size(state, BOOT_PRIMARY_SLOT, sector);
-        off = boot_img_sector_off(state, BOOT_PRIMARY_SLOT, sector);
-        sector--;
-    } while (sz < trailer_sz);
-
-    rc = boot_erase_region(fap_primary_slot, off, sz);
-    assert(rc == 0);
+#ifdef MCUBOOT_DECOMPRESS_IMAGES
+    if (IS_COMPRESSED(boot_img_hdr(state, BOOT_SECONDARY_SLOT))) {
+        rc = boot_decompress_slot(state, bs, fap_primary_slot,
+                                  fap_secondary_slot, &size);
+        hdr_slot = BOOT_PRIMARY_SLOT;
+    } else
 #endif
-
-#ifdef MCUBOOT_ENC_IMAGES
-    if (IS_ENCRYPTED(boot_img_hdr(state, BOOT_SECONDARY_SLOT))) {
-        rc = boot_enc_load(BOOT_CURR_ENC(state), BOOT_SECONDARY_SLOT,
-                boot_img_hdr(state, BOOT_SECONDARY_SLOT),
-                fap_secondary_slot, bs);
-
-        if (rc < 0) {
-            return BOOT_EBADIMAGE;
-        }
-        if (rc == 0 && boot_enc_set_key(BOOT_CURR_ENC(state), 1, bs)) {
-            return BOOT_EBADIMAGE;
-        }
+    {
+        rc = boot_overwrite_slot(state, bs, fap_primary_slot,
+                                 fap_secondary_slot, &size);
     }
-#endif
-
-    BOOT_LOG_INF("Image %d copying the secondary slot to the primary slot: 0x%zx bytes",
-                 image_index, size);
-    rc = boot_copy_region(state, fap_secondary_slot, fap_primary_slot, 0, 0, size);
     if (rc != 0) {
         return rc;
     }
@@ -1473,16 +2145,25 @@ boot_copy_image(struct boot_loader_state *state, struct boot_status *bs)
     /* Update the stored security counter with the new image's security counter
      * value. Both slots hold the new image at this point, but the secondary
      * slot's image header must be passed since the image headers in the
-     * boot_data structure have not been updated yet.
+     * boot_data structure have not been updated yet, unless the new image was
+     * rebuilt from a delta or compressed image and its header read back.
      */
     rc = boot_update_security_counter(BOOT_CURR_IMG(state), BOOT_PRIMARY_SLOT,
-                                boot_img_hdr(state, BOOT_SECONDARY_SLOT));
+                                boot_img_hdr(state, hdr_slot));
     if (rc != 0) {
         BOOT_LOG_ERR("Security counter update failed after image upgrade.");
         return rc;
     }
 #endif /* MCUBOOT_HW_ROLLBACK_PROT */
 
+#ifdef MCUBOOT_DELTA_IMAGES
+    if (delta) {
+        /* Forgetting the progress also cancels the upgrade. */
+        rc = boot_delta_clear_progress(state, fap_secondary_slot);
+        assert(rc == 0);
+    }
+#endif
+
 #ifndef MCUBOOT_OVERWRITE_ONLY_KEEP_BACKUP
     /*
      * Erases header and trailer. The trailer is erased because when a new
@@ -1637,8 +2318,18 @@ boot_swap_image(struct boot_loader_state *state, struct boot_status *bs)
         flash_area_close(fap);
     }
 
+#ifdef MCUBOOT_PARALLEL_UPGRADES
+    if (!bs->swapped)
+#endif
     swap_run(state, bs, copy_size);
 
+#ifdef MCUBOOT_PARALLEL_UPGRADES
+    if (boot_swap_lent(state)) {
+        /* The swap is finished in the turn of this image. */
+        return 0;
+    }
+#endif
+
 #ifdef MCUBOOT_VALIDATE_PRIMARY_SLOT
     extern int boot_status_fails;
     if (boot_status_fails > 0) {
@@ -1921,7 +2612,8 @@ boot_prepare_image_for_update(struct boot_loader_state *state,
         }
 #endif
 
-#if defined(MCUBOOT_SWAP_USING_SCRATCH) || defined(MCUBOOT_SWAP_USING_MOVE)
+#if defined(MCUBOOT_SWAP_USING_SCRATCH) || defined(MCUBOOT_SWAP_USING_MOVE) || \
+    defined(MCUBOOT_SWAP_USING_OFFSET)
         /*
          * Must re-read image headers because the boot status might
          * have been updated in the previous function call.
@@ -2083,7 +2775,8 @@ static int
 check_downgrade_prevention(struct boot_loader_state *state)
 {
 #if defined(MCUBOOT_DOWNGRADE_PREVENTION) && \
-    (defined(MCUBOOT_SWAP_USING_MOVE) || defined(MCUBOOT_SWAP_USING_SCRATCH))
+    (defined(MCUBOOT_SWAP_USING_MOVE) || defined(MCUBOOT_SWAP_USING_SCRATCH) || \
+     defined(MCUBOOT_SWAP_USING_OFFSET))
     uint32_t security_counter[2];
     int rc;
 
@@ -2097,9 +2790,11 @@ check_downgrade_prevention(struct boot_loader_state *state)
         }
         /* If there is no security counter in slot 1, or it's lower than
          * that of slot 0, prevent downgrade */
-        rc = bootutil_get_img_security_cnt(&(BOOT_IMG(state, 1).hdr),
-                                           BOOT_IMG(state, 1).area,
-                                           &security_counter[1]);
+        rc = bootutil_get_img_security_cnt_at(&(BOOT_IMG(state, 1).hdr),
+                    BOOT_IMG(state, 1).area,
+                    boot_get_state_secondary_offset(state,
+                                                    BOOT_IMG(state, 1).area),
+                    &security_counter[1]);
         if (rc != 0 || security_counter[0] > security_counter[1]) {
             rc = -1;
         }
@@ -2123,6 +2818,154 @@ check_downgrade_prevention(struct boot_loader_state *state)
 #endif
 }
 
+#ifdef MCUBOOT_PARALLEL_UPGRADES
+void
+boot_swap_lend(struct boot_loader_state *state)
+{
+    struct boot_status *bs;
+    uint8_t image_index;
+    uint32_t steps;
+    uint8_t i;
+    int rc;
+
+    /* Lent operations do not lend any in turn. */
+    if (state->swap_lending) {
+        return;
+    }
+
+    state->swap_lending = true;
+    image_index = BOOT_CURR_IMG(state);
+    steps = state->swap_steps;
+
+    for (i = image_index + 1; i < BOOT_IMAGE_NUMBER; i++) {
+        bs = state->swap_bs[i];
+        if (bs == NULL) {
+            continue;
+        }
+
+        BOOT_CURR_IMG(state) = i;
+        state->swap_steps = 1;
+        state->swap_yielded = false;
+
+        if (boot_status_is_reset(bs)) {
+            rc = boot_swap_image(state, bs);
+            assert(rc == 0);
+            (void)rc;
+        } else {
+            swap_run(state, bs, bs->swap_size);
+        }
+
+        if (!state->swap_yielded) {
+            /* Done, or it could not start: its own turn takes it over. */
+            bs->swapped = 1;
+            state->swap_bs[i] = NULL;
+        }
+    }
+
+    BOOT_CURR_IMG(state) = image_index;
+    state->swap_steps = steps;
+    state->swap_yielded = false;
+    state->swap_lending = false;
+}
+
+/**
+ * Performs the upgrades of all the images, interleaving their swaps.
+ *
+ * Each image takes its turn as with one upgrade after the other, but each
+ * sector erase of its swap lends a sector operation to the swaps of the
+ * later images, so that erases on a flash device overlap the operations on
+ * others.  The images are still left upgraded in turn, which is what
+ * boot_review_image_swap_types() expects of an interrupted upgrade.
+ *
+ * @param state                 Boot loader status information.
+ */
+static void
+boot_perform_parallel_updates(struct boot_loader_state *state)
+{
+    struct boot_status bs[BOOT_IMAGE_NUMBER];
+    uint8_t image_index;
+    int rc;
+
+    /* Which images get swapped is settled before any swap starts, as the
+     * swaps of the later images start along with that of the first one.
+     */
+    IMAGES_ITER(BOOT_CURR_IMG(state)) {
+        image_index = BOOT_CURR_IMG(state);
+        state->swap_bs[image_index] = NULL;
+
+        if (state->img_mask[image_index]) {
+            continue;
+        }
+
+        boot_status_reset(&bs[image_index]);
+        bs[image_index].swap_type = BOOT_SWAP_TYPE(state);
+
+        switch (BOOT_SWAP_TYPE(state)) {
+        case BOOT_SWAP_TYPE_TEST:
+            /* fallthrough */
+        case BOOT_SWAP_TYPE_PERM:
+            if (check_downgrade_prevention(state) != 0) {
+                /* Downgrade prevented */
+                BOOT_SWAP_TYPE(state) = BOOT_SWAP_TYPE_NONE;
+                break;
+            }
+            /* fallthrough */
+        case BOOT_SWAP_TYPE_REVERT:
+#ifdef MCUBOOT_ENC_IMAGES
+            boot_enc_zeroize(BOOT_CURR_ENC(state));
+#endif
+            state->swap_bs[image_index] = &bs[image_index];
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    IMAGES_ITER(BOOT_CURR_IMG(state)) {
+        image_index = BOOT_CURR_IMG(state);
+
+        if (state->img_mask[image_index]) {
+            continue;
+        }
+
+        switch (BOOT_SWAP_TYPE(state)) {
+        case BOOT_SWAP_TYPE_NONE:
+            break;
+
+        case BOOT_SWAP_TYPE_TEST:
+            /* fallthrough */
+        case BOOT_SWAP_TYPE_PERM:
+            /* fallthrough */
+        case BOOT_SWAP_TYPE_REVERT:
+            state->swap_bs[image_index] = NULL;
+            rc = boot_perform_update(state, &bs[image_index]);
+            assert(rc == 0);
+            break;
+
+        case BOOT_SWAP_TYPE_FAIL:
+            /* image_ok needs to be explicitly set to avoid a new revert. */
+            rc = swap_set_image_ok(image_index);
+            if (rc != 0) {
+                BOOT_SWAP_TYPE(state) = BOOT_SWAP_TYPE_PANIC;
+            }
+            break;
+
+        default:
+            BOOT_SWAP_TYPE(state) = BOOT_SWAP_TYPE_PANIC;
+        }
+
+        if (BOOT_SWAP_TYPE(state) == BOOT_SWAP_TYPE_PANIC) {
+            BOOT_LOG_ERR("panic!");
+            assert(0);
+
+            /* Loop forever... */
+            FIH_PANIC;
+        }
+    }
+}
+#endif /* MCUBOOT_PARALLEL_UPGRADES */
+
 fih_ret
 context_boot_go(struct boot_loader_state *state, struct boot_rsp *rsp)
 {
@@ -2154,6 +2997,15 @@ context_boot_go(struct boot_loader_state *state, struct boot_rsp *rsp)
     (void)has_upgrade;
 #endif
 
+#ifdef MCUBOOT_TLV_INDEX
+    boot_tlv_index_attach(state);
+#endif
+
+#ifdef MCUBOOT_PARALLEL_UPGRADES
+    /* Swaps only yield when interleaved. */
+    state->swap_steps = UINT32_MAX;
+#endif
+
     /* Iterate over all the images. By the end of the loop the swap type has
      * to be determined for each image and all aborted swaps have to be
      * completed.
@@ -2246,6 +3098,9 @@ context_boot_go(struct boot_loader_state *state, struct boot_rsp *rsp)
     /* Trigger status change callback with upgrading status */
     mcuboot_status_change(MCUBOOT_STATUS_UPGRADING);
 
+#ifdef MCUBOOT_PARALLEL_UPGRADES
+    boot_perform_parallel_updates(state);
+#else
     /* Iterate over all the images. At this point there are no aborted swaps
      * and the swap types are determined for each image. By the end of the loop
      * all required update operations will have been finished.
@@ -2321,6 +3176,7 @@ context_boot_go(struct boot_loader_state *state, struct boot_rsp *rsp)
             FIH_PANIC;
         }
     }
+#endif /* MCUBOOT_PARALLEL_UPGRADES */
 
     /* Iterate over all the images. At this point all required update operations
      * have finished. By the end of the loop each image in the primary slot will
@@ -2423,6 +3279,9 @@ out:
     memset(&bs, 0, sizeof(struct boot_status));
 #endif
 
+#ifdef MCUBOOT_TLV_INDEX
+    boot_tlv_index_attach(NULL);
+#endif
     close_all_flash_areas(state);
     FIH_RET(fih_rc);
 }
@@ -2841,6 +3700,10 @@ context_boot_go(struct boot_loader_state *state, struct boot_rsp *rsp)
     int rc;
     FIH_DECLARE(fih_rc, FIH_FAILURE);
 
+#ifdef MCUBOOT_TLV_INDEX
+    boot_tlv_index_attach(state);
+#endif
+
     rc = boot_get_slot_usage(state);
     if (rc != 0) {
         goto out;
@@ -2896,6 +3759,9 @@ context_boot_go(struct boot_loader_state *state, struct boot_rsp *rsp)
     fill_rsp(state, rsp);
 
 out:
+#ifdef MCUBOOT_TLV_INDEX
+    boot_tlv_index_attach(NULL);
+#endif
     close_all_flash_areas(state);
 
     if (rc != 0) {
@@ -121,20 +121,12 @@ boot_decrypt_and_copy_image_to_sram(struct boot_loader_state *state,
     /* The flow for the decryption and copy of the image is as follows :
      * 1. The whole image is copied to the RAM (header + payload + TLV).
      * 2. The encryption key is loaded from the TLV in flash.
-     * 3. The image is then decrypted chunk by chunk in RAM (1 chunk
-     * is 1024 bytes). Only the payload section is decrypted.
+     * 3. The payload is then decrypted in place in RAM, in a single pass.
      * 4. The image is authenticated in RAM.
      */
     const struct flash_area *fap_src = NULL;
     struct boot_status bs;
-    uint32_t blk_off;
     uint32_t tlv_off;
-    uint32_t blk_sz;
-    uint32_t bytes_copied = hdr->ih_hdr_size;
-    uint32_t chunk_sz;
-    uint32_t max_sz = 1024;
-    uint16_t idx;
-    uint8_t * cur_dst;
     int area_id;
     int rc;
     uint8_t * ram_dst = (void *)(IMAGE_RAM_BASE + img_dst);
@@ -163,28 +155,10 @@ boot_decrypt_and_copy_image_to_sram(struct boot_loader_state *state,
         goto done;
     }
 
-    /* Starting at the end of the header as the header section is not encrypted */
-    while (bytes_copied < tlv_off) { /* TLV section copied previously */
-        if (src_sz - bytes_copied > max_sz) {
-            chunk_sz = max_sz;
-        } else {
-            chunk_sz = src_sz - bytes_copied;
-        }
-
-        cur_dst = ram_dst + bytes_copied;
-        blk_sz = chunk_sz;
-        idx = 0;
-        blk_off = ((bytes_copied) - hdr->ih_hdr_size) & 0xf;
-        if (bytes_copied + chunk_sz > tlv_off) {
-            /* Going over TLV section
-             * Part of the chunk is encrypted payload */
-            blk_sz = tlv_off - (bytes_copied);
-        }
-        boot_enc_decrypt(BOOT_CURR_ENC(state), slot,
-                (bytes_copied + idx) - hdr->ih_hdr_size, blk_sz,
-                blk_off, cur_dst);
-        bytes_copied += chunk_sz;
-    }
+    /* The header and the TLVs are not encrypted. */
+    boot_enc_decrypt(BOOT_CURR_ENC(state), slot, 0,
+                     tlv_off - hdr->ih_hdr_size, 0,
+                     ram_dst + hdr->ih_hdr_size);
     rc = 0;
 
 done:
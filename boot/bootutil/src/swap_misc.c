@@ -30,7 +30,8 @@
 
 BOOT_LOG_MODULE_DECLARE(mcuboot);
 
-#if defined(MCUBOOT_SWAP_USING_SCRATCH) || defined(MCUBOOT_SWAP_USING_MOVE)
+#if defined(MCUBOOT_SWAP_USING_SCRATCH) || defined(MCUBOOT_SWAP_USING_MOVE) || \
+    defined(MCUBOOT_SWAP_USING_OFFSET)
 int
 swap_erase_trailer_sectors(const struct boot_loader_state *state,
                            const struct flash_area *fap)
@@ -230,5 +231,35 @@ out:
     return rc;
 }
 
+int
+swap_erase_and_copy_region(struct boot_loader_state *state,
+                           struct boot_status *bs,
+                           const struct flash_area *fap_src,
+                           const struct flash_area *fap_dst,
+                           uint32_t off_src, uint32_t off_dst,
+                           uint32_t sz, uint32_t copy_sz)
+{
+#ifdef MCUBOOT_COPY_SKIP_UNCHANGED
+    /* A reset only ever interrupts the first region copied by the following
+     * boot, and a half-programmed or half-erased sector can read back right,
+     * so that one is always copied again.
+     */
+    if (bs->copied &&
+        boot_copy_region_unchanged(state, fap_src, fap_dst, off_src, off_dst,
+                                   sz, copy_sz)) {
+        BOOT_LOG_DBG("unchanged region; fa_id=%d off=0x%lx",
+                     flash_area_get_id(fap_dst), (unsigned long)off_dst);
+        return 0;
+    }
+    bs->copied = 1;
+#else
+    (void)bs;
+#endif
+
+    return boot_erase_and_copy_region(state, fap_src, fap_dst, off_src,
+                                      off_dst, sz, copy_sz);
+}
+
 
-#endif /* defined(MCUBOOT_SWAP_USING_SCRATCH) || defined(MCUBOOT_SWAP_USING_MOVE) */
+#endif /* defined(MCUBOOT_SWAP_USING_SCRATCH) || defined(MCUBOOT_SWAP_USING_MOVE) ||
+          defined(MCUBOOT_SWAP_USING_OFFSET) */
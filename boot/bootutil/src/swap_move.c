@@ -47,25 +47,195 @@ int boot_status_fails = 0;
 #define BOOT_STATUS_ASSERT(x) ASSERT(x)
 #endif
 
-uint32_t
-find_last_idx(struct boot_loader_state *state, uint32_t swap_size)
-{
-    uint32_t sector_sz;
+/*
+ * The slots are swapped a group of sectors at a time: a group spans the
+ * sectors of both slots from an offset where a sector starts in each slot
+ * to the next such offset, so with the same sectors in both slots it is a
+ * single sector.  Before the swap, the image in the primary slot is moved
+ * up by the move distance, which is at least the size of any group and of
+ * any sector of the primary slot below its trailer: neither erasing a group
+ * nor erasing a sector to move data to then ever erases data that has yet
+ * to be copied.
+ */
+struct swap_move_group {
+    size_t pri_idx;
+    size_t sec_idx;
+    uint32_t off;
     uint32_t sz;
-    uint32_t last_idx;
+};
+
+struct swap_move_layout {
+    uint32_t dist;          /* Distance the primary slot is moved up by */
+    uint32_t end;           /* End of the last group swapped */
+    uint32_t groups;        /* Number of groups swapped */
+    uint32_t move_first;    /* First primary slot sector moved to */
+    uint32_t move_last;     /* Last primary slot sector moved to */
+};
+
+static void
+swap_move_group_init(struct swap_move_group *group)
+{
+    memset(group, 0, sizeof *group);
+}
+
+/*
+ * Advances to the next group: returns false once either slot ends.
+ */
+static bool
+swap_move_group_next(const struct boot_loader_state *state,
+                     struct swap_move_group *group)
+{
+    uint32_t pri_end;
+    uint32_t sec_end;
+
+    group->off += group->sz;
+    pri_end = group->off;
+    sec_end = group->off;
+
+    do {
+        if (pri_end <= sec_end) {
+            if (group->pri_idx >= boot_img_num_sectors(state, BOOT_PRIMARY_SLOT)) {
+                return false;
+            }
+            pri_end += boot_img_sector_size(state, BOOT_PRIMARY_SLOT,
+                                            group->pri_idx++);
+        } else {
+            if (group->sec_idx >= boot_img_num_sectors(state, BOOT_SECONDARY_SLOT)) {
+                return false;
+            }
+            sec_end += boot_img_sector_size(state, BOOT_SECONDARY_SLOT,
+                                            group->sec_idx++);
+        }
+    } while (pri_end != sec_end);
+
+    group->sz = pri_end - group->off;
+
+    return true;
+}
+
+/*
+ * Offset of the first sector of the primary slot holding the trailer.
+ */
+static uint32_t
+swap_move_trailer_off(const struct boot_loader_state *state)
+{
+    uint32_t sz = 0;
+    uint32_t trailer_sz;
+    size_t first_trailer_idx;
+
+    trailer_sz = boot_trailer_sz(BOOT_WRITE_SZ(state));
+    first_trailer_idx = boot_img_num_sectors(state, BOOT_PRIMARY_SLOT) - 1;
 
-    sector_sz = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, 0);
-    sz = 0;
-    last_idx = 0;
     while (1) {
-        sz += sector_sz;
-        last_idx++;
-        if (sz >= swap_size) {
+        sz += boot_img_sector_size(state, BOOT_PRIMARY_SLOT, first_trailer_idx);
+        if  (sz >= trailer_sz || first_trailer_idx == 0) {
             break;
         }
+        first_trailer_idx--;
     }
 
-    return last_idx;
+    return boot_img_sector_off(state, BOOT_PRIMARY_SLOT, first_trailer_idx);
+}
+
+/*
+ * Returns the move distance: the size of the largest group or sector of the
+ * primary slot below the trailer, rounded up to the start of a sector of
+ * the primary slot; 0 if no sector starts there.
+ */
+static uint32_t
+swap_move_dist(const struct boot_loader_state *state)
+{
+    struct swap_move_group group;
+    uint32_t trailer_off;
+    uint32_t dist = 0;
+    size_t i;
+
+    trailer_off = swap_move_trailer_off(state);
+
+    for (i = 0; i < boot_img_num_sectors(state, BOOT_PRIMARY_SLOT); i++) {
+        if (boot_img_sector_off(state, BOOT_PRIMARY_SLOT, i) >= trailer_off) {
+            break;
+        }
+        if (boot_img_sector_size(state, BOOT_PRIMARY_SLOT, i) > dist) {
+            dist = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, i);
+        }
+    }
+
+    swap_move_group_init(&group);
+    while (swap_move_group_next(state, &group) &&
+           group.off + group.sz <= trailer_off) {
+        if (group.sz > dist) {
+            dist = group.sz;
+        }
+    }
+
+    for (i = 0; i < boot_img_num_sectors(state, BOOT_PRIMARY_SLOT); i++) {
+        if (boot_img_sector_off(state, BOOT_PRIMARY_SLOT, i) >= dist) {
+            return boot_img_sector_off(state, BOOT_PRIMARY_SLOT, i);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Finds the groups a swap of swap_size bytes spans and the sectors of the
+ * primary slot their data is moved to: returns 0 on success, -1 if the
+ * slots cannot hold that many bytes.
+ */
+static int
+swap_move_get_layout(const struct boot_loader_state *state, uint32_t swap_size,
+                     struct swap_move_layout *layout)
+{
+    struct swap_move_group group;
+    size_t num_sectors;
+    size_t i;
+
+    memset(layout, 0, sizeof *layout);
+
+    layout->dist = swap_move_dist(state);
+    if (layout->dist == 0) {
+        return -1;
+    }
+
+    swap_move_group_init(&group);
+    do {
+        if (!swap_move_group_next(state, &group)) {
+            return -1;
+        }
+        layout->groups++;
+    } while (group.off + group.sz < swap_size);
+    layout->end = group.off + group.sz;
+
+    num_sectors = boot_img_num_sectors(state, BOOT_PRIMARY_SLOT);
+    for (i = 0; i < num_sectors; i++) {
+        if (boot_img_sector_off(state, BOOT_PRIMARY_SLOT, i) == layout->dist) {
+            layout->move_first = i;
+        }
+        if (boot_img_sector_off(state, BOOT_PRIMARY_SLOT, i) <
+            layout->end + layout->dist) {
+            layout->move_last = i;
+        }
+    }
+
+    if (layout->move_last < layout->move_first ||
+        boot_img_sector_off(state, BOOT_PRIMARY_SLOT, num_sectors - 1) +
+        boot_img_sector_size(state, BOOT_PRIMARY_SLOT, num_sectors - 1) <
+        layout->end + layout->dist) {
+        return -1;
+    }
+
+    return 0;
+}
+
+uint32_t
+find_last_idx(struct boot_loader_state *state, uint32_t swap_size)
+{
+    struct swap_move_layout layout;
+
+    (void)swap_move_get_layout(state, swap_size, &layout);
+
+    return layout.groups;
 }
 
 int
@@ -73,9 +243,8 @@ boot_read_image_header(struct boot_loader_state *state, int slot,
                        struct image_header *out_hdr, struct boot_status *bs)
 {
     const struct flash_area *fap;
+    struct swap_move_layout layout;
     uint32_t off;
-    uint32_t sz;
-    uint32_t last_idx;
     uint32_t swap_size;
     int area_id;
     int rc;
@@ -84,6 +253,10 @@ boot_read_image_header(struct boot_loader_state *state, int slot,
     (void)state;
 #endif
 
+#ifdef MCUBOOT_TLV_INDEX
+    BOOT_IMG(state, slot).tlv_index.status = BOOT_TLV_INDEX_EMPTY;
+#endif
+
     off = 0;
     if (bs && !boot_status_is_reset(bs)) {
         boot_find_status(BOOT_CURR_IMG(state), &fap);
@@ -93,21 +266,23 @@ boot_read_image_header(struct boot_loader_state *state, int slot,
         }
         flash_area_close(fap);
 
-        last_idx = find_last_idx(state, swap_size);
-        sz = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, 0);
+        if (swap_move_get_layout(state, swap_size, &layout) != 0) {
+            return BOOT_EBADSTATUS;
+        }
 
         /*
          * Find the correct offset or slot where the image header is expected to
          * be found for the steps where it is moved or swapped.
          */
-        if (bs->op == BOOT_STATUS_OP_MOVE && slot == 0 && bs->idx > last_idx) {
-            off = sz;
+        if (bs->op == BOOT_STATUS_OP_MOVE && slot == 0 &&
+            bs->idx > layout.move_last - layout.move_first + 1) {
+            off = layout.dist;
         } else if (bs->op == BOOT_STATUS_OP_SWAP) {
-            if (bs->idx > 1 && bs->idx <= last_idx) {
+            if (bs->idx > 1 && bs->idx <= layout.groups) {
                 slot = (slot == 0) ? 1 : 0;
             } else if (bs->idx == 1) {
                 if (slot == 0) {
-                    off = sz;
+                    off = layout.dist;
                 } else if (slot == 1 && bs->state == 2) {
                     slot = 0;
                 }
@@ -141,6 +316,494 @@ done:
     return rc;
 }
 
+#ifdef MCUBOOT_SWAP_MOVE_STATUS_BATCH
+#ifdef MCUBOOT_ENC_IMAGES
+#error "MCUBOOT_SWAP_MOVE_STATUS_BATCH is not supported with MCUBOOT_ENC_IMAGES"
+#endif
+
+#define BOOT_STATUS_BATCH   MCUBOOT_SWAP_MOVE_STATUS_BATCH
+#define BOOT_STATUS_BATCHES ((BOOT_MAX_IMG_SECTORS * BOOT_STATUS_STATE_COUNT + \
+                              BOOT_STATUS_BATCH - 1) / BOOT_STATUS_BATCH)
+
+#define FNV_OFFSET_BASIS    2166136261u
+#define FNV_PRIME           16777619u
+
+/*
+ * With MCUBOOT_SWAP_MOVE_STATUS_BATCH, the status area of the primary slot
+ * holds a record per batch of that many sector operations rather than an
+ * entry per operation.  The operations of a swap form a chain: operation n
+ * copies sector C(n) over sector C(n - 1), which operation n - 1 has just
+ * copied (see swap_move_sector()).  A batch is recorded before it starts,
+ * with a digest of the data each of its operations is going to copy.  After
+ * a reset, the sectors of the last recorded batch are hashed, and the swap
+ * resumes after the first operation of the batch that their contents agree
+ * with: every later operation then copies the data it was recorded with,
+ * and the only sector that may hold anything else is the one the next
+ * operation overwrites.
+ */
+struct boot_status_batch {
+    uint32_t hash[BOOT_STATUS_BATCH];
+    uint16_t batch;
+    uint16_t count;
+    uint32_t check;
+};
+
+#if BOOT_STATUS_BATCH < 2 || BOOT_STATUS_BATCHES > UINT16_MAX
+#error "Invalid MCUBOOT_SWAP_MOVE_STATUS_BATCH"
+#endif
+
+static uint32_t
+swap_status_fnv(uint32_t hash, const uint8_t *buf, uint32_t len)
+{
+    while (len-- > 0) {
+        hash = (hash ^ *buf++) * FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/*
+ * Returns sector C(n) of the chain of sector operations of a swap of
+ * last_idx sectors, as its index shifted left by one ORed with its slot.
+ */
+static uint32_t
+swap_move_sector(uint32_t last_idx, uint32_t n)
+{
+    if (n <= last_idx) {
+        /* Moves, from the last sector down to the first. */
+        return ((last_idx - n) << 1) | BOOT_PRIMARY_SLOT;
+    }
+
+    /* Swaps: the secondary slot sector to the primary slot, then the
+     * moved primary slot sector to the secondary slot.
+     */
+    n -= last_idx;
+    return ((n / 2) << 1) | ((n & 1) ? BOOT_SECONDARY_SLOT : BOOT_PRIMARY_SLOT);
+}
+
+static int
+swap_status_hash_sector(struct boot_loader_state *state,
+                        const struct flash_area *fap_pri,
+                        const struct flash_area *fap_sec,
+                        uint32_t sector, uint32_t *hash)
+{
+    const struct flash_area *fap;
+    uint8_t buf[128];
+    uint32_t sz;
+    uint32_t off;
+    uint32_t pos;
+    uint32_t len;
+    int slot;
+    int rc;
+
+    slot = sector & 1;
+    fap = (slot == BOOT_PRIMARY_SLOT) ? fap_pri : fap_sec;
+    off = boot_img_sector_off(state, slot, sector >> 1);
+    sz = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, 0);
+
+    *hash = FNV_OFFSET_BASIS;
+    for (pos = 0; pos < sz; pos += len) {
+        len = (sz - pos > sizeof buf) ? sizeof buf : sz - pos;
+        rc = flash_area_read(fap, off + pos, buf, len);
+        if (rc != 0) {
+            return BOOT_EFLASH;
+        }
+
+        *hash = swap_status_fnv(*hash, buf, len);
+    }
+
+    MCUBOOT_WATCHDOG_FEED();
+
+    return 0;
+}
+
+/*
+ * Number of sector operations of the swap that are done, according to bs.
+ */
+static uint32_t
+swap_status_done(const struct boot_status *bs, uint32_t last_idx)
+{
+    if (bs->op == BOOT_STATUS_OP_MOVE) {
+        return bs->idx - BOOT_STATUS_IDX_0;
+    }
+
+    return last_idx +
+           (bs->idx - BOOT_STATUS_IDX_0) * BOOT_STATUS_SWAP_STATE_COUNT +
+           (bs->state - BOOT_STATUS_STATE_0);
+}
+
+static void
+swap_status_set_done(struct boot_status *bs, uint32_t last_idx, uint32_t done)
+{
+    if (done == 0) {
+        /* Nothing done: the status stays reset. */
+    } else if (done <= last_idx) {
+        bs->op = BOOT_STATUS_OP_MOVE;
+        bs->idx = done + BOOT_STATUS_IDX_0;
+        bs->state = BOOT_STATUS_STATE_0;
+    } else {
+        done -= last_idx;
+        bs->op = BOOT_STATUS_OP_SWAP;
+        bs->idx = (done / BOOT_STATUS_SWAP_STATE_COUNT) + BOOT_STATUS_IDX_0;
+        bs->state = (done % BOOT_STATUS_SWAP_STATE_COUNT) + BOOT_STATUS_STATE_0;
+    }
+}
+
+/*
+ * Number of sector operations in the batch that starts after done of them.
+ */
+static uint32_t
+swap_status_batch_count(uint32_t last_idx, uint32_t done)
+{
+    uint32_t left;
+
+    left = last_idx * BOOT_STATUS_STATE_COUNT - done;
+    return (left > BOOT_STATUS_BATCH) ? BOOT_STATUS_BATCH : left;
+}
+
+static uint32_t
+swap_status_batch_sz(const struct boot_loader_state *state)
+{
+    return ALIGN_UP(sizeof(struct boot_status_batch), BOOT_WRITE_SZ(state));
+}
+
+/*
+ * Whether both slots are made of sectors of a single size, so that groups
+ * and sectors are the same.
+ */
+static bool
+swap_status_uniform(const struct boot_loader_state *state)
+{
+    uint32_t sz;
+    size_t slot;
+    size_t i;
+
+    sz = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, 0);
+    for (slot = BOOT_PRIMARY_SLOT; slot <= BOOT_SECONDARY_SLOT; slot++) {
+        for (i = 0; i < boot_img_num_sectors(state, slot); i++) {
+            if (boot_img_sector_size(state, slot, i) != sz) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Batches are only recorded if the records of the largest swap fit in the
+ * status area and the slots are made of sectors of a single size; otherwise,
+ * every operation is recorded as usual.
+ */
+static bool
+swap_status_batched(const struct boot_loader_state *state,
+                    const struct flash_area *fap)
+{
+    return BOOT_STATUS_BATCHES * swap_status_batch_sz(state) <=
+           boot_status_sz(flash_area_align(fap)) &&
+           swap_status_uniform(state);
+}
+
+/*
+ * Reads the record of the given batch: returns 0 if it is valid, 1 if not
+ * and a negative value on flash errors.
+ */
+static int
+swap_status_read_batch(const struct boot_loader_state *state,
+                       const struct flash_area *fap, uint32_t batch,
+                       struct boot_status_batch *rec)
+{
+    uint32_t off;
+    int rc;
+
+    off = boot_status_off(fap) + batch * swap_status_batch_sz(state);
+    rc = flash_area_read(fap, off, rec, sizeof *rec);
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    if (rec->batch != batch || rec->count == 0 ||
+        rec->count > BOOT_STATUS_BATCH ||
+        rec->check != swap_status_fnv(FNV_OFFSET_BASIS, (const uint8_t *)rec,
+                                      offsetof(struct boot_status_batch,
+                                               check))) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Records the batch that starts with the next sector operation, if it does
+ * start one, unless a previous boot already recorded it before a reset.
+ */
+static int
+swap_status_batch_begin(struct boot_loader_state *state,
+                        struct boot_status *bs,
+                        const struct flash_area *fap_pri,
+                        const struct flash_area *fap_sec)
+{
+    struct boot_status_batch rec;
+    uint8_t buf[ALIGN_UP(sizeof(struct boot_status_batch), BOOT_MAX_ALIGN)];
+    uint32_t last_idx;
+    uint32_t done;
+    uint32_t sector;
+    uint32_t i;
+    uint32_t p;
+    int rc;
+
+    if (!swap_status_batched(state, fap_pri)) {
+        return 0;
+    }
+
+#ifdef MCUBOOT_COPY_SKIP_UNCHANGED
+    /* A reset may have left a half-written sector anywhere in the batch it
+     * interrupted, so that batch is always copied in full.
+     */
+    if (!bs->batched) {
+        bs->copied = 0;
+    }
+#endif
+
+    last_idx = find_last_idx(state, bs->swap_size);
+    done = swap_status_done(bs, last_idx);
+    if (done % BOOT_STATUS_BATCH != 0) {
+        return 0;
+    }
+
+    rc = swap_status_read_batch(state, fap_pri, done / BOOT_STATUS_BATCH, &rec);
+    if (rc <= 0) {
+        return rc;
+    }
+
+    memset(&rec, 0, sizeof rec);
+    rec.batch = done / BOOT_STATUS_BATCH;
+    rec.count = swap_status_batch_count(last_idx, done);
+
+    for (i = 1; i <= rec.count; i++) {
+        /* Data copied to the sector by an earlier operation of the batch is
+         * already known.
+         */
+        sector = swap_move_sector(last_idx, done + i);
+        for (p = i - 1; p > 0; p--) {
+            if (swap_move_sector(last_idx, done + p - 1) == sector) {
+                break;
+            }
+        }
+
+        if (p > 0) {
+            rec.hash[i - 1] = rec.hash[p - 1];
+        } else {
+            rc = swap_status_hash_sector(state, fap_pri, fap_sec, sector,
+                                         &rec.hash[i - 1]);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+    }
+
+    rec.check = swap_status_fnv(FNV_OFFSET_BASIS, (const uint8_t *)&rec,
+                                offsetof(struct boot_status_batch, check));
+
+    memset(buf, flash_area_erased_val(fap_pri), sizeof buf);
+    memcpy(buf, &rec, sizeof rec);
+
+    BOOT_LOG_DBG("writing swap status batch %d", rec.batch);
+
+    rc = flash_area_write(fap_pri, boot_status_off(fap_pri) +
+                          rec.batch * swap_status_batch_sz(state),
+                          buf, swap_status_batch_sz(state));
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    bs->batched = 1;
+
+    return 0;
+}
+
+/*
+ * Finds the first point in the batch of the given record, from which the
+ * swap can resume: returns 0 and the number of operations done then, 1 if
+ * the contents of the sectors agree with none and a negative value on flash
+ * errors.
+ */
+static int
+swap_status_batch_resume(struct boot_loader_state *state,
+                         const struct flash_area *fap_pri,
+                         const struct flash_area *fap_sec,
+                         uint32_t last_idx,
+                         const struct boot_status_batch *rec,
+                         uint32_t *done)
+{
+    uint32_t sector[BOOT_STATUS_BATCH + 1];
+    uint32_t hash[BOOT_STATUS_BATCH + 1];
+    uint32_t first;
+    uint32_t expected;
+    uint32_t t;
+    uint32_t q;
+    uint32_t p;
+    int rc;
+
+    first = rec->batch * BOOT_STATUS_BATCH;
+
+    /* Sector q is read by operation q and overwritten by operation q + 1 of
+     * the batch; some sectors appear more than once.
+     */
+    for (q = 0; q <= rec->count; q++) {
+        sector[q] = swap_move_sector(last_idx, first + q);
+        for (p = 0; p < q && sector[p] != sector[q]; p++) {
+        }
+
+        if (p < q) {
+            hash[q] = hash[p];
+        } else {
+            rc = swap_status_hash_sector(state, fap_pri, fap_sec, sector[q],
+                                         &hash[q]);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+    }
+
+    for (t = 0; t <= rec->count; t++) {
+        for (q = 0; q <= rec->count; q++) {
+            for (p = 0; p < q && sector[p] != sector[q]; p++) {
+            }
+
+            if (p < q || (t < rec->count && sector[q] == sector[t])) {
+                /* Checked already, or overwritten by the next operation. */
+                continue;
+            }
+
+            /* The sector holds what the last operation up to t copied to
+             * it, or else what it held when the batch started.
+             */
+            for (p = t; p > 0 && sector[p - 1] != sector[q]; p--) {
+            }
+
+            if (p > 0) {
+                expected = rec->hash[p - 1];
+            } else {
+                expected = rec->hash[q - 1];
+            }
+
+            if (hash[q] != expected) {
+                break;
+            }
+        }
+
+        if (q > rec->count) {
+            *done = first + t;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int
+swap_read_status_batches(const struct flash_area *fap,
+                         struct boot_loader_state *state,
+                         struct boot_status *bs)
+{
+    const struct flash_area *fap_sec;
+    struct boot_status_batch rec;
+    uint32_t swap_size;
+    uint32_t last_idx;
+    uint32_t batch;
+    uint32_t done;
+    uint32_t i;
+    bool inconsistent;
+    int rc;
+
+    for (batch = BOOT_STATUS_BATCHES; batch > 0; batch--) {
+        rc = swap_status_read_batch(state, fap, batch - 1, &rec);
+        if (rc < 0) {
+            return BOOT_EFLASH;
+        } else if (rc == 0) {
+            break;
+        }
+    }
+
+    if (batch == 0) {
+        /* no swap status found; nothing to do */
+        return 0;
+    }
+    batch--;
+
+    rc = boot_read_swap_size(fap, &swap_size);
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    last_idx = find_last_idx(state, swap_size);
+    done = batch * BOOT_STATUS_BATCH;
+    if (done >= last_idx * BOOT_STATUS_STATE_COUNT ||
+        rec.count != swap_status_batch_count(last_idx, done)) {
+        return BOOT_EBADSTATUS;
+    }
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_SECONDARY(BOOT_CURR_IMG(state)),
+                         &fap_sec);
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    rc = swap_status_batch_resume(state, fap, fap_sec, last_idx, &rec, &done);
+    flash_area_close(fap_sec);
+    if (rc < 0) {
+        return BOOT_EFLASH;
+    }
+
+    /* The batch is unknown if a record before it is missing. */
+    inconsistent = (rc != 0);
+    if (rc != 0) {
+        done = batch * BOOT_STATUS_BATCH + rec.count;
+    }
+    for (i = 0; i < batch && !inconsistent; i++) {
+        rc = swap_status_read_batch(state, fap, i, &rec);
+        if (rc < 0) {
+            return BOOT_EFLASH;
+        }
+        inconsistent = (rc != 0);
+    }
+
+    if (inconsistent) {
+        /* This means there was an error writing status on the last
+         * swap. Tell user and move on to validation!
+         */
+#if !defined(__BOOTSIM__)
+        BOOT_LOG_ERR("Detected inconsistent status!");
+#endif
+
+#if !defined(MCUBOOT_VALIDATE_PRIMARY_SLOT)
+        /* With validation of the primary slot disabled, there is no way
+         * to be sure the swapped primary slot is OK, so abort!
+         */
+        assert(0);
+#endif
+    }
+
+    swap_status_set_done(bs, last_idx, done);
+
+    return 0;
+}
+
+static int
+swap_write_status(struct boot_loader_state *state, struct boot_status *bs,
+                  const struct flash_area *fap_pri)
+{
+    if (swap_status_batched(state, fap_pri)) {
+        return 0;
+    }
+
+    return boot_write_status(state, bs);
+}
+#else
+#define swap_write_status(state, bs, fap_pri) boot_write_status((state), (bs))
+#endif /* MCUBOOT_SWAP_MOVE_STATUS_BATCH */
+
 int
 swap_read_status_bytes(const struct flash_area *fap,
         struct boot_loader_state *state, struct boot_status *bs)
@@ -156,6 +819,12 @@ swap_read_status_bytes(const struct flash_area *fap,
     int erased_sections;
     int i;
 
+#ifdef MCUBOOT_SWAP_MOVE_STATUS_BATCH
+    if (swap_status_batched(state, fap)) {
+        return swap_read_status_batches(fap, state, bs);
+    }
+#endif
+
     max_entries = boot_status_entries(BOOT_CURR_IMG(state), fap);
     if (max_entries < 0) {
         return BOOT_EBADARGS;
@@ -234,68 +903,36 @@ boot_status_internal_off(const struct boot_status *bs, int elem_sz)
     return off;
 }
 
-static int app_max_sectors(struct boot_loader_state *state)
-{
-    uint32_t sz = 0;
-    uint32_t sector_sz;
-    uint32_t trailer_sz;
-    uint32_t first_trailer_idx;
-
-    sector_sz = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, 0);
-    trailer_sz = boot_trailer_sz(BOOT_WRITE_SZ(state));
-    first_trailer_idx = boot_img_num_sectors(state, BOOT_PRIMARY_SLOT) - 1;
-
-    while (1) {
-        sz += sector_sz;
-        if  (sz >= trailer_sz) {
-            break;
-        }
-        first_trailer_idx--;
-    }
-
-    return first_trailer_idx;
-}
-
 int
 boot_slots_compatible(struct boot_loader_state *state)
 {
     size_t num_sectors_pri;
     size_t num_sectors_sec;
-    size_t sector_sz_pri = 0;
-    size_t sector_sz_sec = 0;
-    size_t i;
-    size_t num_usable_sectors_pri;
+    size_t sector_sz_pri;
+    size_t sector_sz_sec;
 
     num_sectors_pri = boot_img_num_sectors(state, BOOT_PRIMARY_SLOT);
     num_sectors_sec = boot_img_num_sectors(state, BOOT_SECONDARY_SLOT);
-    num_usable_sectors_pri = app_max_sectors(state);
 
-    if ((num_sectors_pri != num_sectors_sec) &&
-            (num_sectors_pri != (num_sectors_sec + 1)) &&
-            (num_usable_sectors_pri != (num_sectors_sec + 1))) {
-        BOOT_LOG_WRN("Cannot upgrade: not a compatible amount of sectors");
-        BOOT_LOG_DBG("slot0 sectors: %d, slot1 sectors: %d, usable slot0 sectors: %d",
-                     (int)num_sectors_pri, (int)num_sectors_sec,
-                     (int)(num_usable_sectors_pri - 1));
-        return 0;
-    } else if (num_sectors_pri > BOOT_MAX_IMG_SECTORS) {
+    if (num_sectors_pri > BOOT_MAX_IMG_SECTORS ||
+        num_sectors_sec > BOOT_MAX_IMG_SECTORS) {
         BOOT_LOG_WRN("Cannot upgrade: more sectors than allowed");
         return 0;
     }
 
-    if (num_usable_sectors_pri != (num_sectors_sec + 1)) {
-        BOOT_LOG_DBG("Non-optimal sector distribution, slot0 has %d usable sectors (%d assigned) "
-                     "but slot1 has %d assigned", (int)(num_usable_sectors_pri - 1),
-                     (int)num_sectors_pri, (int)num_sectors_sec);
+    if (app_max_size(state) == 0) {
+        BOOT_LOG_WRN("Cannot upgrade: not a compatible sector layout");
+        BOOT_LOG_DBG("slot0 sectors: %d, slot1 sectors: %d, move distance: %d",
+                     (int)num_sectors_pri, (int)num_sectors_sec,
+                     (int)swap_move_dist(state));
+        return 0;
     }
 
-    for (i = 0; i < num_sectors_sec; i++) {
-        sector_sz_pri = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, i);
-        sector_sz_sec = boot_img_sector_size(state, BOOT_SECONDARY_SLOT, i);
-        if (sector_sz_pri != sector_sz_sec) {
-            BOOT_LOG_WRN("Cannot upgrade: not same sector layout");
-            return 0;
-        }
+    sector_sz_pri = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, 0);
+    sector_sz_sec = boot_img_sector_size(state, BOOT_SECONDARY_SLOT, 0);
+    if (sector_sz_pri != sector_sz_sec) {
+        BOOT_LOG_DBG("Different sector sizes, slot0: %d, slot1: %d",
+                     (int)sector_sz_pri, (int)sector_sz_sec);
     }
 
 #ifdef MCUBOOT_SLOT0_EXPECTED_ERASE_SIZE
@@ -318,13 +955,6 @@ boot_slots_compatible(struct boot_loader_state *state)
     }
 #endif
 
-    if (num_sectors_pri > num_sectors_sec) {
-        if (sector_sz_pri != boot_img_sector_size(state, BOOT_PRIMARY_SLOT, i)) {
-            BOOT_LOG_WRN("Cannot upgrade: not same sector layout");
-            return 0;
-        }
-    }
-
     return 1;
 }
 
@@ -381,25 +1011,28 @@ swap_status_source(struct boot_loader_state *state)
 }
 
 /*
- * "Moves" the sector located at idx - 1 to idx.
+ * "Moves" the data the move distance below sector idx of the primary slot to
+ * it, up to the end of the groups swapped.
  */
 static void
-boot_move_sector_up(int idx, uint32_t sz, struct boot_loader_state *state,
-        struct boot_status *bs, const struct flash_area *fap_pri,
-        const struct flash_area *fap_sec)
+boot_move_sector_up(int idx, const struct swap_move_layout *layout,
+        struct boot_loader_state *state, struct boot_status *bs,
+        const struct flash_area *fap_pri, const struct flash_area *fap_sec)
 {
     uint32_t new_off;
     uint32_t old_off;
+    uint32_t sz;
+    uint32_t copy_sz;
     int rc;
 
-    /*
-     * FIXME: assuming sectors of size == sz, a single off variable
-     * would be enough
-     */
-
     /* Calculate offset from start of image area. */
     new_off = boot_img_sector_off(state, BOOT_PRIMARY_SLOT, idx);
-    old_off = boot_img_sector_off(state, BOOT_PRIMARY_SLOT, idx - 1);
+    old_off = new_off - layout->dist;
+    sz = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, idx);
+    copy_sz = layout->end + layout->dist - new_off;
+    if (copy_sz > sz) {
+        copy_sz = sz;
+    }
 
     if (bs->idx == BOOT_STATUS_IDX_0) {
         if (bs->source != BOOT_STATUS_SOURCE_PRIMARY_SLOT) {
@@ -414,52 +1047,74 @@ boot_move_sector_up(int idx, uint32_t sz, struct boot_loader_state *state,
         assert(rc == 0);
     }
 
-    rc = boot_erase_region(fap_pri, new_off, sz);
-    assert(rc == 0);
+#ifdef MCUBOOT_SWAP_MOVE_STATUS_BATCH
+    rc = swap_status_batch_begin(state, bs, fap_pri, fap_sec);
+    BOOT_STATUS_ASSERT(rc == 0);
+#endif
 
-    rc = boot_copy_region(state, fap_pri, fap_pri, old_off, new_off, sz);
+    rc = swap_erase_and_copy_region(state, bs, fap_pri, fap_pri, old_off,
+                                    new_off, sz, copy_sz);
     assert(rc == 0);
 
-    rc = boot_write_status(state, bs);
+    rc = swap_write_status(state, bs, fap_pri);
 
     bs->idx++;
     BOOT_STATUS_ASSERT(rc == 0);
 }
 
+/*
+ * Swaps the group of sz bytes at off, the data of the primary slot being
+ * read from where it was moved to.
+ */
 static void
-boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
-        struct boot_status *bs, const struct flash_area *fap_pri,
-        const struct flash_area *fap_sec)
+boot_swap_sectors(uint32_t off, uint32_t sz,
+        const struct swap_move_layout *layout,
+        struct boot_loader_state *state, struct boot_status *bs,
+        const struct flash_area *fap_pri, const struct flash_area *fap_sec)
 {
     uint32_t pri_off;
     uint32_t pri_up_off;
     uint32_t sec_off;
     int rc;
 
-    pri_up_off = boot_img_sector_off(state, BOOT_PRIMARY_SLOT, idx);
-    pri_off = boot_img_sector_off(state, BOOT_PRIMARY_SLOT, idx - 1);
-    sec_off = boot_img_sector_off(state, BOOT_SECONDARY_SLOT, idx - 1);
+    pri_up_off = off + layout->dist;
+    pri_off = off;
+    sec_off = off;
 
     if (bs->state == BOOT_STATUS_STATE_0) {
-        rc = boot_erase_region(fap_pri, pri_off, sz);
-        assert(rc == 0);
+        if (boot_swap_yield(state)) {
+            return;
+        }
 
-        rc = boot_copy_region(state, fap_sec, fap_pri, sec_off, pri_off, sz);
+#ifdef MCUBOOT_SWAP_MOVE_STATUS_BATCH
+        rc = swap_status_batch_begin(state, bs, fap_pri, fap_sec);
+        BOOT_STATUS_ASSERT(rc == 0);
+#endif
+
+        rc = swap_erase_and_copy_region(state, bs, fap_sec, fap_pri, sec_off,
+                                        pri_off, sz, sz);
         assert(rc == 0);
 
-        rc = boot_write_status(state, bs);
+        rc = swap_write_status(state, bs, fap_pri);
         bs->state = BOOT_STATUS_STATE_1;
         BOOT_STATUS_ASSERT(rc == 0);
     }
 
     if (bs->state == BOOT_STATUS_STATE_1) {
-        rc = boot_erase_region(fap_sec, sec_off, sz);
-        assert(rc == 0);
+        if (boot_swap_yield(state)) {
+            return;
+        }
+
+#ifdef MCUBOOT_SWAP_MOVE_STATUS_BATCH
+        rc = swap_status_batch_begin(state, bs, fap_pri, fap_sec);
+        BOOT_STATUS_ASSERT(rc == 0);
+#endif
 
-        rc = boot_copy_region(state, fap_pri, fap_sec, pri_up_off, sec_off, sz);
+        rc = swap_erase_and_copy_region(state, bs, fap_pri, fap_sec,
+                                        pri_up_off, sec_off, sz, sz);
         assert(rc == 0);
 
-        rc = boot_write_status(state, bs);
+        rc = swap_write_status(state, bs, fap_pri);
         bs->idx++;
         bs->state = BOOT_STATUS_STATE_0;
         BOOT_STATUS_ASSERT(rc == 0);
@@ -518,47 +1173,36 @@ void
 swap_run(struct boot_loader_state *state, struct boot_status *bs,
          uint32_t copy_size)
 {
-    uint32_t sz;
-    uint32_t sector_sz;
+    struct swap_move_layout layout;
+    struct swap_move_group group;
     uint32_t idx;
-    uint32_t trailer_sz;
-    uint32_t first_trailer_idx;
-    uint32_t last_idx;
+    uint32_t trailer_off;
     uint8_t image_index;
     const struct flash_area *fap_pri;
     const struct flash_area *fap_sec;
     int rc;
 
-    BOOT_LOG_INF("Starting swap using move algorithm.");
+    if (!boot_swap_lent(state) || boot_status_is_reset(bs)) {
+        BOOT_LOG_INF("Starting swap using move algorithm.");
+    }
 
-    last_idx = find_last_idx(state, copy_size);
-    sector_sz = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, 0);
+    rc = swap_move_get_layout(state, copy_size, &layout);
 
     /*
      * When starting a new swap upgrade, check that there is enough space.
      */
     if (boot_status_is_reset(bs)) {
-        sz = 0;
-        trailer_sz = boot_trailer_sz(BOOT_WRITE_SZ(state));
-        first_trailer_idx = boot_img_num_sectors(state, BOOT_PRIMARY_SLOT) - 1;
+        trailer_off = swap_move_trailer_off(state);
 
-        while (1) {
-            sz += sector_sz;
-            if  (sz >= trailer_sz) {
-                break;
-            }
-            first_trailer_idx--;
-        }
-
-        if (last_idx >= first_trailer_idx) {
+        if (rc != 0 || layout.end + layout.dist > trailer_off) {
             BOOT_LOG_WRN("Not enough free space to run swap upgrade");
             BOOT_LOG_WRN("required %d bytes but only %d are available",
-                         (last_idx + 1) * sector_sz,
-                         first_trailer_idx * sector_sz);
+                         (int)(layout.end + layout.dist), (int)trailer_off);
             bs->swap_type = BOOT_SWAP_TYPE_NONE;
             return;
         }
     }
+    assert(rc == 0);
 
     image_index = BOOT_CURR_IMG(state);
 
@@ -571,10 +1215,13 @@ swap_run(struct boot_loader_state *state, struct boot_status *bs,
     fixup_revert(state, bs, fap_sec);
 
     if (bs->op == BOOT_STATUS_OP_MOVE) {
-        idx = last_idx;
-        while (idx > 0) {
-            if (idx <= (last_idx - bs->idx + 1)) {
-                boot_move_sector_up(idx, sector_sz, state, bs, fap_pri, fap_sec);
+        idx = layout.move_last;
+        while (idx >= layout.move_first) {
+            if (idx <= (layout.move_last - bs->idx + 1)) {
+                if (boot_swap_yield(state)) {
+                    goto out;
+                }
+                boot_move_sector_up(idx, &layout, state, bs, fap_pri, fap_sec);
             }
             idx--;
         }
@@ -584,32 +1231,46 @@ swap_run(struct boot_loader_state *state, struct boot_status *bs,
     bs->op = BOOT_STATUS_OP_SWAP;
 
     idx = 1;
-    while (idx <= last_idx) {
+    swap_move_group_init(&group);
+    while (idx <= layout.groups && swap_move_group_next(state, &group)) {
         if (idx >= bs->idx) {
-            boot_swap_sectors(idx, sector_sz, state, bs, fap_pri, fap_sec);
+            boot_swap_sectors(group.off, group.sz, &layout, state, bs,
+                              fap_pri, fap_sec);
+            if (boot_swap_yielded(state)) {
+                goto out;
+            }
         }
         idx++;
     }
 
+out:
     flash_area_close(fap_pri);
     flash_area_close(fap_sec);
 }
 
 int app_max_size(struct boot_loader_state *state)
 {
-    uint32_t sector_sz_primary;
-    uint32_t sector_sz_secondary;
-    uint32_t sz_primary;
-    uint32_t sz_secondary;
+    struct swap_move_group group;
+    uint32_t trailer_off;
+    uint32_t dist;
+    uint32_t sz = 0;
 
-    sector_sz_primary = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, 0);
-    sector_sz_secondary = boot_img_sector_size(state, BOOT_SECONDARY_SLOT, 0);
+    /* Account for image flags and the move distance: the image must end
+     * where a group does.
+     */
+    trailer_off = swap_move_trailer_off(state);
+    dist = swap_move_dist(state);
+    if (dist == 0 || dist > trailer_off) {
+        return 0;
+    }
 
-    /* Account for image flags and move sector */
-    sz_primary = app_max_sectors(state) * sector_sz_primary - sector_sz_primary;
-    sz_secondary = boot_img_num_sectors(state, BOOT_SECONDARY_SLOT) * sector_sz_secondary;
+    swap_move_group_init(&group);
+    while (swap_move_group_next(state, &group) &&
+           group.off + group.sz <= trailer_off - dist) {
+        sz = group.off + group.sz;
+    }
 
-    return (sz_primary <= sz_secondary ? sz_primary : sz_secondary);
+    return sz;
 }
 
 #endif
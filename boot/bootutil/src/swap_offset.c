@@ -0,0 +1,736 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Copyright (c) 2019 JUUL Labs
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bootutil/bootutil.h"
+#include "bootutil_priv.h"
+#include "swap_priv.h"
+#include "bootutil/bootutil_log.h"
+
+#include "mcuboot_config/mcuboot_config.h"
+
+BOOT_LOG_MODULE_DECLARE(mcuboot);
+
+#ifdef MCUBOOT_SWAP_USING_OFFSET
+
+#ifdef MCUBOOT_ENC_IMAGES
+#error "MCUBOOT_SWAP_USING_OFFSET is not supported with MCUBOOT_ENC_IMAGES"
+#endif
+
+/*
+ * Swap using offset: an upgrade image is stored in the secondary slot one
+ * sector past its start, and every sector of the primary slot is swapped with
+ * it directly, without first moving the primary slot image up by a sector as
+ * swap using move does.  For each sector n, from the first one:
+ *
+ *   1. sector n of the primary slot is copied to sector n of the secondary
+ *      slot, which holds data that step 2 for sector n - 1 already copied;
+ *   2. sector n + 1 of the secondary slot is copied to sector n of the primary
+ *      slot.
+ *
+ * The image that leaves the primary slot ends up at the start of the
+ * secondary slot.  Swapping it back, as a revert does, runs the same steps
+ * in reverse order and direction, from the last sector down: sector n of the
+ * primary slot goes to sector n + 1 of the secondary slot, then sector n of
+ * the secondary slot goes to sector n of the primary slot.
+ *
+ * Every step is recorded in an entry of the swap status of the primary slot.
+ * Swaps moving an image back also get the first entry written before they
+ * start, as the images in both slots carry no hint of the direction.
+ */
+
+#if defined(MCUBOOT_VALIDATE_PRIMARY_SLOT)
+/*
+ * FIXME: this might have to be updated for threaded sim
+ */
+int boot_status_fails = 0;
+#define BOOT_STATUS_ASSERT(x)                \
+    do {                                     \
+        if (!(x)) {                          \
+            boot_status_fails++;             \
+        }                                    \
+    } while (0)
+#else
+#define BOOT_STATUS_ASSERT(x) ASSERT(x)
+#endif
+
+static uint32_t
+find_last_idx(struct boot_loader_state *state, uint32_t swap_size)
+{
+    uint32_t sector_sz;
+    uint32_t sz;
+    uint32_t last_idx;
+
+    sector_sz = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, 0);
+    sz = 0;
+    last_idx = 0;
+    while (1) {
+        sz += sector_sz;
+        last_idx++;
+        if (sz >= swap_size) {
+            break;
+        }
+    }
+
+    return last_idx;
+}
+
+/*
+ * Number of swap steps done, according to bs.
+ */
+static uint32_t
+swap_steps_done(const struct boot_status *bs)
+{
+    if (bs->op == BOOT_STATUS_OP_MOVE) {
+        return 0;
+    }
+
+    return (bs->idx - BOOT_STATUS_IDX_0) * BOOT_STATUS_SWAP_STATE_COUNT +
+           (bs->state - BOOT_STATUS_STATE_0);
+}
+
+uint32_t
+boot_get_state_secondary_offset(struct boot_loader_state *state,
+                                const struct flash_area *fap)
+{
+    if (state != NULL && state->secondary_offset[BOOT_CURR_IMG(state)] &&
+        flash_area_get_id(fap) ==
+        FLASH_AREA_IMAGE_SECONDARY(BOOT_CURR_IMG(state))) {
+        return boot_img_sector_size(state, BOOT_SECONDARY_SLOT, 0);
+    }
+
+    return 0;
+}
+
+int
+boot_read_image_header(struct boot_loader_state *state, int slot,
+                       struct image_header *out_hdr, struct boot_status *bs)
+{
+    const struct flash_area *fap;
+    uint32_t off;
+    uint32_t sz;
+    uint32_t last_idx;
+    uint32_t swap_size;
+    uint32_t done;
+    int area_id;
+    int rc;
+
+#ifdef MCUBOOT_TLV_INDEX
+    BOOT_IMG(state, slot).tlv_index.status = BOOT_TLV_INDEX_EMPTY;
+#endif
+
+    off = 0;
+    sz = boot_img_sector_size(state, BOOT_SECONDARY_SLOT, 0);
+    if (bs && !boot_status_is_reset(bs)) {
+        boot_find_status(BOOT_CURR_IMG(state), &fap);
+        if (fap == NULL || boot_read_swap_size(fap, &swap_size)) {
+            rc = BOOT_EFLASH;
+            goto done;
+        }
+        flash_area_close(fap);
+
+        last_idx = find_last_idx(state, swap_size);
+        done = swap_steps_done(bs);
+
+        /*
+         * Until the swap is over, find the headers of the images each slot
+         * held when it started; once it is over, those of the images each
+         * slot holds now.
+         */
+        if (done >= last_idx * BOOT_STATUS_SWAP_STATE_COUNT) {
+            if (slot == BOOT_SECONDARY_SLOT) {
+                if (bs->op == BOOT_STATUS_OP_SWAP_BACK) {
+                    off = sz;
+                }
+                state->secondary_offset[BOOT_CURR_IMG(state)] = (off != 0);
+            }
+        } else if (bs->op == BOOT_STATUS_OP_SWAP) {
+            if (slot == BOOT_PRIMARY_SLOT && done >= 1) {
+                slot = BOOT_SECONDARY_SLOT;
+            } else if (slot == BOOT_SECONDARY_SLOT && done >= 2) {
+                slot = BOOT_PRIMARY_SLOT;
+            } else if (slot == BOOT_SECONDARY_SLOT) {
+                off = sz;
+            }
+        } else if (slot == BOOT_PRIMARY_SLOT &&
+                   done >= last_idx * BOOT_STATUS_SWAP_STATE_COUNT - 1) {
+            slot = BOOT_SECONDARY_SLOT;
+            off = sz;
+        }
+    }
+
+    area_id = flash_area_id_from_multi_image_slot(BOOT_CURR_IMG(state), slot);
+    rc = flash_area_open(area_id, &fap);
+    if (rc != 0) {
+        rc = BOOT_EFLASH;
+        goto done;
+    }
+
+    if (slot == BOOT_SECONDARY_SLOT && (bs == NULL || boot_status_is_reset(bs))) {
+        /* Look for an upgrade image past the first sector first, then at the
+         * start of the slot, where a swap leaves the image it moves out of
+         * the primary slot.
+         */
+        rc = flash_area_read(fap, sz, out_hdr, sizeof *out_hdr);
+        if (rc != 0) {
+            rc = BOOT_EFLASH;
+            goto done;
+        }
+
+        state->secondary_offset[BOOT_CURR_IMG(state)] =
+            (out_hdr->ih_magic == IMAGE_MAGIC);
+        if (out_hdr->ih_magic != IMAGE_MAGIC) {
+            rc = flash_area_read(fap, 0, out_hdr, sizeof *out_hdr);
+        }
+    } else {
+        rc = flash_area_read(fap, off, out_hdr, sizeof *out_hdr);
+    }
+    if (rc != 0) {
+        rc = BOOT_EFLASH;
+        goto done;
+    }
+
+    /* We only know where the headers are located when bs is valid */
+    if (bs != NULL && out_hdr->ih_magic != IMAGE_MAGIC) {
+        rc = -1;
+        goto done;
+    }
+
+    rc = 0;
+
+done:
+    flash_area_close(fap);
+    return rc;
+}
+
+int
+swap_read_status_bytes(const struct flash_area *fap,
+        struct boot_loader_state *state, struct boot_status *bs)
+{
+    uint32_t off;
+    uint8_t status;
+    int max_entries;
+    int found_idx;
+    uint8_t write_sz;
+    bool back;
+    bool inconsistent;
+    int rc;
+    int i;
+
+    max_entries = boot_status_entries(BOOT_CURR_IMG(state), fap);
+    if (max_entries < 0) {
+        return BOOT_EBADARGS;
+    }
+
+    write_sz = BOOT_WRITE_SZ(state);
+    off = boot_status_off(fap);
+
+    /* The first entry marks swaps moving an image back. */
+    rc = flash_area_read(fap, off, &status, 1);
+    if (rc < 0) {
+        return BOOT_EFLASH;
+    }
+    back = !bootutil_buffer_is_erased(fap, &status, 1);
+
+    /* The steps are recorded in order; the last one written tells how many
+     * are done.
+     */
+    found_idx = 0;
+    inconsistent = false;
+    for (i = max_entries - 1; i > 0; i--) {
+        rc = flash_area_read(fap, off + i * write_sz, &status, 1);
+        if (rc < 0) {
+            return BOOT_EFLASH;
+        }
+
+        if (bootutil_buffer_is_erased(fap, &status, 1)) {
+            if (found_idx != 0) {
+                inconsistent = true;
+            }
+        } else if (found_idx == 0) {
+            found_idx = i;
+        }
+    }
+
+    if (inconsistent) {
+        /* This means there was an error writing status on the last
+         * swap. Tell user and move on to validation!
+         */
+#if !defined(__BOOTSIM__)
+        BOOT_LOG_ERR("Detected inconsistent status!");
+#endif
+
+#if !defined(MCUBOOT_VALIDATE_PRIMARY_SLOT)
+        /* With validation of the primary slot disabled, there is no way
+         * to be sure the swapped primary slot is OK, so abort!
+         */
+        assert(0);
+#endif
+    }
+
+    if (found_idx == 0 && !back) {
+        /* no swap status found; nothing to do */
+    } else {
+        bs->op = back ? BOOT_STATUS_OP_SWAP_BACK : BOOT_STATUS_OP_SWAP;
+        bs->idx = (found_idx / BOOT_STATUS_SWAP_STATE_COUNT) + BOOT_STATUS_IDX_0;
+        bs->state = (found_idx % BOOT_STATUS_SWAP_STATE_COUNT) + BOOT_STATUS_STATE_0;
+    }
+
+    return 0;
+}
+
+uint32_t
+boot_status_internal_off(const struct boot_status *bs, int elem_sz)
+{
+    if (bs->op == BOOT_STATUS_OP_MOVE) {
+        /* Not started yet: the entry marking a swap moving an image back. */
+        return 0;
+    }
+
+    return (1 + swap_steps_done(bs)) * elem_sz;
+}
+
+/*
+ * Index of the first sector of the given slot that holds part of its
+ * trailer.
+ */
+static int app_max_sectors(struct boot_loader_state *state, int slot)
+{
+    uint32_t sz = 0;
+    uint32_t sector_sz;
+    uint32_t trailer_sz;
+    uint32_t first_trailer_idx;
+
+    sector_sz = boot_img_sector_size(state, slot, 0);
+    trailer_sz = boot_trailer_sz(BOOT_WRITE_SZ(state));
+    first_trailer_idx = boot_img_num_sectors(state, slot) - 1;
+
+    while (1) {
+        sz += sector_sz;
+        if  (sz >= trailer_sz) {
+            break;
+        }
+        first_trailer_idx--;
+    }
+
+    return first_trailer_idx;
+}
+
+int
+boot_slots_compatible(struct boot_loader_state *state)
+{
+    size_t num_sectors_pri;
+    size_t num_sectors_sec;
+    size_t sector_sz_pri = 0;
+    size_t sector_sz_sec = 0;
+    size_t i;
+
+    num_sectors_pri = boot_img_num_sectors(state, BOOT_PRIMARY_SLOT);
+    num_sectors_sec = boot_img_num_sectors(state, BOOT_SECONDARY_SLOT);
+
+    if ((num_sectors_sec != num_sectors_pri) &&
+            (num_sectors_sec != (num_sectors_pri + 1))) {
+        BOOT_LOG_WRN("Cannot upgrade: not a compatible amount of sectors");
+        BOOT_LOG_DBG("slot0 sectors: %d, slot1 sectors: %d",
+                     (int)num_sectors_pri, (int)num_sectors_sec);
+        return 0;
+    } else if (num_sectors_sec > BOOT_MAX_IMG_SECTORS) {
+        BOOT_LOG_WRN("Cannot upgrade: more sectors than allowed");
+        return 0;
+    }
+
+    if (num_sectors_sec != (num_sectors_pri + 1)) {
+        BOOT_LOG_DBG("Non-optimal sector distribution, slot0 has %d sectors "
+                     "and slot1 has %d, which should be one more",
+                     (int)num_sectors_pri, (int)num_sectors_sec);
+    }
+
+    for (i = 0; i < num_sectors_pri; i++) {
+        sector_sz_pri = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, i);
+        sector_sz_sec = boot_img_sector_size(state, BOOT_SECONDARY_SLOT, i);
+        if (sector_sz_pri != sector_sz_sec) {
+            BOOT_LOG_WRN("Cannot upgrade: not same sector layout");
+            return 0;
+        }
+    }
+
+#ifdef MCUBOOT_SLOT0_EXPECTED_ERASE_SIZE
+    if (sector_sz_pri != MCUBOOT_SLOT0_EXPECTED_ERASE_SIZE) {
+        BOOT_LOG_DBG("Discrepancy, slot0 expected erase size: %d, actual: %d",
+                     MCUBOOT_SLOT0_EXPECTED_ERASE_SIZE, sector_sz_pri);
+    }
+#endif
+#ifdef MCUBOOT_SLOT1_EXPECTED_ERASE_SIZE
+    if (sector_sz_sec != MCUBOOT_SLOT1_EXPECTED_ERASE_SIZE) {
+        BOOT_LOG_DBG("Discrepancy, slot1 expected erase size: %d, actual: %d",
+                     MCUBOOT_SLOT1_EXPECTED_ERASE_SIZE, sector_sz_sec);
+    }
+#endif
+
+#if defined(MCUBOOT_SLOT0_EXPECTED_WRITE_SIZE) || defined(MCUBOOT_SLOT1_EXPECTED_WRITE_SIZE)
+    if (!swap_write_block_size_check(state)) {
+        BOOT_LOG_WRN("Cannot upgrade: slot write sizes are not compatible");
+        return 0;
+    }
+#endif
+
+    if (num_sectors_sec > num_sectors_pri) {
+        if (sector_sz_sec != boot_img_sector_size(state, BOOT_SECONDARY_SLOT, i)) {
+            BOOT_LOG_WRN("Cannot upgrade: not same sector layout");
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+#define BOOT_LOG_SWAP_STATE(area, state)                            \
+    BOOT_LOG_INF("%s: magic=%s, swap_type=0x%x, copy_done=0x%x, "   \
+                 "image_ok=0x%x",                                   \
+                 (area),                                            \
+                 ((state)->magic == BOOT_MAGIC_GOOD ? "good" :      \
+                  (state)->magic == BOOT_MAGIC_UNSET ? "unset" :    \
+                  "bad"),                                           \
+                 (state)->swap_type,                                \
+                 (state)->copy_done,                                \
+                 (state)->image_ok)
+
+int
+swap_status_source(struct boot_loader_state *state)
+{
+    struct boot_swap_state state_primary_slot;
+    struct boot_swap_state state_secondary_slot;
+    int rc;
+    uint8_t source;
+    uint8_t image_index;
+
+#if (BOOT_IMAGE_NUMBER == 1)
+    (void)state;
+#endif
+
+    image_index = BOOT_CURR_IMG(state);
+
+    rc = boot_read_swap_state_by_id(FLASH_AREA_IMAGE_PRIMARY(image_index),
+            &state_primary_slot);
+    assert(rc == 0);
+
+    BOOT_LOG_SWAP_STATE("Primary image", &state_primary_slot);
+
+    rc = boot_read_swap_state_by_id(FLASH_AREA_IMAGE_SECONDARY(image_index),
+            &state_secondary_slot);
+    assert(rc == 0);
+
+    BOOT_LOG_SWAP_STATE("Secondary image", &state_secondary_slot);
+
+    if (state_primary_slot.magic == BOOT_MAGIC_GOOD &&
+            state_primary_slot.copy_done == BOOT_FLAG_UNSET &&
+            state_secondary_slot.magic != BOOT_MAGIC_GOOD) {
+
+        source = BOOT_STATUS_SOURCE_PRIMARY_SLOT;
+
+        BOOT_LOG_INF("Boot source: primary slot");
+        return source;
+    }
+
+    BOOT_LOG_INF("Boot source: none");
+    return BOOT_STATUS_SOURCE_NONE;
+}
+
+/*
+ * Swaps sector idx - 1 of the primary slot with the image stored from
+ * sector idx of the secondary slot.
+ */
+static void
+boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
+        struct boot_status *bs, const struct flash_area *fap_pri,
+        const struct flash_area *fap_sec)
+{
+    uint32_t pri_off;
+    uint32_t sec_off;
+    uint32_t sec_up_off;
+    int rc;
+
+    pri_off = boot_img_sector_off(state, BOOT_PRIMARY_SLOT, idx - 1);
+    sec_off = boot_img_sector_off(state, BOOT_SECONDARY_SLOT, idx - 1);
+    sec_up_off = boot_img_sector_off(state, BOOT_SECONDARY_SLOT, idx);
+
+    if (bs->state == BOOT_STATUS_STATE_0) {
+        if (boot_swap_yield(state)) {
+            return;
+        }
+
+        rc = swap_erase_and_copy_region(state, bs, fap_pri, fap_sec, pri_off,
+                                        sec_off, sz, sz);
+        assert(rc == 0);
+
+        rc = boot_write_status(state, bs);
+        bs->state = BOOT_STATUS_STATE_1;
+        BOOT_STATUS_ASSERT(rc == 0);
+    }
+
+    if (bs->state == BOOT_STATUS_STATE_1) {
+        if (boot_swap_yield(state)) {
+            return;
+        }
+
+        rc = swap_erase_and_copy_region(state, bs, fap_sec, fap_pri,
+                                        sec_up_off, pri_off, sz, sz);
+        assert(rc == 0);
+
+        rc = boot_write_status(state, bs);
+        bs->idx++;
+        bs->state = BOOT_STATUS_STATE_0;
+        BOOT_STATUS_ASSERT(rc == 0);
+    }
+}
+
+/*
+ * Swaps sector idx - 1 of the primary slot with the image stored from the
+ * start of the secondary slot, moving the primary slot sector one sector up.
+ */
+static void
+boot_swap_sectors_back(int idx, uint32_t sz, struct boot_loader_state *state,
+        struct boot_status *bs, const struct flash_area *fap_pri,
+        const struct flash_area *fap_sec)
+{
+    uint32_t pri_off;
+    uint32_t sec_off;
+    uint32_t sec_up_off;
+    int rc;
+
+    pri_off = boot_img_sector_off(state, BOOT_PRIMARY_SLOT, idx - 1);
+    sec_off = boot_img_sector_off(state, BOOT_SECONDARY_SLOT, idx - 1);
+    sec_up_off = boot_img_sector_off(state, BOOT_SECONDARY_SLOT, idx);
+
+    if (bs->state == BOOT_STATUS_STATE_0) {
+        if (boot_swap_yield(state)) {
+            return;
+        }
+
+        rc = swap_erase_and_copy_region(state, bs, fap_pri, fap_sec, pri_off,
+                                        sec_up_off, sz, sz);
+        assert(rc == 0);
+
+        rc = boot_write_status(state, bs);
+        bs->state = BOOT_STATUS_STATE_1;
+        BOOT_STATUS_ASSERT(rc == 0);
+    }
+
+    if (bs->state == BOOT_STATUS_STATE_1) {
+        if (boot_swap_yield(state)) {
+            return;
+        }
+
+        rc = swap_erase_and_copy_region(state, bs, fap_sec, fap_pri, sec_off,
+                                        pri_off, sz, sz);
+        assert(rc == 0);
+
+        rc = boot_write_status(state, bs);
+        bs->idx++;
+        bs->state = BOOT_STATUS_STATE_0;
+        BOOT_STATUS_ASSERT(rc == 0);
+    }
+}
+
+/*
+ * Starts the swap: the swap status moves to the primary slot, and swaps
+ * moving an image back get recorded as such before the secondary slot
+ * trailer goes away.
+ */
+static void
+swap_begin(struct boot_loader_state *state, struct boot_status *bs,
+        const struct flash_area *fap_pri, const struct flash_area *fap_sec)
+{
+    int rc;
+
+    if (bs->source != BOOT_STATUS_SOURCE_PRIMARY_SLOT) {
+        rc = swap_erase_trailer_sectors(state, fap_pri);
+        assert(rc == 0);
+
+        rc = swap_status_init(state, fap_pri, bs);
+        assert(rc == 0);
+    }
+
+    if (!state->secondary_offset[BOOT_CURR_IMG(state)]) {
+        rc = boot_write_status(state, bs);
+        BOOT_STATUS_ASSERT(rc == 0);
+        bs->op = BOOT_STATUS_OP_SWAP_BACK;
+    } else {
+        bs->op = BOOT_STATUS_OP_SWAP;
+    }
+
+    rc = swap_erase_trailer_sectors(state, fap_sec);
+    assert(rc == 0);
+}
+
+/*
+ * When starting a revert the swap status exists in the primary slot, and
+ * the status in the secondary slot is erased. To start the swap, the status
+ * area in the primary slot must be re-initialized; if during the small
+ * window of time between re-initializing it and writing the first metadata
+ * a reset happens, the swap process is broken and cannot be resumed.
+ *
+ * This function handles the issue by making the revert look like a permanent
+ * upgrade (by initializing the secondary slot).
+ */
+static void
+fixup_revert(const struct boot_loader_state *state, struct boot_status *bs,
+        const struct flash_area *fap_sec)
+{
+    struct boot_swap_state swap_state;
+    int rc;
+
+#if (BOOT_IMAGE_NUMBER == 1)
+    (void)state;
+#endif
+
+    /* No fixup required */
+    if (bs->swap_type != BOOT_SWAP_TYPE_REVERT ||
+        bs->op != BOOT_STATUS_OP_MOVE ||
+        bs->idx != BOOT_STATUS_IDX_0) {
+        return;
+    }
+
+    rc = boot_read_swap_state(fap_sec, &swap_state);
+    assert(rc == 0);
+
+    BOOT_LOG_SWAP_STATE("Secondary image", &swap_state);
+
+    if (swap_state.magic == BOOT_MAGIC_UNSET) {
+        rc = swap_erase_trailer_sectors(state, fap_sec);
+        assert(rc == 0);
+
+        rc = boot_write_image_ok(fap_sec);
+        assert(rc == 0);
+
+        rc = boot_write_swap_size(fap_sec, bs->swap_size);
+        assert(rc == 0);
+
+        rc = boot_write_magic(fap_sec);
+        assert(rc == 0);
+    }
+}
+
+void
+swap_run(struct boot_loader_state *state, struct boot_status *bs,
+         uint32_t copy_size)
+{
+    uint32_t sector_sz;
+    uint32_t idx;
+    uint32_t last_idx;
+    uint32_t max_idx;
+    uint8_t image_index;
+    const struct flash_area *fap_pri;
+    const struct flash_area *fap_sec;
+    int rc;
+
+    if (!boot_swap_lent(state) || boot_status_is_reset(bs)) {
+        BOOT_LOG_INF("Starting swap using offset algorithm.");
+    }
+
+    last_idx = find_last_idx(state, copy_size);
+    sector_sz = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, 0);
+
+    /*
+     * When starting a new swap upgrade, check that there is enough space:
+     * the secondary slot holds the primary slot sectors one sector up.
+     */
+    if (boot_status_is_reset(bs)) {
+        max_idx = app_max_sectors(state, BOOT_PRIMARY_SLOT);
+        if (max_idx > (uint32_t)app_max_sectors(state, BOOT_SECONDARY_SLOT) - 1) {
+            max_idx = app_max_sectors(state, BOOT_SECONDARY_SLOT) - 1;
+        }
+
+        if (last_idx > max_idx) {
+            BOOT_LOG_WRN("Not enough free space to run swap upgrade");
+            BOOT_LOG_WRN("required %d bytes but only %d are available",
+                         last_idx * sector_sz, max_idx * sector_sz);
+            bs->swap_type = BOOT_SWAP_TYPE_NONE;
+            return;
+        }
+    }
+
+    image_index = BOOT_CURR_IMG(state);
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_PRIMARY(image_index), &fap_pri);
+    assert (rc == 0);
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_SECONDARY(image_index), &fap_sec);
+    assert (rc == 0);
+
+    fixup_revert(state, bs, fap_sec);
+
+    if (bs->op == BOOT_STATUS_OP_MOVE) {
+        swap_begin(state, bs, fap_pri, fap_sec);
+    }
+
+    idx = 1;
+    while (idx <= last_idx) {
+        if (idx >= bs->idx) {
+            if (bs->op == BOOT_STATUS_OP_SWAP) {
+                boot_swap_sectors(idx, sector_sz, state, bs, fap_pri, fap_sec);
+            } else {
+                boot_swap_sectors_back(last_idx - idx + 1, sector_sz, state,
+                                       bs, fap_pri, fap_sec);
+            }
+            if (boot_swap_yielded(state)) {
+                goto out;
+            }
+        }
+        idx++;
+    }
+
+    if (bs->op == BOOT_STATUS_OP_SWAP) {
+        /* Drop what is left of the upgrade image past the swapped sectors,
+         * so that its header cannot be found at the offset any more.
+         */
+        rc = boot_erase_region(fap_sec,
+                               boot_img_sector_off(state, BOOT_SECONDARY_SLOT,
+                                                   last_idx),
+                               sector_sz);
+        assert(rc == 0);
+    }
+
+out:
+    flash_area_close(fap_pri);
+    flash_area_close(fap_sec);
+}
+
+int app_max_size(struct boot_loader_state *state)
+{
+    uint32_t sector_sz_primary;
+    uint32_t sector_sz_secondary;
+    uint32_t sz_primary;
+    uint32_t sz_secondary;
+
+    sector_sz_primary = boot_img_sector_size(state, BOOT_PRIMARY_SLOT, 0);
+    sector_sz_secondary = boot_img_sector_size(state, BOOT_SECONDARY_SLOT, 0);
+
+    /* Account for image flags and the offset sector */
+    sz_primary = app_max_sectors(state, BOOT_PRIMARY_SLOT) * sector_sz_primary;
+    sz_secondary = (app_max_sectors(state, BOOT_SECONDARY_SLOT) - 1) *
+                   sector_sz_secondary;
+
+    return (sz_primary <= sz_secondary ? sz_primary : sz_secondary);
+}
+
+#endif
@@ -21,7 +21,8 @@
 
 #include "mcuboot_config/mcuboot_config.h"
 
-#if defined(MCUBOOT_SWAP_USING_SCRATCH) || defined(MCUBOOT_SWAP_USING_MOVE)
+#if defined(MCUBOOT_SWAP_USING_SCRATCH) || defined(MCUBOOT_SWAP_USING_MOVE) || \
+    defined(MCUBOOT_SWAP_USING_OFFSET)
 
 /**
  * Calculates the amount of space required to store the trailer, and erases
@@ -82,6 +83,19 @@ int swap_set_copy_done(uint8_t image_index);
  */
 int swap_set_image_ok(uint8_t image_index);
 
+/**
+ * Erases sz bytes at off_dst in fap_dst and copies copy_sz of them from
+ * off_src in fap_src.  With MCUBOOT_COPY_SKIP_UNCHANGED, nothing is written
+ * if the destination already holds that data, except for the first region of
+ * the boot, which may be the one left half-written by a reset.
+ */
+int swap_erase_and_copy_region(struct boot_loader_state *state,
+                               struct boot_status *bs,
+                               const struct flash_area *fap_src,
+                               const struct flash_area *fap_dst,
+                               uint32_t off_src, uint32_t off_dst,
+                               uint32_t sz, uint32_t copy_sz);
+
 /**
  * Start a new or resume an interrupted swap according to the parameters
  * found in the given boot_status.
@@ -93,15 +107,24 @@ void swap_run(struct boot_loader_state *state,
 #if MCUBOOT_SWAP_USING_SCRATCH
 #define BOOT_SCRATCH_AREA(state) ((state)->scratch.area)
 
+#ifdef MCUBOOT_SWAP_SCRATCH_POOL
+/**
+ * Size of the part of the scratch area a swap step can use: a window of the
+ * scratch pool, or the whole area if it is too small to hold a pool.
+ */
+size_t boot_scratch_area_size(const struct boot_loader_state *state);
+#else
 static inline size_t boot_scratch_area_size(const struct boot_loader_state *state)
 {
     return flash_area_get_size(BOOT_SCRATCH_AREA(state));
 }
 #endif
+#endif
 
-#endif /* defined(MCUBOOT_SWAP_USING_SCRATCH) || defined(MCUBOOT_SWAP_USING_MOVE) */
+#endif /* defined(MCUBOOT_SWAP_USING_SCRATCH) || defined(MCUBOOT_SWAP_USING_MOVE) ||
+          defined(MCUBOOT_SWAP_USING_OFFSET) */
 
-#if defined(MCUBOOT_SWAP_USING_MOVE)
+#if defined(MCUBOOT_SWAP_USING_MOVE) || defined(MCUBOOT_SWAP_USING_OFFSET)
 /**
  * Check if device write block sizes are as expected, function should emit an error if there is
  * a problem. If true is returned, the slots are marked as compatible, otherwise the slots are
@@ -112,7 +135,7 @@ static inline size_t boot_scratch_area_size(const struct boot_loader_state *stat
  * slot.
  */
 bool swap_write_block_size_check(struct boot_loader_state *state);
-#endif /* defined(MCUBOOT_SWAP_USING_MOVE) */
+#endif /* defined(MCUBOOT_SWAP_USING_MOVE) || defined(MCUBOOT_SWAP_USING_OFFSET) */
 
 /**
  * Returns the maximum size of an application that can be loaded to a slot.
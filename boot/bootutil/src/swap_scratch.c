@@ -30,7 +30,7 @@
 
 BOOT_LOG_MODULE_DECLARE(mcuboot);
 
-#if !defined(MCUBOOT_SWAP_USING_MOVE)
+#if !defined(MCUBOOT_SWAP_USING_MOVE) && !defined(MCUBOOT_SWAP_USING_OFFSET)
 
 #if defined(MCUBOOT_VALIDATE_PRIMARY_SLOT)
 /*
@@ -132,6 +132,221 @@ boot_status_internal_off(const struct boot_status *bs, int elem_sz)
            (bs->state - BOOT_STATUS_STATE_0) * elem_sz;
 }
 
+#if defined(MCUBOOT_SWAP_SCRATCH_POOL) && !defined(MCUBOOT_OVERWRITE_ONLY)
+#if MCUBOOT_SWAP_SCRATCH_POOL < 2
+#error "MCUBOOT_SWAP_SCRATCH_POOL must be at least 2"
+#endif
+
+/*
+ * With MCUBOOT_SWAP_SCRATCH_POOL, the scratch area is a pool of that many
+ * windows of the same size, followed by a sector logging the swaps started
+ * and by the sectors of the scratch trailer:
+ *
+ *   | window 0 | window 1 | ... | window N-1 | (unused) | log | trailer |
+ *
+ * Each swap appends an entry to the log before it starts, and step n of a
+ * swap that finds s entries in the log uses window (s + n) % N, so both
+ * the steps of a swap and successive swaps spread their erases over all
+ * the windows.  A step only erases the sectors of its window it copies to,
+ * rather than the whole area, and the trailer is only erased at the start
+ * and end of the swap.  The log sector is only erased once it is full.
+ *
+ * A scratch area too small for a pool, or with sectors of different sizes,
+ * is used whole by every step, as without MCUBOOT_SWAP_SCRATCH_POOL.
+ */
+
+/*
+ * Index of the first sector of the scratch area holding its trailer.
+ */
+static size_t
+swap_scratch_trailer_sector(const struct boot_loader_state *state)
+{
+    uint32_t trailer_off;
+    size_t sector;
+
+    trailer_off = boot_status_off(BOOT_SCRATCH_AREA(state));
+    sector = state->scratch.num_sectors - 1;
+    while (sector > 0 && boot_scratch_sector_off(state, sector) > trailer_off) {
+        sector--;
+    }
+
+    return sector;
+}
+
+/*
+ * The scratch area holds a pool if the sectors before its log are of the same
+ * size and enough of them for a window of at least a sector each.
+ */
+static bool
+swap_scratch_pooled(const struct boot_loader_state *state)
+{
+    size_t log_sector;
+    size_t i;
+
+    log_sector = swap_scratch_trailer_sector(state);
+    if (log_sector < 2) {
+        return false;
+    }
+    log_sector--;
+
+    for (i = 1; i < log_sector; i++) {
+        if (boot_scratch_sector_size(state, i) !=
+            boot_scratch_sector_size(state, 0)) {
+            return false;
+        }
+    }
+
+    return log_sector >= MCUBOOT_SWAP_SCRATCH_POOL;
+}
+
+size_t
+boot_scratch_area_size(const struct boot_loader_state *state)
+{
+    size_t log_sector;
+
+    if (!swap_scratch_pooled(state)) {
+        return flash_area_get_size(BOOT_SCRATCH_AREA(state));
+    }
+
+    log_sector = swap_scratch_trailer_sector(state) - 1;
+    return log_sector / MCUBOOT_SWAP_SCRATCH_POOL *
+           boot_scratch_sector_size(state, 0);
+}
+
+/*
+ * Reads the number of swaps in the log, each an entry of the write size.
+ */
+static int
+swap_scratch_log_count(const struct boot_loader_state *state,
+                       uint32_t *count)
+{
+    const struct flash_area *fap;
+    size_t log_sector;
+    uint32_t off;
+    uint32_t max_entries;
+    uint8_t entry;
+    int rc;
+
+    fap = BOOT_SCRATCH_AREA(state);
+    log_sector = swap_scratch_trailer_sector(state) - 1;
+    off = boot_scratch_sector_off(state, log_sector);
+    max_entries = boot_scratch_sector_size(state, log_sector) /
+                  BOOT_WRITE_SZ(state);
+
+    for (*count = 0; *count < max_entries; (*count)++) {
+        rc = flash_area_read(fap, off + *count * BOOT_WRITE_SZ(state),
+                             &entry, 1);
+        if (rc != 0) {
+            return BOOT_EFLASH;
+        }
+
+        if (bootutil_buffer_is_erased(fap, &entry, 1)) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Appends an entry for a new swap to the log, erasing it first if full.
+ */
+static int
+swap_scratch_log_append(const struct boot_loader_state *state)
+{
+    const struct flash_area *fap;
+    uint8_t buf[BOOT_MAX_ALIGN];
+    size_t log_sector;
+    uint32_t off;
+    uint32_t count;
+    int rc;
+
+    rc = swap_scratch_log_count(state, &count);
+    if (rc != 0) {
+        return rc;
+    }
+
+    fap = BOOT_SCRATCH_AREA(state);
+    log_sector = swap_scratch_trailer_sector(state) - 1;
+    off = boot_scratch_sector_off(state, log_sector);
+
+    if (count == boot_scratch_sector_size(state, log_sector) /
+                 BOOT_WRITE_SZ(state)) {
+        rc = boot_erase_region(fap, off,
+                               boot_scratch_sector_size(state, log_sector));
+        if (rc != 0) {
+            return BOOT_EFLASH;
+        }
+        count = 0;
+    }
+
+    memset(buf, flash_area_erased_val(fap), sizeof buf);
+    buf[0] = BOOT_FLAG_SET;
+
+    rc = flash_area_write(fap, off + count * BOOT_WRITE_SZ(state), buf,
+                          BOOT_WRITE_SZ(state));
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    return 0;
+}
+
+/*
+ * Offset of the window used by step swap_idx of the swap, given the number
+ * of swaps in the log.
+ */
+static uint32_t
+swap_scratch_window_off(const struct boot_loader_state *state,
+                        uint32_t count, uint32_t swap_idx)
+{
+    if (!swap_scratch_pooled(state)) {
+        return 0;
+    }
+
+    return ((count + swap_idx) % MCUBOOT_SWAP_SCRATCH_POOL) *
+           boot_scratch_area_size(state);
+}
+
+/*
+ * Erases the sectors of the window at off holding sz bytes, or all of the
+ * scratch area without a pool.
+ */
+static int
+swap_scratch_erase_window(const struct boot_loader_state *state,
+                          const struct flash_area *fap, uint32_t off,
+                          uint32_t sz)
+{
+    size_t sector_sz;
+
+    if (!swap_scratch_pooled(state)) {
+        return boot_erase_region(fap, 0, flash_area_get_size(fap));
+    }
+
+    sector_sz = boot_scratch_sector_size(state, 0);
+    return boot_erase_region(fap, off,
+                             (sz + sector_sz - 1) / sector_sz * sector_sz);
+}
+
+/*
+ * Erases the scratch trailer, which is all of the scratch area without a
+ * pool.
+ */
+static int
+swap_scratch_erase_trailer(const struct boot_loader_state *state,
+                           const struct flash_area *fap)
+{
+    uint32_t off;
+
+    if (!swap_scratch_pooled(state)) {
+        return boot_erase_region(fap, 0, flash_area_get_size(fap));
+    }
+
+    off = boot_scratch_sector_off(state, swap_scratch_trailer_sector(state));
+    return boot_erase_region(fap, off, flash_area_get_size(fap) - off);
+}
+#endif /* MCUBOOT_SWAP_SCRATCH_POOL && !MCUBOOT_OVERWRITE_ONLY */
+
 /*
  * Slots are compatible when all sectors that store up to to size of the image
  * round up to sector size, in both slot's are able to fit in the scratch
@@ -537,14 +752,16 @@ find_swap_count(const struct boot_loader_state *state, uint32_t copy_size)
  * @param idx                   The index of the first sector in the range of
  *                                  sectors being swapped.
  * @param sz                    The number of bytes to swap.
+ * @param scratch_off           The offset within the scratch area of the
+ *                                  region used for the swap.
  * @param bs                    The current boot status.  This struct gets
  *                                  updated according to the outcome.
  *
  * @return                      0 on success; nonzero on failure.
  */
 static void
-boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
-        struct boot_status *bs)
+boot_swap_sectors(int idx, uint32_t sz, uint32_t scratch_off,
+        struct boot_loader_state *state, struct boot_status *bs)
 {
     const struct flash_area *fap_primary_slot;
     const struct flash_area *fap_secondary_slot;
@@ -613,8 +830,19 @@ boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
 
     if (bs->state == BOOT_STATUS_STATE_0) {
         BOOT_LOG_DBG("erasing scratch area");
+#ifdef MCUBOOT_SWAP_SCRATCH_POOL
+        rc = swap_scratch_erase_window(state, fap_scratch, scratch_off, sz);
+        assert(rc == 0);
+
+        if (bs->idx == BOOT_STATUS_IDX_0 && swap_scratch_pooled(state)) {
+            rc = swap_scratch_erase_trailer(state, fap_scratch);
+            assert(rc == 0);
+        }
+#else
+        (void)scratch_off;
         rc = boot_erase_region(fap_scratch, 0, flash_area_get_size(fap_scratch));
         assert(rc == 0);
+#endif
 
         if (bs->idx == BOOT_STATUS_IDX_0) {
             /* Write a trailer to the scratch area, even if we don't need the
@@ -636,14 +864,18 @@ boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
                 assert(rc == 0);
 
                 /* Erase the temporary trailer from the scratch area. */
+#ifdef MCUBOOT_SWAP_SCRATCH_POOL
+                rc = swap_scratch_erase_trailer(state, fap_scratch);
+#else
                 rc = boot_erase_region(fap_scratch, 0,
                         flash_area_get_size(fap_scratch));
+#endif
                 assert(rc == 0);
             }
         }
 
         rc = boot_copy_region(state, fap_secondary_slot, fap_scratch,
-                              img_off, 0, copy_sz);
+                              img_off, scratch_off, copy_sz);
         assert(rc == 0);
 
         rc = boot_write_status(state, bs);
@@ -652,11 +884,9 @@ boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
     }
 
     if (bs->state == BOOT_STATUS_STATE_1) {
-        rc = boot_erase_region(fap_secondary_slot, img_off, sz);
-        assert(rc == 0);
-
-        rc = boot_copy_region(state, fap_primary_slot, fap_secondary_slot,
-                              img_off, img_off, copy_sz);
+        rc = swap_erase_and_copy_region(state, bs, fap_primary_slot,
+                                        fap_secondary_slot, img_off, img_off,
+                                        sz, copy_sz);
         assert(rc == 0);
 
         if (bs->idx == BOOT_STATUS_IDX_0 && !bs->use_scratch) {
@@ -673,14 +903,12 @@ boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
     }
 
     if (bs->state == BOOT_STATUS_STATE_2) {
-        rc = boot_erase_region(fap_primary_slot, img_off, sz);
-        assert(rc == 0);
-
         /* NOTE: If this is the final sector, we exclude the image trailer from
          * this copy (copy_sz was truncated earlier).
          */
-        rc = boot_copy_region(state, fap_scratch, fap_primary_slot,
-                              0, img_off, copy_sz);
+        rc = swap_erase_and_copy_region(state, bs, fap_scratch,
+                                        fap_primary_slot, scratch_off, img_off,
+                                        sz, copy_sz);
         assert(rc == 0);
 
         if (bs->use_scratch) {
@@ -734,7 +962,11 @@ boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
         BOOT_STATUS_ASSERT(rc == 0);
 
         if (erase_scratch) {
+#ifdef MCUBOOT_SWAP_SCRATCH_POOL
+            rc = swap_scratch_erase_trailer(state, fap_scratch);
+#else
             rc = boot_erase_region(fap_scratch, 0, flash_area_get_size(fap_scratch));
+#endif
             assert(rc == 0);
         }
     }
@@ -752,16 +984,38 @@ swap_run(struct boot_loader_state *state, struct boot_status *bs,
     int first_sector_idx;
     int last_sector_idx;
     uint32_t swap_idx;
+    uint32_t scratch_off;
+#ifdef MCUBOOT_SWAP_SCRATCH_POOL
+    uint32_t count = 0;
+    int rc;
+#endif
 
     BOOT_LOG_INF("Starting swap using scratch algorithm.");
 
+#ifdef MCUBOOT_SWAP_SCRATCH_POOL
+    if (swap_scratch_pooled(state)) {
+        if (boot_status_is_reset(bs)) {
+            rc = swap_scratch_log_append(state);
+            assert(rc == 0);
+        }
+
+        rc = swap_scratch_log_count(state, &count);
+        assert(rc == 0);
+    }
+#endif
+
     last_sector_idx = find_last_sector_idx(state, copy_size);
 
     swap_idx = 0;
     while (last_sector_idx >= 0) {
         sz = boot_copy_sz(state, last_sector_idx, &first_sector_idx);
         if (swap_idx >= (bs->idx - BOOT_STATUS_IDX_0)) {
-            boot_swap_sectors(first_sector_idx, sz, state, bs);
+#ifdef MCUBOOT_SWAP_SCRATCH_POOL
+            scratch_off = swap_scratch_window_off(state, count, swap_idx);
+#else
+            scratch_off = 0;
+#endif
+            boot_swap_sectors(first_sector_idx, sz, scratch_off, state, bs);
         }
 
         last_sector_idx = first_sector_idx - 1;
@@ -894,6 +1148,10 @@ boot_read_image_header(struct boot_loader_state *state, int slot,
     uint32_t swap_count;
     uint32_t swap_size;
 #endif
+#ifdef MCUBOOT_SWAP_SCRATCH_POOL
+    uint32_t count = 0;
+#endif
+    uint32_t hdr_off = 0;
     int area_id;
     int hdr_slot;
     int rc = 0;
@@ -906,6 +1164,10 @@ boot_read_image_header(struct boot_loader_state *state, int slot,
     (void)state;
 #endif
 
+#ifdef MCUBOOT_TLV_INDEX
+    BOOT_IMG(state, slot).tlv_index.status = BOOT_TLV_INDEX_EMPTY;
+#endif
+
     hdr_slot = slot;
 
 #ifdef MCUBOOT_SWAP_USING_SCRATCH
@@ -943,6 +1205,15 @@ boot_read_image_header(struct boot_loader_state *state, int slot,
                  * scratch area.
                  */
                 hdr_slot = BOOT_NUM_SLOTS;
+#ifdef MCUBOOT_SWAP_SCRATCH_POOL
+                if (swap_scratch_pooled(state)) {
+                    rc = swap_scratch_log_count(state, &count);
+                    if (rc != 0) {
+                        goto done;
+                    }
+                }
+                hdr_off = swap_scratch_window_off(state, count, swap_count - 1);
+#endif
             } else if (slot == BOOT_PRIMARY_SLOT && bs->state >= BOOT_STATUS_STATE_2) {
                 /* After BOOT_STATUS_STATE_2, the primary image's header has been moved to the
                  * secondary slot.
@@ -963,7 +1234,7 @@ boot_read_image_header(struct boot_loader_state *state, int slot,
 
     rc = flash_area_open(area_id, &fap);
     if (rc == 0) {
-        rc = flash_area_read(fap, 0, out_hdr, sizeof *out_hdr);
+        rc = flash_area_read(fap, hdr_off, out_hdr, sizeof *out_hdr);
         flash_area_close(fap);
     }
 
@@ -976,4 +1247,4 @@ done:
     return rc;
 }
 
-#endif /* !MCUBOOT_SWAP_USING_MOVE */
+#endif /* !MCUBOOT_SWAP_USING_MOVE && !MCUBOOT_SWAP_USING_OFFSET */
@@ -23,30 +23,32 @@
 #include "bootutil/image.h"
 #include "bootutil_priv.h"
 
+#ifdef MCUBOOT_TLV_INDEX
+/* Loader state whose images get their TLVs indexed, if any; with the
+ * simulator, that of the boot running in the calling thread.
+ */
+#if defined(__BOOTSIM__)
+static __thread struct boot_loader_state *boot_tlv_index_state;
+#else
+static struct boot_loader_state *boot_tlv_index_state;
+#endif
+
+static struct boot_tlv_index *boot_tlv_index_get(const struct image_header *hdr,
+                                                 const struct flash_area *fap);
+#endif
+
 /*
- * Initialize a TLV iterator.
- *
- * @param it An iterator struct
- * @param hdr image_header of the slot's image
- * @param fap flash_area of the slot which is storing the image
- * @param type Type of TLV to look for
- * @param prot true if TLV has to be stored in the protected area, false otherwise
- *
- * @returns 0 if the TLV iterator was successfully started
- *          -1 on errors
+ * Start a TLV iterator that reads the TLV area from flash.
  */
-int
-bootutil_tlv_iter_begin(struct image_tlv_iter *it, const struct image_header *hdr,
-                        const struct flash_area *fap, uint16_t type, bool prot)
+static int
+bootutil_tlv_iter_scan(struct image_tlv_iter *it, const struct image_header *hdr,
+                       const struct flash_area *fap, uint32_t start_off,
+                       uint16_t type, bool prot)
 {
     uint32_t off_;
     struct image_tlv_info info;
 
-    if (it == NULL || hdr == NULL || fap == NULL) {
-        return -1;
-    }
-
-    off_ = BOOT_TLV_OFF(hdr);
+    off_ = start_off + BOOT_TLV_OFF(hdr);
     if (LOAD_IMAGE_DATA(hdr, fap, off_, &info, sizeof(info))) {
         return -1;
     }
@@ -76,9 +78,105 @@ bootutil_tlv_iter_begin(struct image_tlv_iter *it, const struct image_header *hd
     it->tlv_end = off_ + it->hdr->ih_protect_tlv_size + info.it_tlv_tot;
     // position on first TLV
     it->tlv_off = off_ + sizeof(info);
+    it->index = NULL;
+    it->index_pos = 0;
     return 0;
 }
 
+/*
+ * Initialize a TLV iterator.
+ *
+ * @param it An iterator struct
+ * @param hdr image_header of the slot's image
+ * @param fap flash_area of the slot which is storing the image
+ * @param type Type of TLV to look for
+ * @param prot true if TLV has to be stored in the protected area, false otherwise
+ *
+ * @returns 0 if the TLV iterator was successfully started
+ *          -1 on errors
+ */
+int
+bootutil_tlv_iter_begin(struct image_tlv_iter *it, const struct image_header *hdr,
+                        const struct flash_area *fap, uint16_t type, bool prot)
+{
+    return bootutil_tlv_iter_begin_at(it, hdr, fap, 0, type, prot);
+}
+
+/*
+ * Initialize a TLV iterator over an image stored start_off bytes into its
+ * flash area.  The offsets it returns are still relative to the area.
+ *
+ * @returns 0 if the TLV iterator was successfully started
+ *          -1 on errors
+ */
+int
+bootutil_tlv_iter_begin_at(struct image_tlv_iter *it,
+                           const struct image_header *hdr,
+                           const struct flash_area *fap, uint32_t start_off,
+                           uint16_t type, bool prot)
+{
+#ifdef MCUBOOT_TLV_INDEX
+    const struct boot_tlv_index *idx;
+#endif
+
+    if (it == NULL || hdr == NULL || fap == NULL) {
+        return -1;
+    }
+
+#ifdef MCUBOOT_TLV_INDEX
+    /* Only images stored at the start of their area are indexed. */
+    idx = (start_off == 0) ? boot_tlv_index_get(hdr, fap) : NULL;
+    if (idx != NULL) {
+        it->hdr = hdr;
+        it->fap = fap;
+        it->type = type;
+        it->prot = prot;
+        it->prot_end = idx->prot_end;
+        it->tlv_end = idx->tlv_end;
+        it->tlv_off = BOOT_TLV_OFF(hdr) + sizeof(struct image_tlv_info);
+        it->index = idx;
+        it->index_pos = 0;
+        return 0;
+    }
+#endif
+
+    return bootutil_tlv_iter_scan(it, hdr, fap, start_off, type, prot);
+}
+
+#ifdef MCUBOOT_TLV_INDEX
+/*
+ * Find next TLV, from the image's TLV index.
+ */
+static int
+boot_tlv_index_next(struct image_tlv_iter *it, uint32_t *off, uint16_t *len,
+                    uint16_t *type)
+{
+    const struct boot_tlv_index *idx = it->index;
+    uint8_t pos;
+
+    while (it->index_pos < idx->count) {
+        pos = it->index_pos++;
+
+        /* No more TLVs in the protected area */
+        if (it->prot &&
+            idx->entries[pos].off - sizeof(struct image_tlv) >= it->prot_end) {
+            return 1;
+        }
+
+        if (it->type == IMAGE_TLV_ANY || idx->entries[pos].type == it->type) {
+            if (type != NULL) {
+                *type = idx->entries[pos].type;
+            }
+            *off = idx->entries[pos].off;
+            *len = idx->entries[pos].len;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+#endif
+
 /*
  * Find next TLV
  *
@@ -102,6 +200,12 @@ bootutil_tlv_iter_next(struct image_tlv_iter *it, uint32_t *off, uint16_t *len,
         return -1;
     }
 
+#ifdef MCUBOOT_TLV_INDEX
+    if (it->index != NULL) {
+        return boot_tlv_index_next(it, off, len, type);
+    }
+#endif
+
     while (it->tlv_off < it->tlv_end) {
         if (it->hdr->ih_protect_tlv_size > 0 && it->tlv_off == it->prot_end) {
             it->tlv_off += sizeof(struct image_tlv_info);
@@ -152,3 +256,109 @@ bootutil_tlv_iter_is_prot(struct image_tlv_iter *it, uint32_t off)
 
     return off < it->prot_end;
 }
+
+#ifdef MCUBOOT_TLV_INDEX
+/*
+ * Record the TLVs of an image in its index, in one pass over its TLV area.
+ */
+static void
+boot_tlv_index_build(struct boot_tlv_index *idx, const struct image_header *hdr,
+                     const struct flash_area *fap)
+{
+    struct image_tlv_iter it;
+    uint32_t off;
+    uint16_t len;
+    uint16_t type;
+    int rc;
+
+    idx->status = BOOT_TLV_INDEX_UNUSABLE;
+    idx->fa_id = flash_area_get_id(fap);
+    idx->count = 0;
+
+    rc = bootutil_tlv_iter_scan(&it, hdr, fap, 0, IMAGE_TLV_ANY, false);
+    if (rc) {
+        return;
+    }
+
+    while (true) {
+        rc = bootutil_tlv_iter_next(&it, &off, &len, &type);
+        if (rc < 0) {
+            return;
+        } else if (rc > 0) {
+            break;
+        }
+
+        if (idx->count == MCUBOOT_TLV_INDEX_SIZE) {
+            return;
+        }
+        idx->entries[idx->count].type = type;
+        idx->entries[idx->count].len = len;
+        idx->entries[idx->count].off = off;
+        idx->count++;
+    }
+
+    idx->prot_end = it.prot_end;
+    idx->tlv_end = it.tlv_end;
+    idx->status = BOOT_TLV_INDEX_READY;
+}
+
+/*
+ * Find the index of the image with the given header, building it on first
+ * use.  Only images whose header lives in the attached loader state are
+ * indexed.
+ */
+static struct boot_tlv_index *
+boot_tlv_index_get(const struct image_header *hdr, const struct flash_area *fap)
+{
+    struct boot_loader_state *state = boot_tlv_index_state;
+    struct boot_tlv_index *idx;
+    int image;
+    int slot;
+
+    if (state == NULL) {
+        return NULL;
+    }
+
+    for (image = 0; image < BOOT_IMAGE_NUMBER; image++) {
+        for (slot = 0; slot < BOOT_NUM_SLOTS; slot++) {
+            if (hdr != &state->imgs[image][slot].hdr) {
+                continue;
+            }
+
+            idx = &state->imgs[image][slot].tlv_index;
+            if (idx->status == BOOT_TLV_INDEX_EMPTY ||
+                idx->fa_id != flash_area_get_id(fap)) {
+                /* During a swap the header may be read from another area. */
+                boot_tlv_index_build(idx, hdr, fap);
+            }
+
+            return idx->status == BOOT_TLV_INDEX_READY ? idx : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Index the TLVs of the images of this loader state from now on, or stop
+ * indexing if state is NULL.  Any index left in the state is dropped, as is
+ * that of a slot whenever boot_read_image_header() reads its header again.
+ */
+void
+boot_tlv_index_attach(struct boot_loader_state *state)
+{
+    int image;
+    int slot;
+
+    boot_tlv_index_state = state;
+    if (state == NULL) {
+        return;
+    }
+
+    for (image = 0; image < BOOT_IMAGE_NUMBER; image++) {
+        for (slot = 0; slot < BOOT_NUM_SLOTS; slot++) {
+            state->imgs[image][slot].tlv_index.status = BOOT_TLV_INDEX_EMPTY;
+        }
+    }
+}
+#endif /* MCUBOOT_TLV_INDEX */
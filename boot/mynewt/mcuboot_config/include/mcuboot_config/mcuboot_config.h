@@ -35,9 +35,31 @@
 #if MYNEWT_VAL(BOOT_SERIAL_MGMT_ECHO)
 #define MCUBOOT_BOOT_MGMT_ECHO 1
 #endif
+#if MYNEWT_VAL(BOOT_SERIAL_UPLOAD_WINDOW)
+#define MCUBOOT_SERIAL_UPLOAD_WINDOW MYNEWT_VAL(BOOT_SERIAL_UPLOAD_WINDOW)
+#endif
+#if MYNEWT_VAL(BOOT_SERIAL_WRITE_QUEUE)
+#define MCUBOOT_SERIAL_WRITE_QUEUE MYNEWT_VAL(BOOT_SERIAL_WRITE_QUEUE)
+#endif
+#if MYNEWT_VAL(BOOT_SERIAL_UPLOAD_HASH)
+#define MCUBOOT_SERIAL_UPLOAD_HASH 1
+#endif
+#if MYNEWT_VAL(BOOT_SERIAL_BINARY_FRAMING)
+#define MCUBOOT_SERIAL_BINARY_FRAMING 1
+#endif
+#if MYNEWT_VAL(BOOT_SERIAL_IMG_GRP_HASH)
+#define MCUBOOT_SERIAL_IMG_GRP_HASH 1
+#endif
+#if MYNEWT_VAL(BOOT_SERIAL_COMPRESSED_UPLOAD)
+#define MCUBOOT_SERIAL_COMPRESSED_UPLOAD 1
+#define MCUBOOT_SERIAL_DECOMPRESS_BUF_SIZE MYNEWT_VAL(BOOT_SERIAL_DECOMPRESS_BUF_SIZE)
+#endif
 #if MYNEWT_VAL(BOOTUTIL_VALIDATE_SLOT0)
 #define MCUBOOT_VALIDATE_PRIMARY_SLOT 1
 #endif
+#if MYNEWT_VAL(BOOTUTIL_VALIDATE_SLOT0_CACHE)
+#define MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE 1
+#endif
 #if MYNEWT_VAL(BOOTUTIL_USE_MBED_TLS)
 #define MCUBOOT_USE_MBED_TLS 1
 #endif
@@ -51,6 +51,24 @@ int flash_device_base(uint8_t fd_id, uintptr_t *ret)
     return 0;
 }
 
+#if defined(CONFIG_BOOT_MAPPED_FLASH_READS)
+int flash_area_get_mapped_ptr(const struct flash_area *fa, uint32_t off,
+                              uint32_t len, const void **ptr)
+{
+    /* Only the flash controller's own device is mapped into memory. */
+    if (fa->fa_dev != flash_dev) {
+        return -ENOTSUP;
+    }
+
+    if (off > fa->fa_size || len > fa->fa_size - off) {
+        return -ERANGE;
+    }
+
+    *ptr = (const void *)(FLASH_DEVICE_BASE + fa->fa_off + off);
+    return 0;
+}
+#endif
+
 /*
  * This depends on the mappings defined in sysflash.h.
  * MCUBoot uses continuous numbering for the primary slot, the secondary slot,
@@ -44,6 +44,15 @@ extern "C" {
  */
 int flash_device_base(uint8_t fd_id, uintptr_t *ret);
 
+/*
+ * Retrieve a pointer through which len bytes at off within the flash
+ * area can be read directly, when the area is memory-mapped.
+ *
+ * Returns 0 on success, or an error code if the range is not mapped.
+ */
+int flash_area_get_mapped_ptr(const struct flash_area *fa, uint32_t off,
+                              uint32_t len, const void **ptr);
+
 int flash_area_id_from_image_slot(int slot);
 int flash_area_id_from_multi_image_slot(int image_index, int slot);
 
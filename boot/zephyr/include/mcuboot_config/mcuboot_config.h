@@ -70,6 +70,54 @@
 #define MCUBOOT_VALIDATE_PRIMARY_SLOT_ONCE
 #endif
 
+#ifdef CONFIG_BOOT_VALIDATE_SLOT0_CACHE
+#define MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE
+#endif
+
+#ifdef CONFIG_BOOT_VERIFY_IMG_SEGMENTS
+#define MCUBOOT_VERIFY_IMG_SEGMENTS
+#endif
+
+#ifdef CONFIG_BOOT_TLV_INDEX
+#define MCUBOOT_TLV_INDEX
+#endif
+
+#ifdef CONFIG_BOOT_MULTI_SIG
+#define MCUBOOT_MULTI_SIG
+#define MCUBOOT_MULTI_SIG_THRESHOLD CONFIG_BOOT_MULTI_SIG_THRESHOLD
+#include <zephyr/kernel.h>
+#define MCUBOOT_CYCLE_COUNT() k_cycle_get_32()
+#endif
+
+#ifdef CONFIG_BOOT_CRYPTO_OPS
+#define MCUBOOT_CRYPTO_OPS
+#define MCUBOOT_CRYPTO_OPS_CTX_SIZE CONFIG_BOOT_CRYPTO_OPS_CTX_SIZE
+#endif
+
+#ifdef CONFIG_BOOT_HASH_BLOCK_SIZE
+#define MCUBOOT_HASH_BLOCK_SIZE CONFIG_BOOT_HASH_BLOCK_SIZE
+#endif
+
+#ifdef CONFIG_BOOT_COPY_BUF_SIZE
+#define MCUBOOT_COPY_BUF_SIZE CONFIG_BOOT_COPY_BUF_SIZE
+#endif
+
+#if defined(CONFIG_BOOT_FLASH_PAGE_SIZE) && (CONFIG_BOOT_FLASH_PAGE_SIZE > 0)
+#define MCUBOOT_FLASH_PAGE_SIZE CONFIG_BOOT_FLASH_PAGE_SIZE
+#endif
+
+#ifdef CONFIG_BOOT_COPY_SKIP_UNCHANGED
+#define MCUBOOT_COPY_SKIP_UNCHANGED
+#endif
+
+#ifdef CONFIG_BOOT_DELTA_IMAGES
+#define MCUBOOT_DELTA_IMAGES
+#endif
+
+#ifdef CONFIG_BOOT_MAPPED_FLASH_READS
+#define MCUBOOT_USE_FLASH_AREA_GET_MAPPED_PTR
+#endif
+
 #ifdef CONFIG_BOOT_UPGRADE_ONLY
 #define MCUBOOT_OVERWRITE_ONLY
 #define MCUBOOT_OVERWRITE_ONLY_FAST
@@ -84,6 +132,22 @@
 #define MCUBOOT_SWAP_USING_MOVE 1
 #endif
 
+#ifdef CONFIG_BOOT_SWAP_USING_OFFSET
+#define MCUBOOT_SWAP_USING_OFFSET 1
+#endif
+
+#ifdef CONFIG_BOOT_PARALLEL_UPGRADES
+#define MCUBOOT_PARALLEL_UPGRADES 1
+#endif
+
+#if defined(CONFIG_BOOT_SWAP_MOVE_STATUS_BATCH) && (CONFIG_BOOT_SWAP_MOVE_STATUS_BATCH > 1)
+#define MCUBOOT_SWAP_MOVE_STATUS_BATCH CONFIG_BOOT_SWAP_MOVE_STATUS_BATCH
+#endif
+
+#if defined(CONFIG_BOOT_SWAP_SCRATCH_POOL) && (CONFIG_BOOT_SWAP_SCRATCH_POOL > 1)
+#define MCUBOOT_SWAP_SCRATCH_POOL CONFIG_BOOT_SWAP_SCRATCH_POOL
+#endif
+
 #ifdef CONFIG_BOOT_DIRECT_XIP
 #define MCUBOOT_DIRECT_XIP
 #endif
@@ -147,6 +211,10 @@
 
 #ifdef CONFIG_BOOT_DECOMPRESSION
 #define MCUBOOT_DECOMPRESS_IMAGES
+#define MCUBOOT_DECOMPRESS_BUF_SIZE CONFIG_BOOT_DECOMPRESSION_BUFFER_SIZE
+#if (CONFIG_BOOT_DECOMPRESSION_BUFFER_SIZE % 64) != 0
+#error "CONFIG_BOOT_DECOMPRESSION_BUFFER_SIZE must be a multiple of 64"
+#endif
 #endif
 
 #ifdef CONFIG_BOOT_BOOTSTRAP
@@ -312,6 +380,27 @@
 #define MCUBOOT_SERIAL_MAX_RECEIVE_SIZE CONFIG_BOOT_SERIAL_MAX_RECEIVE_SIZE
 #endif
 
+#ifdef CONFIG_BOOT_SERIAL_BINARY_FRAMING
+#define MCUBOOT_SERIAL_BINARY_FRAMING
+#endif
+
+#if defined(CONFIG_BOOT_SERIAL_UPLOAD_WINDOW) && (CONFIG_BOOT_SERIAL_UPLOAD_WINDOW > 0)
+#define MCUBOOT_SERIAL_UPLOAD_WINDOW CONFIG_BOOT_SERIAL_UPLOAD_WINDOW
+#endif
+
+#if defined(CONFIG_BOOT_SERIAL_WRITE_QUEUE) && (CONFIG_BOOT_SERIAL_WRITE_QUEUE > 0)
+#define MCUBOOT_SERIAL_WRITE_QUEUE CONFIG_BOOT_SERIAL_WRITE_QUEUE
+#endif
+
+#ifdef CONFIG_BOOT_SERIAL_UPLOAD_HASH
+#define MCUBOOT_SERIAL_UPLOAD_HASH
+#endif
+
+#ifdef CONFIG_BOOT_SERIAL_COMPRESSED_UPLOAD
+#define MCUBOOT_SERIAL_COMPRESSED_UPLOAD
+#define MCUBOOT_SERIAL_DECOMPRESS_BUF_SIZE CONFIG_BOOT_SERIAL_DECOMPRESS_BUF_SIZE
+#endif
+
 #ifdef CONFIG_BOOT_SERIAL_UNALIGNED_BUFFER_SIZE
 #define MCUBOOT_SERIAL_UNALIGNED_BUFFER_SIZE CONFIG_BOOT_SERIAL_UNALIGNED_BUFFER_SIZE
 #endif
@@ -34,19 +34,30 @@
 #if defined(MCUBOOT_SIGN_RSA)
 extern const unsigned char rsa_pub_key[];
 extern unsigned int rsa_pub_key_len;
+#if defined(MCUBOOT_HAVE_PUB_KEY_HASH)
+extern const unsigned char rsa_pub_key_hash[];
+#endif
 #elif defined(MCUBOOT_SIGN_EC256)
 extern const unsigned char ecdsa_pub_key[];
 extern unsigned int ecdsa_pub_key_len;
+#if defined(MCUBOOT_HAVE_PUB_KEY_HASH)
+extern const unsigned char ecdsa_pub_key_hash[];
+#endif
 #elif defined(MCUBOOT_SIGN_ED25519)
 extern const unsigned char ed25519_pub_key[];
 extern unsigned int ed25519_pub_key_len;
+#if defined(MCUBOOT_HAVE_PUB_KEY_HASH)
+extern const unsigned char ed25519_pub_key_hash[];
+#endif
 #endif
 #endif
 
 /*
  * NOTE: *_pub_key and *_pub_key_len are autogenerated based on the provided
  *       key file. If no key file was configured, the array and length must be
- *       provided and added to the build manually.
+ *       provided and added to the build manually.  *_pub_key_hash is generated
+ *       along with them (MCUBOOT_HAVE_PUB_KEY_HASH); without it the hash of
+ *       the key is computed at boot.
  */
 #if defined(HAVE_KEYS)
 const struct bootutil_key bootutil_keys[] = {
@@ -54,12 +65,21 @@ const struct bootutil_key bootutil_keys[] = {
 #if defined(MCUBOOT_SIGN_RSA)
         .key = rsa_pub_key,
         .len = &rsa_pub_key_len,
+#if defined(MCUBOOT_HAVE_PUB_KEY_HASH)
+        .hash = rsa_pub_key_hash,
+#endif
 #elif defined(MCUBOOT_SIGN_EC256)
         .key = ecdsa_pub_key,
         .len = &ecdsa_pub_key_len,
+#if defined(MCUBOOT_HAVE_PUB_KEY_HASH)
+        .hash = ecdsa_pub_key_hash,
+#endif
 #elif defined(MCUBOOT_SIGN_ED25519)
         .key = ed25519_pub_key,
         .len = &ed25519_pub_key_len,
+#if defined(MCUBOOT_HAVE_PUB_KEY_HASH)
+        .hash = ed25519_pub_key_hash,
+#endif
 #endif
     },
 };
@@ -51,8 +51,13 @@ boot_image_validate(const struct flash_area *fa_p,
          */
         hdr->ih_flags &= ~(ENCRYPTIONFLAGS);
     }
+#ifdef MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE
+    FIH_CALL(bootutil_img_validate_cached, fih_rc, NULL, 0, hdr, fa_p, tmpbuf,
+             BOOT_TMPBUF_SZ);
+#else
     FIH_CALL(bootutil_img_validate, fih_rc, NULL, 0, hdr, fa_p, tmpbuf,
              BOOT_TMPBUF_SZ, NULL, 0, NULL);
+#endif
 
     FIH_RET(fih_rc);
 }
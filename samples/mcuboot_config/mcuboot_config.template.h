@@ -65,8 +65,41 @@
 /* Uncomment to only erase and overwrite those primary slot sectors needed
  * to install the new image, rather than the entire image slot. */
 /* #define MCUBOOT_OVERWRITE_ONLY_FAST */
+
+/* Uncomment to accept delta images (imgtool sign --delta-base), patches to
+ * the image in the primary slot, as upgrades. */
+/* #define MCUBOOT_DELTA_IMAGES */
+
+/* Uncomment to accept images compressed with imgtool sign --compression
+ * lzma2 or lzma2armthumb as upgrades, decompressing them into the primary
+ * slot.  MCUBOOT_DECOMPRESS_BUF_SIZE (4096 by default) decompressed bytes are
+ * kept in RAM; earlier data is read back from the primary slot. */
+/* #define MCUBOOT_DECOMPRESS_IMAGES */
+/* #define MCUBOOT_DECOMPRESS_BUF_SIZE 4096 */
 #endif
 
+/* With MCUBOOT_SWAP_USING_MOVE, uncomment to record the progress of swaps
+ * once per this many sector operations rather than after each of them, which
+ * saves most status writes on flash with a large write size.  Not supported
+ * with encrypted images. */
+/* #define MCUBOOT_SWAP_MOVE_STATUS_BATCH 8 */
+
+/* With swap using scratch, uncomment to split the scratch area into a pool of
+ * this many windows used in turn by the steps of swaps, followed by a log
+ * sector and the scratch trailer, so that each step only erases its window. */
+/* #define MCUBOOT_SWAP_SCRATCH_POOL 4 */
+
+/* Uncomment to swap images without a scratch area by storing upgrades one
+ * sector past the start of the secondary slot, which must be one sector larger
+ * than the primary slot.  Not supported with encrypted images. */
+/* #define MCUBOOT_SWAP_USING_OFFSET */
+
+/* Uncomment to interleave the swaps of several images, so that erases on one
+ * flash device overlap the swaps of images on others.  Requires swap using
+ * move or offset, and a flash driver that does not wait for erases to
+ * complete before returning. */
+/* #define MCUBOOT_PARALLEL_UPGRADES */
+
 /* Uncomment to enable the direct-xip code path. */
 /* #define MCUBOOT_DIRECT_XIP */
 /* Uncomment to enable the revert mechanism in direct-xip mode. */
@@ -115,6 +148,11 @@
 #define MCUBOOT_ENC_IMAGES
 #endif
 
+/* Uncomment to change the number of AES blocks of key stream generated at a
+ * time (8 by default, using 16 bytes of stack each) when images are
+ * encrypted or decrypted. */
+/* #define MCUBOOT_AES_CTR_BATCH 8 */
+
 /*
  * Always check the signature of the image in the primary slot before booting,
  * even if no upgrade was performed. This is recommended if the boot
@@ -122,6 +160,54 @@
  */
 #define MCUBOOT_VALIDATE_PRIMARY_SLOT
 
+/* Uncomment to keep a record of the last successful validation of the
+ * primary slot in its trailer, so unchanged images are not re-hashed on
+ * every boot.  The port must provide boot_validation_cache_key(). */
+/* #define MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE */
+
+/* Uncomment to check images signed with a segment hash table (imgtool sign
+ * --hash-segment-size) a segment at a time while they are hashed, so corrupt
+ * images are rejected at their first bad segment. */
+/* #define MCUBOOT_VERIFY_IMG_SEGMENTS */
+
+/* Uncomment to index the TLVs of each image the first time one of them is
+ * looked up, so later lookups do not read the TLV area again.  Images with
+ * more than MCUBOOT_TLV_INDEX_SIZE (16) TLVs are still scanned. */
+/* #define MCUBOOT_TLV_INDEX */
+
+/* Uncomment to accept images once MCUBOOT_MULTI_SIG_THRESHOLD (1) of the
+ * built-in keys have signed them, without verifying their other signatures.
+ * Several MCUBOOT_SIGN_* types may then be enabled together.  Define
+ * MCUBOOT_CYCLE_COUNT() to a cycle counter read for bootutil_sig_stats_get()
+ * to report the cost of each signature algorithm. */
+/* #define MCUBOOT_MULTI_SIG */
+/* #define MCUBOOT_MULTI_SIG_THRESHOLD 1 */
+/* #define MCUBOOT_CYCLE_COUNT() 0 */
+
+/* Uncomment to offer image hashing, AES-CTR decryption and signature checks
+ * to a crypto driver registered at run time with
+ * bootutil_crypto_ops_register(), falling back to the library selected
+ * above.  See bootutil/crypto/ops.h. */
+/* #define MCUBOOT_CRYPTO_OPS */
+/* #define MCUBOOT_CRYPTO_OPS_CTX_SIZE 256 */
+
+/* Uncomment to change the size of the buffer images are read into while
+ * being hashed (256 bytes by default).  Larger blocks need fewer flash reads;
+ * the port may also lend a buffer at run time with boot_set_hash_arena(). */
+/* #define MCUBOOT_HASH_BLOCK_SIZE 4096 */
+
+/* Uncomment to change the size of the buffer images are copied through
+ * during upgrades (1024 bytes by default), e.g. to a flash sector so each is
+ * written at once; the port may also lend a buffer at run time with
+ * boot_set_copy_arena().  Define MCUBOOT_FLASH_PAGE_SIZE to split those
+ * writes on program page boundaries. */
+/* #define MCUBOOT_COPY_BUF_SIZE 4096 */
+/* #define MCUBOOT_FLASH_PAGE_SIZE 256 */
+
+/* Uncomment to have swap upgrades leave alone the sectors that already hold
+ * the data they would receive, and image copies skip writing erased data. */
+/* #define MCUBOOT_COPY_SKIP_UNCHANGED */
+
 /*
  * Flash abstraction
  */
@@ -130,6 +216,23 @@
  * See the flash APIs for more details. */
 /* #define MCUBOOT_USE_FLASH_AREA_GET_SECTORS */
 
+/* Uncomment if your flash map API supports flash_area_get_mapped_ptr(), so
+ * images on memory-mapped flash are hashed in place rather than copied.
+ * See the flash APIs for more details. */
+/* #define MCUBOOT_USE_FLASH_AREA_GET_MAPPED_PTR */
+
+/* Uncomment if your flash map API supports flash_area_read_submit() and
+ * flash_area_read_wait(), to overlap flash reads (e.g. DMA from an external
+ * SPI-NOR) with hashing and copying of the previous block.
+ * See the flash APIs for more details. */
+/* #define MCUBOOT_USE_FLASH_AREA_ASYNC_READ */
+
+/* Uncomment if your flash map API supports flash_area_erase_submit() and
+ * flash_area_erase_poll(), to erase the next sector while the previous one is
+ * programmed when copying images, e.g. on flash with several banks.
+ * See the flash APIs for more details. */
+/* #define MCUBOOT_USE_FLASH_AREA_ASYNC_ERASE */
+
 /* Default maximum number of flash sectors per image slot; change
  * as desirable. */
 #define MCUBOOT_MAX_IMG_SECTORS 128
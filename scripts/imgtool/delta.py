@@ -0,0 +1,157 @@
+# SPDX-License-Identifier: Apache-2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""
+Delta images.
+
+The body of a delta image is a patch that the bootloader applies in place to
+the image in the primary slot (the base image) to get a complete new signed
+image.  It is a sequence of operations, in the order of the bytes they
+produce:
+
+    u32 op      bits 31-30: OP_COPY or OP_ADD, bits 29-0: length
+    u32 src     OP_COPY only: offset of the bytes in the base image
+    u8  data[]  OP_ADD only: the bytes themselves
+
+Words are little endian.
+
+The bootloader rebuilds the new image from its last sector down to its first
+one, so the bytes copied into a sector must come from at or below the end of
+that sector in the base image.
+"""
+
+import struct
+
+from .image import (IMAGE_MAGIC, TLV_INFO_MAGIC, TLV_PROT_INFO_MAGIC,
+                    TLV_VALUES)
+
+OP_COPY = 1
+OP_ADD = 2
+OP_SHIFT = 30
+MAX_OP_LEN = (1 << OP_SHIFT) - 1
+
+# Shorter matches cost more as COPY operations than as literal bytes.
+MIN_MATCH = 16
+# Base image offsets indexed for matches; code is mostly word aligned.
+INDEX_STEP = 4
+# Candidate matches tried for each block.
+MAX_CANDIDATES = 8
+
+HASH_TLVS = (TLV_VALUES['SHA256'], TLV_VALUES['SHA384'], TLV_VALUES['SHA512'])
+
+
+def parse_base(data, endian='little'):
+    """Return the signed part and the hash of the base image in data."""
+    e = '<' if endian == 'little' else '>'
+    magic, _, header_size, _, img_size = struct.unpack(e + 'IIHHI', data[:16])
+    if magic != IMAGE_MAGIC:
+        raise ValueError("Delta base is not a signed image")
+
+    off = header_size + img_size
+    magic, tlv_tot = struct.unpack(e + 'HH', data[off:off + 4])
+    if magic == TLV_PROT_INFO_MAGIC:
+        off += tlv_tot
+        magic, tlv_tot = struct.unpack(e + 'HH', data[off:off + 4])
+    if magic != TLV_INFO_MAGIC:
+        raise ValueError("Delta base has no TLV area")
+
+    end = off + tlv_tot
+    off += 4
+    while off < end:
+        tlv_type, tlv_len = struct.unpack(e + 'HH', data[off:off + 4])
+        if tlv_type in HASH_TLVS:
+            return data[:end], data[off + 4:off + 4 + tlv_len]
+        off += 4 + tlv_len
+    raise ValueError("Delta base has no hash TLV")
+
+
+class _Patch:
+    def __init__(self):
+        self.data = bytearray()
+
+    def copy(self, src, length):
+        while length > 0:
+            n = min(length, MAX_OP_LEN)
+            self.data += struct.pack('<II', (OP_COPY << OP_SHIFT) | n, src)
+            src += n
+            length -= n
+
+    def add(self, data):
+        for i in range(0, len(data), MAX_OP_LEN):
+            chunk = data[i:i + MAX_OP_LEN]
+            self.data += struct.pack('<I', (OP_ADD << OP_SHIFT) | len(chunk))
+            self.data += chunk
+
+
+def _match_len(base, src, target, pos, limit):
+    """Length of the common run of base[src:] and target[pos:], up to limit"""
+    n = 0
+    while n < limit:
+        step = min(64, limit - n)
+        if base[src + n:src + n + step] == target[pos + n:pos + n + step]:
+            n += step
+            continue
+        while n < limit and base[src + n] == target[pos + n]:
+            n += 1
+        break
+    return n
+
+
+def make_patch(base, target, sector_size):
+    """
+    Encode target, the complete signed new image, as a patch to base, the
+    complete signed image in the primary slot.
+
+    sector_size must divide the size of every primary slot sector.
+    """
+    base = bytes(base)
+    target = bytes(target)
+    index = {}
+    for off in range(0, len(base) - MIN_MATCH + 1, INDEX_STEP):
+        index.setdefault(base[off:off + MIN_MATCH], []).append(off)
+
+    patch = _Patch()
+    added = 0
+    pos = 0
+    while pos < len(target):
+        sector_end = (pos // sector_size + 1) * sector_size
+        candidates = []
+        if pos + MIN_MATCH <= len(base):
+            candidates.append(pos)
+        candidates += index.get(bytes(target[pos:pos + MIN_MATCH]),
+                                [])[-MAX_CANDIDATES:]
+
+        best_src, best_len = 0, 0
+        for src in candidates:
+            limit = min(len(target) - pos, len(base) - src)
+            if src > pos:
+                # Copying from higher up is only possible within the
+                # sector, which is still unchanged then.
+                limit = min(limit, sector_end - src)
+            if limit <= best_len:
+                continue
+            n = _match_len(base, src, target, pos, limit)
+            if n > best_len:
+                best_src, best_len = src, n
+
+        if best_len >= MIN_MATCH:
+            patch.add(target[added:pos])
+            patch.copy(best_src, best_len)
+            pos += best_len
+            added = pos
+        else:
+            pos += 1
+    patch.add(target[added:])
+
+    return bytes(patch.data)
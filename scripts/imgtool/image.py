@@ -71,6 +71,7 @@ IMAGE_F = {
         'COMPRESSED_LZMA1':      0x0000200,
         'COMPRESSED_LZMA2':      0x0000400,
         'COMPRESSED_ARM_THUMB':  0x0000800,
+        'DELTA':                 0x0001000,
 }
 
 TLV_VALUES = {
@@ -94,6 +95,9 @@ TLV_VALUES = {
         'DECOMP_SIZE': 0x70,
         'DECOMP_SHA': 0x71,
         'DECOMP_SIGNATURE': 0x72,
+        'SEG_HASH': 0x80,
+        'DELTA_BASE_SHA': 0x90,
+        'DELTA_SIZE': 0x91,
 }
 
 TLV_SIZE = 4
@@ -362,6 +366,10 @@ class Image:
 
         self.check_header()
 
+    def load_delta(self, patch):
+        """Load the patch of a delta image from buffer"""
+        self.load_compressed(patch, b'')
+
     def save(self, path, hex_addr=None):
         """Save an image from a given file"""
         ext = os.path.splitext(path)[1][1:].lower()
@@ -447,7 +455,8 @@ class Image:
     def create(self, key, public_key_format, enckey, dependencies=None,
                sw_type=None, custom_tlvs=None, compression_tlvs=None,
                compression_type=None, encrypt_keylen=128, clear=False,
-               fixed_sig=None, pub_key=None, vector_to_sign=None, user_sha='auto'):
+               fixed_sig=None, pub_key=None, vector_to_sign=None, user_sha='auto',
+               hash_segment_size=None, delta_tlvs=None):
         self.enckey = enckey
 
         # key decides on sha, then pub_key; of both are none default is used
@@ -515,6 +524,26 @@ class Image:
         if custom_tlvs is not None:
             for value in custom_tlvs.values():
                 protected_tlv_size += TLV_SIZE + len(value)
+        if delta_tlvs is not None:
+            for value in delta_tlvs.values():
+                protected_tlv_size += TLV_SIZE + len(value)
+
+        if hash_segment_size is not None:
+            if hash_segment_size <= 0:
+                raise click.UsageError("Hash segment size must be positive")
+            # The segment hashes cover the header and the image, which is
+            # padded below when encrypting.
+            hashed_size = len(self.payload)
+            if self.enckey is not None:
+                hashed_size += -len(self.payload) % 16
+            hash_segment_count = -(-hashed_size // hash_segment_size)
+            hash_segment_len = 4 + hash_segment_count * \
+                hash_algorithm().digest_size
+            if hash_segment_len > 0xffff:
+                raise click.UsageError(
+                    "Hash segment size {} is too small for this image".format(
+                        hash_segment_size))
+            protected_tlv_size += TLV_SIZE + hash_segment_len
 
         if protected_tlv_size != 0:
             # Add the size of the TLV info header
@@ -539,6 +568,8 @@ class Image:
                 compression_flags = IMAGE_F['COMPRESSED_LZMA2']
                 if compression_type == "lzma2armthumb":
                     compression_flags |= IMAGE_F['COMPRESSED_ARM_THUMB']
+        if delta_tlvs is not None:
+            compression_flags |= IMAGE_F['DELTA']
         # This adds the header to the payload as well
         if encrypt_keylen == 256:
             self.add_header(enckey, protected_tlv_size, compression_flags, 256)
@@ -579,6 +610,19 @@ class Image:
             if custom_tlvs is not None:
                 for tag, value in custom_tlvs.items():
                     prot_tlv.add(tag, value)
+            if delta_tlvs is not None:
+                for tag, value in delta_tlvs.items():
+                    prot_tlv.add(tag, value)
+
+            if hash_segment_size is not None:
+                # One digest of the plain text per segment of the header
+                # and image, so the image can be checked a segment at a time.
+                payload = struct.pack(e + 'I', hash_segment_size)
+                for off in range(0, len(self.payload), hash_segment_size):
+                    sha = hash_algorithm()
+                    sha.update(self.payload[off:off + hash_segment_size])
+                    payload += sha.digest()
+                prot_tlv.add('SEG_HASH', payload)
 
             protected_tlv_off = len(self.payload)
             self.payload += prot_tlv.get()
@@ -71,14 +71,12 @@ class KeyClass(object):
                            .format(self.shortname()),
                 file=file)
 
-    def emit_c_public_hash(self, file=sys.stdout):
-        digest = Hash(SHA256())
-        digest.update(self.get_public_bytes())
+    def emit_c_public_hash(self, file=sys.stdout, hash_algorithm=None):
         self._emit(
                 header="const unsigned char {}_pub_key_hash[] = {{"
                        .format(self.shortname()),
                 trailer="};",
-                encoded_bytes=digest.finalize(),
+                encoded_bytes=self._public_hash(hash_algorithm),
                 indent="    ",
                 len_format="const unsigned int {}_pub_key_hash_len = {{}};"
                            .format(self.shortname()),
@@ -87,10 +85,17 @@ class KeyClass(object):
     def emit_raw_public(self, file=sys.stdout):
         self._emit_raw(self.get_public_bytes(), file=file)
 
-    def emit_raw_public_hash(self, file=sys.stdout):
-        digest = Hash(SHA256())
-        digest.update(self.get_public_bytes())
-        self._emit_raw(digest.finalize(), file=file)
+    def emit_raw_public_hash(self, file=sys.stdout, hash_algorithm=None):
+        self._emit_raw(self._public_hash(hash_algorithm), file=file)
+
+    def _public_hash(self, hash_algorithm=None):
+        """Hash of the public key; SHA256 unless a hashlib constructor is
+        given."""
+        if hash_algorithm is None:
+            digest = Hash(SHA256())
+            digest.update(self.get_public_bytes())
+            return digest.finalize()
+        return hash_algorithm(self.get_public_bytes()).digest()
 
     def emit_rust_public(self, file=sys.stdout):
         self._emit(
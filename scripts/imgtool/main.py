@@ -27,7 +27,8 @@ import os
 import lzma
 import hashlib
 import base64
-from imgtool import image, imgtool_version
+from intelhex import IntelHex
+from imgtool import delta, image, imgtool_version
 from imgtool.version import decode_version
 from imgtool.dumpinfo import dump_imginfo
 from .keys import (
@@ -181,8 +182,12 @@ def getpub(key, encoding, lang, output):
 @click.option('-o', '--output', metavar='output', required=False,
               help='Specify the output file\'s name. \
                     The stdout is used if it is not provided.')
-@click.command(help='Dump the SHA256 hash of the public key')
-def getpubhash(key, output, encoding):
+@click.option('--sha', 'user_sha', type=click.Choice(valid_sha), default='auto',
+              help='selected sha algorithm to use; defaults to "auto" which is '
+              'the default of "sign" for the key type, so the hash matches '
+              'the one the bootloader computes for the key')
+@click.command(help='Dump the hash of the public key')
+def getpubhash(key, output, encoding, user_sha):
     if not encoding:
         encoding = valid_hash_encodings[0]
     key = load_key(key)
@@ -191,10 +196,12 @@ def getpubhash(key, output, encoding):
         output = sys.stdout
     if key is None:
         print("Invalid passphrase")
-    elif encoding == 'lang-c':
-        key.emit_c_public_hash(file=output)
+        return
+    hash_algorithm, _ = image.key_and_user_sha_to_alg_and_tlv(key, user_sha)
+    if encoding == 'lang-c':
+        key.emit_c_public_hash(file=output, hash_algorithm=hash_algorithm)
     elif encoding == 'raw':
-        key.emit_raw_public_hash(file=output)
+        key.emit_raw_public_hash(file=output, hash_algorithm=hash_algorithm)
     else:
         raise click.UsageError()
 
@@ -433,6 +440,17 @@ class BasedIntParamType(click.ParamType):
               help='send to OUTFILE the payload or payload''s digest instead '
               'of complied image. These data can be used for external image '
               'signing')
+@click.option('--hash-segment-size', type=BasedIntParamType(), required=False,
+              help='Add a protected TLV with the hash of every segment of '
+              'this many bytes of the image, so that the bootloader can check '
+              'it a segment at a time')
+@click.option('--delta-base', metavar='filename', required=False,
+              help='Output a delta image, a patch to this signed image in '
+              'the primary slot, if it is smaller than the full image. Only '
+              'supported in overwrite-only mode.')
+@click.option('--delta-sector-size', type=BasedIntParamType(), default=4096,
+              help='A size that divides every primary slot sector, for '
+              '--delta-base (default 4096)')
 @click.command(help='''Create a signed or unsigned image\n
                INFILE and OUTFILE are parsed as Intel HEX if the params have
                .hex extension, otherwise binary format is used''')
@@ -442,7 +460,7 @@ def sign(key, public_key_format, align, version, pad_sig, header_size,
          dependencies, load_addr, hex_addr, erased_val, save_enctlv,
          security_counter, boot_record, custom_tlv, rom_fixed, max_align,
          clear, fix_sig, fix_sig_pubkey, sig_out, user_sha, vector_to_sign,
-         non_bootable):
+         non_bootable, hash_segment_size, delta_base, delta_sector_size):
 
     if confirm:
         # Confirmed but non-padded images don't make much sense, because
@@ -457,6 +475,14 @@ def sign(key, public_key_format, align, version, pad_sig, header_size,
                       security_counter=security_counter, max_align=max_align,
                       non_bootable=non_bootable)
     compression_tlvs = {}
+    if delta_base and (encrypt or compression != 'disabled'):
+        raise click.UsageError('Delta images can be neither encrypted nor '
+                               'compressed')
+    if delta_base and (fix_sig or vector_to_sign):
+        raise click.UsageError('Delta images cannot be signed externally')
+    if hash_segment_size and compression != 'disabled':
+        raise click.UsageError('Compressed images cannot have a segment '
+                               'hash table')
     img.load(infile)
     key = load_key(key) if key else None
     enckey = load_key(encrypt) if encrypt else None
@@ -511,7 +537,8 @@ def sign(key, public_key_format, align, version, pad_sig, header_size,
 
     img.create(key, public_key_format, enckey, dependencies, boot_record,
                custom_tlvs, compression_tlvs, None, int(encrypt_keylen), clear,
-               baked_signature, pub_key, vector_to_sign, user_sha)
+               baked_signature, pub_key, vector_to_sign, user_sha,
+               hash_segment_size)
 
     if compression in ["lzma2", "lzma2armthumb"]:
         compressed_img = image.Image(version=decode_version(version),
@@ -521,7 +548,8 @@ def sign(key, public_key_format, align, version, pad_sig, header_size,
                   overwrite_only=overwrite_only, endian=endian,
                   load_addr=load_addr, rom_fixed=rom_fixed,
                   erased_val=erased_val, save_enctlv=save_enctlv,
-                  security_counter=security_counter, max_align=max_align)
+                  security_counter=security_counter, max_align=max_align,
+                  non_bootable=non_bootable)
         compression_filters = [
             {"id": lzma.FILTER_LZMA2, "preset": comp_default_preset,
                 "dict_size": comp_default_dictsize, "lp": comp_default_lp,
@@ -554,12 +582,59 @@ def sign(key, public_key_format, align, version, pad_sig, header_size,
                compression, int(encrypt_keylen), clear, baked_signature,
                pub_key, vector_to_sign)
             img = compressed_img
+
+    if delta_base:
+        # Images are only padded as they are saved: the patch and DELTA_SIZE
+        # are those of the unpadded image, and only the image saved is padded.
+        base_hash, patch = make_delta(delta_base, img, delta_sector_size)
+        full_size = len(img.payload)
+        print(f"delta image size: {len(patch)} bytes")
+        print(f"full image size: {full_size} bytes")
+        delta_img = image.Image(version=decode_version(version),
+                  header_size=header_size, pad_header=pad_header,
+                  pad=pad, confirm=confirm, align=int(align),
+                  slot_size=slot_size, max_sectors=max_sectors,
+                  overwrite_only=overwrite_only, endian=endian,
+                  load_addr=load_addr, rom_fixed=rom_fixed,
+                  erased_val=erased_val, save_enctlv=save_enctlv,
+                  security_counter=security_counter, max_align=max_align,
+                  non_bootable=non_bootable)
+        delta_img.load_delta(patch)
+        delta_img.base_addr = img.base_addr
+        delta_tlvs = {
+            'DELTA_BASE_SHA': base_hash,
+            'DELTA_SIZE': struct.pack(img.get_struct_endian() + 'L',
+                                      full_size),
+        }
+        delta_img.create(key, public_key_format, None, dependencies,
+               boot_record, custom_tlvs, {}, None, int(encrypt_keylen),
+               clear, None, None, None, user_sha, None,
+               delta_tlvs)
+        if len(delta_img.payload) < full_size:
+            img = delta_img
     img.save(outfile, hex_addr)
     if sig_out is not None:
         new_signature = img.get_signature()
         save_signature(sig_out, new_signature)
 
 
+def make_delta(base_path, img, sector_size):
+    ext = os.path.splitext(base_path)[1][1:].lower()
+    try:
+        if ext == image.INTEL_HEX_EXT:
+            data = IntelHex(base_path).tobinstr()
+        else:
+            with open(base_path, 'rb') as f:
+                data = f.read()
+    except FileNotFoundError:
+        raise click.UsageError("Delta base file not found")
+    try:
+        base, base_hash = delta.parse_base(data, img.endian or 'little')
+    except (ValueError, struct.error) as e:
+        raise click.UsageError(str(e))
+    return base_hash, delta.make_patch(base, img.payload, sector_size)
+
+
 class AliasesGroup(click.Group):
 
     _aliases = {
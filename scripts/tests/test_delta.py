@@ -0,0 +1,198 @@
+# SPDX-License-Identifier: Apache-2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import random
+import struct
+from pathlib import Path
+
+import pytest
+from click.testing import CliRunner
+
+from imgtool.delta import OP_ADD, OP_COPY, OP_SHIFT, parse_base
+from imgtool.image import (
+    IMAGE_F,
+    Image,
+    TLV_PROT_INFO_MAGIC,
+    TLV_VALUES,
+    VerifyResult,
+)
+from imgtool.main import imgtool
+
+HEADER_SIZE = 0x200
+SLOT_SIZE = 0x7a000
+SECTOR_SIZE = 0x1000
+
+
+@pytest.fixture
+def key_file() -> Path:
+    return Path(__file__).parents[2] / 'root-ec-p256.pem'
+
+
+def sign(in_file: Path, out_file: Path, key_file: Path, version: str,
+         *args) -> None:
+    result = CliRunner().invoke(
+        imgtool,
+        [
+            'sign',
+            str(in_file),
+            str(out_file),
+            f'--header-size={HEADER_SIZE}',
+            f'--slot-size={SLOT_SIZE}',
+            f'--version={version}',
+            '--pad-header',
+            f'--key={key_file}',
+            *args
+        ],
+    )
+    assert result.exit_code == 0
+
+
+def delta_tlvs(image: bytes):
+    """Return the flags, patch and delta TLVs of a delta image"""
+    _, _, header_size, prot_size, img_size, flags = struct.unpack(
+        'IIHHII', image[:20])
+    off = header_size + img_size
+    magic, _ = struct.unpack('HH', image[off:off + 4])
+    assert magic == TLV_PROT_INFO_MAGIC
+    end = off + prot_size
+    off += 4
+    tlvs = {}
+    while off < end:
+        tlv_type, tlv_len = struct.unpack('HH', image[off:off + 4])
+        tlvs[tlv_type] = image[off + 4:off + 4 + tlv_len]
+        off += 4 + tlv_len
+    return flags, image[header_size:header_size + img_size], tlvs
+
+
+def apply_patch(base: bytes, patch: bytes, size: int) -> bytes:
+    """Apply patch in place to base, a sector at a time from the last one"""
+    ops = []
+    off = 0
+    tgt = 0
+    while off < len(patch):
+        op, = struct.unpack('<I', patch[off:off + 4])
+        kind, length = op >> OP_SHIFT, op & ((1 << OP_SHIFT) - 1)
+        if kind == OP_COPY:
+            src, = struct.unpack('<I', patch[off + 4:off + 8])
+            ops.append((tgt, length, src, None))
+            off += 8
+        else:
+            assert kind == OP_ADD
+            ops.append((tgt, length, None, patch[off + 4:off + 4 + length]))
+            off += 4 + length
+        tgt += length
+    assert tgt == size
+
+    flash = bytearray(base) + bytearray([0xff] * max(0, size - len(base)))
+    for start in reversed(range(0, size, SECTOR_SIZE)):
+        stop = min(start + SECTOR_SIZE, size)
+        sector = bytearray()
+        for op_tgt, length, src, data in ops:
+            lo, hi = max(op_tgt, start), min(op_tgt + length, stop)
+            if lo >= hi:
+                continue
+            if data is None:
+                sector += flash[src + lo - op_tgt:src + hi - op_tgt]
+            else:
+                sector += data[lo - op_tgt:hi - op_tgt]
+        flash[start:stop] = sector
+    return bytes(flash[:size])
+
+
+def test_delta(tmpdir: Path, key_file: Path):
+    """
+    Test that ``imgtool sign --delta-base`` outputs a patch to the base image
+    that rebuilds the new signed image when applied in place.
+    """
+    rng = random.Random(0)
+    base_data = bytes(rng.getrandbits(8) for _ in range(0x6000))
+    # Change a few bytes, grow a function and drop some data further on.
+    new_data = bytearray(base_data)
+    new_data[0x100:0x104] = b'\x01\x02\x03\x04'
+    new_data[0x2000:0x2000] = bytes(rng.getrandbits(8) for _ in range(0x40))
+    del new_data[0x4800:0x4830]
+    new_data = bytes(new_data)
+
+    base_in = tmpdir / 'base.bin'
+    base_in.write_binary(base_data)
+    base_out = tmpdir / 'base_signed.bin'
+    sign(base_in, base_out, key_file, '1.0.0')
+
+    new_in = tmpdir / 'new.bin'
+    new_in.write_binary(new_data)
+    new_out = tmpdir / 'new_signed.bin'
+    sign(new_in, new_out, key_file, '1.1.0', f'--delta-base={base_out}',
+         f'--delta-sector-size={SECTOR_SIZE}')
+
+    with open(new_out, 'rb') as f:
+        image = f.read()
+    flags, patch, tlvs = delta_tlvs(image)
+    assert flags & IMAGE_F['DELTA']
+    assert len(image) < len(new_data) // 2
+
+    # The patch and the delta TLVs are part of the signed region.
+    result, _, _ = Image.verify(str(new_out), None)
+    assert result == VerifyResult.OK
+
+    with open(base_out, 'rb') as f:
+        base, base_hash = parse_base(f.read())
+    assert tlvs[TLV_VALUES['DELTA_BASE_SHA']] == base_hash
+    size, = struct.unpack('I', tlvs[TLV_VALUES['DELTA_SIZE']])
+
+    patched = tmpdir / 'patched.bin'
+    patched.write_binary(apply_patch(base, patch, size))
+    result, _, _ = Image.verify(str(patched), None)
+    assert result == VerifyResult.OK
+    with open(patched, 'rb') as f:
+        data = f.read()
+    assert data[HEADER_SIZE:HEADER_SIZE + len(new_data)] == new_data
+
+
+def test_delta_pad(tmpdir: Path, key_file: Path):
+    """
+    Test that ``imgtool sign --delta-base --pad`` pads the delta image, not
+    the image the patch rebuilds.
+    """
+    rng = random.Random(1)
+    base_data = bytes(rng.getrandbits(8) for _ in range(0x6000))
+    new_data = bytearray(base_data)
+    new_data[0x100:0x104] = b'\x01\x02\x03\x04'
+    new_data = bytes(new_data)
+
+    base_in = tmpdir / 'base.bin'
+    base_in.write_binary(base_data)
+    base_out = tmpdir / 'base_signed.bin'
+    sign(base_in, base_out, key_file, '1.0.0', '--pad')
+
+    new_in = tmpdir / 'new.bin'
+    new_in.write_binary(new_data)
+    new_out = tmpdir / 'new_signed.bin'
+    sign(new_in, new_out, key_file, '1.1.0', '--pad',
+         f'--delta-base={base_out}', f'--delta-sector-size={SECTOR_SIZE}')
+
+    with open(new_out, 'rb') as f:
+        image = f.read()
+    assert len(image) == SLOT_SIZE
+    flags, patch, tlvs = delta_tlvs(image)
+    assert flags & IMAGE_F['DELTA']
+
+    with open(base_out, 'rb') as f:
+        base, _ = parse_base(f.read())
+    size, = struct.unpack('I', tlvs[TLV_VALUES['DELTA_SIZE']])
+    assert size < len(new_data) + 0x400
+
+    patched = tmpdir / 'patched.bin'
+    patched.write_binary(apply_patch(base, patch, size))
+    result, _, _ = Image.verify(str(patched), None)
+    assert result == VerifyResult.OK
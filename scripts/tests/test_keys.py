@@ -177,6 +177,50 @@ def test_getpubhash(key_type, encoding, tmp_path_persistent):
     assert pub_key_hash.stat().st_size > 0
 
 
+
+@pytest.mark.parametrize(
+    "key_type,sha,size",
+    [
+        ("ecdsa-p256", "auto", 32),
+        ("ecdsa-p384", "auto", 48),
+        ("ed25519", "auto", 32),
+        ("ed25519", "512", 64),
+    ],
+)
+def test_getpubhash_sha(key_type, sha, size, tmp_path_persistent):
+    """Hash the public key with the algorithm used to sign images"""
+    runner = CliRunner()
+
+    gen_key = tmp_name(tmp_path_persistent, key_type, GEN_KEY_EXT)
+    pub_key_hash = tmp_name(
+        tmp_path_persistent, key_type, PUB_KEY_HASH_EXT + ".sha" + sha
+    )
+
+    result = runner.invoke(
+        imgtool,
+        [
+            "getpubhash",
+            "--key",
+            str(gen_key),
+            "--output",
+            str(pub_key_hash),
+            "--encoding",
+            "raw",
+            "--sha",
+            sha,
+        ],
+    )
+    assert result.exit_code == 0
+    assert pub_key_hash.stat().st_size == size
+
+    # Key types that are only signed with one algorithm reject others.
+    if key_type == "ecdsa-p256":
+        result = runner.invoke(
+            imgtool,
+            ["getpubhash", "--key", str(gen_key), "--sha", "512"],
+        )
+        assert result.exit_code != 0
+
 @pytest.mark.parametrize("key_type", KEY_TYPES)
 def test_sign_verify(key_type, tmp_path_persistent):
     """Test basic sign and verify"""
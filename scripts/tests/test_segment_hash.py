@@ -0,0 +1,100 @@
+# SPDX-License-Identifier: Apache-2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import hashlib
+import struct
+from pathlib import Path
+
+import pytest
+from click.testing import CliRunner
+
+from imgtool.image import (
+    Image,
+    TLV_PROT_INFO_MAGIC,
+    TLV_VALUES,
+    VerifyResult,
+)
+from imgtool.main import imgtool
+
+VERSION = '2.0.0'
+HEADER_SIZE = 0x200
+SLOT_SIZE = 0x7a000
+
+
+@pytest.fixture
+def key_file() -> Path:
+    return Path(__file__).parents[2] / 'root-ec-p256.pem'
+
+
+def segment_table(image: bytes):
+    """Return the segment size and digests of the segment hash TLV"""
+    _, _, header_size, prot_size, img_size = struct.unpack('IIHHI',
+                                                           image[:16])
+    off = header_size + img_size
+    magic, _ = struct.unpack('HH', image[off:off + 4])
+    assert magic == TLV_PROT_INFO_MAGIC
+    end = off + prot_size
+    off += 4
+    while off < end:
+        tlv_type, tlv_len = struct.unpack('HH', image[off:off + 4])
+        if tlv_type == TLV_VALUES['SEG_HASH']:
+            value = image[off + 4:off + 4 + tlv_len]
+            seg_size, = struct.unpack('I', value[:4])
+            digests = [value[i:i + 32] for i in range(4, len(value), 32)]
+            return seg_size, digests, image[:header_size + img_size]
+        off += 4 + tlv_len
+    return None
+
+
+@pytest.mark.parametrize('seg_size', [0x100, 0x400, 0x1000])
+def test_segment_hash(tmpdir: Path, key_file: Path, seg_size: int):
+    """
+    Test that ``imgtool sign --hash-segment-size`` adds a protected table
+    with the hash of every segment of the header and image.
+    """
+    in_file = tmpdir / 'zephyr.bin'
+    with in_file.open("wb") as f:
+        f.write(b"hello world\x00\x00\x00\x00\x00" * 200)
+    out_file: Path = tmpdir / 'zephyr_signed.bin'
+
+    runner = CliRunner()
+    result = runner.invoke(
+        imgtool,
+        [
+            'sign',
+            str(in_file),
+            str(out_file),
+            f'--header-size={HEADER_SIZE}',
+            f'--slot-size={SLOT_SIZE}',
+            f'--version={VERSION}',
+            '--pad-header',
+            f'--hash-segment-size={seg_size}',
+            f'--key={key_file}'
+        ],
+    )
+    assert result.exit_code == 0
+
+    with open(out_file, 'rb') as f:
+        table = segment_table(f.read())
+    assert table is not None
+    size, digests, hashed = table
+    assert size == seg_size
+    assert len(digests) == -(-len(hashed) // seg_size)
+    for i, digest in enumerate(digests):
+        segment = hashed[i * seg_size:(i + 1) * seg_size]
+        assert hashlib.sha256(segment).digest() == digest
+
+    # The table is part of the signed region.
+    result, _, _ = Image.verify(str(out_file), None)
+    assert result == VerifyResult.OK
@@ -20,6 +20,7 @@ fn main() {
     let sig_ed25519 = env::var("CARGO_FEATURE_SIG_ED25519").is_ok();
     let overwrite_only = env::var("CARGO_FEATURE_OVERWRITE_ONLY").is_ok();
     let swap_move = env::var("CARGO_FEATURE_SWAP_MOVE").is_ok();
+    let swap_offset = env::var("CARGO_FEATURE_SWAP_OFFSET").is_ok();
     let validate_primary_slot =
                   env::var("CARGO_FEATURE_VALIDATE_PRIMARY_SLOT").is_ok();
     let enc_rsa = env::var("CARGO_FEATURE_ENC_RSA").is_ok();
@@ -38,6 +39,20 @@ fn main() {
     let direct_xip = env::var("CARGO_FEATURE_DIRECT_XIP").is_ok();
     let max_align_32 = env::var("CARGO_FEATURE_MAX_ALIGN_32").is_ok();
     let hw_rollback_protection = env::var("CARGO_FEATURE_HW_ROLLBACK_PROTECTION").is_ok();
+    let mapped_flash = env::var("CARGO_FEATURE_MAPPED_FLASH").is_ok();
+    let async_read = env::var("CARGO_FEATURE_ASYNC_READ").is_ok();
+    let async_erase = env::var("CARGO_FEATURE_ASYNC_ERASE").is_ok();
+    let validation_cache = env::var("CARGO_FEATURE_VALIDATION_CACHE").is_ok();
+    let hash_segments = env::var("CARGO_FEATURE_HASH_SEGMENTS").is_ok();
+    let tlv_index = env::var("CARGO_FEATURE_TLV_INDEX").is_ok();
+    let multi_sig = env::var("CARGO_FEATURE_MULTI_SIG").is_ok();
+    let crypto_ops = env::var("CARGO_FEATURE_CRYPTO_OPS").is_ok();
+    let copy_skip_unchanged = env::var("CARGO_FEATURE_COPY_SKIP_UNCHANGED").is_ok();
+    let delta_images = env::var("CARGO_FEATURE_DELTA_IMAGES").is_ok();
+    let decompress_images = env::var("CARGO_FEATURE_DECOMPRESS_IMAGES").is_ok();
+    let swap_move_status_batch = env::var("CARGO_FEATURE_SWAP_MOVE_STATUS_BATCH").is_ok();
+    let parallel_upgrades = env::var("CARGO_FEATURE_PARALLEL_UPGRADES").is_ok();
+    let scratch_pool = env::var("CARGO_FEATURE_SCRATCH_POOL").is_ok();
 
     let mut conf = CachedBuild::new();
     conf.conf.define("__BOOTSIM__", None);
@@ -84,9 +99,103 @@ fn main() {
         conf.file("csupport/security_cnt.c");
     }
 
-    // Currently no more than one sig type can be used simultaneously.
+    if mapped_flash {
+        conf.conf.define("MCUBOOT_USE_FLASH_AREA_GET_MAPPED_PTR", None);
+    }
+
+    if async_read {
+        conf.conf.define("MCUBOOT_USE_FLASH_AREA_ASYNC_READ", None);
+    }
+
+    if async_erase {
+        conf.conf.define("MCUBOOT_USE_FLASH_AREA_ASYNC_ERASE", None);
+    }
+
+    if validation_cache {
+        conf.conf.define("MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE", None);
+    }
+
+    if hash_segments {
+        conf.conf.define("MCUBOOT_VERIFY_IMG_SEGMENTS", None);
+    }
+
+    if tlv_index {
+        conf.conf.define("MCUBOOT_TLV_INDEX", None);
+    }
+
+    if multi_sig {
+        conf.conf.define("MCUBOOT_MULTI_SIG", None);
+    }
+
+    if crypto_ops {
+        conf.conf.define("MCUBOOT_CRYPTO_OPS", None);
+    }
+
+    if copy_skip_unchanged {
+        conf.conf.define("MCUBOOT_COPY_SKIP_UNCHANGED", None);
+    }
+
+    if delta_images {
+        if !overwrite_only {
+            panic!("Delta images require overwrite only");
+        }
+        conf.conf.define("MCUBOOT_DELTA_IMAGES", None);
+    }
+
+    if decompress_images {
+        if !overwrite_only {
+            panic!("Decompressing images requires overwrite only");
+        }
+        conf.conf.define("MCUBOOT_DECOMPRESS_IMAGES", None);
+        // The smallest window, so matches are also read back from flash.
+        conf.conf.define("MCUBOOT_DECOMPRESS_BUF_SIZE", Some("1024"));
+    }
+
+    if swap_offset && (swap_move || overwrite_only) {
+        panic!("Only one upgrade mode can be selected");
+    }
+
+    if swap_offset && (enc_rsa || enc_aes256_rsa || enc_kw || enc_aes256_kw || enc_ec256 ||
+                       enc_ec256_mbedtls || enc_aes256_ec256 || enc_x25519 || enc_aes256_x25519) {
+        panic!("Swap using offset does not support encrypted images");
+    }
+
+    if swap_move_status_batch {
+        if !swap_move {
+            panic!("Batched swap status requires swap move");
+        }
+        // Small batches, so a swap spans many of them; with the 1 to 4 byte
+        // write sizes, the records do not fit and every step is recorded.
+        conf.conf.define("MCUBOOT_SWAP_MOVE_STATUS_BATCH", Some("4"));
+    }
+
+    if parallel_upgrades {
+        if !multiimage {
+            panic!("Parallel upgrades require multiimage");
+        }
+        if !(swap_move || swap_offset) {
+            panic!("Parallel upgrades require swap move or swap offset");
+        }
+        if bootstrap {
+            panic!("Parallel upgrades do not support bootstrap");
+        }
+        conf.conf.define("MCUBOOT_PARALLEL_UPGRADES", None);
+    }
+
+    if scratch_pool {
+        if swap_move || swap_offset || overwrite_only {
+            panic!("Scratch pool requires swap using scratch");
+        }
+        // Devices with a scratch area of many sectors get windows of a few
+        // sectors; those with a single scratch sector keep using it whole.
+        conf.conf.define("MCUBOOT_SWAP_SCRATCH_POOL", Some("4"));
+    }
+
+    // Currently no more than one sig type can be used simultaneously, apart
+    // from ECDSA and Ed25519 (both Tinycrypt based) with multi-sig.
+    let mixed_sig = multi_sig && sig_ecdsa && sig_ed25519;
     if vec![sig_rsa, sig_rsa3072, sig_ecdsa, sig_ed25519].iter()
-        .fold(0, |sum, &v| sum + v as i32) > 1 {
+        .fold(0, |sum, &v| sum + v as i32) > 1 && !mixed_sig {
         panic!("mcuboot does not support more than one sig type at the same time");
     }
 
@@ -249,12 +358,23 @@ fn main() {
         conf.file("../../ext/mbedtls/library/platform_util.c");
     }
 
+    if mixed_sig {
+        // Ed25519 signatures are checked along with the ECDSA ones.
+        conf.conf.define("MCUBOOT_SIGN_ED25519", None);
+
+        conf.conf.include("../../ext/tinycrypt-sha512/lib/include");
+        conf.file("../../ext/tinycrypt-sha512/lib/source/sha512.c");
+        conf.file("../../ext/fiat/src/curve25519.c");
+    }
+
     if overwrite_only {
         conf.conf.define("MCUBOOT_OVERWRITE_ONLY", None);
     }
 
     if swap_move {
         conf.conf.define("MCUBOOT_SWAP_USING_MOVE", None);
+    } else if swap_offset {
+        conf.conf.define("MCUBOOT_SWAP_USING_OFFSET", None);
     } else if !overwrite_only && !direct_xip && !ram_load {
         conf.conf.define("CONFIG_BOOT_SWAP_USING_SCRATCH", None);
         conf.conf.define("MCUBOOT_SWAP_USING_SCRATCH", None);
@@ -450,7 +570,8 @@ fn main() {
         conf.file("../../boot/bootutil/src/image_rsa.c");
     } else if sig_ecdsa || sig_ecdsa_mbedtls || sig_ecdsa_psa {
         conf.file("../../boot/bootutil/src/image_ecdsa.c");
-    } else if sig_ed25519 {
+    }
+    if sig_ed25519 {
         conf.file("../../boot/bootutil/src/image_ed25519.c");
     }
 
@@ -461,12 +582,17 @@ fn main() {
     conf.file("../../boot/bootutil/src/swap_misc.c");
     conf.file("../../boot/bootutil/src/swap_scratch.c");
     conf.file("../../boot/bootutil/src/swap_move.c");
+    conf.file("../../boot/bootutil/src/swap_offset.c");
     conf.file("../../boot/bootutil/src/caps.c");
     conf.file("../../boot/bootutil/src/bootutil_misc.c");
     conf.file("../../boot/bootutil/src/bootutil_public.c");
     conf.file("../../boot/bootutil/src/tlv.c");
+    conf.file("../../boot/bootutil/src/crypto_ops.c");
+    conf.file("../../boot/bootutil/src/decompress.c");
+    conf.file("../../boot/bootutil/src/delta.c");
     conf.file("../../boot/bootutil/src/fault_injection_hardening.c");
     conf.file("csupport/run.c");
+    conf.file("csupport/crypto_host.c");
     conf.conf.include("../../boot/bootutil/include");
     conf.conf.include("csupport");
     conf.conf.debug(true);
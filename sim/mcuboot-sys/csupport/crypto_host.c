@@ -0,0 +1,448 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Reference crypto backend for the simulator, using the SHA and AES
+ * instructions of x86-64 hosts for SHA256 and AES-CTR.  It shows how an
+ * accelerator plugs into bootutil/crypto/ops.h, and lets the tests compare
+ * it with the software libraries.  Other hash sizes are left to the library.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "bootutil/crypto/ops.h"
+
+#ifdef MCUBOOT_CRYPTO_OPS
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define SHA_TARGET __attribute__((target("sha,sse4.1,ssse3")))
+#define AES_TARGET __attribute__((target("aes,sse2")))
+
+#define SHA256_BLOCK_SIZE 64
+
+struct host_sha256 {
+    uint32_t state[8];
+    uint64_t total;
+    uint32_t buf_len;
+    uint8_t buf[SHA256_BLOCK_SIZE];
+};
+
+struct host_aes {
+    uint8_t rk[15][16];
+    uint32_t rounds;
+};
+
+typedef char host_ctx_size_check[(sizeof(struct host_sha256) <=
+                                  sizeof(bootutil_crypto_ops_ctx) &&
+                                  sizeof(struct host_aes) <=
+                                  sizeof(bootutil_crypto_ops_ctx)) ? 1 : -1];
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t sha256_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+/*
+ * Compress whole blocks with the SHA extensions, four rounds per pair of
+ * sha256rnds2, computing the message schedule four words at a time.
+ */
+SHA_TARGET static void
+host_sha256_blocks(uint32_t state[8], const uint8_t *data, size_t blocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                         0x0405060700010203ULL);
+    __m128i state0, state1, abef, cdgh, tmp, msg;
+    __m128i w[4];
+    int i;
+
+    /* Reorder the state into the ABEF/CDGH layout of sha256rnds2. */
+    tmp = _mm_loadu_si128((const __m128i *)&state[0]);
+    state1 = _mm_loadu_si128((const __m128i *)&state[4]);
+    tmp = _mm_shuffle_epi32(tmp, 0xb1);
+    state1 = _mm_shuffle_epi32(state1, 0x1b);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+    while (blocks-- > 0) {
+        abef = state0;
+        cdgh = state1;
+
+        for (i = 0; i < 16; i++) {
+            if (i < 4) {
+                w[i] = _mm_shuffle_epi8(
+                        _mm_loadu_si128((const __m128i *)&data[i * 16]),
+                        bswap);
+            } else {
+                /* W[t..t+3] from W[t-16..t-13], W[t-12..], W[t-8..] and
+                 * W[t-4..].
+                 */
+                tmp = _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4);
+                w[i & 3] = _mm_sha256msg2_epu32(
+                        _mm_add_epi32(_mm_sha256msg1_epu32(w[i & 3],
+                                                           w[(i + 1) & 3]),
+                                      tmp),
+                        w[(i + 3) & 3]);
+            }
+
+            msg = _mm_add_epi32(w[i & 3],
+                    _mm_loadu_si128((const __m128i *)&sha256_k[i * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0e);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+        data += SHA256_BLOCK_SIZE;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128((__m128i *)&state[0], state0);
+    _mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+static int
+host_sha256_init(bootutil_crypto_ops_ctx *ctx, uint32_t digest_len)
+{
+    struct host_sha256 *sha = (struct host_sha256 *)ctx;
+
+    if (digest_len != 32) {
+        return BOOTUTIL_CRYPTO_OPS_FALLBACK;
+    }
+
+    memcpy(sha->state, sha256_iv, sizeof(sha->state));
+    sha->total = 0;
+    sha->buf_len = 0;
+    return 0;
+}
+
+static int
+host_sha256_update(bootutil_crypto_ops_ctx *ctx, const void *data,
+                   uint32_t data_len)
+{
+    struct host_sha256 *sha = (struct host_sha256 *)ctx;
+    const uint8_t *p = data;
+    uint32_t n;
+
+    sha->total += data_len;
+
+    if (sha->buf_len > 0) {
+        n = SHA256_BLOCK_SIZE - sha->buf_len;
+        if (n > data_len) {
+            n = data_len;
+        }
+        memcpy(&sha->buf[sha->buf_len], p, n);
+        sha->buf_len += n;
+        p += n;
+        data_len -= n;
+        if (sha->buf_len < SHA256_BLOCK_SIZE) {
+            return 0;
+        }
+        host_sha256_blocks(sha->state, sha->buf, 1);
+        sha->buf_len = 0;
+    }
+
+    n = data_len / SHA256_BLOCK_SIZE;
+    if (n > 0) {
+        host_sha256_blocks(sha->state, p, n);
+        p += n * SHA256_BLOCK_SIZE;
+        data_len -= n * SHA256_BLOCK_SIZE;
+    }
+
+    memcpy(sha->buf, p, data_len);
+    sha->buf_len = data_len;
+    return 0;
+}
+
+static int
+host_sha256_update_v(bootutil_crypto_ops_ctx *ctx,
+                     const struct bootutil_crypto_iovec *iov, size_t iov_cnt)
+{
+    size_t i;
+
+    for (i = 0; i < iov_cnt; i++) {
+        host_sha256_update(ctx, iov[i].base, iov[i].len);
+    }
+
+    return 0;
+}
+
+static int
+host_sha256_finish(bootutil_crypto_ops_ctx *ctx, uint8_t *output)
+{
+    struct host_sha256 *sha = (struct host_sha256 *)ctx;
+    uint64_t bits = sha->total * 8;
+    int i;
+
+    sha->buf[sha->buf_len++] = 0x80;
+    if (sha->buf_len > SHA256_BLOCK_SIZE - 8) {
+        memset(&sha->buf[sha->buf_len], 0, SHA256_BLOCK_SIZE - sha->buf_len);
+        host_sha256_blocks(sha->state, sha->buf, 1);
+        sha->buf_len = 0;
+    }
+    memset(&sha->buf[sha->buf_len], 0, SHA256_BLOCK_SIZE - 8 - sha->buf_len);
+    for (i = 0; i < 8; i++) {
+        sha->buf[SHA256_BLOCK_SIZE - 1 - i] = (uint8_t)(bits >> (i * 8));
+    }
+    host_sha256_blocks(sha->state, sha->buf, 1);
+
+    for (i = 0; i < 8; i++) {
+        output[i * 4] = (uint8_t)(sha->state[i] >> 24);
+        output[i * 4 + 1] = (uint8_t)(sha->state[i] >> 16);
+        output[i * 4 + 2] = (uint8_t)(sha->state[i] >> 8);
+        output[i * 4 + 3] = (uint8_t)sha->state[i];
+    }
+    return 0;
+}
+
+static void
+host_sha256_drop(bootutil_crypto_ops_ctx *ctx)
+{
+    memset(ctx, 0, sizeof(struct host_sha256));
+}
+
+/* One step of the AES key expansion, assist holding the aeskeygenassist
+ * word already broadcast.
+ */
+AES_TARGET static __m128i
+host_aes_expand(__m128i key, __m128i assist)
+{
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, assist);
+}
+
+#define AES128_RK(i, rcon)                                                  \
+    rk[i] = host_aes_expand(rk[(i) - 1], _mm_shuffle_epi32(                 \
+                _mm_aeskeygenassist_si128(rk[(i) - 1], rcon), 0xff))
+
+#define AES256_RK(i, rcon)                                                  \
+    do {                                                                    \
+        rk[i] = host_aes_expand(rk[(i) - 2], _mm_shuffle_epi32(             \
+                    _mm_aeskeygenassist_si128(rk[(i) - 1], rcon), 0xff));   \
+        if ((i) + 1 < 15) {                                                 \
+            rk[(i) + 1] = host_aes_expand(rk[(i) - 1], _mm_shuffle_epi32(   \
+                        _mm_aeskeygenassist_si128(rk[i], 0), 0xaa));        \
+        }                                                                   \
+    } while (0)
+
+AES_TARGET static int
+host_aes_set_key(bootutil_crypto_ops_ctx *ctx, const uint8_t *key,
+                 uint32_t key_len)
+{
+    struct host_aes *aes = (struct host_aes *)ctx;
+    __m128i rk[15];
+    uint32_t i;
+
+    if (key_len == 16) {
+        rk[0] = _mm_loadu_si128((const __m128i *)key);
+        AES128_RK(1, 0x01);
+        AES128_RK(2, 0x02);
+        AES128_RK(3, 0x04);
+        AES128_RK(4, 0x08);
+        AES128_RK(5, 0x10);
+        AES128_RK(6, 0x20);
+        AES128_RK(7, 0x40);
+        AES128_RK(8, 0x80);
+        AES128_RK(9, 0x1b);
+        AES128_RK(10, 0x36);
+        aes->rounds = 10;
+    } else if (key_len == 32) {
+        rk[0] = _mm_loadu_si128((const __m128i *)key);
+        rk[1] = _mm_loadu_si128((const __m128i *)&key[16]);
+        AES256_RK(2, 0x01);
+        AES256_RK(4, 0x02);
+        AES256_RK(6, 0x04);
+        AES256_RK(8, 0x08);
+        AES256_RK(10, 0x10);
+        AES256_RK(12, 0x20);
+        AES256_RK(14, 0x40);
+        aes->rounds = 14;
+    } else {
+        return BOOTUTIL_CRYPTO_OPS_FALLBACK;
+    }
+
+    for (i = 0; i <= aes->rounds; i++) {
+        _mm_storeu_si128((__m128i *)aes->rk[i], rk[i]);
+    }
+    return 0;
+}
+
+/* Number of counter blocks encrypted together to fill the AES pipeline. */
+#define AES_CTR_LANES 8
+
+/*
+ * Encrypt cnt consecutive counter blocks, starting at counter, into
+ * stream, and advance the counter past them.
+ */
+AES_TARGET static void
+host_aes_ctr_stream(const struct host_aes *aes, uint8_t *counter,
+                    uint8_t *stream, int cnt)
+{
+    __m128i blk[AES_CTR_LANES];
+    __m128i rk;
+    uint32_t ctr;
+    uint32_t r;
+    int i;
+
+    ctr = ((uint32_t)counter[12] << 24) | ((uint32_t)counter[13] << 16) |
+          ((uint32_t)counter[14] << 8) | counter[15];
+
+    for (i = 0; i < cnt; i++) {
+        counter[12] = (uint8_t)(ctr >> 24);
+        counter[13] = (uint8_t)(ctr >> 16);
+        counter[14] = (uint8_t)(ctr >> 8);
+        counter[15] = (uint8_t)ctr;
+        blk[i] = _mm_loadu_si128((const __m128i *)counter);
+        ctr++;
+    }
+    counter[12] = (uint8_t)(ctr >> 24);
+    counter[13] = (uint8_t)(ctr >> 16);
+    counter[14] = (uint8_t)(ctr >> 8);
+    counter[15] = (uint8_t)ctr;
+
+    rk = _mm_loadu_si128((const __m128i *)aes->rk[0]);
+    for (i = 0; i < cnt; i++) {
+        blk[i] = _mm_xor_si128(blk[i], rk);
+    }
+    for (r = 1; r < aes->rounds; r++) {
+        rk = _mm_loadu_si128((const __m128i *)aes->rk[r]);
+        for (i = 0; i < cnt; i++) {
+            blk[i] = _mm_aesenc_si128(blk[i], rk);
+        }
+    }
+    rk = _mm_loadu_si128((const __m128i *)aes->rk[aes->rounds]);
+    for (i = 0; i < cnt; i++) {
+        _mm_storeu_si128((__m128i *)&stream[i * 16],
+                         _mm_aesenclast_si128(blk[i], rk));
+    }
+}
+
+static int
+host_aes_ctr_crypt(bootutil_crypto_ops_ctx *ctx, uint8_t *counter,
+                   const uint8_t *in, uint32_t len, uint32_t blk_off,
+                   uint8_t *out)
+{
+    const struct host_aes *aes = (const struct host_aes *)ctx;
+    uint8_t stream[AES_CTR_LANES * 16];
+    uint32_t n;
+    uint32_t i;
+    int cnt;
+
+    if (blk_off >= 16) {
+        return -1;
+    }
+
+    while (len > 0) {
+        /* A partial first block uses the key stream of the current
+         * counter from blk_off on.
+         */
+        cnt = (int)((blk_off + len + 15) / 16);
+        if (cnt > AES_CTR_LANES) {
+            cnt = AES_CTR_LANES;
+        }
+        host_aes_ctr_stream(aes, counter, stream, cnt);
+
+        n = (uint32_t)cnt * 16 - blk_off;
+        if (n > len) {
+            n = len;
+        }
+        for (i = 0; i < n; i++) {
+            out[i] = in[i] ^ stream[blk_off + i];
+        }
+        in += n;
+        out += n;
+        len -= n;
+        blk_off = 0;
+    }
+
+    return 0;
+}
+
+static void
+host_aes_drop(bootutil_crypto_ops_ctx *ctx)
+{
+    memset(ctx, 0, sizeof(struct host_aes));
+}
+
+static const struct bootutil_hash_ops host_hash_ops = {
+    .init = host_sha256_init,
+    .update = host_sha256_update,
+    .update_v = host_sha256_update_v,
+    .finish = host_sha256_finish,
+    .drop = host_sha256_drop,
+};
+
+static const struct bootutil_aes_ctr_ops host_aes_ctr_ops = {
+    .set_key = host_aes_set_key,
+    .crypt = host_aes_ctr_crypt,
+    .drop = host_aes_drop,
+};
+
+static const struct bootutil_crypto_ops host_crypto_ops = {
+    .name = "x86-64 SHA/AES-NI",
+    .hash = &host_hash_ops,
+    .aes_ctr = &host_aes_ctr_ops,
+    .verify_sig = NULL,
+};
+
+const struct bootutil_crypto_ops *
+sim_host_crypto_ops(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    int sha;
+    int aes;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return NULL;
+    }
+    aes = (ecx & bit_AES) && (ecx & bit_SSE4_1) && (ecx & bit_SSSE3);
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return NULL;
+    }
+    sha = (ebx & bit_SHA) != 0;
+
+    return (aes && sha) ? &host_crypto_ops : NULL;
+}
+
+#else
+
+const struct bootutil_crypto_ops *
+sim_host_crypto_ops(void)
+{
+    return NULL;
+}
+
+#endif /* __x86_64__ && __GNUC__ */
+
+#endif /* MCUBOOT_CRYPTO_OPS */
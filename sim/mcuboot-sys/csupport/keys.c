@@ -50,6 +50,12 @@ const unsigned char root_pub_der[] = {
     0xc9, 0x02, 0x03, 0x01, 0x00, 0x01
 };
 const unsigned int root_pub_der_len = 270;
+const unsigned char root_pub_der_hash[] = {
+    0xfc, 0x57, 0x01, 0xdc, 0x61, 0x35, 0xe1, 0x32,
+    0x38, 0x47, 0xbd, 0xc4, 0x0f, 0x04, 0xd2, 0xe5,
+    0xbe, 0xe5, 0x83, 0x3b, 0x23, 0xc2, 0x9f, 0x93,
+    0x59, 0x3d, 0x00, 0x01, 0x8c, 0xfa, 0x99, 0x94,
+};
 #elif MCUBOOT_SIGN_RSA_LEN == 3072
 #define HAVE_KEYS
 const unsigned char root_pub_der[] = {
@@ -105,6 +111,12 @@ const unsigned char root_pub_der[] = {
     0x3b, 0x02, 0x03, 0x01, 0x00, 0x01,
 };
 const unsigned int root_pub_der_len = 398;
+const unsigned char root_pub_der_hash[] = {
+    0x44, 0x97, 0x93, 0xfb, 0x65, 0xcd, 0x76, 0x98,
+    0x75, 0x3d, 0x5b, 0x3f, 0x35, 0xfa, 0xb1, 0x5f,
+    0x1e, 0x3a, 0x45, 0x11, 0x1f, 0xf2, 0x4e, 0x1d,
+    0x46, 0x74, 0x1d, 0xe5, 0xae, 0x12, 0xd5, 0x9e,
+};
 #endif
 #elif defined(MCUBOOT_SIGN_EC256) || \
       defined(MCUBOOT_SIGN_EC384)
@@ -124,6 +136,12 @@ const unsigned char root_pub_der[] = {
     0x8b, 0x68, 0x34, 0xcc, 0x3a, 0x6a, 0xfc, 0x53,
     0x8e, 0xfa, 0xc1, };
 const unsigned int root_pub_der_len = 91;
+const unsigned char root_pub_der_hash[] = {
+    0xe3, 0x04, 0x66, 0xf6, 0xb8, 0x47, 0x0c, 0x1f,
+    0x29, 0x07, 0x0b, 0x17, 0xf1, 0xe2, 0xd3, 0xe9,
+    0x4d, 0x44, 0x5e, 0x3f, 0x60, 0x80, 0x87, 0xfd,
+    0xc7, 0x11, 0xe4, 0x38, 0x2b, 0xb5, 0x38, 0xb6,
+};
 #else /* MCUBOOT_SIGN_EC384 */
 const unsigned char root_pub_der[] = {
     0x30, 0x76, 0x30, 0x10, 0x06, 0x07, 0x2a, 0x86,
@@ -143,10 +161,21 @@ const unsigned char root_pub_der[] = {
     0xa8, 0xf2, 0x48, 0xfe, 0x3a, 0x60, 0x69, 0xa5,
 };
 const unsigned int root_pub_der_len = 120;
+const unsigned char root_pub_der_hash[] = {
+    0x85, 0xb7, 0xbd, 0x5f, 0x5d, 0xff, 0x9a, 0x03,
+    0xa9, 0x99, 0x27, 0xad, 0xaf, 0x6c, 0xa6, 0xfe,
+    0xbd, 0xe8, 0x22, 0xc1, 0xa4, 0x80, 0x92, 0x83,
+    0x24, 0xa8, 0xe6, 0x03, 0x23, 0x71, 0x5c, 0x57,
+    0x79, 0x46, 0x1c, 0x49, 0x6a, 0x95, 0xae, 0xe8,
+    0xc4, 0xf9, 0x0b, 0x99, 0x77, 0x9f, 0x84, 0x8a,
+};
 #endif /* MCUBOOT_SIGN_EC384 */
-#elif defined(MCUBOOT_SIGN_ED25519)
-#define HAVE_KEYS
-const unsigned char root_pub_der[] = {
+#endif
+
+/* With MCUBOOT_MULTI_SIG, this key may be used along with the ECDSA one. */
+#if defined(MCUBOOT_SIGN_ED25519)
+#define HAVE_ED25519_KEY
+const unsigned char ed25519_pub_der[] = {
     0x30, 0x2a, 0x30, 0x05, 0x06, 0x03, 0x2b, 0x65,
     0x70, 0x03, 0x21, 0x00, 0xd4, 0xb3, 0x1b, 0xa4,
     0x9a, 0x3a, 0xdd, 0x3f, 0x82, 0x5d, 0x10, 0xca,
@@ -154,17 +183,33 @@ const unsigned char root_pub_der[] = {
     0xcc, 0xc4, 0x9f, 0x1a, 0x40, 0x3a, 0x5c, 0x13,
     0x20, 0xff, 0xb4, 0xe0,
 };
-const unsigned int root_pub_der_len = 44;
+const unsigned int ed25519_pub_der_len = 44;
+const unsigned char ed25519_pub_der_hash[] = {
+    0xc1, 0x90, 0x7f, 0xa4, 0xea, 0xc7, 0xfa, 0xe3,
+    0x84, 0x0a, 0x78, 0x90, 0x2b, 0x6f, 0x07, 0x10,
+    0xb0, 0x37, 0xe9, 0x96, 0x8e, 0x5c, 0x62, 0x74,
+    0xa1, 0x2a, 0x28, 0x79, 0x0c, 0x7d, 0x4e, 0x3c,
+};
 #endif
 
-#if defined(HAVE_KEYS)
+#if defined(HAVE_KEYS) || defined(HAVE_ED25519_KEY)
 const struct bootutil_key bootutil_keys[] = {
+#if defined(HAVE_KEYS)
     {
         .key = root_pub_der,
         .len = &root_pub_der_len,
+        .hash = root_pub_der_hash,
     },
+#endif
+#if defined(HAVE_ED25519_KEY)
+    {
+        .key = ed25519_pub_der,
+        .len = &ed25519_pub_der_len,
+        .hash = ed25519_pub_der_hash,
+    },
+#endif
 };
-const int bootutil_key_cnt = 1;
+const int bootutil_key_cnt = sizeof(bootutil_keys) / sizeof(bootutil_keys[0]);
 #endif
 
 #if defined(MCUBOOT_ENCRYPT_RSA)
@@ -39,21 +39,80 @@ extern void sim_set_context(struct sim_context *ctx);
 extern void sim_reset_context(void);
 
 extern int sim_flash_erase(uint8_t flash_id, uint32_t offset, uint32_t size);
+extern int sim_flash_erase_submit(uint8_t flash_id, uint32_t offset,
+        uint32_t size);
+extern int sim_flash_erase_poll(uint8_t flash_id, uint32_t offset,
+        uint32_t size);
 extern int sim_flash_read(uint8_t flash_id, uint32_t offset, uint8_t *dest,
         uint32_t size);
 extern int sim_flash_write(uint8_t flash_id, uint32_t offset, const uint8_t *src,
         uint32_t size);
+extern int sim_flash_read_submit(uint8_t flash_id, uint32_t offset,
+        uint8_t *dest, uint32_t size);
+extern int sim_flash_read_wait(void);
+extern int sim_flash_mapped_ptr(uint8_t flash_id, uint32_t offset,
+        uint32_t size, const void **ptr);
 extern uint32_t sim_flash_align(uint8_t flash_id);
 extern uint8_t sim_flash_erased_val(uint8_t flash_id);
 
+#ifdef MCUBOOT_CRYPTO_OPS
+#include "bootutil/crypto/ops.h"
+extern const struct bootutil_crypto_ops *sim_host_crypto_ops(void);
+#endif
+
 struct sim_context {
     int flash_counter;
     int jumped;
     uint8_t c_asserts;
     uint8_t c_catch_asserts;
+    uint32_t flash_reads;
+    uint32_t flash_read_bytes;
+    uint32_t flash_writes;
+    uint32_t flash_write_bytes;
+    uint32_t flash_write_pages;
+    uint32_t flash_erases;
+    uint32_t flash_erase_bytes;
+    uint32_t flash_now_us;
+    uint32_t flash_time_us;
+    uint32_t flash_busy_us;
+    uint32_t flash_ready_us[4];
     jmp_buf boot_jmpbuf;
 };
 
+/* Page size used to count page programs, as on a typical SPI NOR part. */
+#define SIM_FLASH_PAGE_SIZE 256
+
+/* Rough SPI NOR timings, in microseconds, as used by the copy bench: the
+ * command and status polling overhead of each call, reading a KiB,
+ * programming a page, and erasing a KiB.
+ */
+#define SIM_FLASH_OP_US         20
+#define SIM_FLASH_READ_KB_US    20
+#define SIM_FLASH_PAGE_US       400
+#define SIM_FLASH_ERASE_KB_US   11000
+
+/*
+ * Account for the time taken by an operation on a flash device.  It starts
+ * once the device is done with its previous operation; reads and writes keep
+ * the bootloader waiting until they complete, while erases return once they
+ * have been started and leave the device busy in the background.
+ */
+static void
+sim_flash_timing(struct sim_context *ctx, uint8_t dev_id, uint32_t busy_us,
+                 bool posted)
+{
+    uint32_t *ready = &ctx->flash_ready_us[dev_id % 4];
+    uint32_t start;
+
+    start = (ctx->flash_now_us > *ready) ? ctx->flash_now_us : *ready;
+    *ready = start + busy_us;
+    ctx->flash_now_us = start + (posted ? SIM_FLASH_OP_US : busy_us);
+    ctx->flash_busy_us += busy_us;
+    if (*ready > ctx->flash_time_us) {
+        ctx->flash_time_us = *ready;
+    }
+}
+
 #ifdef MCUBOOT_ENCRYPT_RSA
 static int
 parse_pubkey(mbedtls_rsa_context *ctx, uint8_t **p, uint8_t *end)
@@ -288,6 +347,212 @@ int invoke_boot_go(struct sim_context *ctx, struct area_desc *adesc,
     }
 }
 
+/*
+ * Validate the image in the given slot, streaming it through a hash buffer of
+ * buf_sz bytes.  Used to benchmark image validation on its own.
+ */
+int invoke_img_validate(struct sim_context *ctx, struct area_desc *adesc,
+                        int image_index, int slot, uint32_t buf_sz)
+{
+    const struct flash_area *fap;
+    struct image_header hdr;
+    uint8_t *buf;
+    int rc;
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+
+    buf = malloc(buf_sz);
+    if (buf == NULL) {
+        return -1;
+    }
+
+    sim_set_flash_areas(adesc);
+    sim_set_context(ctx);
+
+    rc = flash_area_open(flash_area_id_from_multi_image_slot(image_index, slot),
+                         &fap);
+    if (rc == 0) {
+        rc = flash_area_read(fap, 0, &hdr, sizeof(hdr));
+        if (rc == 0) {
+            FIH_CALL(bootutil_img_validate, fih_rc, NULL, image_index, &hdr,
+                     fap, buf, buf_sz, NULL, 0, NULL);
+            rc = FIH_EQ(fih_rc, FIH_SUCCESS) ? 0 : -1;
+        }
+        flash_area_close(fap);
+    }
+
+    sim_reset_flash_areas();
+    sim_reset_context();
+    free(buf);
+    return rc;
+}
+
+/*
+ * Validate the image in the primary slot through its validation cache record,
+ * as the bootloader does at the end of a normal boot.  Returns 1 when the
+ * bootloader is built without the validation cache.
+ */
+int invoke_img_validate_cached(struct sim_context *ctx,
+                               struct area_desc *adesc, int image_index)
+{
+#ifdef MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE
+    const struct flash_area *fap;
+    struct image_header hdr;
+    static uint8_t buf[BOOT_TMPBUF_SZ];
+    int rc;
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+
+    sim_set_flash_areas(adesc);
+    sim_set_context(ctx);
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_PRIMARY(image_index), &fap);
+    if (rc == 0) {
+        rc = flash_area_read(fap, 0, &hdr, sizeof(hdr));
+        if (rc == 0) {
+            FIH_CALL(bootutil_img_validate_cached, fih_rc, NULL, image_index,
+                     &hdr, fap, buf, sizeof(buf));
+            rc = FIH_EQ(fih_rc, FIH_SUCCESS) ? 0 : -1;
+        }
+        flash_area_close(fap);
+    }
+
+    sim_reset_flash_areas();
+    sim_reset_context();
+    return rc;
+#else
+    (void)ctx;
+    (void)adesc;
+    (void)image_index;
+    return 1;
+#endif
+}
+
+/*
+ * Check count segments of the image in the primary slot, from first,
+ * against its segment hash table.  Returns 1 when the bootloader is built
+ * without segment hashes.
+ */
+int invoke_img_check_segments(struct sim_context *ctx,
+                              struct area_desc *adesc, int image_index,
+                              uint32_t first, uint32_t count)
+{
+#ifdef MCUBOOT_VERIFY_IMG_SEGMENTS
+    const struct flash_area *fap;
+    struct image_header hdr;
+    static uint8_t buf[BOOT_TMPBUF_SZ];
+    int rc;
+
+    sim_set_flash_areas(adesc);
+    sim_set_context(ctx);
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_PRIMARY(image_index), &fap);
+    if (rc == 0) {
+        rc = flash_area_read(fap, 0, &hdr, sizeof(hdr));
+        if (rc == 0) {
+            rc = bootutil_img_check_segments(&hdr, fap, first, count, buf,
+                                             sizeof(buf)) ? -1 : 0;
+        }
+        flash_area_close(fap);
+    }
+
+    sim_reset_flash_areas();
+    sim_reset_context();
+    return rc;
+#else
+    (void)ctx;
+    (void)adesc;
+    (void)image_index;
+    (void)first;
+    (void)count;
+    return 1;
+#endif
+}
+
+/*
+ * Copy the signature verification statistics of this thread to stats, and
+ * reset them if asked to.  Returns 1 when the bootloader is built without
+ * MCUBOOT_MULTI_SIG.
+ */
+int invoke_sig_stats(struct bootutil_sig_stats *stats, int reset)
+{
+#ifdef MCUBOOT_MULTI_SIG
+    bootutil_sig_stats_get(stats);
+    if (reset) {
+        bootutil_sig_stats_reset();
+    }
+    return 0;
+#else
+    (void)stats;
+    (void)reset;
+    return 1;
+#endif
+}
+
+/*
+ * Have this thread hash and decrypt with the SHA/AES instructions of the
+ * host, or with the software libraries again.  Returns 1 when the bootloader
+ * is built without MCUBOOT_CRYPTO_OPS, and -1 if the host lacks the
+ * instructions.
+ */
+int invoke_crypto_ops(int enable)
+{
+#ifdef MCUBOOT_CRYPTO_OPS
+    const struct bootutil_crypto_ops *ops = NULL;
+
+    if (enable) {
+        ops = sim_host_crypto_ops();
+        if (ops == NULL) {
+            return -1;
+        }
+    }
+    return bootutil_crypto_ops_register(ops);
+#else
+    (void)enable;
+    return 1;
+#endif
+}
+
+/*
+ * Lend this thread's bootloader a buffer to hash images through, or stop
+ * using one if buf is NULL.
+ */
+void invoke_set_hash_arena(uint8_t *buf, uint32_t len)
+{
+    boot_set_hash_arena(buf, len);
+}
+
+/*
+ * Lend this thread's bootloader a buffer to copy images through, or stop
+ * using one if buf is NULL.
+ */
+void invoke_set_copy_arena(uint8_t *buf, uint32_t len)
+{
+    boot_set_copy_arena(buf, len);
+}
+
+#ifdef MCUBOOT_VALIDATE_PRIMARY_SLOT_CACHE
+/* Stands in for a device-unique secret. */
+static const uint8_t sim_validation_cache_key[32] = {
+    0x6d, 0x63, 0x75, 0x62, 0x6f, 0x6f, 0x74, 0x2d,
+    0x73, 0x69, 0x6d, 0x2d, 0x76, 0x61, 0x6c, 0x69,
+    0x64, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x2d, 0x63,
+    0x61, 0x63, 0x68, 0x65, 0x2d, 0x6b, 0x65, 0x79,
+};
+
+int boot_validation_cache_key(uint8_t image_index, uint8_t *key,
+                              size_t *key_len)
+{
+    if (*key_len < sizeof(sim_validation_cache_key)) {
+        return -1;
+    }
+
+    memcpy(key, sim_validation_cache_key, sizeof(sim_validation_cache_key));
+    /* Give each image its own secret. */
+    key[0] ^= image_index;
+    *key_len = sizeof(sim_validation_cache_key);
+    return 0;
+}
+#endif
+
 void *os_malloc(size_t size)
 {
     // printf("os_malloc 0x%x bytes\n", size);
@@ -339,9 +604,34 @@ int flash_area_read(const struct flash_area *area, uint32_t off, void *dst,
 {
     BOOT_LOG_SIM("%s: area=%d, off=%x, len=%x",
                  __func__, area->fa_id, off, len);
+    struct sim_context *ctx = sim_get_context();
+    ctx->flash_reads++;
+    ctx->flash_read_bytes += len;
+    sim_flash_timing(ctx, area->fa_device_id,
+                     SIM_FLASH_OP_US + len * SIM_FLASH_READ_KB_US / 1024, false);
     return sim_flash_read(area->fa_device_id, area->fa_off + off, dst, len);
 }
 
+int flash_area_read_submit(const struct flash_area *area, uint32_t off,
+                           void *dst, uint32_t len)
+{
+    BOOT_LOG_SIM("%s: area=%d, off=%x, len=%x",
+                 __func__, area->fa_id, off, len);
+    struct sim_context *ctx = sim_get_context();
+    ctx->flash_reads++;
+    ctx->flash_read_bytes += len;
+    sim_flash_timing(ctx, area->fa_device_id,
+                     SIM_FLASH_OP_US + len * SIM_FLASH_READ_KB_US / 1024, false);
+    return sim_flash_read_submit(area->fa_device_id, area->fa_off + off, dst,
+                                 len);
+}
+
+int flash_area_read_wait(const struct flash_area *area)
+{
+    (void)area;
+    return sim_flash_read_wait();
+}
+
 int flash_area_write(const struct flash_area *area, uint32_t off, const void *src,
                      uint32_t len)
 {
@@ -352,6 +642,17 @@ int flash_area_write(const struct flash_area *area, uint32_t off, const void *sr
         ctx->jumped++;
         longjmp(ctx->boot_jmpbuf, 1);
     }
+    ctx->flash_writes++;
+    ctx->flash_write_bytes += len;
+    if (len > 0) {
+        uint32_t start = area->fa_off + off;
+        uint32_t pages = (start + len - 1) / SIM_FLASH_PAGE_SIZE -
+                         start / SIM_FLASH_PAGE_SIZE + 1;
+
+        ctx->flash_write_pages += pages;
+        sim_flash_timing(ctx, area->fa_device_id,
+                         SIM_FLASH_OP_US + pages * SIM_FLASH_PAGE_US, false);
+    }
     return sim_flash_write(area->fa_device_id, area->fa_off + off, src, len);
 }
 
@@ -364,9 +665,48 @@ int flash_area_erase(const struct flash_area *area, uint32_t off, uint32_t len)
         ctx->jumped++;
         longjmp(ctx->boot_jmpbuf, 1);
     }
+    ctx->flash_erases++;
+    ctx->flash_erase_bytes += len;
+    sim_flash_timing(ctx, area->fa_device_id,
+                     SIM_FLASH_OP_US + len / 1024 * SIM_FLASH_ERASE_KB_US, true);
     return sim_flash_erase(area->fa_device_id, area->fa_off + off, len);
 }
 
+int flash_area_erase_submit(const struct flash_area *area, uint32_t off,
+                            uint32_t len)
+{
+    BOOT_LOG_SIM("%s: area=%d, off=%x, len=%x", __func__,
+                 area->fa_id, off, len);
+    struct sim_context *ctx = sim_get_context();
+    if (--(ctx->flash_counter) == 0) {
+        ctx->jumped++;
+        longjmp(ctx->boot_jmpbuf, 1);
+    }
+    ctx->flash_erases++;
+    ctx->flash_erase_bytes += len;
+    sim_flash_timing(ctx, area->fa_device_id,
+                     SIM_FLASH_OP_US + len / 1024 * SIM_FLASH_ERASE_KB_US, true);
+    return sim_flash_erase_submit(area->fa_device_id, area->fa_off + off, len);
+}
+
+int flash_area_erase_poll(const struct flash_area *area)
+{
+    return sim_flash_erase_poll(area->fa_device_id, area->fa_off,
+                                area->fa_size);
+}
+
+int flash_area_get_mapped_ptr(const struct flash_area *area, uint32_t off,
+                              uint32_t len, const void **ptr)
+{
+    BOOT_LOG_SIM("%s: area=%d, off=%x, len=%x", __func__,
+                 area->fa_id, off, len);
+    if (off > area->fa_size || len > area->fa_size - off) {
+        return -1;
+    }
+    return sim_flash_mapped_ptr(area->fa_device_id, area->fa_off + off, len,
+                                ptr);
+}
+
 int flash_area_to_sectors(int idx, int *cnt, struct flash_area *ret)
 {
     uint32_t i;
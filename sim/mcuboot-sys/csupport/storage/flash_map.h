@@ -120,6 +120,39 @@ int flash_area_write(const struct flash_area *, uint32_t off, const void *src,
   uint32_t len);
 int flash_area_erase(const struct flash_area *, uint32_t off, uint32_t len);
 
+/*
+ * Asynchronous reads: start reading len bytes at off into dst, then wait for
+ * the read to land.  At most one read is in flight at a time, and dst must
+ * not be accessed until flash_area_read_wait() has returned.
+ *
+ * Both return 0 on success, or an error code on failure.
+ */
+int flash_area_read_submit(const struct flash_area *, uint32_t off, void *dst,
+  uint32_t len);
+int flash_area_read_wait(const struct flash_area *);
+
+/*
+ * Asynchronous erases: start erasing len bytes at off, then poll until the
+ * erase has completed.  Other sectors may be read and written meanwhile.
+ *
+ * flash_area_erase_submit() returns 0 on success, or an error code on
+ * failure; flash_area_erase_poll() returns 0 once the erases in flight in the
+ * area have completed, a positive value while they have not, or a negative
+ * error code on failure.
+ */
+int flash_area_erase_submit(const struct flash_area *, uint32_t off,
+  uint32_t len);
+int flash_area_erase_poll(const struct flash_area *);
+
+/*
+ * Retrieve a pointer through which len bytes at off can be read directly,
+ * for flash areas that are memory-mapped.
+ *
+ * Returns 0 on success, or an error code if the range is not mapped.
+ */
+int flash_area_get_mapped_ptr(const struct flash_area *, uint32_t off,
+  uint32_t len, const void **ptr);
+
 /*
  * Alignment restriction for flash writes.
  */
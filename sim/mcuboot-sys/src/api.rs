@@ -12,9 +12,12 @@ use simflash::{Result, Flash, FlashPtr};
 use std::{
     cell::RefCell,
     collections::HashMap,
+    env,
     mem,
     ptr,
     slice,
+    thread,
+    time::Duration,
 };
 
 /// A FlashMap maintain a table of [device_id -> Flash trait]
@@ -96,6 +99,17 @@ pub struct CSimContext {
     pub jumped: libc::c_int,
     pub c_asserts: u8,
     pub c_catch_asserts: u8,
+    pub flash_reads: u32,
+    pub flash_read_bytes: u32,
+    pub flash_writes: u32,
+    pub flash_write_bytes: u32,
+    pub flash_write_pages: u32,
+    pub flash_erases: u32,
+    pub flash_erase_bytes: u32,
+    pub flash_now_us: u32,
+    pub flash_time_us: u32,
+    pub flash_busy_us: u32,
+    pub flash_ready_us: [u32; 4],
     // NOTE: Always leave boot_jmpbuf declaration at the end; this should
     // store a "jmp_buf" which is arch specific and not defined by libc crate.
     // The size below is enough to store data on a x86_64 machine.
@@ -109,6 +123,17 @@ impl Default for CSimContext {
             jumped: 0,
             c_asserts: 0,
             c_catch_asserts: 0,
+            flash_reads: 0,
+            flash_read_bytes: 0,
+            flash_writes: 0,
+            flash_write_bytes: 0,
+            flash_write_pages: 0,
+            flash_erases: 0,
+            flash_erase_bytes: 0,
+            flash_now_us: 0,
+            flash_time_us: 0,
+            flash_busy_us: 0,
+            flash_ready_us: [0; 4],
             boot_jmpbuf: [0; 48],
         }
     }
@@ -170,6 +195,47 @@ thread_local! {
     pub static SIM_CTX: RefCell<CSimContextPtr> = RefCell::new(CSimContextPtr::new());
     pub static RAM_CTX: RefCell<BootsimRamInfo> = RefCell::new(BootsimRamInfo::default());
     pub static NV_COUNTER_CTX: RefCell<NvCounterStorage> = RefCell::new(NvCounterStorage::new());
+    static PENDING_READ: RefCell<Option<PendingRead>> = RefCell::new(None);
+    static PENDING_ERASES: RefCell<Vec<PendingErase>> = RefCell::new(Vec::new());
+}
+
+/// A read started through `flash_area_read_submit`.  The data is fetched up front, but only
+/// handed over to the C buffer once the read is waited for, so code that looks at the buffer too
+/// early sees stale contents.  A worker thread stands in for the DMA transfer, taking
+/// `MCUBOOT_SIM_READ_NS_PER_BYTE` nanoseconds per byte, so that the overlap with hashing and
+/// copying can be measured.
+struct PendingRead {
+    dest: *mut u8,
+    data: Vec<u8>,
+    worker: Option<thread::JoinHandle<()>>,
+}
+
+/// An erase started through `flash_area_erase_submit`.  It only takes effect once it has been
+/// polled `ERASE_POLLS` times, and the sectors it erases cannot be read or written until then, so
+/// code that uses them before the erase is seen to complete fails.  Other sectors stay usable, as
+/// on flash with erase-suspend or several banks.
+struct PendingErase {
+    dev_id: u8,
+    offset: u32,
+    size: u32,
+    polls: u32,
+}
+
+const ERASE_POLLS: u32 = 2;
+
+/// Is an erase in flight over any part of the given range.
+fn erase_pending(dev_id: u8, offset: u32, size: u32) -> bool {
+    PENDING_ERASES.with(|pending| {
+        pending.borrow().iter().any(|e| {
+            e.dev_id == dev_id && e.offset < offset + size && offset < e.offset + e.size
+        })
+    })
+}
+
+fn read_ns_per_byte() -> u64 {
+    env::var("MCUBOOT_SIM_READ_NS_PER_BYTE").ok()
+        .and_then(|v| v.parse().ok())
+        .unwrap_or(0)
 }
 
 /// Set the flash device to be used by the simulation.  The pointer is unsafely stashed away.
@@ -196,6 +262,10 @@ pub fn clear_flash(dev_id: u8) {
     THREAD_CTX.with(|ctx| {
         ctx.borrow_mut().flash_map.remove(&dev_id);
     });
+    // An erase still in flight when the bootloader stopped never completes.
+    PENDING_ERASES.with(|pending| {
+        pending.borrow_mut().retain(|e| e.dev_id != dev_id);
+    });
 }
 
 // This isn't meant to call directly, but by a wrapper.
@@ -240,6 +310,10 @@ pub extern "C" fn sim_reset_context() {
     SIM_CTX.with(|ctx| {
         ctx.borrow_mut().ptr = ptr::null();
     });
+    // A simulated power failure can leave a read in flight.
+    PENDING_READ.with(|pending| {
+        *pending.borrow_mut() = None;
+    });
 }
 
 #[no_mangle]
@@ -280,8 +354,57 @@ pub extern "C" fn sim_flash_erase(dev_id: u8, offset: u32, size: u32) -> libc::c
     rc
 }
 
+#[no_mangle]
+pub extern "C" fn sim_flash_erase_submit(dev_id: u8, offset: u32, size: u32) -> libc::c_int {
+    if erase_pending(dev_id, offset, size) {
+        warn!("Erasing flash at 0x{:x} while it is being erased", offset);
+        return -1;
+    }
+    PENDING_ERASES.with(|pending| {
+        pending.borrow_mut().push(PendingErase { dev_id, offset, size, polls: ERASE_POLLS });
+    });
+    0
+}
+
+/// Poll the erases in flight within the given range: returns 1 while any of them is, or 0 once
+/// all of them have completed.
+#[no_mangle]
+pub extern "C" fn sim_flash_erase_poll(dev_id: u8, offset: u32, size: u32) -> libc::c_int {
+    let mut done = vec![];
+    let mut busy = false;
+    PENDING_ERASES.with(|pending| {
+        let mut pending = pending.borrow_mut();
+        let mut i = 0;
+        while i < pending.len() {
+            let e = &mut pending[i];
+            if e.dev_id != dev_id || e.offset < offset || e.offset + e.size > offset + size {
+                i += 1;
+                continue;
+            }
+            e.polls -= 1;
+            if e.polls == 0 {
+                done.push(pending.remove(i));
+            } else {
+                busy = true;
+                i += 1;
+            }
+        }
+    });
+    for e in done {
+        let rc = sim_flash_erase(e.dev_id, e.offset, e.size);
+        if rc != 0 {
+            return rc;
+        }
+    }
+    if busy { 1 } else { 0 }
+}
+
 #[no_mangle]
 pub extern "C" fn sim_flash_read(dev_id: u8, offset: u32, dest: *mut u8, size: u32) -> libc::c_int {
+    if erase_pending(dev_id, offset, size) {
+        warn!("Reading flash at 0x{:x} while it is being erased", offset);
+        return -1;
+    }
     let mut rc: libc::c_int = -19;
     THREAD_CTX.with(|ctx| {
         if let Some(flash) = ctx.borrow().flash_map.get(&dev_id) {
@@ -295,6 +418,10 @@ pub extern "C" fn sim_flash_read(dev_id: u8, offset: u32, dest: *mut u8, size: u
 
 #[no_mangle]
 pub extern "C" fn sim_flash_write(dev_id: u8, offset: u32, src: *const u8, size: u32) -> libc::c_int {
+    if erase_pending(dev_id, offset, size) {
+        warn!("Writing flash at 0x{:x} while it is being erased", offset);
+        return -1;
+    }
     let mut rc: libc::c_int = -19;
     THREAD_CTX.with(|ctx| {
         if let Some(flash) = ctx.borrow().flash_map.get(&dev_id) {
@@ -306,6 +433,64 @@ pub extern "C" fn sim_flash_write(dev_id: u8, offset: u32, src: *const u8, size:
     rc
 }
 
+#[no_mangle]
+pub extern "C" fn sim_flash_read_submit(dev_id: u8, offset: u32, dest: *mut u8, size: u32) -> libc::c_int {
+    let mut data = vec![0u8; size as usize];
+    let rc = sim_flash_read(dev_id, offset, data.as_mut_ptr(), size);
+    if rc != 0 {
+        return rc;
+    }
+
+    let delay = read_ns_per_byte() * size as u64;
+    let worker = if delay > 0 {
+        Some(thread::spawn(move || thread::sleep(Duration::from_nanos(delay))))
+    } else {
+        None
+    };
+    PENDING_READ.with(|pending| {
+        *pending.borrow_mut() = Some(PendingRead { dest, data, worker });
+    });
+    0
+}
+
+#[no_mangle]
+pub extern "C" fn sim_flash_read_wait() -> libc::c_int {
+    PENDING_READ.with(|pending| {
+        match pending.borrow_mut().take() {
+            Some(read) => {
+                if let Some(worker) = read.worker {
+                    worker.join().unwrap();
+                }
+                unsafe { ptr::copy_nonoverlapping(read.data.as_ptr(), read.dest, read.data.len()) };
+                0
+            }
+            None => {
+                warn!("Waiting for a flash read that was never submitted");
+                -1
+            }
+        }
+    })
+}
+
+#[no_mangle]
+pub extern "C" fn sim_flash_mapped_ptr(dev_id: u8, offset: u32, size: u32,
+                                       ptr: *mut *const u8) -> libc::c_int {
+    let mut rc: libc::c_int = -19;
+    THREAD_CTX.with(|ctx| {
+        if let Some(flash) = ctx.borrow().flash_map.get(&dev_id) {
+            let dev = unsafe { &*(flash.ptr) };
+            rc = match dev.mapped(offset as usize, size as usize) {
+                Ok(data) => {
+                    unsafe { *ptr = data.as_ptr() };
+                    0
+                }
+                Err(e) => map_err(Err(e)),
+            };
+        }
+    });
+    rc
+}
+
 #[no_mangle]
 pub extern "C" fn sim_flash_align(id: u8) -> u32 {
     THREAD_CTX.with(|ctx| {
@@ -15,6 +15,43 @@ use std::sync::Once;
 
 use std::borrow::Borrow;
 
+/// The flash operations done by an invocation of `boot_go`.
+#[derive(Clone, Copy, Debug, Default)]
+pub struct FlashStats {
+    /// The number of `flash_area_read` calls made, and the bytes read.
+    pub reads: u32,
+    pub read_bytes: u32,
+    /// The number of `flash_area_write` calls made, the bytes written, and the number of 256 byte
+    /// flash pages they programmed (a page written by two calls counts twice).
+    pub writes: u32,
+    pub write_bytes: u32,
+    pub write_pages: u32,
+    /// The number of `flash_area_erase` calls made, and the bytes erased.
+    pub erases: u32,
+    pub erase_bytes: u32,
+    /// The time the operations would take on SPI NOR flash parts, in microseconds, with erases
+    /// running in the background and the operations on each device waiting for the previous one to
+    /// finish, and the time during which the devices are busy, added over all of them.
+    pub time_us: u32,
+    pub busy_us: u32,
+}
+
+impl FlashStats {
+    fn from_ctx(ctx: &api::CSimContext) -> FlashStats {
+        FlashStats {
+            reads: ctx.flash_reads,
+            read_bytes: ctx.flash_read_bytes,
+            writes: ctx.flash_writes,
+            write_bytes: ctx.flash_write_bytes,
+            write_pages: ctx.flash_write_pages,
+            erases: ctx.flash_erases,
+            erase_bytes: ctx.flash_erase_bytes,
+            time_us: ctx.flash_time_us,
+            busy_us: ctx.flash_busy_us,
+        }
+    }
+}
+
 /// The result of an invocation of `boot_go`.  This is intentionally opaque so that we can provide
 /// accessors for everything we need from this.
 #[derive(Debug)]
@@ -27,6 +64,7 @@ pub enum BootGoResult {
         asserts: u8,
 
         resp: api::BootRsp,
+        stats: FlashStats,
     },
 }
 
@@ -65,6 +103,14 @@ impl BootGoResult {
             _ => None,
         }
     }
+
+    /// Retrieve the flash operations done by a run that was not interrupted.
+    pub fn flash_stats(&self) -> Option<&FlashStats> {
+        match self {
+            BootGoResult::Normal { stats, .. } => Some(stats),
+            _ => None,
+        }
+    }
 }
 
 /// Invoke the bootloader on this flash device.
@@ -111,7 +157,164 @@ pub fn boot_go(multiflash: &mut SimMultiFlash, areadesc: &AreaDesc,
     if result == -0x13579 {
         BootGoResult::Stopped
     } else {
-        BootGoResult::Normal { result, asserts, resp: rsp }
+        BootGoResult::Normal {
+            result,
+            asserts,
+            resp: rsp,
+            stats: FlashStats::from_ctx(&sim_ctx),
+        }
+    }
+}
+
+/// The outcome of validating a single image with `img_validate`.
+#[derive(Debug)]
+pub struct ValidateResult {
+    /// Did the image pass validation.
+    pub valid: bool,
+    /// The number of `flash_area_read` calls made.
+    pub reads: u32,
+    /// The total number of bytes read from flash.
+    pub read_bytes: u32,
+}
+
+/// Validate the image in the given slot on its own, hashing it through a buffer of `buf_sz`
+/// bytes.
+pub fn img_validate(multiflash: &mut SimMultiFlash, areadesc: &AreaDesc, image_index: i32,
+                    slot: i32, buf_sz: u32) -> ValidateResult {
+    init_crypto();
+
+    for (&dev_id, flash) in multiflash.iter_mut() {
+        api::set_flash(dev_id, flash);
+    }
+    let mut sim_ctx = api::CSimContext::default();
+    let rc = unsafe {
+        let adesc = areadesc.get_c();
+        raw::invoke_img_validate(&mut sim_ctx as *mut _, adesc.borrow() as *const _,
+                                 image_index, slot, buf_sz)
+    };
+    for &dev_id in multiflash.keys() {
+        api::clear_flash(dev_id);
+    }
+    ValidateResult {
+        valid: rc == 0,
+        reads: sim_ctx.flash_reads,
+        read_bytes: sim_ctx.flash_read_bytes,
+    }
+}
+
+/// Validate the image in the primary slot the way a normal boot does, going through its
+/// validation cache record.  Returns `None` if the bootloader is built without the cache.
+pub fn img_validate_cached(multiflash: &mut SimMultiFlash, areadesc: &AreaDesc,
+                           image_index: i32) -> Option<ValidateResult> {
+    init_crypto();
+
+    for (&dev_id, flash) in multiflash.iter_mut() {
+        api::set_flash(dev_id, flash);
+    }
+    let mut sim_ctx = api::CSimContext::default();
+    let rc = unsafe {
+        let adesc = areadesc.get_c();
+        raw::invoke_img_validate_cached(&mut sim_ctx as *mut _, adesc.borrow() as *const _,
+                                        image_index)
+    };
+    for &dev_id in multiflash.keys() {
+        api::clear_flash(dev_id);
+    }
+    if rc > 0 {
+        return None;
+    }
+    Some(ValidateResult {
+        valid: rc == 0,
+        reads: sim_ctx.flash_reads,
+        read_bytes: sim_ctx.flash_read_bytes,
+    })
+}
+
+/// Check `count` segments of the image in the primary slot, starting at `first`, against its
+/// segment hash table.  Returns `None` if the bootloader is built without segment hashes.
+pub fn img_check_segments(multiflash: &mut SimMultiFlash, areadesc: &AreaDesc, image_index: i32,
+                          first: u32, count: u32) -> Option<ValidateResult> {
+    init_crypto();
+
+    for (&dev_id, flash) in multiflash.iter_mut() {
+        api::set_flash(dev_id, flash);
+    }
+    let mut sim_ctx = api::CSimContext::default();
+    let rc = unsafe {
+        let adesc = areadesc.get_c();
+        raw::invoke_img_check_segments(&mut sim_ctx as *mut _, adesc.borrow() as *const _,
+                                       image_index, first, count)
+    };
+    for &dev_id in multiflash.keys() {
+        api::clear_flash(dev_id);
+    }
+    if rc > 0 {
+        return None;
+    }
+    Some(ValidateResult {
+        valid: rc == 0,
+        reads: sim_ctx.flash_reads,
+        read_bytes: sim_ctx.flash_read_bytes,
+    })
+}
+
+/// Signature verification statistics of one signature algorithm, see
+/// `struct bootutil_sig_stats`.
+#[repr(C)]
+#[derive(Debug, Default, Clone, Copy)]
+pub struct SigStats {
+    pub verified: u32,
+    pub accepted: u32,
+    pub skipped: u32,
+    pub cycles: u32,
+}
+
+/// Signature algorithms, as indexes in the statistics returned by `sig_stats`.
+pub const SIG_RSA: usize = 0;
+pub const SIG_ECDSA: usize = 1;
+pub const SIG_ED25519: usize = 2;
+
+/// Return the signature verification statistics gathered by this thread, resetting them if
+/// `reset` is set.  Returns `None` if the bootloader is built without multi-sig.
+pub fn sig_stats(reset: bool) -> Option<[SigStats; 3]> {
+    let mut stats = [SigStats::default(); 3];
+    let rc = unsafe { raw::invoke_sig_stats(stats.as_mut_ptr(), reset as libc::c_int) };
+    if rc != 0 {
+        return None;
+    }
+    Some(stats)
+}
+
+/// Have this thread hash and decrypt images with the SHA/AES instructions of the host
+/// (`enable`), or with the software libraries.  Returns false, leaving the software libraries
+/// in use, if the bootloader is built without crypto-ops or the host lacks the instructions.
+pub fn host_crypto_ops(enable: bool) -> bool {
+    unsafe { raw::invoke_crypto_ops(enable as libc::c_int) == 0 }
+}
+
+/// Have the bootloader hash images through the given buffer in the following `boot_go` calls on
+/// this thread, or through its own buffer again if `None`.  The buffer must not be dropped before
+/// the arena is cleared.
+pub fn set_hash_arena(buf: Option<&mut [u32]>) {
+    unsafe {
+        match buf {
+            Some(buf) => raw::invoke_set_hash_arena(buf.as_mut_ptr() as *mut u8,
+                                                    (buf.len() * 4) as u32),
+            None => raw::invoke_set_hash_arena(std::ptr::null_mut(), 0),
+        }
+    }
+}
+
+/// Have the bootloader copy images through the given buffer in the following `boot_go` calls on
+/// this thread, or through its own buffer again if `None`.  The buffer is made of words so that
+/// it is aligned as the bootloader requires, and must not be dropped before the arena is cleared.
+pub fn set_copy_arena(buf: Option<&mut [u32]>) {
+    unsafe {
+        match buf {
+            Some(buf) => raw::invoke_set_copy_arena(buf.as_mut_ptr() as *mut u8,
+                                                    (buf.len() * 4) as u32),
+            None => raw::invoke_set_copy_arena(std::ptr::null_mut(), 0),
+        }
     }
 }
 
@@ -177,6 +380,24 @@ mod raw {
         pub fn invoke_boot_go(sim_ctx: *mut CSimContext, areadesc: *const CAreaDesc,
             rsp: *mut BootRsp, image_index: libc::c_int) -> libc::c_int;
 
+        pub fn invoke_img_validate(sim_ctx: *mut CSimContext, areadesc: *const CAreaDesc,
+            image_index: libc::c_int, slot: libc::c_int, buf_sz: u32) -> libc::c_int;
+
+        pub fn invoke_img_validate_cached(sim_ctx: *mut CSimContext,
+            areadesc: *const CAreaDesc, image_index: libc::c_int) -> libc::c_int;
+
+        pub fn invoke_img_check_segments(sim_ctx: *mut CSimContext,
+            areadesc: *const CAreaDesc, image_index: libc::c_int,
+            first: u32, count: u32) -> libc::c_int;
+
+        pub fn invoke_sig_stats(stats: *mut super::SigStats, reset: libc::c_int) -> libc::c_int;
+
+        pub fn invoke_crypto_ops(enable: libc::c_int) -> libc::c_int;
+
+        pub fn invoke_set_hash_arena(buf: *mut u8, len: u32);
+
+        pub fn invoke_set_copy_arena(buf: *mut u8, len: u32);
+
         pub fn boot_trailer_sz(min_write_sz: u32) -> u32;
         pub fn boot_status_sz(min_write_sz: u32) -> u32;
 
@@ -55,6 +55,7 @@ pub trait Flash {
     fn erase(&mut self, offset: usize, len: usize) -> Result<()>;
     fn write(&mut self, offset: usize, payload: &[u8]) -> Result<()>;
     fn read(&self, offset: usize, data: &mut [u8]) -> Result<()>;
+    fn mapped(&self, offset: usize, len: usize) -> Result<&[u8]>;
 
     fn add_bad_region(&mut self, offset: usize, len: usize, rate: f32) -> Result<()>;
     fn reset_bad_regions(&mut self);
@@ -227,6 +228,15 @@ impl Flash for SimFlash {
         Ok(())
     }
 
+    /// Memory-mapped access hands out the backing store itself.
+    fn mapped(&self, offset: usize, len: usize) -> Result<&[u8]> {
+        if offset + len > self.data.len() {
+            bail!(ebounds("Mapping outside of device"));
+        }
+
+        Ok(&self.data[offset .. offset + len])
+    }
+
     /// Adds a new flash bad region. Writes to this area fail with a chance
     /// given by `rate`.
     fn add_bad_region(&mut self, offset: usize, len: usize, rate: f32) -> Result<()> {
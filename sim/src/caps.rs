@@ -30,6 +30,14 @@ pub enum Caps {
     DirectXip            = (1 << 17),
     HwRollbackProtection = (1 << 18),
     EcdsaP384            = (1 << 19),
+    HashSegments         = (1 << 20),
+    MultiSig             = (1 << 21),
+    CryptoOps            = (1 << 22),
+    CopySkipUnchanged    = (1 << 23),
+    DeltaImages          = (1 << 24),
+    DecompressImages     = (1 << 25),
+    SwapUsingOffset      = (1 << 26),
+    ParallelUpgrades     = (1 << 27),
 }
 
 impl Caps {
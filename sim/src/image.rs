@@ -19,7 +19,8 @@ use rand::{
     rngs::SmallRng,
 };
 use std::{
-    collections::{BTreeMap, HashSet}, io::{Cursor, Write}, mem, rc::Rc, slice
+    collections::{BTreeMap, HashSet}, io::{Cursor, Write}, mem, rc::Rc, slice,
+    time::Instant,
 };
 use aes::{
     Aes128,
@@ -50,14 +51,18 @@ use crate::depends::{
     PairDep,
     UpgradeInfo,
 };
-use crate::tlv::{ManifestGen, TlvGen, TlvFlags};
+use crate::tlv::{ManifestGen, TlvGen, TlvFlags, TlvKinds};
 use crate::utils::align_up;
 use typenum::{U32, U16};
+use xz2::stream::{Action, Filters, LzmaOptions, Status, Stream};
 
 /// For testing, use a non-zero offset for the ram-load, to make sure the offset is getting used
 /// properly, but the value is not really that important.
 const RAM_LOAD_ADDR: u32 = 1024;
 
+/// Size of the segments covered by each entry of the segment hash table.
+const SEG_HASH_SIZE: usize = 4096;
+
 /// A builder for Images.  This describes a single run of the simulator,
 /// capturing the configuration of a particular set of devices, including
 /// the flash simulator(s) and the information about the slots.
@@ -95,6 +100,9 @@ struct ImageData {
     size: usize,
     plain: Vec<u8>,
     cipher: Option<Vec<u8>>,
+    /// Where the image starts within the secondary slot, when it is there.
+    /// Upgrades for swap using offset are stored one sector in.
+    secondary_off: usize,
 }
 
 /// For the RamLoad test cases, we need a contiguous area of RAM to load these images into.  For
@@ -130,6 +138,11 @@ pub enum ImageManipulation {
     /// false to overlap by 1 byte
     OverlapImages(bool),
     CorruptHigherVersionImage,
+    /// Fill the payload as for an image of the same size at the given offset, so that most of it
+    /// matches that image.
+    SharedPayload(usize),
+    /// Fill the payload with something like Thumb code, which compresses.
+    Compressible,
 }
 
 
@@ -339,6 +352,114 @@ impl ImagesBuilder {
         }
     }
 
+    /// Build an upgrade whose payload matches that of the image in the primary slot, as a small
+    /// delta update would; only the header, the TLVs and the first bytes of the payload differ.
+    pub fn make_delta_image(self) -> Images {
+        let mut flash = self.flash;
+        let ram = self.ram.clone(); // TODO: Avoid this clone.
+        let images = self.slots.into_iter().enumerate().map(|(image_num, slots)| {
+            let dep = BoringDep::new(image_num, &NO_DEPS);
+            let primaries = install_image(&mut flash, &slots[0],
+                maximal(42784), &ram, &dep, ImageManipulation::None, Some(0));
+            let upgrades = install_image(&mut flash, &slots[1],
+                maximal(42784), &ram, &dep,
+                ImageManipulation::SharedPayload(slots[0].base_off), Some(0));
+            mark_upgrade(&mut flash, &slots[1]);
+            OneImage {
+                slots,
+                primaries,
+                upgrades,
+            }}).collect();
+        install_ptable(&mut flash, &self.areadesc);
+        let mut images = Images {
+            flash,
+            areadesc: self.areadesc,
+            images,
+            total_count: None,
+            ram: self.ram,
+        };
+
+        if Caps::modifies_flash() {
+            images.total_count = Some(images.run_basic_upgrade(true)
+                                      .expect("Unable to perform basic upgrade"));
+        }
+        images
+    }
+
+    /// Construct an upgrade like `make_delta_image`, but stored as a delta image: a patch to the
+    /// image in the primary slot.
+    pub fn make_delta_patch_image(self) -> Images {
+        let mut flash = self.flash;
+        let ram = self.ram.clone(); // TODO: Avoid this clone.
+        let images = self.slots.into_iter().enumerate().map(|(image_num, slots)| {
+            let dep = BoringDep::new(image_num, &NO_DEPS);
+            let primaries = install_image(&mut flash, &slots[0],
+                maximal(42784), &ram, &dep, ImageManipulation::None, Some(0));
+            let upgrades = install_image(&mut flash, &slots[1],
+                maximal(42784), &ram, &dep,
+                ImageManipulation::SharedPayload(slots[0].base_off), Some(0));
+            if Caps::DeltaImages.present() {
+                install_patch_image(&mut flash, &slots[1], &primaries, &upgrades, &dep);
+            }
+            mark_upgrade(&mut flash, &slots[1]);
+            OneImage {
+                slots,
+                primaries,
+                upgrades,
+            }}).collect();
+        install_ptable(&mut flash, &self.areadesc);
+        let mut images = Images {
+            flash,
+            areadesc: self.areadesc,
+            images,
+            total_count: None,
+            ram: self.ram,
+        };
+
+        if Caps::DeltaImages.present() {
+            images.total_count = Some(images.run_basic_upgrade(true)
+                                      .expect("Unable to perform basic upgrade"));
+        }
+        images
+    }
+
+    /// Construct an upgrade stored as a compressed image, which the bootloader decompresses into
+    /// the primary slot.  With `arm_thumb`, the image goes through the ARM-Thumb BCJ filter before
+    /// being compressed, as with imgtool's lzma2armthumb compression.
+    pub fn make_compressed_image(self, arm_thumb: bool) -> Images {
+        let mut flash = self.flash;
+        let ram = self.ram.clone(); // TODO: Avoid this clone.
+        let images = self.slots.into_iter().enumerate().map(|(image_num, slots)| {
+            let dep = BoringDep::new(image_num, &NO_DEPS);
+            let primaries = install_image(&mut flash, &slots[0],
+                maximal(42784), &ram, &dep, ImageManipulation::None, Some(0));
+            let upgrades = install_image(&mut flash, &slots[1],
+                maximal(42784), &ram, &dep, ImageManipulation::Compressible, Some(0));
+            if Caps::DecompressImages.present() {
+                install_compressed_image(&mut flash, &slots[1], &upgrades, &dep, arm_thumb);
+            }
+            mark_upgrade(&mut flash, &slots[1]);
+            OneImage {
+                slots,
+                primaries,
+                upgrades,
+            }}).collect();
+        install_ptable(&mut flash, &self.areadesc);
+        let mut images = Images {
+            flash,
+            areadesc: self.areadesc,
+            images,
+            total_count: None,
+            ram: self.ram,
+        };
+
+        if Caps::DecompressImages.present() {
+            images.total_count = Some(images.run_basic_upgrade(true)
+                                      .expect("Unable to perform basic upgrade"));
+        }
+        images
+    }
+
     pub fn make_erased_secondary_image(self) -> Images {
         let mut flash = self.flash;
         let ram = self.ram.clone(); // TODO: Avoid this clone.
@@ -451,7 +572,7 @@ impl ImagesBuilder {
 
                 let mut flash = SimMultiFlash::new();
                 flash.insert(dev_id, dev);
-                (flash, Rc::new(areadesc), &[Caps::SwapUsingMove])
+                (flash, Rc::new(areadesc), &[Caps::SwapUsingMove, Caps::SwapUsingOffset])
             }
             DeviceName::K64f => {
                 // NXP style flash.  Small sectors, one small sector for scratch.
@@ -482,7 +603,7 @@ impl ImagesBuilder {
 
                 let mut flash = SimMultiFlash::new();
                 flash.insert(dev_id, dev);
-                (flash, Rc::new(areadesc), &[Caps::SwapUsingMove])
+                (flash, Rc::new(areadesc), &[Caps::SwapUsingMove, Caps::SwapUsingOffset])
             }
             DeviceName::Nrf52840 => {
                 // Simulating the flash on the nrf52840 with partitions set up so that the scratch size
@@ -530,7 +651,28 @@ impl ImagesBuilder {
                 let mut flash = SimMultiFlash::new();
                 flash.insert(0, dev0);
                 flash.insert(1, dev1);
-                (flash, Rc::new(areadesc), &[Caps::SwapUsingMove])
+                (flash, Rc::new(areadesc), &[Caps::SwapUsingOffset])
+            }
+            DeviceName::Nrf52840MultiSpiFlash => {
+                // Simulate nrf52840 with the slots of the second image on an external SPI flash,
+                // so each flash device holds the slots of one image.
+                let dev0 = SimFlash::new(vec![4096; 128], align as usize, erased_val);
+                let dev1 = SimFlash::new(vec![4096; 64], align as usize, erased_val);
+
+                let mut areadesc = AreaDesc::new();
+                areadesc.add_flash_sectors(0, &dev0);
+                areadesc.add_flash_sectors(1, &dev1);
+
+                areadesc.add_image(0x020000, 0x020000, FlashId::Image0, 0);
+                areadesc.add_image(0x040000, 0x020000, FlashId::Image1, 0);
+                areadesc.add_image(0x060000, 0x001000, FlashId::ImageScratch, 0);
+                areadesc.add_image(0x000000, 0x020000, FlashId::Image2, 1);
+                areadesc.add_image(0x020000, 0x020000, FlashId::Image3, 1);
+
+                let mut flash = SimMultiFlash::new();
+                flash.insert(0, dev0);
+                flash.insert(1, dev1);
+                (flash, Rc::new(areadesc), &[])
             }
             DeviceName::K64fMulti => {
                 // NXP style flash, but larger, to support multiple images.
@@ -653,7 +795,8 @@ impl Images {
     }
 
     fn is_swap_upgrade(&self) -> bool {
-        Caps::SwapUsingScratch.present() || Caps::SwapUsingMove.present()
+        Caps::SwapUsingScratch.present() || Caps::SwapUsingMove.present() ||
+            Caps::SwapUsingOffset.present()
     }
 
     pub fn run_basic_revert(&self) -> bool {
@@ -1410,6 +1553,620 @@ impl Images {
         }
     }
 
+    /// Benchmark validation of the images in the primary slot, hashing them through buffers of
+    /// increasing size.  The number of flash reads and the throughput are logged for each block
+    /// size; the test only fails if an image does not validate.
+    pub fn run_hash_bench(&self) -> bool {
+        if !Caps::modifies_flash() {
+            info!("Skipping run_hash_bench, as images are hashed from RAM");
+            return false;
+        }
+
+        let mut flash = self.flash.clone();
+        let mut fails = 0;
+
+        for &blk_sz in &[256u32, 1024, 4096, 16384] {
+            for image_index in 0 .. self.images.len() {
+                let start = Instant::now();
+                let res = c::img_validate(&mut flash, &self.areadesc, image_index as i32, 0,
+                                          blk_sz);
+                let elapsed = start.elapsed().as_secs_f64();
+
+                if !res.valid {
+                    warn!("Image {} failed validation with {} byte blocks", image_index, blk_sz);
+                    fails += 1;
+                    continue;
+                }
+
+                info!("Hash bench: image {}, {:5} byte blocks: {:5} reads, {} bytes, {:.1} MB/s",
+                      image_index, blk_sz, res.reads, res.read_bytes,
+                      res.read_bytes as f64 / elapsed / 1_000_000.0);
+            }
+        }
+
+        fails > 0
+    }
+
+    /// Upgrade with the bootloader hashing images through a lent buffer larger than its own.  The
+    /// upgrade must succeed, and must not need more flash reads than without the buffer.
+    pub fn run_hash_arena(&self) -> bool {
+        if !Caps::modifies_flash() {
+            info!("Skipping run_hash_arena, as images are hashed from RAM");
+            return false;
+        }
+
+        let mut reads = [0u32; 2];
+        let mut fails = 0;
+
+        for (i, &arena_sz) in [0usize, 16384].iter().enumerate() {
+            let mut arena = vec![0u32; arena_sz / 4];
+            let mut flash = self.flash.clone();
+
+            c::set_hash_arena(if arena_sz > 0 { Some(&mut arena[..]) } else { None });
+            let res = c::boot_go(&mut flash, &self.areadesc, None, None, false);
+            c::set_hash_arena(None);
+
+            match res.flash_stats() {
+                Some(stats) if res.success() => reads[i] = stats.reads,
+                _ => {
+                    warn!("Upgrade failed hashing through a {} byte arena", arena_sz);
+                    return true;
+                }
+            }
+            if !self.verify_images(&flash, 0, 1) {
+                warn!("Primary slot image verification FAIL hashing through a {} byte arena",
+                      arena_sz);
+                fails += 1;
+            }
+        }
+
+        info!("Hash arena: {} reads without, {} with a 16384 byte arena", reads[0], reads[1]);
+        if reads[1] > reads[0] {
+            warn!("Hashing through an arena needed more flash reads");
+            fails += 1;
+        }
+
+        fails > 0
+    }
+
+    /// Check that once the primary slot has been validated, later validations only go through
+    /// its cache record, and that a record which has been tampered with is not trusted, nor one
+    /// whose image has a security counter below the stored one.
+    pub fn run_validation_cache(&self) -> bool {
+        if !Caps::modifies_flash() {
+            info!("Skipping run_validation_cache, as images are validated from RAM");
+            return false;
+        }
+
+        let mut flash = self.flash.clone();
+        let mut fails = 0;
+
+        for (image_index, image) in self.images.iter().enumerate() {
+            let index = image_index as i32;
+            let full = match c::img_validate_cached(&mut flash, &self.areadesc, index) {
+                None => {
+                    info!("Skipping run_validation_cache, as the cache is not enabled");
+                    return false;
+                }
+                Some(res) => res,
+            };
+            if !full.valid {
+                warn!("Image {}: first validation failed", image_index);
+                fails += 1;
+                continue;
+            }
+
+            let cached = c::img_validate_cached(&mut flash, &self.areadesc, index).unwrap();
+            info!("Validation cache: image {}, {} bytes read on first boot, {} when cached",
+                  image_index, full.read_bytes, cached.read_bytes);
+            if !cached.valid || cached.read_bytes * 4 > full.read_bytes {
+                warn!("Image {}: cached validation did not skip hashing", image_index);
+                fails += 1;
+            }
+            let cached_flash = flash.clone();
+
+            // The record is the lowest part of the trailer, just above the status area.
+            let slot = &image.slots[0];
+            let align = flash.get(&slot.dev_id).unwrap().align() as u32;
+            let info_sz = (c::boot_trailer_sz(align) - c::boot_status_sz(align)) as usize;
+            let record_off = slot.base_off + slot.len - info_sz;
+
+            // A forged record is not trusted, nor replaced.
+            flip_byte(&mut flash, slot.dev_id, record_off + 1);
+            for _ in 0 .. 2 {
+                let res = c::img_validate_cached(&mut flash, &self.areadesc, index).unwrap();
+                if !res.valid || res.read_bytes < full.read_bytes / 2 {
+                    warn!("Image {}: tampered cache record was trusted", image_index);
+                    fails += 1;
+                }
+            }
+
+            // So an image modified behind its back fails validation.
+            flip_byte(&mut flash, slot.dev_id, slot.base_off + image.primaries.size / 2);
+            let res = c::img_validate_cached(&mut flash, &self.areadesc, index).unwrap();
+            if res.valid {
+                warn!("Image {}: modified image passed validation", image_index);
+                fails += 1;
+            }
+
+            // The stored security counter may be raised after the record was written.
+            if Caps::HwRollbackProtection.present() {
+                let mut flash = cached_flash;
+                c::set_security_counter(image_index as u32, 1);
+                let res = c::img_validate_cached(&mut flash, &self.areadesc, index).unwrap();
+                if res.valid {
+                    warn!("Image {}: cached image below the security counter passed validation",
+                          image_index);
+                    fails += 1;
+                }
+            }
+        }
+
+        fails > 0
+    }
+
+    /// Check that images carrying a segment hash table are rejected as soon as a corrupt segment
+    /// is hashed, and that segments can be checked on their own.
+    pub fn run_hash_segments(&self) -> bool {
+        if !Caps::HashSegments.present() || !Caps::modifies_flash() {
+            info!("Skipping run_hash_segments, as it is not enabled");
+            return false;
+        }
+
+        let mut flash = self.flash.clone();
+        let mut fails = 0;
+
+        for (image_index, image) in self.images.iter().enumerate() {
+            let index = image_index as i32;
+            let full = c::img_validate(&mut flash, &self.areadesc, index, 0, 1024);
+            if !full.valid {
+                warn!("Image {}: validation failed", image_index);
+                fails += 1;
+                continue;
+            }
+
+            // The table covers the header and the image body.
+            let plain = &image.primaries.plain;
+            let hdr_size = u16::from_le_bytes(plain[8..10].try_into().unwrap()) as usize;
+            let img_size = u32::from_le_bytes(plain[12..16].try_into().unwrap()) as usize;
+            let hashed_len = hdr_size + img_size;
+            let segs = ((hashed_len + SEG_HASH_SIZE - 1) / SEG_HASH_SIZE) as u32;
+            let res = c::img_check_segments(&mut flash, &self.areadesc, index, 0, segs).unwrap();
+            if !res.valid {
+                warn!("Image {}: segments do not match their table", image_index);
+                fails += 1;
+            }
+
+            // Corrupt the first segment.
+            let slot = &image.slots[0];
+            flip_byte(&mut flash, slot.dev_id, slot.base_off + 100);
+
+            let res = c::img_validate(&mut flash, &self.areadesc, index, 0, 1024);
+            info!("Segment hashes: image {}, {} bytes read when valid, {} when corrupt",
+                  image_index, full.read_bytes, res.read_bytes);
+            if res.valid {
+                warn!("Image {}: corrupt image passed validation", image_index);
+                fails += 1;
+            }
+            if segs > 4 && res.read_bytes * 2 > full.read_bytes {
+                warn!("Image {}: corrupt segment did not stop hashing", image_index);
+                fails += 1;
+            }
+
+            let res = c::img_check_segments(&mut flash, &self.areadesc, index, 0, 1).unwrap();
+            if res.valid {
+                warn!("Image {}: corrupt segment passed its check", image_index);
+                fails += 1;
+            }
+            if segs > 1 {
+                let res = c::img_check_segments(&mut flash, &self.areadesc, index, 1,
+                                                segs - 1).unwrap();
+                if !res.valid {
+                    warn!("Image {}: intact segments failed their check", image_index);
+                    fails += 1;
+                }
+            }
+        }
+
+        fails > 0
+    }
+
+    /// Check that images are accepted on their first valid signature, without verifying the
+    /// others, and on a later one when the first is corrupt.
+    pub fn run_multi_sig(&self) -> bool {
+        if !Caps::MultiSig.present() || !Caps::modifies_flash() {
+            info!("Skipping run_multi_sig, as it is not enabled");
+            return false;
+        }
+
+        let algs = [
+            ("RSA", Caps::RSA2048.present() || Caps::RSA3072.present(), c::SIG_RSA),
+            ("ECDSA", Caps::has_ecdsa(), c::SIG_ECDSA),
+            ("Ed25519", Caps::Ed25519.present(), c::SIG_ED25519),
+        ];
+        let sigs = algs.iter().filter(|alg| alg.1).count() as u32;
+
+        let mut flash = self.flash.clone();
+        let mut fails = 0;
+
+        for (image_index, image) in self.images.iter().enumerate() {
+            let index = image_index as i32;
+            c::sig_stats(true);
+            let res = c::img_validate(&mut flash, &self.areadesc, index, 0, 1024);
+            let stats = c::sig_stats(true).unwrap();
+            for &(name, present, alg) in &algs {
+                if present {
+                    info!("Multi-sig: image {}, {}: {:?}", image_index, name, stats[alg]);
+                }
+            }
+            let verified: u32 = stats.iter().map(|s| s.verified).sum();
+            let accepted: u32 = stats.iter().map(|s| s.accepted).sum();
+            let skipped: u32 = stats.iter().map(|s| s.skipped).sum();
+            if !res.valid || verified != 1 || accepted != 1 || skipped != sigs - 1 {
+                warn!("Image {}: not accepted on its first signature", image_index);
+                fails += 1;
+                continue;
+            }
+
+            // Corrupt the first signature, which is the last byte of the first signature TLV.
+            let plain = &image.primaries.plain;
+            let hdr_size = u16::from_le_bytes(plain[8..10].try_into().unwrap()) as usize;
+            let prot_size = u16::from_le_bytes(plain[10..12].try_into().unwrap()) as usize;
+            let img_size = u32::from_le_bytes(plain[12..16].try_into().unwrap()) as usize;
+            let mut off = hdr_size + img_size + prot_size + 4;
+            let sig_end = loop {
+                let kind = u16::from_le_bytes(plain[off..off + 2].try_into().unwrap());
+                let len = u16::from_le_bytes(plain[off + 2..off + 4].try_into().unwrap());
+                off += 4 + len as usize;
+                if kind == TlvKinds::RSA2048 as u16 || kind == TlvKinds::RSA3072 as u16 ||
+                    kind == TlvKinds::ECDSASIG as u16 || kind == TlvKinds::ED25519 as u16 {
+                    break off;
+                }
+            };
+            let slot = &image.slots[0];
+            flip_byte(&mut flash, slot.dev_id, slot.base_off + sig_end - 1);
+
+            let res = c::img_validate(&mut flash, &self.areadesc, index, 0, 1024);
+            let stats = c::sig_stats(true).unwrap();
+            let verified: u32 = stats.iter().map(|s| s.verified).sum();
+            if res.valid != (sigs > 1) || verified != sigs.min(2) {
+                warn!("Image {}: {} signatures verified after corrupting the first, valid {}",
+                      image_index, verified, res.valid);
+                fails += 1;
+            }
+        }
+
+        fails > 0
+    }
+
+    /// Compare the host crypto backend with the software libraries: images must validate with
+    /// either, a corrupt image must still be rejected, and an upgrade, decrypting encrypted
+    /// images, must go through with the backend.  The time taken to validate the images is
+    /// logged for both.
+    pub fn run_crypto_ops(&self) -> bool {
+        if !Caps::CryptoOps.present() || !Caps::modifies_flash() {
+            info!("Skipping run_crypto_ops, as it is not enabled");
+            return false;
+        }
+        if !c::host_crypto_ops(true) {
+            info!("Skipping run_crypto_ops, as the host has no SHA/AES instructions");
+            return false;
+        }
+
+        let mut flash = self.flash.clone();
+        let mut fails = 0;
+
+        for image_index in 0 .. self.images.len() {
+            let index = image_index as i32;
+            let mut rates = [0.0; 2];
+
+            for (i, &accel) in [false, true].iter().enumerate() {
+                c::host_crypto_ops(accel);
+                let start = Instant::now();
+                let res = c::img_validate(&mut flash, &self.areadesc, index, 0, 4096);
+                let elapsed = start.elapsed().as_secs_f64();
+                if !res.valid {
+                    warn!("Image {} failed validation, host crypto {}", image_index, accel);
+                    fails += 1;
+                }
+                rates[i] = res.read_bytes as f64 / elapsed / 1_000_000.0;
+            }
+            info!("Crypto ops: image {}, {:.1} MB/s in software, {:.1} MB/s on the host",
+                  image_index, rates[0], rates[1]);
+        }
+
+        let mut corrupt = flash.clone();
+        let slot = &self.images[0].slots[0];
+        flip_byte(&mut corrupt, slot.dev_id, slot.base_off + 0x100);
+        if c::img_validate(&mut corrupt, &self.areadesc, 0, 0, 4096).valid {
+            warn!("Corrupt image passed validation with host crypto");
+            fails += 1;
+        }
+
+        if !c::boot_go(&mut flash, &self.areadesc, None, None, false).success() {
+            warn!("Upgrade with host crypto failed");
+            fails += 1;
+        } else if !self.verify_images(&flash, 0, 1) {
+            warn!("Primary slot image verification FAIL after upgrade with host crypto");
+            fails += 1;
+        }
+
+        c::host_crypto_ops(false);
+        fails > 0
+    }
+
+    /// Benchmark an upgrade with the bootloader copying images through its own buffer, then
+    /// through lent buffers of increasing size.  The flash operations and the time they would
+    /// take on a typical SPI NOR part are logged for each buffer; the test fails if an upgrade
+    /// fails, or if a larger buffer needs more flash writes.
+    pub fn run_copy_bench(&self) -> bool {
+        if !Caps::modifies_flash() {
+            info!("Skipping run_copy_bench, as images are not copied in flash");
+            return false;
+        }
+
+        // Rough SPI NOR timings, in microseconds: the command and status polling overhead of
+        // each call, reading a KiB, programming a 256 byte page, and erasing a KiB.
+        const OP_US: f64 = 20.0;
+        const READ_KB_US: f64 = 20.0;
+        const PAGE_PROGRAM_US: f64 = 400.0;
+        const ERASE_KB_US: f64 = 11_000.0;
+
+        let mut fails = 0;
+        let mut last_writes = u32::MAX;
+
+        for &arena_sz in &[0usize, 4096, 16384, 65536] {
+            let mut arena = vec![0u32; arena_sz / 4];
+            let mut flash = self.flash.clone();
+
+            c::set_copy_arena(if arena_sz > 0 { Some(&mut arena[..]) } else { None });
+            let res = c::boot_go(&mut flash, &self.areadesc, None, None, false);
+            c::set_copy_arena(None);
+
+            let stats = match res.flash_stats() {
+                Some(stats) if res.success() => *stats,
+                _ => {
+                    warn!("Upgrade failed copying through a {} byte arena", arena_sz);
+                    fails += 1;
+                    continue;
+                }
+            };
+            if !self.verify_images(&flash, 0, 1) {
+                warn!("Primary slot image verification FAIL copying through a {} byte arena",
+                      arena_sz);
+                fails += 1;
+            }
+            if stats.writes > last_writes {
+                warn!("Copying through a {} byte arena needed more flash writes", arena_sz);
+                fails += 1;
+            }
+            last_writes = stats.writes;
+
+            let ops = stats.reads + stats.writes + stats.erases;
+            let time_us = ops as f64 * OP_US +
+                stats.read_bytes as f64 / 1024.0 * READ_KB_US +
+                stats.write_pages as f64 * PAGE_PROGRAM_US +
+                stats.erase_bytes as f64 / 1024.0 * ERASE_KB_US;
+            info!("Copy bench: {:5} byte arena: {:5} reads, {:5} writes ({} pages), \
+                   {:4} erases, {:.0} ms",
+                  arena_sz, stats.reads, stats.writes, stats.write_pages, stats.erases,
+                  time_us / 1000.0);
+        }
+
+        fails > 0
+    }
+
+    /// Upgrade all the images with their swaps interleaved.  The upgrade must succeed, and when the
+    /// images are on different flash devices, it must take less time than the devices are busy,
+    /// as the erases on one device then overlap operations on the others.
+    pub fn run_parallel_upgrade(&self) -> bool {
+        if !Caps::ParallelUpgrades.present() {
+            info!("Skipping run_parallel_upgrade, as it is not enabled");
+            return false;
+        }
+
+        let mut fails = 0;
+        let mut flash = self.flash.clone();
+        let res = c::boot_go(&mut flash, &self.areadesc, None, None, false);
+
+        let stats = match res.flash_stats() {
+            Some(stats) if res.success() => *stats,
+            _ => {
+                warn!("Parallel upgrade failed");
+                return true;
+            }
+        };
+        if !self.verify_images(&flash, 0, 1) {
+            warn!("Primary slot image verification FAIL after parallel upgrade");
+            fails += 1;
+        }
+
+        let devices: HashSet<u8> = self.images.iter().map(|image| image.slots[0].dev_id).collect();
+        if devices.len() > 1 && stats.time_us >= stats.busy_us {
+            warn!("Parallel upgrade took {} us with the flash busy for {} us",
+                  stats.time_us, stats.busy_us);
+            fails += 1;
+        }
+        info!("Parallel upgrade: {} images on {} devices, {:.0} ms, flash busy {:.0} ms",
+              self.images.len(), devices.len(),
+              stats.time_us as f64 / 1000.0, stats.busy_us as f64 / 1000.0);
+
+        fails > 0
+    }
+
+    /// Check that an upgrade sharing most of its payload with the image in the primary slot needs
+    /// fewer flash writes than the same upgrade over a primary slot with a byte changed in each of
+    /// its sectors, and that both succeed.
+    pub fn run_skip_unchanged(&self) -> bool {
+        if !Caps::CopySkipUnchanged.present() || !Caps::modifies_flash() {
+            info!("Skipping run_skip_unchanged, as it is not enabled");
+            return false;
+        }
+
+        let encrypted = Caps::EncRsa.present() || Caps::EncKw.present() ||
+            Caps::EncEc256.present() || Caps::EncX25519.present();
+        let mut changed = self.flash.clone();
+        let mut shared_sectors = false;
+
+        for image in &self.images {
+            let slot = &image.slots[0];
+            let end = slot.base_off + image.primaries.size;
+            let bases: Vec<(usize, usize)> = changed.get(&slot.dev_id).unwrap().sector_iter()
+                .filter(|s| s.base >= slot.base_off && s.base < end)
+                .map(|s| (s.base, s.size))
+                .collect();
+
+            // The first and the last sectors of the image differ from the upgrade anyway.
+            shared_sectors |= bases.len() > 2;
+            for (base, size) in bases {
+                flip_byte(&mut changed, slot.dev_id, (base + size / 2).min(end - 1));
+            }
+        }
+
+        let upgrade = |flash: &mut SimMultiFlash| {
+            let res = c::boot_go(flash, &self.areadesc, None, None, false);
+            if res.success() && self.verify_images(flash, 0, 1) {
+                res.flash_stats().copied()
+            } else {
+                None
+            }
+        };
+
+        match (upgrade(&mut self.flash.clone()), upgrade(&mut changed)) {
+            (Some(delta), Some(full)) => {
+                info!("Skip unchanged: {} bytes written and {} erases, against {} and {}",
+                      delta.write_bytes, delta.erases, full.write_bytes, full.erases);
+                if shared_sectors && !encrypted && delta.write_bytes >= full.write_bytes {
+                    warn!("Unchanged sectors were written again");
+                    return true;
+                }
+                false
+            }
+            _ => {
+                warn!("Upgrade FAIL");
+                true
+            }
+        }
+    }
+
+    /// Test a delta image upgrade: the primary slot must end up holding the image the patch was
+    /// made for, also when power fails while it is applied, and a patch must be refused by an
+    /// image other than the one it was made for.
+    pub fn run_delta_patch_upgrade(&self) -> bool {
+        if !Caps::DeltaImages.present() {
+            info!("Skipping run_delta_patch_upgrade, as it is not enabled");
+            return false;
+        }
+
+        let mut fails = 0;
+
+        let mut flash = self.flash.clone();
+        let res = c::boot_go(&mut flash, &self.areadesc, None, None, false);
+        if !res.success() || !self.verify_images(&flash, 0, 1) {
+            warn!("Delta image upgrade FAIL");
+            fails += 1;
+        }
+
+        // The patch must leave a base image it was not made for alone.
+        let mut changed = self.flash.clone();
+        for image in &self.images {
+            let slot = &image.slots[0];
+            flip_byte(&mut changed, slot.dev_id, slot.base_off + image.primaries.size / 2);
+        }
+        let mut flash = changed.clone();
+        c::boot_go(&mut flash, &self.areadesc, None, None, false);
+        for image in &self.images {
+            let slot = &image.slots[0];
+            let mut before = vec![0u8; slot.len];
+            let mut after = vec![0u8; slot.len];
+            changed.get(&slot.dev_id).unwrap().read(slot.base_off, &mut before).unwrap();
+            flash.get(&slot.dev_id).unwrap().read(slot.base_off, &mut after).unwrap();
+            if before[..image.primaries.size] != after[..image.primaries.size] {
+                warn!("Delta image applied to another image");
+                fails += 1;
+            }
+        }
+
+        if self.run_perm_with_fails() {
+            fails += 1;
+        }
+
+        fails > 0
+    }
+
+    /// Test a compressed image upgrade: the primary slot must end up holding the image that was
+    /// compressed, also when power fails while it is decompressed.
+    pub fn run_compressed_upgrade(&self) -> bool {
+        if !Caps::DecompressImages.present() {
+            info!("Skipping run_compressed_upgrade, as it is not enabled");
+            return false;
+        }
+
+        let mut fails = 0;
+
+        let mut flash = self.flash.clone();
+        let res = c::boot_go(&mut flash, &self.areadesc, None, None, false);
+        if !res.success() || !self.verify_images(&flash, 0, 1) {
+            warn!("Compressed image upgrade FAIL");
+            fails += 1;
+        }
+
+        if self.run_perm_with_fails() {
+            fails += 1;
+        }
+
+        fails > 0
+    }
+
+    /// Benchmark the upgrade from the compressed images against the same upgrade from the images
+    /// themselves.  The flash operations, time and throughput of both are logged; the test only
+    /// fails if an upgrade does not succeed.
+    pub fn run_decompress_bench(&self) -> bool {
+        if !Caps::DecompressImages.present() {
+            info!("Skipping run_decompress_bench, as it is not enabled");
+            return false;
+        }
+
+        let mut plain = self.flash.clone();
+        for image in &self.images {
+            let slot = &image.slots[1];
+            let dev = plain.get_mut(&slot.dev_id).unwrap();
+            dev.erase(slot.base_off, slot.len).unwrap();
+            dev.write(slot.base_off, &image.upgrades.plain).unwrap();
+            mark_upgrade(&mut plain, slot);
+        }
+
+        let size: usize = self.images.iter().map(|image| image.upgrades.size).sum();
+        let mut fails = 0;
+
+        for (name, flash) in [("compressed", &self.flash), ("plain", &plain)] {
+            let mut flash = flash.clone();
+            let start = Instant::now();
+            let res = c::boot_go(&mut flash, &self.areadesc, None, None, false);
+            let elapsed = start.elapsed().as_secs_f64();
+
+            let stats = match res.flash_stats() {
+                Some(stats) if res.success() => *stats,
+                _ => {
+                    warn!("Upgrade from the {} images failed", name);
+                    fails += 1;
+                    continue;
+                }
+            };
+            if !self.verify_images(&flash, 0, 1) {
+                warn!("Primary slot image verification FAIL after the {} upgrade", name);
+                fails += 1;
+            }
+
+            info!("Decompress bench: {:10} upgrade: {:5} reads ({} bytes), {:5} writes, \
+                   {:4} erases, {:.1} MB/s",
+                  name, stats.reads, stats.read_bytes, stats.writes, stats.erases,
+                  size as f64 / elapsed / 1_000_000.0);
+        }
+
+        fails > 0
+    }
+
     /// Test a boot, optionally stopping after 'n' flash options.  Returns a count
     /// of the number of flash operations done total.
     fn try_upgrade(&self, stop: Option<i32>, permanent: bool) -> (SimMultiFlash, i32) {
@@ -1738,7 +2495,7 @@ fn image_largest_trailer(dev: &dyn Flash) -> usize {
                 // This computation is incorrect, and we need to figure out the correct size.
                 // c::boot_status_sz(dev.align() as u32) as usize
                 16 + 4 * dev.align()
-            } else if Caps::SwapUsingMove.present() {
+            } else if Caps::SwapUsingMove.present() || Caps::SwapUsingOffset.present() {
                 let sector_size = dev.sector_iter().next().unwrap().size as u32;
                 align_up(c::boot_trailer_sz(dev.align() as u32), sector_size) as usize
             } else if Caps::SwapUsingScratch.present() {
@@ -1750,15 +2507,26 @@ fn image_largest_trailer(dev: &dyn Flash) -> usize {
             trailer
 }
 
+/// The offset of images installed into the given slot: upgrades for swap using offset are stored
+/// one sector past the start of the secondary slot.
+fn secondary_offset(dev: &dyn Flash, slot: &SlotInfo) -> usize {
+    if slot.index == 1 && Caps::SwapUsingOffset.present() {
+        dev.sector_iter().find(|s| s.base == slot.base_off).unwrap().size
+    } else {
+        0
+    }
+}
+
 /// Install a "program" into the given image.  This fakes the image header, or at least all of the
 /// fields used by the given code.  Returns a copy of the image that was written.
 fn install_image(flash: &mut SimMultiFlash, slot: &SlotInfo, len: ImageSize,
                  ram: &RamData,
                  deps: &dyn Depender, img_manipulation: ImageManipulation, security_counter:Option<u32>) -> ImageData {
     let offset = slot.base_off;
-    let slot_len = slot.len;
     let dev_id = slot.dev_id;
     let dev = flash.get_mut(&dev_id).unwrap();
+    let secondary_off = secondary_offset(&*dev, slot);
+    let slot_len = slot.len - secondary_off;
 
     let mut tlv: Box<dyn ManifestGen> = Box::new(make_tlv());
     if img_manipulation == ImageManipulation::IgnoreRamLoadFlag {
@@ -1774,6 +2542,13 @@ fn install_image(flash: &mut SimMultiFlash, slot: &SlotInfo, len: ImageSize,
     }
 
     const HDR_SIZE: usize = 32;
+
+    // Bound the size of the segment hash table by the slot until the image
+    // size is known.
+    if Caps::HashSegments.present() {
+        tlv.set_segment_hash(SEG_HASH_SIZE, slot_len);
+    }
+
     let place = ram.lookup(&slot);
     let load_addr = if Caps::RamLoad.present() {
         match img_manipulation {
@@ -1807,6 +2582,10 @@ fn install_image(flash: &mut SimMultiFlash, slot: &SlotInfo, len: ImageSize,
 
     };
 
+    if Caps::HashSegments.present() {
+        tlv.set_segment_hash(SEG_HASH_SIZE, HDR_SIZE + len);
+    }
+
     // Generate a boot header.  Note that the size doesn't include the header.
     let header = ImageHeader {
         magic: tlv.get_magic(),
@@ -1827,7 +2606,11 @@ fn install_image(flash: &mut SimMultiFlash, slot: &SlotInfo, len: ImageSize,
 
     // The core of the image itself is just pseudorandom data.
     let mut b_img = vec![0; len];
-    splat(&mut b_img, offset);
+    match img_manipulation {
+        ImageManipulation::SharedPayload(seed) => splat(&mut b_img, seed),
+        ImageManipulation::Compressible => splat_code(&mut b_img, offset),
+        _ => splat(&mut b_img, offset),
+    }
 
     // Add some information at the start of the payload to make it easier
     // to see what it is.  This will fail if the image itself is too small.
@@ -1927,8 +2710,10 @@ fn install_image(flash: &mut SimMultiFlash, slot: &SlotInfo, len: ImageSize,
             size: image_sz,
             plain: copy,
             cipher: enc_copy,
+            secondary_off: 0,
         }
     } else {
+        let offset = offset + secondary_off;
 
         dev.write(offset, &buf).unwrap();
 
@@ -1954,16 +2739,205 @@ fn install_image(flash: &mut SimMultiFlash, slot: &SlotInfo, len: ImageSize,
             size: image_sz,
             plain: copy,
             cipher: enc_copy,
+            secondary_off,
         }
     }
 }
 
+/// Replace the image in the given slot with a delta image, which patches the image `base` into the
+/// image `target`.
+fn install_patch_image(flash: &mut SimMultiFlash, slot: &SlotInfo, base: &ImageData,
+                       target: &ImageData, deps: &dyn Depender) {
+    let dev = flash.get_mut(&slot.dev_id).unwrap();
+    let base = &base.plain[..base.size];
+    let target = &target.plain[..target.size];
+    let patch = make_patch(base, target);
+
+    let mut tlv: Box<dyn ManifestGen> = Box::new(make_tlv());
+    tlv.set_security_counter(Some(0));
+    for dep in deps.my_deps(slot.base_off, slot.index) {
+        tlv.add_dependency(deps.other_id(), &dep);
+    }
+    tlv.set_delta(&image_hash(base), target.len() as u32);
+
+    const HDR_SIZE: usize = 32;
+
+    if Caps::HashSegments.present() {
+        tlv.set_segment_hash(SEG_HASH_SIZE, HDR_SIZE + patch.len());
+    }
+
+    let header = ImageHeader {
+        magic: tlv.get_magic(),
+        load_addr: 0,
+        hdr_size: HDR_SIZE as u16,
+        protect_tlv_size: tlv.protect_size(),
+        img_size: patch.len() as u32,
+        flags: tlv.get_flags(),
+        ver: deps.my_version(slot.base_off, slot.index),
+        _pad2: 0,
+    };
+
+    let mut buf = header.as_raw().to_vec();
+    assert_eq!(buf.len(), HDR_SIZE);
+    tlv.add_bytes(&buf);
+    tlv.add_bytes(&patch);
+    buf.extend_from_slice(&patch);
+    buf.append(&mut tlv.make_tlv());
+
+    let align = dev.align();
+    while buf.len() % align != 0 {
+        buf.push(dev.erased_val());
+    }
+
+    info!("Delta image of {:#x} bytes for an image of {:#x}", buf.len(), target.len());
+    dev.erase(slot.base_off, slot.len).unwrap();
+    dev.write(slot.base_off, &buf).unwrap();
+}
+
+/// Encode the delta image operations that produce `target` out of `base`.  Runs of bytes that
+/// match `base` at the same offset are copied from it, the other bytes are added.
+fn make_patch(base: &[u8], target: &[u8]) -> Vec<u8> {
+    const MIN_COPY: usize = 16;
+
+    fn add(patch: &mut Vec<u8>, data: &[u8]) {
+        if !data.is_empty() {
+            patch.write_u32::<LittleEndian>((2 << 30) | data.len() as u32).unwrap();
+            patch.extend_from_slice(data);
+        }
+    }
+
+    let mut patch = vec![];
+    let mut added = 0;
+    let mut pos = 0;
+    while pos < target.len() {
+        let run = target[pos..].iter()
+            .zip(&base[pos.min(base.len())..])
+            .take_while(|(a, b)| a == b)
+            .count();
+        if run >= MIN_COPY {
+            add(&mut patch, &target[added..pos]);
+            patch.write_u32::<LittleEndian>((1 << 30) | run as u32).unwrap();
+            patch.write_u32::<LittleEndian>(pos as u32).unwrap();
+            added = pos + run;
+        }
+        pos += run + 1;
+    }
+    add(&mut patch, &target[added..]);
+    patch
+}
+
+/// Replace the image in the given slot with a compressed image of `target`, made as imgtool does:
+/// the body is a two byte header followed by the body of `target` as a raw LZMA2 stream.
+fn install_compressed_image(flash: &mut SimMultiFlash, slot: &SlotInfo, target: &ImageData,
+                            deps: &dyn Depender, arm_thumb: bool) {
+    let dev = flash.get_mut(&slot.dev_id).unwrap();
+    let target = &target.plain[..target.size];
+
+    const HDR_SIZE: usize = 32;
+
+    let body_size = u32::from_le_bytes([target[12], target[13], target[14], target[15]]);
+    // A 128 KiB dictionary, and lc=3, lp=1, pb=2.
+    let mut body = vec![10, (2 * 5 + 1) * 9 + 3];
+    body.append(&mut lzma2_compress(&target[HDR_SIZE..HDR_SIZE + body_size as usize],
+                                    arm_thumb));
+
+    let mut tlv: Box<dyn ManifestGen> = Box::new(make_tlv());
+    tlv.set_security_counter(Some(0));
+    for dep in deps.my_deps(slot.base_off, slot.index) {
+        tlv.add_dependency(deps.other_id(), &dep);
+    }
+    let sig = image_tlv(target, &[TlvKinds::RSA2048, TlvKinds::ECDSASIG, TlvKinds::RSA3072,
+                                  TlvKinds::ED25519]);
+    tlv.set_decompress(body_size, &image_hash(target), sig.as_deref(), arm_thumb);
+
+    let header = ImageHeader {
+        magic: tlv.get_magic(),
+        load_addr: 0,
+        hdr_size: HDR_SIZE as u16,
+        protect_tlv_size: tlv.protect_size(),
+        img_size: body.len() as u32,
+        flags: tlv.get_flags(),
+        ver: deps.my_version(slot.base_off, slot.index),
+        _pad2: 0,
+    };
+
+    let mut buf = header.as_raw().to_vec();
+    assert_eq!(buf.len(), HDR_SIZE);
+    tlv.add_bytes(&buf);
+    tlv.add_bytes(&body);
+    buf.extend_from_slice(&body);
+    buf.append(&mut tlv.make_tlv());
+
+    let align = dev.align();
+    while buf.len() % align != 0 {
+        buf.push(dev.erased_val());
+    }
+
+    info!("Compressed image of {:#x} bytes for an image of {:#x}", buf.len(), target.len());
+    dev.erase(slot.base_off, slot.len).unwrap();
+    dev.write(slot.base_off, &buf).unwrap();
+}
+
+/// Compress `data` to a raw LZMA2 stream with the settings imgtool uses, optionally through the
+/// ARM-Thumb BCJ filter.
+fn lzma2_compress(data: &[u8], arm_thumb: bool) -> Vec<u8> {
+    let mut opts = LzmaOptions::new_preset(9).unwrap();
+    opts.dict_size(128 * 1024)
+        .literal_context_bits(3)
+        .literal_position_bits(1)
+        .position_bits(2);
+    let mut filters = Filters::new();
+    if arm_thumb {
+        filters.arm_thumb();
+    }
+    filters.lzma2(&opts);
+
+    let mut stream = Stream::new_raw_encoder(&filters).unwrap();
+    let mut out = Vec::with_capacity(data.len());
+    loop {
+        out.reserve(4096);
+        let done = stream.total_in() as usize;
+        if let Status::StreamEnd = stream.process_vec(&data[done..], &mut out,
+                                                      Action::Finish).unwrap() {
+            break;
+        }
+    }
+    out
+}
+
+/// Retrieve the first of the given TLVs outside of the protected area of a signed image.
+fn image_tlv(image: &[u8], kinds: &[TlvKinds]) -> Option<Vec<u8>> {
+    let u16_at = |off: usize| u16::from_le_bytes([image[off], image[off + 1]]) as usize;
+    let hdr_size = u16_at(8);
+    let protect_size = u16_at(10);
+    let img_size = u16_at(12) | (u16_at(14) << 16);
+
+    let start = hdr_size + img_size + protect_size;
+    let end = start + u16_at(start + 2);
+    let mut off = start + 4;
+    while off < end {
+        let kind = u16_at(off) as u16;
+        let len = u16_at(off + 2);
+        if kinds.iter().any(|&k| k as u16 == kind) {
+            return Some(image[off + 4 .. off + 4 + len].to_vec());
+        }
+        off += 4 + len;
+    }
+    None
+}
+
+/// Retrieve the hash TLV of a signed image.
+fn image_hash(image: &[u8]) -> Vec<u8> {
+    image_tlv(image, &[TlvKinds::SHA256, TlvKinds::SHA384]).expect("Image has no hash TLV")
+}
+
 /// Install no image.  This is used when no upgrade happens.
 fn install_no_image() -> ImageData {
     ImageData {
         size: 0,
         plain: vec![],
         cipher: None,
+        secondary_off: 0,
     }
 }
 
@@ -2004,6 +2978,8 @@ fn make_tlv() -> TlvGen {
             TlvGen::new_rsa_pss()
         } else if Caps::RSA3072.present() {
             TlvGen::new_rsa3072_pss()
+        } else if Caps::EcdsaP256.present() && Caps::Ed25519.present() {
+            TlvGen::new_ecdsa_ed25519()
         } else if Caps::EcdsaP256.present() || Caps::EcdsaP384.present() {
             TlvGen::new_ecdsa()
         } else if Caps::Ed25519.present() {
@@ -2042,7 +3018,11 @@ fn verify_image(flash: &SimMultiFlash, slot: &SlotInfo, images: &ImageData) -> b
     let dev_id = slot.dev_id;
 
     let mut copy = vec![0u8; buf.len()];
-    let offset = slot.base_off;
+    let offset = if slot.index == 1 {
+        slot.base_off + images.secondary_off
+    } else {
+        slot.base_off
+    };
     let dev = flash.get(&dev_id).unwrap();
     dev.read(offset, &mut copy).unwrap();
 
@@ -2270,16 +3250,63 @@ fn mark_permanent_upgrade(flash: &mut SimMultiFlash, slot: &SlotInfo) {
     dev.write(off, &ok).unwrap();
 }
 
-// Drop some pseudo-random gibberish onto the data.
-fn splat(data: &mut [u8], seed: usize) {
+/// Invert one byte of a flash device, rewriting the sector that holds it.
+fn flip_byte(flash: &mut SimMultiFlash, dev_id: u8, off: usize) {
+    let dev = flash.get_mut(&dev_id).unwrap();
+    let sector = dev.sector_iter()
+        .find(|s| s.base <= off && off < s.base + s.size)
+        .unwrap();
+    let mut buf = vec![0u8; sector.size];
+    dev.read(sector.base, &mut buf).unwrap();
+    buf[off - sector.base] ^= 0xff;
+    dev.erase(sector.base, sector.size).unwrap();
+    dev.write(sector.base, &buf).unwrap();
+}
+
+fn splat_rng(len: usize, seed: usize) -> SmallRng {
     let mut seed_block = [0u8; 32];
     let mut buf = Cursor::new(&mut seed_block[..]);
     buf.write_u32::<LittleEndian>(0x135782ea).unwrap();
     buf.write_u32::<LittleEndian>(0x92184728).unwrap();
-    buf.write_u32::<LittleEndian>(data.len() as u32).unwrap();
+    buf.write_u32::<LittleEndian>(len as u32).unwrap();
     buf.write_u32::<LittleEndian>(seed as u32).unwrap();
-    let mut rng: SmallRng = SeedableRng::from_seed(seed_block);
-    rng.fill_bytes(data);
+    SeedableRng::from_seed(seed_block)
+}
+
+// Drop some pseudo-random gibberish onto the data.
+fn splat(data: &mut [u8], seed: usize) {
+    splat_rng(data.len(), seed).fill_bytes(data);
+}
+
+// Fill the data with something like Thumb code: a few pseudo-random functions, repeated, with BL
+// instructions calling a few others in between.  It compresses, and better with the ARM-Thumb BCJ
+// filter, which turns the calls to the same function into the same bytes.
+fn splat_code(data: &mut [u8], seed: usize) {
+    let mut rng = splat_rng(data.len(), seed);
+    let funcs: Vec<Vec<u8>> = (0 .. 32).map(|_| {
+        let mut func = vec![0u8; rng.gen_range(8 .. 96) * 2];
+        rng.fill_bytes(&mut func);
+        func
+    }).collect();
+    let callees: Vec<usize> = (0 .. 16).map(|_| rng.gen_range(0 .. data.len()) & !1).collect();
+
+    let mut pos = 0;
+    while pos + 4 <= data.len() {
+        if rng.gen_ratio(1, 4) {
+            let callee = callees[rng.gen_range(0 .. callees.len())];
+            let rel = (callee.wrapping_sub(pos + 4) >> 1) as u32;
+            data[pos .. pos + 4].copy_from_slice(&[(rel >> 11) as u8,
+                                                 0xf0 | ((rel >> 19) & 7) as u8,
+                                                 rel as u8,
+                                                 0xf8 | ((rel >> 8) & 7) as u8]);
+            pos += 4;
+        } else {
+            let func = &funcs[rng.gen_range(0 .. funcs.len())];
+            let len = func.len().min(data.len() - pos);
+            data[pos .. pos + len].copy_from_slice(&func[.. len]);
+            pos += len;
+        }
+    }
 }
 
 /// Return a read-only view into the raw bytes of this object
@@ -2294,7 +3321,8 @@ trait AsRaw : Sized {
 /// Returns an ImageSize representing the best size to test, possibly just with the given size.
 fn maximal(size: usize) -> ImageSize {
     if Caps::OverwriteUpgrade.present() ||
-        Caps::SwapUsingMove.present()
+        Caps::SwapUsingMove.present() ||
+        Caps::SwapUsingOffset.present()
     {
         ImageSize::Given(size)
     } else {
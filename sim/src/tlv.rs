@@ -62,6 +62,12 @@ pub enum TlvKinds {
     ENCX25519 = 0x33,
     DEPENDENCY = 0x40,
     SECCNT = 0x50,
+    DECOMPSIZE = 0x70,
+    DECOMPSHA = 0x71,
+    DECOMPSIGNATURE = 0x72,
+    SEGHASH = 0x80,
+    DELTABASESHA = 0x90,
+    DELTASIZE = 0x91,
 }
 
 #[allow(dead_code, non_camel_case_types)]
@@ -71,6 +77,9 @@ pub enum TlvFlags {
     ENCRYPTED_AES128 = 0x04,
     ENCRYPTED_AES256 = 0x08,
     RAM_LOAD = 0x20,
+    COMPRESSED_LZMA2 = 0x400,
+    COMPRESSED_ARM_THUMB = 0x800,
+    DELTA = 0x1000,
 }
 
 /// A generator for manifests.  The format of the manifest can be either a
@@ -118,6 +127,19 @@ pub trait ManifestGen {
     /// Sets the ignore_ram_load_flag so that can be validated when it is missing,
     /// it will not load successfully.
     fn set_ignore_ram_load_flag(&mut self);
+
+    /// Add a table with the hash of every `seg_size` bytes of the first
+    /// `hashed_len` bytes of the payload (the header and the image body).
+    /// The length can be an upper bound until the image size is known.
+    fn set_segment_hash(&mut self, seg_size: usize, hashed_len: usize);
+
+    /// Make this a delta image, whose payload patches the image with the
+    /// given hash into an image of `target_size` bytes.
+    fn set_delta(&mut self, base_hash: &[u8], target_size: u32);
+
+    /// Make this a compressed image of an image with a body of `size` bytes,
+    /// and the given hash and signature.
+    fn set_decompress(&mut self, size: u32, hash: &[u8], sig: Option<&[u8]>, arm_thumb: bool);
 }
 
 #[derive(Debug, Default)]
@@ -132,6 +154,12 @@ pub struct TlvGen {
     security_cnt: Option<u32>,
     /// Ignore RAM_LOAD flag
     ignore_ram_load_flag: bool,
+    /// Segment size and covered length of the segment hash table, if any.
+    seg_hash: Option<(usize, usize)>,
+    /// Base image hash and target size of a delta image.
+    delta: Option<(Vec<u8>, u32)>,
+    /// Body size, hash and signature of the image a compressed image holds.
+    decomp: Option<(u32, Vec<u8>, Option<Vec<u8>>)>,
 }
 
 #[derive(Debug)]
@@ -187,6 +215,15 @@ impl TlvGen {
         }
     }
 
+    /// Sign with both the ECDSA P-256 and the Ed25519 key.
+    #[allow(dead_code)]
+    pub fn new_ecdsa_ed25519() -> TlvGen {
+        TlvGen {
+            kinds: vec![TlvKinds::SHA256, TlvKinds::ECDSASIG, TlvKinds::ED25519],
+            ..Default::default()
+        }
+    }
+
     #[allow(dead_code)]
     pub fn new_enc_rsa(aes_key_size: u32) -> TlvGen {
         let flag = if aes_key_size == 256 {
@@ -313,6 +350,22 @@ impl TlvGen {
         }
     }
 
+    /// Size of the digests this generator produces.
+    fn hash_size(&self) -> usize {
+        if self.kinds.contains(&TlvKinds::SHA384) { 48 } else { 32 }
+    }
+
+    /// Size of the value of the segment hash TLV.
+    fn seg_hash_size(&self) -> u16 {
+        match self.seg_hash {
+            Some((seg_size, hashed_len)) => {
+                let count = (hashed_len + seg_size - 1) / seg_size;
+                (4 + count * self.hash_size()) as u16
+            }
+            None => 0,
+        }
+    }
+
     #[allow(dead_code)]
     pub fn new_sec_cnt() -> TlvGen {
        TlvGen {
@@ -330,11 +383,17 @@ impl ManifestGen for TlvGen {
 
     /// Retrieve the header flags for this configuration.  This can be called at any time.
     fn get_flags(&self) -> u32 {
+        let flags = if self.delta.is_some() {
+            self.flags | (TlvFlags::DELTA as u32)
+        } else {
+            self.flags
+        };
+
         // For the RamLoad case, add in the flag for this feature.
         if Caps::RamLoad.present() && !self.ignore_ram_load_flag {
-            self.flags | (TlvFlags::RAM_LOAD as u32)
+            flags | (TlvFlags::RAM_LOAD as u32)
         } else {
-            self.flags
+            flags
         }
     }
 
@@ -345,7 +404,8 @@ impl ManifestGen for TlvGen {
 
     fn protect_size(&self) -> u16 {
         let mut size = 0;
-        if !self.dependencies.is_empty() || (Caps::HwRollbackProtection.present() && self.security_cnt.is_some()) {
+        if !self.dependencies.is_empty() || (Caps::HwRollbackProtection.present() && self.security_cnt.is_some()) ||
+            self.seg_hash.is_some() || self.delta.is_some() || self.decomp.is_some() {
             // include the TLV area header.
             size += 4;
             // add space for each dependency.
@@ -353,6 +413,18 @@ impl ManifestGen for TlvGen {
             if Caps::HwRollbackProtection.present() && self.security_cnt.is_some() {
                 size += 4 + 4;
             }
+            if self.seg_hash.is_some() {
+                size += 4 + self.seg_hash_size();
+            }
+            if let Some((base_hash, _)) = &self.delta {
+                size += 4 + base_hash.len() as u16 + 4 + 4;
+            }
+            if let Some((_, hash, sig)) = &self.decomp {
+                size += 4 + 4 + 4 + hash.len() as u16;
+                if let Some(sig) = sig {
+                    size += 4 + sig.len() as u16;
+                }
+            }
         }
         size
     }
@@ -462,6 +534,47 @@ impl ManifestGen for TlvGen {
                 protected_tlv.write_u32::<LittleEndian>(self.security_cnt.unwrap() as u32).unwrap();
             }
 
+            // The segment hashes cover the header and image body, which is
+            // all of the payload at this point.
+            if let Some((seg_size, hashed_len)) = self.seg_hash {
+                assert_eq!(hashed_len, self.payload.len(), "segment hash length incorrect");
+                let algorithm = if self.hash_size() == 48 {
+                    &digest::SHA384
+                } else {
+                    &digest::SHA256
+                };
+                protected_tlv.write_u16::<LittleEndian>(TlvKinds::SEGHASH as u16).unwrap();
+                protected_tlv.write_u16::<LittleEndian>(self.seg_hash_size()).unwrap();
+                protected_tlv.write_u32::<LittleEndian>(seg_size as u32).unwrap();
+                for seg in self.payload.chunks(seg_size) {
+                    protected_tlv.extend_from_slice(digest::digest(algorithm, seg).as_ref());
+                }
+            }
+
+            if let Some((base_hash, target_size)) = &self.delta {
+                protected_tlv.write_u16::<LittleEndian>(TlvKinds::DELTABASESHA as u16).unwrap();
+                protected_tlv.write_u16::<LittleEndian>(base_hash.len() as u16).unwrap();
+                protected_tlv.extend_from_slice(base_hash);
+                protected_tlv.write_u16::<LittleEndian>(TlvKinds::DELTASIZE as u16).unwrap();
+                protected_tlv.write_u16::<LittleEndian>(4).unwrap();
+                protected_tlv.write_u32::<LittleEndian>(*target_size).unwrap();
+            }
+
+            if let Some((decomp_size, hash, sig)) = &self.decomp {
+                protected_tlv.write_u16::<LittleEndian>(TlvKinds::DECOMPSIZE as u16).unwrap();
+                protected_tlv.write_u16::<LittleEndian>(4).unwrap();
+                protected_tlv.write_u32::<LittleEndian>(*decomp_size).unwrap();
+                protected_tlv.write_u16::<LittleEndian>(TlvKinds::DECOMPSHA as u16).unwrap();
+                protected_tlv.write_u16::<LittleEndian>(hash.len() as u16).unwrap();
+                protected_tlv.extend_from_slice(hash);
+                if let Some(sig) = sig {
+                    protected_tlv.write_u16::<LittleEndian>(TlvKinds::DECOMPSIGNATURE as u16)
+                        .unwrap();
+                    protected_tlv.write_u16::<LittleEndian>(sig.len() as u16).unwrap();
+                    protected_tlv.extend_from_slice(sig);
+                }
+            }
+
             assert_eq!(size, protected_tlv.len() as u16, "protected TLV length incorrect");
         }
 
@@ -833,6 +946,22 @@ impl ManifestGen for TlvGen {
     fn set_ignore_ram_load_flag(&mut self) {
         self.ignore_ram_load_flag = true;
     }
+
+    fn set_segment_hash(&mut self, seg_size: usize, hashed_len: usize) {
+        self.seg_hash = Some((seg_size, hashed_len));
+    }
+
+    fn set_delta(&mut self, base_hash: &[u8], target_size: u32) {
+        self.delta = Some((base_hash.to_vec(), target_size));
+    }
+
+    fn set_decompress(&mut self, size: u32, hash: &[u8], sig: Option<&[u8]>, arm_thumb: bool) {
+        self.flags |= TlvFlags::COMPRESSED_LZMA2 as u32;
+        if arm_thumb {
+            self.flags |= TlvFlags::COMPRESSED_ARM_THUMB as u32;
+        }
+        self.decomp = Some((size, hash.to_vec(), sig.map(|sig| sig.to_vec())));
+    }
 }
 
 include!("rsa_pub_key-rs.txt");
@@ -69,6 +69,20 @@ sim_test!(downgrade_prevention, make_image(&REV_DEPS, true), run_nodowngrade());
 sim_test!(direct_xip_first, make_no_upgrade_image(&NO_DEPS, ImageManipulation::None), run_direct_xip());
 sim_test!(ram_load_first, make_no_upgrade_image(&NO_DEPS, ImageManipulation::None), run_ram_load());
 sim_test!(ram_load_split, make_no_upgrade_image(&NO_DEPS, ImageManipulation::None), run_split_ram_load());
+sim_test!(hash_bench, make_no_upgrade_image(&NO_DEPS, ImageManipulation::None), run_hash_bench());
+sim_test!(hash_arena, make_image(&NO_DEPS, true), run_hash_arena());
+sim_test!(validation_cache, make_no_upgrade_image(&NO_DEPS, ImageManipulation::None), run_validation_cache());
+sim_test!(hash_segments, make_no_upgrade_image(&NO_DEPS, ImageManipulation::None), run_hash_segments());
+sim_test!(multi_sig, make_no_upgrade_image(&NO_DEPS, ImageManipulation::None), run_multi_sig());
+sim_test!(crypto_ops, make_image(&NO_DEPS, true), run_crypto_ops());
+sim_test!(copy_bench, make_image(&NO_DEPS, true), run_copy_bench());
+sim_test!(parallel_upgrade, make_image(&NO_DEPS, true), run_parallel_upgrade());
+sim_test!(skip_unchanged, make_delta_image(), run_skip_unchanged());
+sim_test!(skip_unchanged_with_fails, make_delta_image(), run_perm_with_fails());
+sim_test!(delta_patch_upgrade, make_delta_patch_image(), run_delta_patch_upgrade());
+sim_test!(compressed_upgrade, make_compressed_image(false), run_compressed_upgrade());
+sim_test!(compressed_thumb_upgrade, make_compressed_image(true), run_compressed_upgrade());
+sim_test!(decompress_bench, make_compressed_image(true), run_decompress_bench());
 sim_test!(hw_prot_failed_security_cnt_check, make_image_with_security_counter(Some(0)), run_hw_rollback_prot());
 sim_test!(hw_prot_missing_security_cnt, make_image_with_security_counter(None), run_hw_rollback_prot());
 sim_test!(ram_load_out_of_bounds, make_no_upgrade_image(&NO_DEPS, ImageManipulation::WrongOffset), run_ram_load_boot_with_result(false));